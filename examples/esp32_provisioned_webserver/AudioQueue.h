@@ -0,0 +1,359 @@
+#ifndef _AUDIOQUEUE_H_
+#define _AUDIOQUEUE_H_
+
+// Command queue for a DFPlayer Mini on a UART. Handlers and the animation
+// loops post commands and return at once; a task owns the UART, keeps up
+// to AUDIO_PIPELINE commands in flight and matches the module's replies
+// to them. Nothing on the caller's side waits for the 9600 baud link.
+//
+// Replies: the module acknowledges (0x41) or rejects (0x40) commands in
+// the order it got them, without saying which command a reply is for, so
+// replies are matched oldest first. A frame lost on the line shifts that
+// matching by one, and the loss only shows as a timeout later. So commands
+// are kept from the last moment nothing was in flight. After a timeout or
+// a rejected frame (busy, checksum), all of them are sent again, in order,
+// once the line is quiet. Track numbers and volumes are absolute (no
+// next/previous), so a repeat leaves the module in the same state, with one
+// exception: a PLAY_TRACK that did get through starts its track over when
+// repeated. The module gives no way to tell a delivered frame from a lost
+// one, so that restart, a fraction of a second into the track, is the cost
+// of not losing the command. The repeats go one at a time, so each reply is
+// known to be for the frame just sent and a second loss only costs that
+// frame another try; the pipeline opens again once the span is clear.
+//
+// Commands are held until the module reports its card online (0x3F), or
+// for AUDIO_ONLINE_TIMEOUT_MS after begin() if it never says so.
+//
+// Frame triggers tie a track to an animation frame. frameShown() is called
+// just before a frame is drawn and posts the frame's tracks to a queue of
+// their own, which the task empties before the command queue, so they go
+// ahead of anything posted and in the order they were added. A trigger that cannot reach the module within
+// AUDIO_TRIGGER_MAX_SKEW_MS of its frame is dropped, so the sound is
+// either close to the picture or absent.
+
+#include <Arduino.h>
+
+#define AUDIO_QUEUE_DEPTH 16
+#define AUDIO_PIPELINE 2          // the module buffers two commands
+#define AUDIO_SPAN 4              // commands kept for resending
+#define AUDIO_ACK_TIMEOUT_MS 120
+#define AUDIO_RETRIES 3
+#define AUDIO_ONLINE_TIMEOUT_MS 5000
+#define AUDIO_TRIGGER_MAX_SKEW_MS 60
+#define AUDIO_MAX_TRIGGERS 8
+#define AUDIO_FRAME_US 10417      // 10 bytes at 9600 baud
+
+class AudioQueue {
+public:
+  // DFPlayer command codes
+  enum : uint8_t {
+    PLAY_TRACK = 0x12, // file NNNN.mp3 in /MP3
+    VOLUME = 0x06,     // 0-30
+    RESUME = 0x0D,
+    PAUSE = 0x0E,
+    STOP = 0x16,
+  };
+
+  bool begin(HardwareSerial& uart, int rxPin, int txPin, BaseType_t core) {
+    if (_task != nullptr) return true;
+    _uart = &uart;
+    _uart->begin(9600, SERIAL_8N1, rxPin, txPin);
+    if (_queue == nullptr) _queue = xQueueCreate(AUDIO_QUEUE_DEPTH, sizeof(Item));
+    if (_triggerQueue == nullptr) _triggerQueue = xQueueCreate(AUDIO_MAX_TRIGGERS, sizeof(Item));
+    if (_queue == nullptr || _triggerQueue == nullptr) return false;
+    _beginUs = micros();
+    xTaskCreatePinnedToCore(taskEntry, "audio", 3072, this, 2, &_task, core);
+    return _task != nullptr;
+  }
+
+  // Queues a command; false if the queue is full or begin() failed
+  bool post(uint8_t cmd, uint16_t param) { return enqueue(cmd, param, false); }
+
+  // Plays track when frame (0 = first) of the running animation is shown
+  bool addTrigger(int frame, uint16_t track) {
+    if (_triggerCount >= AUDIO_MAX_TRIGGERS) return false;
+    _triggers[_triggerCount].frame = frame;
+    _triggers[_triggerCount].track = track;
+    ++_triggerCount;
+    return true;
+  }
+  void clearTriggers() { _triggerCount = 0; }
+  int getTriggerCount() { return _triggerCount; }
+  int getTriggerFrame(int i) { return _triggers[i].frame; }
+  uint16_t getTriggerTrack(int i) { return _triggers[i].track; }
+
+  // Called by the animation loops just before drawing frame
+  void frameShown(int frame) {
+    for (int i = 0; i < _triggerCount; ++i) {
+      if (_triggers[i].frame == frame && enqueue(PLAY_TRACK, _triggers[i].track, true)) ++_triggersFired;
+    }
+  }
+
+  void resetStats() {
+    _posted = _sent = _acked = _retries = _failed = _dropped = 0;
+    _triggersFired = _triggersLate = 0;
+    _ackSumUs = 0;
+    _ackCount = 0;
+    _skewMaxUs = 0;
+    _lastError = 0;
+  }
+
+  // Nothing queued and every command answered or given up on
+  bool idle() { return getQueued() == 0 && _spanCount == 0; }
+
+  bool isOnline() { return _online; }
+  uint32_t getQueued() { return _queue ? uxQueueMessagesWaiting(_queue) + uxQueueMessagesWaiting(_triggerQueue) : 0; }
+  uint32_t getPosted() { return _posted; }
+  uint32_t getSent() { return _sent; }         // frames on the wire, repeats included
+  uint32_t getAcked() { return _acked; }
+  uint32_t getRetries() { return _retries; }   // frames sent again
+  uint32_t getFailed() { return _failed; }     // rejected, or out of retries
+  uint32_t getDropped() { return _dropped; }   // queue full
+  uint8_t getLastError() { return _lastError; }
+  uint16_t getLastFinished() { return _lastFinished; }
+  uint32_t getTriggersFired() { return _triggersFired; }
+  uint32_t getTriggersLate() { return _triggersLate; }
+  uint32_t getAvgAck() { return _ackCount > 0 ? _ackSumUs / _ackCount : 0; } // microseconds, send to ACK
+  uint32_t getMaxSkew() { return _skewMaxUs; } // microseconds, frame to trigger received by the module
+
+private:
+  struct Item {
+    uint8_t cmd;
+    uint16_t param;
+    bool trigger;
+    uint32_t postedUs;
+  };
+
+  enum EntryState { WAITING, SENT, DONE, FAILED };
+
+  struct Entry {
+    Item item;
+    EntryState state;
+    uint8_t tries;
+    bool sure;          // acknowledged with nothing else in flight
+    uint32_t sentUs;
+  };
+
+  struct Trigger {
+    int frame;
+    uint16_t track;
+  };
+
+  HardwareSerial* _uart = nullptr;
+  QueueHandle_t _queue = nullptr;
+  QueueHandle_t _triggerQueue = nullptr;
+  TaskHandle_t _task = nullptr;
+  uint32_t _beginUs = 0;
+  volatile bool _online = false;
+
+  Entry _span[AUDIO_SPAN];
+  int _spanCount = 0;
+  bool _resend = false;
+  bool _careful = false; // one frame in flight until the span clears
+  uint8_t _rx[10];
+  int _rxLen = 0;
+
+  Trigger _triggers[AUDIO_MAX_TRIGGERS];
+  int _triggerCount = 0;
+
+  uint32_t _posted = 0;
+  uint32_t _sent = 0;
+  uint32_t _acked = 0;
+  uint32_t _retries = 0;
+  uint32_t _failed = 0;
+  uint32_t _dropped = 0;
+  uint32_t _triggersFired = 0;
+  uint32_t _triggersLate = 0;
+  uint64_t _ackSumUs = 0;
+  uint32_t _ackCount = 0;
+  uint32_t _skewMaxUs = 0;
+  volatile uint8_t _lastError = 0;
+  volatile uint16_t _lastFinished = 0;
+
+  bool enqueue(uint8_t cmd, uint16_t param, bool trigger) {
+    if (_task == nullptr) return false;
+    Item item = {cmd, param, trigger, (uint32_t)micros()};
+    if (xQueueSendToBack(trigger ? _triggerQueue : _queue, &item, 0) != pdTRUE) {
+      ++_dropped;
+      return false;
+    }
+    ++_posted;
+    xTaskNotifyGive(_task);
+    return true;
+  }
+
+  static void taskEntry(void* arg) { static_cast<AudioQueue*>(arg)->run(); }
+
+  void run() {
+    uint32_t lastQueryUs = 0;
+    for (;;) {
+      while (_uart->available() > 0) readByte(_uart->read());
+      uint32_t now = micros();
+      if (!_online) {
+        if (now - _beginUs >= AUDIO_ONLINE_TIMEOUT_MS * 1000UL) {
+          _online = true; // no word from the module; try anyway
+        } else if (now - lastQueryUs >= 500000) {
+          sendFrame(0x3F, 0, false); // which storage is online
+          lastQueryUs = now;
+        }
+      }
+      checkTimeout(now);
+      if (_online) fill(now);
+
+      if (_spanCount > 0 || !_online) {
+        vTaskDelay(pdMS_TO_TICKS(2)); // a reply takes at least a frame time
+      } else {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50)); // woken by enqueue(); also catches unsolicited messages
+      }
+    }
+  }
+
+  // Sends what the pipeline has room for: repeats first, then new commands
+  void fill(uint32_t now) {
+    for (;;) {
+      int inFlight = 0;
+      Entry* next = nullptr;
+      for (int i = 0; i < _spanCount; ++i) {
+        if (_span[i].state == SENT) ++inFlight;
+        if (_span[i].state == WAITING && next == nullptr) next = &_span[i];
+      }
+      if (inFlight >= (_careful ? 1 : AUDIO_PIPELINE)) return;
+      if (next == nullptr) {
+        if (_resend || _spanCount >= AUDIO_SPAN) return;
+        Item item;
+        if (xQueueReceive(_triggerQueue, &item, 0) != pdTRUE && xQueueReceive(_queue, &item, 0) != pdTRUE) return;
+        next = &_span[_spanCount++];
+        next->item = item;
+        next->tries = 0;
+        next->sure = false;
+      }
+      if (next->item.trigger && now - next->item.postedUs > AUDIO_TRIGGER_MAX_SKEW_MS * 1000UL) {
+        next->state = FAILED; // too late to match its frame
+        ++_triggersLate;
+        settle();
+        continue;
+      }
+      if (next->tries > 0) ++_retries;
+      if (next->item.trigger) {
+        uint32_t skew = now - next->item.postedUs + AUDIO_FRAME_US;
+        if (skew > _skewMaxUs) _skewMaxUs = skew;
+      }
+      ++next->tries;
+      next->state = SENT;
+      next->sentUs = now;
+      sendFrame(next->item.cmd, next->item.param, true);
+    }
+  }
+
+  // The oldest unanswered frame has waited too long: stop matching and
+  // send the span again
+  void checkTimeout(uint32_t now) {
+    Entry* oldest = oldestSent();
+    if (oldest == nullptr || now - oldest->sentUs < AUDIO_ACK_TIMEOUT_MS * 1000UL) return;
+    _resend = true;
+    for (int i = 0; i < _spanCount; ++i) {
+      if (_span[i].state == SENT) _span[i].state = DONE;
+    }
+    settle();
+  }
+
+  Entry* oldestSent() {
+    for (int i = 0; i < _spanCount; ++i) {
+      if (_span[i].state == SENT) return &_span[i];
+    }
+    return nullptr;
+  }
+
+  // Once nothing is in flight: clear the span, or queue it to go again.
+  // A resend takes the entries not yet sent along with it, so they still
+  // reach the module after the ones before them.
+  void settle() {
+    for (int i = 0; i < _spanCount; ++i) {
+      if (_span[i].state == SENT || (_span[i].state == WAITING && !_resend)) return;
+    }
+    if (!_resend) {
+      _spanCount = 0;
+      _careful = false;
+      return;
+    }
+    _resend = false;
+    _careful = true;
+    int kept = 0;
+    for (int i = 0; i < _spanCount; ++i) {
+      Entry e = _span[i];
+      if (e.state == FAILED || (e.state == DONE && e.sure)) continue;
+      if (e.tries > AUDIO_RETRIES) {
+        ++_failed;
+        continue;
+      }
+      e.state = WAITING;
+      _span[kept++] = e;
+    }
+    _spanCount = kept;
+  }
+
+  void readByte(int b) {
+    if (_rxLen == 0 && b != 0x7E) return;
+    _rx[_rxLen++] = (uint8_t)b;
+    if (_rxLen < 10) return;
+    _rxLen = 0;
+    if (_rx[9] != 0xEF || (uint16_t)(_rx[7] << 8 | _rx[8]) != checksum(_rx)) return; // lost: a timeout will tell
+    reply(_rx[3], (uint16_t)(_rx[5] << 8 | _rx[6]));
+  }
+
+  void reply(uint8_t cmd, uint16_t param) {
+    uint32_t now = micros();
+    switch (cmd) {
+    case 0x41: { // ACK
+      Entry* e = oldestSent();
+      if (e == nullptr) return;
+      e->state = DONE;
+      e->sure = _careful;
+      ++_acked;
+      _ackSumUs += now - e->sentUs;
+      ++_ackCount;
+      settle();
+      break;
+    }
+    case 0x40: { // error
+      _lastError = (uint8_t)param;
+      Entry* e = oldestSent();
+      if (e == nullptr) return;
+      if (param == 1 || param == 3 || param == 4) { // busy, bad frame, checksum: send again
+        e->state = DONE;
+        _resend = true;
+      } else {                                      // file missing and the like
+        e->state = FAILED;
+        ++_failed;
+      }
+      settle();
+      break;
+    }
+    case 0x3F: // card online
+      _online = true;
+      break;
+    case 0x3D: // track finished
+      _lastFinished = param;
+      break;
+    default:
+      break;
+    }
+  }
+
+  static uint16_t checksum(const uint8_t* f) {
+    uint16_t sum = 0;
+    for (int i = 1; i < 7; ++i) sum += f[i];
+    return (uint16_t)-sum;
+  }
+
+  void sendFrame(uint8_t cmd, uint16_t param, bool feedback) {
+    uint8_t f[10] = {0x7E, 0xFF, 0x06, cmd, (uint8_t)(feedback ? 1 : 0), (uint8_t)(param >> 8), (uint8_t)param, 0, 0, 0xEF};
+    uint16_t sum = checksum(f);
+    f[7] = (uint8_t)(sum >> 8);
+    f[8] = (uint8_t)sum;
+    _uart->write(f, sizeof(f));
+    ++_sent;
+  }
+};
+
+#endif // _AUDIOQUEUE_H_
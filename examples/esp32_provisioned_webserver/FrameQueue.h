@@ -0,0 +1,309 @@
+#ifndef _FRAMEQUEUE_H_
+#define _FRAMEQUEUE_H_
+
+// Bounded, latest-wins frame queue between the network receive path and a
+// decoder task on the other core.
+//
+// The receiver never blocks: when every slot is taken it overwrites the
+// oldest frame still waiting, so a slow decoder sheds frames instead of
+// stalling the upload. The decoder asks for the next frame with acquire(),
+// which adapts to the load:
+//   - keeping up (decode time <= frame interval): frames are shown in
+//     order;
+//   - falling behind, or the oldest frame already past its latency budget:
+//     it jumps to the newest frame and drops everything before it.
+// Every frame is a complete JPEG, so any of them can be dropped.
+
+#include <Arduino.h>
+
+#ifndef FRAME_QUEUE_SLOTS
+#define FRAME_QUEUE_SLOTS 3 // one being written, one being decoded, one ready
+#endif
+
+class FrameQueue {
+public:
+  struct Frame {
+    uint8_t* data;
+    int32_t len;
+    uint32_t seq;
+    uint32_t arrivalUs;
+  };
+
+  bool begin(int32_t slotSize, uint32_t latencyBudgetMs) {
+    end();
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      _slots[i].frame.data = (uint8_t*)malloc(slotSize);
+      if (_slots[i].frame.data == nullptr) {
+        end();
+        return false;
+      }
+    }
+    _slotSize = slotSize;
+    _budgetUs = latencyBudgetMs * 1000;
+    resetStats();
+    return true;
+  }
+
+  void end() {
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      free(_slots[i].frame.data);
+      _slots[i].frame.data = nullptr;
+      _slots[i].state = FREE;
+    }
+    _writing = nullptr;
+    _prevByte = 0;
+  }
+
+  void resetStats() {
+    _seq = 0;
+    _received = _shown = 0;
+    _droppedLate = _droppedOverflow = _droppedBad = 0;
+    _latencySumUs = 0;
+    _latencyMaxUs = 0;
+    _maxDepth = 0;
+    _lastArrivalUs = 0;
+    _intervalUs = _decodeUs = 0;
+  }
+
+  // ----- Receive side (never blocks) -----
+
+  // Splits a JPEG stream on SOI/EOI markers; bytes between frames
+  // (multipart boundaries and part headers) are skipped. Returns the number
+  // of frames completed.
+  int pushJpegStream(const uint8_t* buf, int32_t len) {
+    int completed = 0;
+    for (int32_t i = 0; i < len; ++i) {
+      uint8_t b = buf[i];
+      if (b == 0xD8 && _prevByte == 0xFF) { // SOI; one already open was cut short
+        if (_writing != nullptr) abortFrame();
+        if (beginFrame()) {
+          append(0xFF);
+          append(0xD8);
+        }
+      } else if (_writing != nullptr) {
+        append(b);
+        if (b == 0xD9 && _prevByte == 0xFF) { // EOI
+          commitFrame();
+          ++completed;
+        }
+      }
+      _prevByte = b;
+    }
+    return completed;
+  }
+
+  // Drops a frame that was cut short
+  void abortFrame() {
+    if (_writing == nullptr) return;
+    portENTER_CRITICAL(&_mux);
+    _writing->state = FREE;
+    _writing = nullptr;
+    ++_droppedBad;
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  // End of stream: a frame still open never got its end marker
+  void finish() {
+    abortFrame();
+    _prevByte = 0;
+  }
+
+  // ----- Decoder side -----
+
+  // Next frame to show, or nullptr if none is ready
+  Frame* acquire() {
+    uint32_t now = micros();
+    portENTER_CRITICAL(&_mux);
+    Slot* pick = oldestReady();
+    if (pick != nullptr) {
+      // Behind, or the oldest frame is already late: skip to the newest
+      if (_decodeUs > _intervalUs || now - pick->frame.arrivalUs > _budgetUs) {
+        Slot* newest = newestReady();
+        dropReadyBefore(newest->frame.seq);
+        pick = newest;
+      }
+      pick->state = DECODING;
+      _decodeStartUs = now;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return pick ? &pick->frame : nullptr;
+  }
+
+  void release(Frame* f, bool shown) {
+    uint32_t now = micros();
+    Slot* s = slotOf(f);
+    portENTER_CRITICAL(&_mux);
+    if (shown) {
+      ++_shown;
+      uint32_t latency = now - f->arrivalUs;
+      _latencySumUs += latency;
+      if (latency > _latencyMaxUs) _latencyMaxUs = latency;
+      _decodeUs = ewma(_decodeUs, now - _decodeStartUs);
+    } else {
+      ++_droppedBad;
+    }
+    s->state = FREE;
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  // Nothing waiting and nothing being decoded
+  bool idle() {
+    portENTER_CRITICAL(&_mux);
+    bool busy = false;
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      busy |= _slots[i].state == READY || _slots[i].state == DECODING;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return !busy;
+  }
+
+  uint32_t getReceived() { return _received; }
+  uint32_t getShown() { return _shown; }
+  uint32_t getDroppedLate() { return _droppedLate; }         // stale or skipped
+  uint32_t getDroppedOverflow() { return _droppedOverflow; } // overwritten while queued
+  uint32_t getDroppedBad() { return _droppedBad; }           // oversize, truncated or undecodable
+  uint32_t getDropped() { return _droppedLate + _droppedOverflow + _droppedBad; }
+  uint32_t getMaxDepth() { return _maxDepth; }
+  uint32_t getAvgLatency() { return _shown > 0 ? _latencySumUs / _shown : 0; } // microseconds
+  uint32_t getMaxLatency() { return _latencyMaxUs; }                            // microseconds
+
+private:
+  enum SlotState { FREE, WRITING, READY, DECODING };
+
+  struct Slot {
+    Frame frame = {nullptr, 0, 0, 0};
+    volatile SlotState state = FREE;
+  };
+
+  Slot _slots[FRAME_QUEUE_SLOTS];
+  Slot* _writing = nullptr;
+  int32_t _slotSize = 0;
+  uint32_t _budgetUs = 0;
+  uint8_t _prevByte = 0;
+  bool _overflowed = false;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+  uint32_t _seq = 0;
+  uint32_t _received = 0;
+  uint32_t _shown = 0;
+  uint32_t _droppedLate = 0;
+  uint32_t _droppedOverflow = 0;
+  uint32_t _droppedBad = 0;
+  uint64_t _latencySumUs = 0;
+  uint32_t _latencyMaxUs = 0;
+  uint32_t _maxDepth = 0;
+
+  // Running estimates (1/4 weight on the newest sample)
+  uint32_t _lastArrivalUs = 0;
+  uint32_t _intervalUs = 0;
+  uint32_t _decodeUs = 0;
+  uint32_t _decodeStartUs = 0;
+
+  static uint32_t ewma(uint32_t avg, uint32_t sample) {
+    return avg == 0 ? sample : avg - avg / 4 + sample / 4;
+  }
+
+  // Writes one frame into a claimed slot; pushJpegStream() finds the bounds
+  bool beginFrame() {
+    Slot* s = claimSlot();
+    if (s == nullptr) return false;
+    s->frame.len = 0;
+    _writing = s;
+    _overflowed = false;
+    return true;
+  }
+
+  void append(uint8_t b) {
+    if (_writing == nullptr) return;
+    if (_writing->frame.len >= _slotSize) {
+      _overflowed = true;
+      return;
+    }
+    _writing->frame.data[_writing->frame.len++] = b;
+  }
+
+  void commitFrame() {
+    if (_writing == nullptr) return;
+    Slot* s = _writing;
+    _writing = nullptr;
+    uint32_t now = micros();
+    portENTER_CRITICAL(&_mux);
+    if (_overflowed) {
+      ++_droppedBad;
+      s->state = FREE;
+    } else {
+      s->frame.seq = ++_seq;
+      s->frame.arrivalUs = now;
+      s->state = READY;
+      ++_received;
+      if (_lastArrivalUs != 0) _intervalUs = ewma(_intervalUs, now - _lastArrivalUs);
+      _lastArrivalUs = now;
+      uint32_t depth = countReady();
+      if (depth > _maxDepth) _maxDepth = depth;
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  // A free slot, or else the oldest waiting frame
+  Slot* claimSlot() {
+    Slot* s = nullptr;
+    portENTER_CRITICAL(&_mux);
+    for (int i = 0; i < FRAME_QUEUE_SLOTS && s == nullptr; ++i) {
+      if (_slots[i].state == FREE) s = &_slots[i];
+    }
+    if (s == nullptr) {
+      s = oldestReady();
+      if (s != nullptr) ++_droppedOverflow;
+    }
+    if (s != nullptr) s->state = WRITING;
+    portEXIT_CRITICAL(&_mux);
+    return s;
+  }
+
+  // Helpers below run inside the critical section
+
+  uint32_t countReady() {
+    uint32_t n = 0;
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) n += _slots[i].state == READY;
+    return n;
+  }
+
+  Slot* oldestReady() {
+    Slot* best = nullptr;
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      Slot* s = &_slots[i];
+      if (s->state == READY && (best == nullptr || s->frame.seq < best->frame.seq)) best = s;
+    }
+    return best;
+  }
+
+  Slot* newestReady() {
+    Slot* best = nullptr;
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      Slot* s = &_slots[i];
+      if (s->state == READY && (best == nullptr || s->frame.seq > best->frame.seq)) best = s;
+    }
+    return best;
+  }
+
+  void dropSlot(Slot* s, uint32_t& counter) {
+    s->state = FREE;
+    ++counter;
+  }
+
+  void dropReadyBefore(uint32_t seq) {
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      Slot* s = &_slots[i];
+      if (s->state == READY && s->frame.seq < seq) dropSlot(s, _droppedLate);
+    }
+  }
+
+  Slot* slotOf(Frame* f) {
+    for (int i = 0; i < FRAME_QUEUE_SLOTS; ++i) {
+      if (&_slots[i].frame == f) return &_slots[i];
+    }
+    return nullptr;
+  }
+};
+
+#endif // _FRAMEQUEUE_H_
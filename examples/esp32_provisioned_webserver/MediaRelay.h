@@ -0,0 +1,562 @@
+#ifndef _MEDIARELAY_H_
+#define _MEDIARELAY_H_
+
+// Fans a file out from one display (the leader) to a group of others (the
+// peers) over ESP-NOW, and has them all show it at the same moment.
+//
+// Transfer: the leader broadcasts the file in RELAY_PAYLOAD-byte packets.
+// Each one carries the session, its index, the packet count, the file
+// size and its kind, so a peer can start from any of them. After every
+// RELAY_FEC_GROUP packets comes a parity packet, the XOR of the group, from
+// which a peer rebuilds one lost packet of that group in place. An END
+// packet then asks every peer for its state. A peer with the whole file,
+// CRC-32 checked, answers HAVE; any other peer answers NACK with the
+// ranges it still misses. The leader broadcasts the union of those again,
+// so one repair serves every peer that lost the same packet, and repeats
+// END, for up to RELAY_ROUNDS rounds.
+//
+// Show: the leader then broadcasts SHOW RELAY_SHOW_COPIES times, each with
+// the time left from the end of that frame to the switch. A peer with the
+// file counts from when the first copy it hears arrived and reports the
+// moment through showAt(). A broadcast reaches every peer at once, so the
+// displays switch within packet handling time of each other; no clocks
+// are shared.
+//
+// The radio is the caller's: begin() takes a function that sends one
+// packet and returns once it is on the air, and the ESP-NOW receive
+// callback hands packets to onReceive(). A task handles the received
+// packets, so a peer answers while its loop() is busy drawing.
+
+#include <Arduino.h>
+
+#define RELAY_PACKET 250            // ESP_NOW_MAX_DATA_LEN
+#define RELAY_HEADER 12
+#define RELAY_PAYLOAD (RELAY_PACKET - RELAY_HEADER)
+#define RELAY_FEC_GROUP 8           // data packets per parity packet
+#define RELAY_MAX_PEERS 20          // ESP-NOW's peer table
+#define RELAY_MAX_FILE 150000
+#define RELAY_ROUNDS 8              // END and repair rounds before giving up
+#define RELAY_REPLY_MS 20           // leader waits this long after END,
+#define RELAY_REPLY_PER_PEER_MS 3   // plus a reply's airtime per peer
+#define RELAY_SHOW_COPIES 3
+#define RELAY_SHOW_GAP_MS 5
+#define RELAY_QUEUE_DEPTH 32
+#define RELAY_NACK_RANGES 60        // (RELAY_PACKET - 5) / 4
+
+class MediaRelay {
+public:
+  // Sends one packet to mac (FF:FF:FF:FF:FF:FF for all) and returns once
+  // it has gone out; false if it could not be sent
+  typedef bool (*SendFn)(void* ctx, const uint8_t* mac, const uint8_t* data, int len);
+
+  bool begin(SendFn send, void* ctx, BaseType_t core) {
+    if (_task != nullptr) return true;
+    _send = send;
+    _ctx = ctx;
+    if (_queue == nullptr) _queue = xQueueCreate(RELAY_QUEUE_DEPTH, sizeof(Packet));
+    if (_queue == nullptr) return false;
+    _txSession = (uint16_t)micros() | 1; // unlike the sessions before a reboot
+    xTaskCreatePinnedToCore(taskEntry, "relay", 4096, this, 2, &_task, core);
+    return _task != nullptr;
+  }
+
+  // Leader: the group transfer() sends to
+  bool addPeer(const uint8_t* mac) {
+    if (_peerCount >= RELAY_MAX_PEERS) return false;
+    memcpy(_peers[_peerCount++], mac, 6);
+    return true;
+  }
+  void clearPeers() { _peerCount = 0; }
+  int getPeerCount() { return _peerCount; }
+  const uint8_t* getPeer(int i) { return _peers[i]; }
+
+  // Peer: take files from leaders
+  void setListening(bool on) { _listening = on; }
+
+  // From the ESP-NOW receive callback: stamps the packet and queues it
+  void onReceive(const uint8_t* mac, const uint8_t* data, int len) {
+    if (_queue == nullptr || len < 4 || len > RELAY_PACKET || data[0] != MAGIC) return;
+    Packet p;
+    p.rxUs = micros();
+    memcpy(p.mac, mac, 6);
+    memcpy(p.data, data, len);
+    p.len = len;
+    if (xQueueSend(_queue, &p, 0) != pdTRUE) ++_overflows;
+  }
+
+  // Leader: sends size bytes to the group, kind being passed on to the
+  // peers. Returns true once every peer has the file, false if some still
+  // lack it after RELAY_ROUNDS rounds. data must stay put until then.
+  bool transfer(uint8_t kind, const uint8_t* data, uint32_t size) {
+    if (_task == nullptr || _peerCount == 0 || size == 0 || size > RELAY_MAX_FILE) return false;
+    uint16_t count = (size + RELAY_PAYLOAD - 1) / RELAY_PAYLOAD;
+    uint32_t* nack = (uint32_t*)calloc((count + 31) / 32, 4);
+    if (nack == nullptr) return false;
+    uint32_t crc = crc32(data, size);
+    uint32_t all = (1u << _peerCount) - 1;
+    uint32_t start = micros();
+    portENTER_CRITICAL(&_mux);
+    ++_txSession;
+    _txCount = count;
+    _txNack = nack;
+    _txReplied = _txHave = _txFailed = 0;
+    _txActive = true;
+    portEXIT_CRITICAL(&_mux);
+    _lastRepairs = 0;
+
+    // Everything once, with parity
+    uint8_t pkt[RELAY_PACKET];
+    uint8_t parity[RELAY_PAYLOAD];
+    memset(parity, 0, sizeof(parity));
+    for (uint16_t i = 0; i < count; ++i) {
+      int n = sendData(pkt, PKT_DATA, i, count, size, kind, data + i * RELAY_PAYLOAD, slotLength(size, i));
+      for (int k = 0; k < n; ++k) parity[k] ^= data[i * RELAY_PAYLOAD + k];
+      if ((i + 1) % RELAY_FEC_GROUP == 0 || i + 1 == count) {
+        uint16_t group = i / RELAY_FEC_GROUP;
+        sendData(pkt, PKT_PARITY, group, count, size, kind, parity, slotLength(size, group * RELAY_FEC_GROUP));
+        memset(parity, 0, sizeof(parity));
+      }
+    }
+
+    // Then ask, and send again what is missing
+    uint32_t have = 0;
+    for (_lastRounds = 1; ; ++_lastRounds) {
+      portENTER_CRITICAL(&_mux);
+      _txReplied = 0;
+      memset(nack, 0, (count + 31) / 32 * 4);
+      portEXIT_CRITICAL(&_mux);
+      header(pkt, PKT_END, _txSession);
+      put16(pkt + 4, count);
+      put32(pkt + 6, size);
+      put32(pkt + 10, crc);
+      pkt[14] = kind;
+      send(BROADCAST, pkt, 15);
+
+      uint32_t window = RELAY_REPLY_MS + _peerCount * RELAY_REPLY_PER_PEER_MS;
+      uint32_t waitStart = millis();
+      uint32_t replied, failed;
+      for (;;) {
+        portENTER_CRITICAL(&_mux);
+        replied = _txReplied;
+        have = _txHave;
+        failed = _txFailed;
+        portEXIT_CRITICAL(&_mux);
+        // Every peer answers every END, and the channel is only quiet
+        // once they all have
+        if ((replied & all) == all || millis() - waitStart >= window) break;
+        delay(1);
+      }
+      if (((have | failed) & all) == all || _lastRounds == RELAY_ROUNDS) break;
+      for (uint16_t i = 0; i < count; ++i) {
+        portENTER_CRITICAL(&_mux);
+        bool wanted = nack[i >> 5] & (1u << (i & 31));
+        portEXIT_CRITICAL(&_mux);
+        if (!wanted) continue;
+        sendData(pkt, PKT_DATA, i, count, size, kind, data + i * RELAY_PAYLOAD, slotLength(size, i));
+        ++_repairs;
+        ++_lastRepairs;
+      }
+    }
+
+    portENTER_CRITICAL(&_mux);
+    _txActive = false;
+    _txNack = nullptr;
+    portEXIT_CRITICAL(&_mux);
+    free(nack);
+    ++_transfers;
+    _lastBytes = size;
+    _lastUs = micros() - start;
+    _lastPeersOk = __builtin_popcount(have & all);
+    return (have & all) == all;
+  }
+
+  // Leader: has the group show the file from the last transfer() leadMs
+  // from now. Returns that moment, in micros().
+  uint32_t show(uint32_t leadMs) {
+    uint8_t pkt[8];
+    uint32_t at = 0;
+    uint32_t txUs = 0;
+    for (int copy = 0; copy < RELAY_SHOW_COPIES; ++copy) {
+      uint32_t now = micros();
+      if (copy > 0 && (int32_t)(at - now) <= (int32_t)txUs) break; // too late for another copy
+      header(pkt, PKT_SHOW, _txSession);
+      put32(pkt + 4, copy == 0 ? leadMs * 1000 : at - now - txUs);
+      send(BROADCAST, pkt, 8);
+      uint32_t sent = micros();
+      if (copy == 0) at = sent + leadMs * 1000;
+      txUs = sent - now;
+      if (copy + 1 < RELAY_SHOW_COPIES) delay(RELAY_SHOW_GAP_MS);
+    }
+    _lastShowAt = at;
+    return at;
+  }
+
+  // Peer: a file is complete and the leader has set when to show it
+  bool showPending() { return _showPending; }
+  uint32_t showAt() { return _showAtUs; }
+
+  // Peer: hands over the pending file. It was malloc()ed; the caller frees
+  // it. Packets for its session are ignored from now on.
+  bool takeFile(uint8_t** data, uint32_t* size, uint8_t* kind) {
+    portENTER_CRITICAL(&_mux);
+    if (!_showPending) {
+      portEXIT_CRITICAL(&_mux);
+      return false;
+    }
+    *data = _rxData;
+    *size = _rxSize;
+    *kind = _rxKind;
+    uint32_t* have = _rxHave;
+    _rxData = nullptr;
+    _rxHave = nullptr;
+    _rxActive = false;
+    _showPending = false;
+    _doneSession = _rxSession;
+    portEXIT_CRITICAL(&_mux);
+    free(have);
+    return true;
+  }
+
+  void resetStats() {
+    _transfers = _sent = _sendFailures = _repairs = 0;
+    _received = _recovered = _nacks = _badFiles = _noMemory = _overflows = 0;
+  }
+
+  // Leader
+  uint32_t getTransfers() { return _transfers; }
+  uint32_t getSent() { return _sent; }             // packets, repairs and control included
+  uint32_t getSendFailures() { return _sendFailures; }
+  uint32_t getRepairs() { return _repairs; }       // data packets sent again
+  uint32_t getLastBytes() { return _lastBytes; }
+  uint32_t getLastUs() { return _lastUs; }         // transfer() of the last file
+  int getLastRounds() { return _lastRounds; }
+  int getLastRepairs() { return _lastRepairs; }
+  int getLastPeersOk() { return _lastPeersOk; }    // peers that had it at the end
+  uint32_t getLastShowAt() { return _lastShowAt; }
+  // Peer
+  uint32_t getReceived() { return _received; }     // files complete
+  uint32_t getRecovered() { return _recovered; }   // packets rebuilt from parity
+  uint32_t getNacks() { return _nacks; }
+  uint32_t getBadFiles() { return _badFiles; }     // CRC mismatch, received again
+  uint32_t getNoMemory() { return _noMemory; }     // files without room for them
+  uint32_t getOverflows() { return _overflows; }   // packets dropped, queue full
+
+private:
+  enum : uint8_t { MAGIC = 0xE7 };
+  enum : uint8_t { PKT_DATA = 1, PKT_PARITY, PKT_END, PKT_HAVE, PKT_NACK, PKT_SHOW };
+  enum : uint8_t { HAVE_OK = 0, HAVE_NO_MEMORY = 1 };
+
+  struct Packet {
+    uint8_t mac[6];
+    uint8_t len;
+    uint8_t data[RELAY_PACKET];
+    uint32_t rxUs;
+  };
+
+  static constexpr uint8_t BROADCAST[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+  SendFn _send = nullptr;
+  void* _ctx = nullptr;
+  QueueHandle_t _queue = nullptr;
+  TaskHandle_t _task = nullptr;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+  // Leader
+  uint8_t _peers[RELAY_MAX_PEERS][6];
+  int _peerCount = 0;
+  uint16_t _txSession = 0;
+  uint16_t _txCount = 0;
+  bool _txActive = false;
+  uint32_t* _txNack = nullptr; // union of the ranges asked for this round
+  uint32_t _txReplied = 0;     // bit per peer
+  uint32_t _txHave = 0;
+  uint32_t _txFailed = 0;      // no room for the file
+
+  // Peer
+  bool _listening = false;
+  bool _rxActive = false;
+  uint16_t _rxSession = 0;
+  int32_t _doneSession = -1;   // taken: ignore its packets, answer HAVE
+  uint16_t _rxCount = 0;
+  uint32_t _rxSize = 0;
+  uint8_t _rxKind = 0;
+  uint8_t* _rxData = nullptr;
+  uint32_t* _rxHave = nullptr; // bit per packet
+  uint16_t _rxMissing = 0;
+  bool _rxComplete = false;
+  volatile bool _showPending = false;
+  volatile uint32_t _showAtUs = 0;
+
+  uint32_t _transfers = 0, _sent = 0, _sendFailures = 0, _repairs = 0;
+  uint32_t _lastBytes = 0, _lastUs = 0, _lastShowAt = 0;
+  int _lastRounds = 0, _lastRepairs = 0, _lastPeersOk = 0;
+  uint32_t _received = 0, _recovered = 0, _nacks = 0, _badFiles = 0, _noMemory = 0, _overflows = 0;
+
+  static void taskEntry(void* self) { static_cast<MediaRelay*>(self)->run(); }
+
+  void run() {
+    Packet p;
+    for (;;) {
+      if (xQueueReceive(_queue, &p, portMAX_DELAY) == pdTRUE) handle(p);
+    }
+  }
+
+  void handle(const Packet& p) {
+    uint16_t session = get16(p.data + 2);
+    switch (p.data[1]) {
+      case PKT_DATA:
+      case PKT_PARITY:
+        if (_listening && p.len > RELAY_HEADER) receiveData(p, session);
+        break;
+      case PKT_END:
+        if (_listening && p.len >= 15) receiveEnd(p, session);
+        break;
+      case PKT_SHOW:
+        if (_listening && p.len >= 8) receiveShow(p, session);
+        break;
+      case PKT_HAVE:
+      case PKT_NACK:
+        if (p.len >= 5) receiveReply(p, session);
+        break;
+    }
+  }
+
+  // ----- Peer -----
+
+  void receiveData(const Packet& p, uint16_t session) {
+    const uint8_t* d = p.data;
+    uint16_t index = get16(d + 4);
+    uint16_t count = get16(d + 6);
+    uint32_t size = d[8] | (d[9] << 8) | ((uint32_t)d[10] << 16);
+    if (session == _doneSession) return;
+    if ((!_rxActive || session != _rxSession) && !startFile(session, count, size, d[11])) return;
+    if (_rxData == nullptr || count != _rxCount || size != _rxSize || _rxComplete) return;
+    const uint8_t* payload = d + RELAY_HEADER;
+    int len = p.len - RELAY_HEADER;
+    if (d[1] == PKT_PARITY) {
+      recover(index, payload, len);
+      return;
+    }
+    if (index >= _rxCount || has(index) || len != slotLength(_rxSize, index)) return;
+    memcpy(_rxData + index * RELAY_PAYLOAD, payload, len);
+    mark(index);
+  }
+
+  // Rebuilds the one packet of group that is missing, if only one is
+  void recover(uint16_t group, const uint8_t* parity, int len) {
+    uint32_t first = group * RELAY_FEC_GROUP;
+    if (first >= _rxCount || len != slotLength(_rxSize, first)) return;
+    uint32_t last = min((uint32_t)_rxCount, first + RELAY_FEC_GROUP);
+    int missing = -1;
+    for (uint32_t i = first; i < last; ++i) {
+      if (has(i)) continue;
+      if (missing >= 0) return; // two gone: the NACK round gets them
+      missing = i;
+    }
+    if (missing < 0) return;
+    uint8_t buf[RELAY_PAYLOAD];
+    memcpy(buf, parity, len);
+    for (uint32_t i = first; i < last; ++i) {
+      if ((int)i == missing) continue;
+      const uint8_t* src = _rxData + i * RELAY_PAYLOAD;
+      int n = slotLength(_rxSize, i);
+      for (int k = 0; k < n; ++k) buf[k] ^= src[k];
+    }
+    memcpy(_rxData + missing * RELAY_PAYLOAD, buf, slotLength(_rxSize, missing));
+    mark(missing);
+    ++_recovered;
+  }
+
+  void receiveEnd(const Packet& p, uint16_t session) {
+    const uint8_t* d = p.data;
+    if (session == _doneSession) {
+      sendHave(p.mac, session, HAVE_OK);
+      return;
+    }
+    uint16_t count = get16(d + 4);
+    uint32_t size = get32(d + 6);
+    uint32_t crc = get32(d + 10);
+    if ((!_rxActive || session != _rxSession) && !startFile(session, count, size, d[14])) return;
+    if (_rxData == nullptr) {
+      sendHave(p.mac, session, HAVE_NO_MEMORY);
+      return;
+    }
+    if (_rxMissing == 0 && !_rxComplete) {
+      if (crc32(_rxData, _rxSize) == crc) {
+        portENTER_CRITICAL(&_mux);
+        _rxComplete = true;
+        portEXIT_CRITICAL(&_mux);
+        ++_received;
+      } else {
+        memset(_rxHave, 0, (_rxCount + 31) / 32 * 4); // start over
+        _rxMissing = _rxCount;
+        ++_badFiles;
+      }
+    }
+    if (_rxComplete) {
+      sendHave(p.mac, session, HAVE_OK);
+    } else {
+      sendNack(p.mac, session);
+    }
+  }
+
+  void receiveShow(const Packet& p, uint16_t session) {
+    portENTER_CRITICAL(&_mux);
+    if (_rxActive && session == _rxSession && _rxComplete && !_showPending) {
+      _showAtUs = p.rxUs + get32(p.data + 4);
+      _showPending = true;
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  // A new session: drops the file before it, shown or not
+  bool startFile(uint16_t session, uint16_t count, uint32_t size, uint8_t kind) {
+    if (size == 0 || size > RELAY_MAX_FILE || count != (size + RELAY_PAYLOAD - 1) / RELAY_PAYLOAD) return false;
+    uint8_t* data = (uint8_t*)malloc(size);
+    uint32_t* have = data ? (uint32_t*)calloc((count + 31) / 32, 4) : nullptr;
+    if (have == nullptr) {
+      free(data);
+      data = nullptr;
+      ++_noMemory;
+    }
+    portENTER_CRITICAL(&_mux);
+    uint8_t* oldData = _rxData;
+    uint32_t* oldHave = _rxHave;
+    _rxData = data;
+    _rxHave = have;
+    _rxSession = session;
+    _rxCount = count;
+    _rxSize = size;
+    _rxKind = kind;
+    _rxMissing = count;
+    _rxComplete = false;
+    _rxActive = true;
+    _showPending = false;
+    portEXIT_CRITICAL(&_mux);
+    free(oldData);
+    free(oldHave);
+    return true;
+  }
+
+  bool has(uint32_t i) { return _rxHave[i >> 5] & (1u << (i & 31)); }
+
+  void mark(uint32_t i) {
+    _rxHave[i >> 5] |= 1u << (i & 31);
+    --_rxMissing;
+  }
+
+  void sendHave(const uint8_t* leader, uint16_t session, uint8_t status) {
+    uint8_t pkt[5];
+    header(pkt, PKT_HAVE, session);
+    pkt[4] = status;
+    send(leader, pkt, sizeof(pkt));
+  }
+
+  // The missing packets as (first, count) ranges, as many as fit
+  void sendNack(const uint8_t* leader, uint16_t session) {
+    uint8_t pkt[RELAY_PACKET];
+    header(pkt, PKT_NACK, session);
+    int ranges = 0;
+    uint32_t i = 0;
+    while (i < _rxCount && ranges < RELAY_NACK_RANGES) {
+      if (has(i)) {
+        ++i;
+        continue;
+      }
+      uint32_t first = i;
+      while (i < _rxCount && !has(i)) ++i;
+      put16(pkt + 5 + ranges * 4, first);
+      put16(pkt + 7 + ranges * 4, i - first);
+      ++ranges;
+    }
+    pkt[4] = ranges;
+    send(leader, pkt, 5 + ranges * 4);
+    ++_nacks;
+  }
+
+  // ----- Leader -----
+
+  void receiveReply(const Packet& p, uint16_t session) {
+    int peer = -1;
+    for (int i = 0; i < _peerCount; ++i) {
+      if (memcmp(_peers[i], p.mac, 6) == 0) peer = i;
+    }
+    if (peer < 0) return;
+    uint32_t bit = 1u << peer;
+    portENTER_CRITICAL(&_mux);
+    if (_txActive && session == _txSession) {
+      _txReplied |= bit;
+      if (p.data[1] == PKT_HAVE) {
+        if (p.data[4] == HAVE_OK) {
+          _txHave |= bit;
+        } else {
+          _txFailed |= bit;
+        }
+      } else {
+        int ranges = min((int)p.data[4], (p.len - 5) / 4);
+        for (int r = 0; r < ranges; ++r) {
+          uint32_t first = get16(p.data + 5 + r * 4);
+          uint32_t end = min((uint32_t)_txCount, first + get16(p.data + 7 + r * 4));
+          for (uint32_t i = first; i < end; ++i) _txNack[i >> 5] |= 1u << (i & 31);
+        }
+      }
+    }
+    portEXIT_CRITICAL(&_mux);
+  }
+
+  int sendData(uint8_t* pkt, uint8_t type, uint16_t index, uint16_t count, uint32_t size, uint8_t kind,
+               const uint8_t* payload, int len) {
+    header(pkt, type, _txSession);
+    put16(pkt + 4, index);
+    put16(pkt + 6, count);
+    pkt[8] = size;
+    pkt[9] = size >> 8;
+    pkt[10] = size >> 16;
+    pkt[11] = kind;
+    memcpy(pkt + RELAY_HEADER, payload, len);
+    send(BROADCAST, pkt, RELAY_HEADER + len);
+    return len;
+  }
+
+  // ----- Both -----
+
+  void send(const uint8_t* mac, const uint8_t* data, int len) {
+    if (_send(_ctx, mac, data, len)) {
+      ++_sent;
+    } else {
+      ++_sendFailures;
+    }
+  }
+
+  static int slotLength(uint32_t size, uint32_t index) {
+    return (int)min((uint32_t)RELAY_PAYLOAD, size - index * RELAY_PAYLOAD);
+  }
+
+  static void header(uint8_t* pkt, uint8_t type, uint16_t session) {
+    pkt[0] = MAGIC;
+    pkt[1] = type;
+    put16(pkt + 2, session);
+  }
+
+  static void put16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+  }
+  static void put32(uint8_t* p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+  }
+  static uint16_t get16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+  static uint32_t get32(const uint8_t* p) { return get16(p) | ((uint32_t)get16(p + 2) << 16); }
+
+  static uint32_t crc32(const uint8_t* data, uint32_t len) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < len; ++i) {
+      crc ^= data[i];
+      for (int k = 0; k < 8; ++k) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+  }
+};
+
+#endif
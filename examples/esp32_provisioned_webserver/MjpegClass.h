@@ -2,89 +2,116 @@
 #define _MJPEGCLASS_H_
 #pragma GCC optimize("O3")
 
-#define READ_BUFFER_SIZE 2048
-
 #include <esp_heap_caps.h>
 #include <Adafruit_ST7789.h>
+#include "PanelConfig.h"
+#include "PanelTransport.h"
 #include "tjpgdClass.h"
 
+// P is the panel descriptor (PanelConfig.h): frames are centred and
+// clipped to its size and converted to its byte order.
+template <class P>
 class MjpegClass
 {
 public:
-  bool setup(Adafruit_ST7789 *tft, uint8_t *mjpeg_buf, int32_t buf_size, int32_t x, int32_t y)
+  bool setup(Adafruit_ST7789 *tft, int32_t x, int32_t y)
   {
     _tft = tft;
-    _mjpeg_buf = mjpeg_buf;
-    _buf_size = buf_size;
     _x = x;
     _y = y;
 
-    _tft_width = _tft->width();
-    _tft_height = _tft->height();
-
-    if (!_read_buf)
-    {
-      _read_buf = (uint8_t *)malloc(READ_BUFFER_SIZE);
-    }
     for (int i = 0; i < 2; ++i)
     {
       if (!_out_bufs[i])
       {
-        _out_bufs[i] = (uint8_t *)heap_caps_malloc(_tft_width * 48 * 2, MALLOC_CAP_DMA);
+        _out_bufs[i] = (uint8_t *)heap_caps_malloc(P::width * 48 * 2, MALLOC_CAP_DMA);
       }
     }
 
-    _out_buf = _out_bufs[0];
-
-    if (_multiTask)
+    if (!_out_bufs[0] || !_out_bufs[1])
     {
-      _jdec.multitask_begin();
+      return false;
     }
 
     return true;
   }
 
-  int readMjpegBuf(const uint8_t *buf, int32_t len)
+  // Decode frames in two slices when their restart markers allow it: the
+  // caller decodes the top band while a task pinned to core decodes the
+  // bottom one into the second output buffer. The task is created once and
+  // kept. Frames without restart markers are still decoded whole.
+  bool beginSlices(BaseType_t core)
   {
-    if (!buf || len == 0) { // end of stream
-      if (_mjpeg_buf_offset > 0) {
-        drawJpg();
-        _mjpeg_buf_offset = 0;
-      }
-      return 1;
+    if (_slice_task)
+    {
+      return true;
+    }
+    if (!_slice_start)
+    {
+      _slice_start = xSemaphoreCreateBinary();
+      _slice_done = xSemaphoreCreateBinary();
+      _panel_lock = xSemaphoreCreateMutex();
     }
+    if (!_slice_start || !_slice_done || !_panel_lock ||
+        xTaskCreatePinnedToCore(sliceTask, "jpgSlice", 4096, this, 1, &_slice_task, core) != pdPASS)
+    {
+      _slice_task = nullptr;
+      return false;
+    }
+    _multiTask = true;
+    return true;
+  }
 
-    for (int i = 0; i < len; ++i) {
-      if (_mjpeg_buf_offset >= _buf_size) {
-        // Serial.println("Buffer overflow");
-        _mjpeg_buf_offset = 0;
-      }
-      _mjpeg_buf[_mjpeg_buf_offset++] = buf[i];
-      if (buf[i] == 0xD9 && _mjpeg_buf[_mjpeg_buf_offset-2] == 0xFF) { // End of JPEG
-        if (drawJpg()) {
-          _mjpeg_buf_offset = 0;
-        } else {
-          // Serial.println("Draw failed");
-          return 0; // Error
-        }
-      }
+  // Draw through a PanelTransport instead of Adafruit_ST7789. The caller
+  // owns it and calls finish() before drawing anything else.
+  void setTransport(PanelTransport *panel)
+  {
+    _panel = panel;
+  }
+
+  void resetStats()
+  {
+    _drawn_frames = 0;
+    _last_decode_us = 0;
+    _total_decode_us = 0;
+    _sliced_frames = 0;
+    _slice_wait_us = 0;
+  }
+
+  uint32_t getDrawnFrames() { return _drawn_frames; }
+  uint32_t getLastDecodeTime() { return _last_decode_us; }   // microseconds
+  uint32_t getTotalDecodeTime() { return _total_decode_us; } // microseconds
+  uint32_t getSlicedFrames() { return _sliced_frames; }      // decoded on both cores
+  uint32_t getSliceWaitTime() { return _slice_wait_us; }     // microseconds the caller waited for the bottom slice
+
+  // Release the output buffers allocated by setup()
+  void end()
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      heap_caps_free(_out_bufs[i]);
+      _out_bufs[i] = nullptr;
     }
-    return 1;
   }
 
-  bool drawJpg()
+  // Draw one complete JPEG (e.g. a FrameQueue slot)
+  bool drawJpg(const uint8_t *jpg, int32_t len)
   {
-    _fileindex = 0;
-    _remain = _mjpeg_buf_offset;
-    TJpgD::JRESULT jres = _jdec.prepare(jpgRead, this);
+    unsigned long start = micros();
+    Slice &top = _slices[0];
+    top.me = this;
+    top.out_buf = _out_bufs[0];
+    top.src = jpg;
+    top.remain = len;
+    TJpgD::JRESULT jres = _jdec.prepare(jpgRead, &top);
     if (jres != TJpgD::JDR_OK)
     {
       Serial.printf("prepare failed! %d\r\n", jres);
       return false;
     }
 
-    _out_width = std::min<int32_t>(_jdec.width, _tft_width);
-    _jpg_x = (_tft_width - _jdec.width) >> 1;
+    _out_width = std::min<int32_t>(_jdec.width, P::width);
+    _jpg_x = (P::width - _jdec.width) >> 1;
     if (0 > _jpg_x)
     {
       _off_x = -_jpg_x;
@@ -94,8 +121,8 @@ public:
     {
       _off_x = 0;
     }
-    _out_height = std::min<int32_t>(_jdec.height, _tft_height);
-    _jpg_y = (_tft_height - _jdec.height) >> 1;
+    _out_height = std::min<int32_t>(_jdec.height, P::height);
+    _jpg_y = (P::height - _jdec.height) >> 1;
     if (0 > _jpg_y)
     {
       _off_y = -_jpg_y;
@@ -106,13 +133,34 @@ public:
       _off_y = 0;
     }
 
-    if (_multiTask)
+    uint32_t rows = _jdec.mcuRows();
+    uint32_t split = rows;
+    int32_t at = _multiTask ? _jdec.findRestartSplit(jpg, len, split) : -1;
+    if (at < 0)
     {
-      jres = _jdec.decomp_multitask(jpgWrite16, jpgWriteRow);
+      jres = _jdec.decomp(jpgWrite16, jpgWriteRow);
     }
     else
     {
-      jres = _jdec.decomp(jpgWrite16, jpgWriteRow);
+      Slice &bottom = _slices[1];
+      bottom.me = this;
+      bottom.out_buf = _out_bufs[1];
+      bottom.src = jpg + at;
+      bottom.remain = len - at;
+      bottom.row_begin = split;
+      bottom.row_end = rows;
+      _jdec2 = _jdec; // tables only; rewind() resets the stream state
+      _jdec2.rewind(jpgRead, &bottom);
+      xSemaphoreGive(_slice_start);
+      jres = _jdec.decompSlice(jpgWrite16, jpgWriteRow, 0, 0, split);
+      unsigned long wait = micros();
+      xSemaphoreTake(_slice_done, portMAX_DELAY);
+      _slice_wait_us += micros() - wait;
+      if (jres == TJpgD::JDR_OK)
+      {
+        jres = bottom.result;
+      }
+      ++_sliced_frames;
     }
 
     if (jres != TJpgD::JDR_OK)
@@ -120,28 +168,51 @@ public:
       Serial.printf("decomp failed! %d\r\n", jres);
       return false;
     }
+    if (_panel)
+    {
+      _panel->flush();
+    }
+    _last_decode_us = micros() - start;
+    _total_decode_us += _last_decode_us;
+    ++_drawn_frames;
     return true;
   }
 
 private:
-  uint8_t *_read_buf;
-  uint8_t *_mjpeg_buf;
-  int32_t _mjpeg_buf_offset = 0;
-
-  Adafruit_ST7789 *_tft;
-  bool _multiTask;
-  uint8_t *_out_bufs[2];
-  uint8_t *_out_buf;
+  // One band of the frame: where its entropy data is read from and the
+  // buffer its MCU rows are converted into
+  struct Slice
+  {
+    MjpegClass *me;
+    uint8_t *out_buf;
+    const uint8_t *src;
+    int32_t remain;
+    uint32_t row_begin;
+    uint32_t row_end;
+    TJpgD::JRESULT result;
+  };
+
+  uint32_t _drawn_frames = 0;
+  uint32_t _last_decode_us = 0;
+  uint32_t _total_decode_us = 0;
+  uint32_t _sliced_frames = 0;
+  uint32_t _slice_wait_us = 0;
+
+  Adafruit_ST7789 *_tft = nullptr;
+  PanelTransport *_panel = nullptr;
+  bool _multiTask = false;
+  uint8_t *_out_bufs[2] = {nullptr, nullptr};
   TJpgD _jdec;
+  TJpgD _jdec2; // bottom slice
+  Slice _slices[2];
+  TaskHandle_t _slice_task = nullptr;
+  SemaphoreHandle_t _slice_start = nullptr;
+  SemaphoreHandle_t _slice_done = nullptr;
+  SemaphoreHandle_t _panel_lock = nullptr; // both slices draw
 
-  int32_t _buf_size;
   int32_t _x;
   int32_t _y;
-  int32_t _remain = 0;
-  uint32_t _fileindex;
 
-  int32_t _tft_width;
-  int32_t _tft_height;
   int32_t _out_width;
   int32_t _out_height;
   int32_t _off_x;
@@ -151,24 +222,37 @@ private:
 
   static uint32_t jpgRead(TJpgD *jdec, uint8_t *buf, uint32_t len)
   {
-    MjpegClass *me = (MjpegClass *)jdec->device;
-    if (len > me->_remain)
-      len = me->_remain;
+    Slice *s = (Slice *)jdec->device;
+    if (len > (uint32_t)s->remain)
+      len = s->remain;
     if (buf)
     {
-      memcpy(buf, (const uint8_t *)me->_mjpeg_buf + me->_fileindex, len);
+      memcpy(buf, s->src, len);
     }
-    me->_fileindex += len;
-    me->_remain -= len;
+    s->src += len;
+    s->remain -= len;
     return len;
   }
 
-  // for 16bit color panel
+  static void sliceTask(void *param)
+  {
+    MjpegClass *me = (MjpegClass *)param;
+    for (;;)
+    {
+      xSemaphoreTake(me->_slice_start, portMAX_DELAY);
+      Slice &s = me->_slices[1];
+      s.result = me->_jdec2.decompSlice(jpgWrite16, jpgWriteRow, 0, s.row_begin, s.row_end);
+      xSemaphoreGive(me->_slice_done);
+    }
+  }
+
+  // for 16bit color panel, in the panel's byte order
   static uint32_t jpgWrite16(TJpgD *jdec, void *bitmap, TJpgD::JRECT *rect)
   {
-    MjpegClass *me = (MjpegClass *)jdec->device;
+    Slice *s = (Slice *)jdec->device;
+    MjpegClass *me = s->me;
 
-    uint16_t *dst = (uint16_t *)me->_out_buf;
+    uint16_t *dst = (uint16_t *)s->out_buf;
 
     uint_fast16_t x = rect->left;
     uint_fast16_t y = rect->top;
@@ -176,36 +260,38 @@ private:
     uint_fast16_t h = rect->bottom + 1 - y;
     uint_fast16_t outWidth = me->_out_width;
     uint_fast16_t outHeight = me->_out_height;
+    uint_fast16_t offX = me->_off_x; // never negative, see drawJpg()
+    uint_fast16_t offY = me->_off_y;
     uint8_t *src = (uint8_t *)bitmap;
     uint_fast16_t oL = 0, oR = 0;
 
-    if (rect->right < me->_off_x)
+    if (rect->right < offX)
       return 1;
-    if (x >= (me->_off_x + outWidth))
+    if (x >= (offX + outWidth))
       return 1;
-    if (rect->bottom < me->_off_y)
+    if (rect->bottom < offY)
       return 1;
-    if (y >= (me->_off_y + outHeight))
+    if (y >= (offY + outHeight))
       return 1;
 
-    if (me->_off_y > y)
+    if (offY > y)
     {
-      uint_fast16_t linesToSkip = me->_off_y - y;
+      uint_fast16_t linesToSkip = offY - y;
       src += linesToSkip * w * 3;
       h -= linesToSkip;
     }
 
-    if (me->_off_x > x)
+    if (offX > x)
     {
-      oL = me->_off_x - x;
+      oL = offX - x;
     }
-    if (rect->right >= (me->_off_x + outWidth))
+    if (rect->right >= (offX + outWidth))
     {
-      oR = (rect->right + 1) - (me->_off_x + outWidth);
+      oR = (rect->right + 1) - (offX + outWidth);
     }
 
     int_fast16_t line = (w - (oL + oR));
-    dst += oL + x - me->_off_x;
+    dst += oL + x - offX;
     src += oL * 3;
     do
     {
@@ -218,7 +304,7 @@ private:
         r8 |= g8 >> 5;
         g8 &= 0x1C;
         b5 = (g8 << 3) + b5;
-        dst[i] = r8 | b5 << 8;
+        dst[i] = P::bigEndian ? (r8 | b5 << 8) : (r8 << 8 | b5);
       } while (++i != line);
       dst += outWidth;
       src += w * 3;
@@ -229,11 +315,29 @@ private:
 
   static uint32_t jpgWriteRow(TJpgD *jdec, uint32_t y, uint32_t h)
   {
-    MjpegClass *me = (MjpegClass *)jdec->device;
-    me->_tft->startWrite();
-    me->_tft->setAddrWindow(me->_jpg_x, me->_jpg_y + y, jdec->width, h);
-    me->_tft->writePixels((uint16_t*)me->_out_buf, jdec->width * h);
-    me->_tft->endWrite();
+    Slice *s = (Slice *)jdec->device;
+    MjpegClass *me = s->me;
+    // jpgWrite16 packed only the rows inside the visible window
+    int32_t top = std::max<int32_t>(y, me->_off_y);
+    int32_t bottom = std::min<int32_t>(y + h, me->_off_y + me->_out_height);
+    if (top >= bottom)
+      return 1;
+    if (me->_panel_lock)
+      xSemaphoreTake(me->_panel_lock, portMAX_DELAY);
+    if (me->_panel)
+    {
+      me->_panel->setWindow(me->_x + me->_jpg_x, me->_y + me->_jpg_y + top - me->_off_y, me->_out_width, bottom - top);
+      me->_panel->pushPixels((uint16_t *)s->out_buf, me->_out_width * (bottom - top), P::bigEndian);
+    }
+    else
+    {
+      me->_tft->startWrite();
+      me->_tft->setAddrWindow(me->_x + me->_jpg_x, me->_y + me->_jpg_y + top - me->_off_y, me->_out_width, bottom - top);
+      me->_tft->writePixels((uint16_t *)s->out_buf, me->_out_width * (bottom - top), true, P::bigEndian);
+      me->_tft->endWrite();
+    }
+    if (me->_panel_lock)
+      xSemaphoreGive(me->_panel_lock);
     return 1;
   }
 };
@@ -0,0 +1,141 @@
+#ifndef _PANELANIM_H_
+#define _PANELANIM_H_
+
+// Panel-native animation (.pan): per-frame dirty rectangles of RLE
+// compressed RGB565 in the ST7789's byte order. Playing a frame is a
+// window per rectangle and a copy of its pixels to the bus; nothing is
+// decompressed beyond expanding runs, and pixels that did not change are
+// never sent. Encode with host/tools/panenc.
+//
+// Layout (integers little-endian, every field 2-byte aligned so the player
+// reads straight from a malloc'd buffer or memory-mapped flash):
+//
+//   header   "PAN1"  u16 width  u16 height  u16 frames  u16 loops  u32 0
+//   frame    u32 bytes (rest of the frame)  u16 delay_ms  u16 rects
+//   rect     u16 x  u16 y  u16 w  u16 h  then runs covering w*h pixels,
+//            row by row
+//   run      u16 token: bit 15 set: (token & 0x7FFF) + 1 copies of the
+//            next pixel; clear: token + 1 literal pixels follow
+//   pixel    RGB565, big-endian
+//
+// The first frame covers the whole canvas; each later frame holds what
+// changed since the one before, so looping back to frame 0 is always
+// valid. loops is 0 for forever.
+
+#include <Arduino.h>
+#include "PanelTransport.h"
+
+#define PANEL_ANIM_HEADER_SIZE 16
+
+class PanelAnim {
+public:
+  // Reads the header; false if this is not a .pan file
+  static bool parseHeader(const uint8_t* data, int32_t len, int& width, int& height, int& frames) {
+    if (len < PANEL_ANIM_HEADER_SIZE || memcmp(data, "PAN1", 4) != 0) return false;
+    width = u16(data + 4);
+    height = u16(data + 6);
+    frames = u16(data + 8);
+    return true;
+  }
+
+  bool open(const uint8_t* data, int32_t len) {
+    int frames;
+    if (!parseHeader(data, len, _width, _height, frames) || frames == 0 || (uintptr_t)data & 1) return false;
+    _data = data;
+    _len = len;
+    _frameCount = frames;
+    _loopCount = u16(data + 10);
+    reset();
+    return true;
+  }
+
+  void close() { _data = nullptr; }
+
+  void reset() {
+    _pos = PANEL_ANIM_HEADER_SIZE;
+    _frame = 0;
+  }
+
+  // Draws the next frame at (x, y) through the transport and queues it.
+  // Returns 1 when more frames follow, 0 after the last one, -1 if the
+  // file is damaged. With sync, waits out the rest of the frame delay.
+  int playFrame(PanelTransport& panel, int x, int y, bool sync, int* delayMs = nullptr) {
+    if (_data == nullptr || _frame >= _frameCount || _pos + 8 > _len) return -1;
+    unsigned long start = millis();
+    uint32_t bytes = u32(_data + _pos);
+    if (bytes < 4 || bytes > (uint32_t)(_len - _pos - 4)) return -1;
+    int32_t end = _pos + 4 + bytes;
+    int frameDelay = u16(_data + _pos + 4);
+    int rects = u16(_data + _pos + 6);
+    int32_t pos = _pos + 8;
+    for (int i = 0; i < rects; ++i) {
+      pos = drawRect(panel, x, y, pos, end);
+      if (pos < 0) return -1;
+    }
+    panel.flush();
+    _pos = end;
+    ++_frame;
+    ++_framesShown;
+    if (delayMs) *delayMs = frameDelay;
+    if (sync) {
+      long wait = frameDelay - (long)(millis() - start);
+      if (wait > 0) delay(wait);
+    }
+    return _frame < _frameCount ? 1 : 0;
+  }
+
+  int getWidth() { return _width; }
+  int getHeight() { return _height; }
+  int getFrameCount() { return _frameCount; }
+  int getLoopCount() { return _loopCount; }
+  uint32_t getFramesShown() { return _framesShown; } // since boot
+
+private:
+  const uint8_t* _data = nullptr;
+  int32_t _len = 0;
+  int32_t _pos = 0;
+  int _width = 0;
+  int _height = 0;
+  int _frameCount = 0;
+  int _loopCount = 0;
+  int _frame = 0;
+  uint32_t _framesShown = 0;
+
+  static uint16_t u16(const uint8_t* p) { return p[0] | p[1] << 8; }
+  static uint32_t u32(const uint8_t* p) { return u16(p) | (uint32_t)u16(p + 2) << 16; }
+
+  // Returns the offset after the rectangle, or -1 if it is damaged
+  int32_t drawRect(PanelTransport& panel, int x0, int y0, int32_t pos, int32_t end) {
+    if (pos + 8 > end) return -1;
+    int x = u16(_data + pos), y = u16(_data + pos + 2);
+    int w = u16(_data + pos + 4), h = u16(_data + pos + 6);
+    pos += 8;
+    if (w == 0 || h == 0 || x + w > _width || y + h > _height) return -1;
+    panel.setWindow(x0 + x, y0 + y, w, h);
+
+    uint16_t fill[64];
+    uint32_t left = (uint32_t)w * h;
+    while (left > 0) {
+      if (pos + 4 > end) return -1;
+      uint16_t token = u16(_data + pos);
+      uint32_t n = (token & 0x7FFF) + 1;
+      if (n > left) return -1;
+      if (token & 0x8000) {
+        uint16_t pixel = *(const uint16_t*)(_data + pos + 2); // already panel order
+        for (int i = 0; i < 64; ++i) fill[i] = pixel;
+        for (uint32_t done = 0; done < n; done += 64) {
+          panel.pushPixels(fill, std::min<uint32_t>(64, n - done), true);
+        }
+        pos += 4;
+      } else {
+        if (pos + 2 + (int32_t)n * 2 > end) return -1;
+        panel.pushPixels((const uint16_t*)(_data + pos + 2), n, true);
+        pos += 2 + n * 2;
+      }
+      left -= n;
+    }
+    return pos;
+  }
+};
+
+#endif // _PANELANIM_H_
@@ -0,0 +1,56 @@
+#ifndef _PANELCONFIG_H_
+#define _PANELCONFIG_H_
+
+// Panel geometry as compile-time constants. The draw paths (PanelDraw.h,
+// MjpegClass) are templates on a descriptor, so line buffers, clipping
+// bounds and the pixel byte order are constants in their inner loops, and
+// one sketch serves every ST7789 size:
+//
+//   default                    2.0"  240x320, landscape 320x240
+//   -DPANEL_ST7789_240X240     1.3"  240x240
+//   -DPANEL_ST7789_135X240     1.14" 135x240, landscape 240x135
+//
+// -DPANEL_ROTATION=n overrides the rotation (default 1, landscape).
+
+#include <Adafruit_ST7789.h>
+
+// The ST7789 has 240x320 of RAM. Smaller glass shows part of it, at the
+// offsets Adafruit_ST7789::init() and setRotation() use. Writes that bypass
+// Adafruit (PanelTransport) have to add them to every address window.
+template <uint16_t NativeW, uint16_t NativeH, uint8_t Rotation, bool BigEndian = true>
+struct St7789Panel {
+  static constexpr uint16_t nativeWidth = NativeW; // as passed to tft.init()
+  static constexpr uint16_t nativeHeight = NativeH;
+  static constexpr uint8_t rotation = Rotation & 3;
+  static constexpr int16_t width = (rotation & 1) ? NativeH : NativeW; // after setRotation()
+  static constexpr int16_t height = (rotation & 1) ? NativeW : NativeH;
+  // Pixels go on the wire high byte first. Decoders that can produce that
+  // order directly (JPEGDEC, AnimatedGIF, MjpegClass) are asked to.
+  static constexpr bool bigEndian = BigEndian;
+
+  static constexpr int16_t rowStart = (NativeW == 240 && NativeH == 240) ? 320 - NativeH : (320 - NativeH) / 2;
+  static constexpr int16_t rowStart2 = (NativeW == 240 && NativeH == 240) ? 0 : (320 - NativeH) / 2;
+  static constexpr int16_t colStart = (NativeW == 135) ? (240 - NativeW + 1) / 2 : (240 - NativeW) / 2;
+  static constexpr int16_t colStart2 = (240 - NativeW) / 2;
+  static constexpr int16_t xOffset = rotation == 0 ? colStart : rotation == 1 ? rowStart : rotation == 2 ? colStart2 : rowStart2;
+  static constexpr int16_t yOffset = rotation == 0 ? rowStart : rotation == 1 ? colStart2 : rotation == 2 ? rowStart2 : colStart;
+
+  static void begin(Adafruit_ST7789& tft) {
+    tft.init(NativeW, NativeH);
+    tft.setRotation(rotation);
+  }
+};
+
+#ifndef PANEL_ROTATION
+#define PANEL_ROTATION 1
+#endif
+
+#if defined(PANEL_ST7789_240X240)
+typedef St7789Panel<240, 240, PANEL_ROTATION> TftPanel;
+#elif defined(PANEL_ST7789_135X240)
+typedef St7789Panel<135, 240, PANEL_ROTATION> TftPanel;
+#else
+typedef St7789Panel<240, 320, PANEL_ROTATION> TftPanel;
+#endif
+
+#endif // _PANELCONFIG_H_
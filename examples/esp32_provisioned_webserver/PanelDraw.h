@@ -0,0 +1,99 @@
+#ifndef _PANELDRAW_H_
+#define _PANELDRAW_H_
+
+// Decoder callbacks for JPEGDEC and AnimatedGIF, specialised on a panel
+// descriptor (PanelConfig.h). Output is clipped to the panel, converted
+// straight into the panel's byte order and queued on the transport.
+
+#include <AnimatedGIF.h>
+#include <JPEGDEC.h>
+#include "PanelConfig.h"
+#include "PanelTransport.h"
+
+// Set the decoder's pixel type to this before decode()
+template <class P>
+constexpr int jpegPixelType() {
+  return P::bigEndian ? RGB565_BIG_ENDIAN : RGB565_LITTLE_ENDIAN;
+}
+
+template <class P>
+constexpr int gifPaletteType() {
+  return P::bigEndian ? GIF_PALETTE_RGB565_BE : GIF_PALETTE_RGB565_LE;
+}
+
+// One JPEGDEC block: rows of iWidth pixels, clipped at the right and
+// bottom edges (images that are too large even at 1/8 scale)
+template <class P>
+int drawJpegBlock(PanelTransport& panel, JPEGDRAW* pDraw) {
+  int x = pDraw->x, y = pDraw->y;
+  if (x >= P::width || y >= P::height) return 1;
+  int w = std::min<int>(pDraw->iWidth, P::width - x);
+  int h = std::min<int>(pDraw->iHeight, P::height - y);
+  panel.setWindow(x, y, w, h);
+  if (w == pDraw->iWidth) {
+    panel.pushPixels(pDraw->pPixels, w * h, P::bigEndian);
+  } else {
+    for (int row = 0; row < h; ++row) {
+      panel.pushPixels(pDraw->pPixels + row * pDraw->iWidth, w, P::bigEndian);
+    }
+  }
+  return 1;
+}
+
+// Where a 1/8-scale preview goes: the area the full decode will cover, at
+// (x, y), w x h, and the size each preview pixel is blown up to
+struct JpegPreview {
+  int x, y, w, h;
+  int zoom;
+};
+
+// One JPEGDEC block of a JPEG_SCALE_EIGHTH decode (pUser: a JpegPreview),
+// each pixel drawn as a zoom x zoom square, clipped to the preview area
+// and the panel. A line is expanded once and queued zoom times.
+template <class P>
+int drawJpegPreview(PanelTransport& panel, JPEGDRAW* pDraw) {
+  const JpegPreview& pv = *static_cast<const JpegPreview*>(pDraw->pUser);
+  uint16_t line[P::width];
+  int x = pv.x + pDraw->x * pv.zoom, y = pv.y + pDraw->y * pv.zoom;
+  int right = std::min<int>(pv.x + pv.w, P::width);
+  int bottom = std::min<int>(pv.y + pv.h, P::height);
+  if (x >= right || y >= bottom) return 1;
+  int w = std::min<int>(pDraw->iWidth * pv.zoom, right - x);
+  int h = std::min<int>(pDraw->iHeight * pv.zoom, bottom - y);
+  panel.setWindow(x, y, w, h);
+  for (int row = 0; row * pv.zoom < h; ++row) {
+    const uint16_t* s = pDraw->pPixels + row * pDraw->iWidth;
+    for (int i = 0, col = 0; i < w; ++col) {
+      for (int k = 0; k < pv.zoom && i < w; ++k) line[i++] = s[col];
+    }
+    int repeat = std::min<int>(pv.zoom, h - row * pv.zoom);
+    for (int k = 0; k < repeat; ++k) panel.pushPixels(line, w, P::bigEndian);
+  }
+  return 1;
+}
+
+// One GIF line: palette lookup into a panel-width buffer, then queued.
+// Transparency is ignored for speed. Lines of a frame share one address
+// window (PanelTransport coalesces them); the last one is flushed so it
+// goes out while playFrame() waits out the frame delay.
+template <class P>
+void drawGifLine(PanelTransport& panel, GIFDRAW* pDraw) {
+  uint16_t line[P::width];
+  int x = pDraw->iX;
+  int y = pDraw->iY + pDraw->y;
+  if (x >= P::width || y >= P::height) return;
+  int w = std::min<int>(pDraw->iWidth, P::width - x);
+
+  const uint8_t* s = pDraw->pPixels;
+  const uint16_t* palette = pDraw->pPalette;
+  for (int i = 0; i < w; ++i) {
+    line[i] = palette[s[i]];
+  }
+  panel.setWindow(x, y, w, 1);
+  panel.pushPixels(line, w, P::bigEndian);
+  if (pDraw->y == pDraw->iHeight - 1) {
+    panel.flush();
+  }
+}
+
+#endif // _PANELDRAW_H_
@@ -0,0 +1,357 @@
+#ifndef _PANELTRANSPORT_H_
+#define _PANELTRANSPORT_H_
+
+// Queued DMA writes to the ST7789 through the ESP-IDF SPI master driver.
+//
+// Adafruit_ST7789 sends every address window and pixel run as a blocking
+// transfer, so the decoder sits idle while the bus is busy. Here pixels
+// are copied into a small ring of DMA buffers and queued; the caller keeps
+// decoding while earlier buffers go out, and only waits when every buffer
+// or queue slot is in flight. Windows that continue straight down from the
+// previous one (the next MCU row of a JPEG, the next line of a GIF) are
+// merged into one RAMWR, and CASET is skipped when the columns match.
+//
+// The device sits on the same host as Arduino's SPI (VSPI), the way
+// TFT_eSPI does its DMA. The two must not interleave: call finish() before
+// any Adafruit drawing. Each side also leaves its clock divider and SPI
+// mode in the host's registers. The IDF driver programs them once, when it
+// first selects the device, so Adafruit is set to the same clock and mode
+// in begin(). finish() runs an empty Arduino transaction, which rewrites
+// them for Arduino's HAL. If the driver can't be set up, every call falls
+// back to the Adafruit write path.
+//
+// begin() takes the panel descriptor (PanelConfig.h) for the RAM offsets
+// of panels smaller than the controller's 240x320.
+
+#include <Arduino.h>
+#include <Adafruit_ST7789.h>
+#include <SPI.h>
+#include <driver/gpio.h>
+#include <driver/spi_master.h>
+#include <esp_heap_caps.h>
+
+#ifndef PANEL_SPI_HOST
+#define PANEL_SPI_HOST SPI3_HOST // VSPI, shared with Arduino's SPI
+#endif
+
+// The ST7789 is rated for a 16ns write cycle (62.5MHz), and 40MHz is the
+// fastest clean division of the 80MHz APB clock below that. Panels on short
+// wires often take -DPANEL_SPI_HZ=SPI_MASTER_FREQ_80M, which is out of spec
+// and needs VSPI's IOMUX pins (SCLK 18, MOSI 23); check for noise first.
+#ifndef PANEL_SPI_HZ
+#define PANEL_SPI_HZ SPI_MASTER_FREQ_40M
+#endif
+
+#ifndef PANEL_QUEUE_DEPTH
+#define PANEL_QUEUE_DEPTH 16 // queued transactions (commands and pixel buffers)
+#endif
+
+#ifndef PANEL_DMA_BUFS
+#define PANEL_DMA_BUFS 3
+#endif
+
+#ifndef PANEL_DMA_BUF_BYTES
+#define PANEL_DMA_BUF_BYTES 4096
+#endif
+
+class PanelTransport {
+public:
+  template <class P>
+  bool begin(Adafruit_ST7789* tft, int8_t cs, int8_t dc, int8_t sclk, int8_t mosi, int hz = PANEL_SPI_HZ) {
+    end();
+    _tft = tft;
+    _cs = cs;
+    _dc = dc;
+    _hz = hz;
+    _panelHeight = P::height;
+    _xOffset = P::xOffset;
+    _yOffset = P::yOffset;
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num = mosi;
+    bus.miso_io_num = -1;
+    bus.sclk_io_num = sclk;
+    bus.quadwp_io_num = -1;
+    bus.quadhd_io_num = -1;
+    bus.max_transfer_sz = PANEL_DMA_BUF_BYTES;
+    esp_err_t err = spi_bus_initialize(PANEL_SPI_HOST, &bus, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) { // already up is fine
+      Serial.printf("Panel DMA unavailable: %s\n", esp_err_to_name(err));
+      return false;
+    }
+    _ownsBus = err == ESP_OK;
+
+    spi_device_interface_config_t dev = {};
+    dev.mode = 0;
+    dev.clock_speed_hz = hz;
+    dev.spics_io_num = -1; // CS is held low across a whole burst
+    dev.flags = SPI_DEVICE_NO_DUMMY;
+    dev.queue_size = PANEL_QUEUE_DEPTH;
+    dev.pre_cb = setDC;
+    err = spi_bus_add_device(PANEL_SPI_HOST, &dev, &_dev);
+    if (err != ESP_OK) {
+      Serial.printf("Panel DMA unavailable: %s\n", esp_err_to_name(err));
+      _dev = nullptr;
+      end();
+      return false;
+    }
+
+    for (int i = 0; i < PANEL_DMA_BUFS; ++i) {
+      _bufs[i] = (uint8_t*)heap_caps_malloc(PANEL_DMA_BUF_BYTES, MALLOC_CAP_DMA);
+      if (_bufs[i] == nullptr) {
+        Serial.println("Panel DMA unavailable: no DMA memory");
+        end();
+        return false;
+      }
+    }
+    _tft->setSPISpeed(hz); // see the top of this file
+    resetStats();
+    return true;
+  }
+
+  void end() {
+    if (_dev != nullptr) {
+      finish();
+      spi_bus_remove_device(_dev);
+      _dev = nullptr;
+    }
+    if (_ownsBus) {
+      spi_bus_free(PANEL_SPI_HOST);
+      _ownsBus = false;
+    }
+    for (int i = 0; i < PANEL_DMA_BUFS; ++i) {
+      heap_caps_free(_bufs[i]);
+      _bufs[i] = nullptr;
+      _bufBusy[i] = false;
+    }
+    _fill = _fillLen = 0;
+  }
+
+  // False when drawing goes through Adafruit_ST7789
+  bool usingDma() { return _dev != nullptr; }
+
+  void resetStats() {
+    _bytes = 0;
+    _transactions = 0;
+    _windows = 0;
+    _coalesced = 0;
+    _stalls = 0;
+    _stallUs = 0;
+    _statsStartMs = millis();
+  }
+
+  // Starts a w x h window at (x, y). One that carries on directly below
+  // the current window sends nothing.
+  void setWindow(int16_t x, int16_t y, int16_t w, int16_t h) {
+    if (_dev == nullptr) {
+      if (_open) _tft->endWrite();
+      _tft->startWrite();
+      _tft->setAddrWindow(x, y, w, h);
+      _open = true;
+      ++_windows;
+      return;
+    }
+
+    if (_ramwr && w > 0 && x == _winX && w == _winW && _winPixels % w == 0 &&
+        y == _winY + (int32_t)(_winPixels / w) && y + h <= _panelHeight) {
+      ++_coalesced;
+      return;
+    }
+
+    queueBuffer(); // pixels still buffered belong to the old window
+    if (!_open) {
+      digitalWrite(_cs, LOW);
+      _open = true;
+    }
+    if (x != _colStart || x + w - 1 != _colEnd) {
+      sendCommand(0x2A, _xOffset + x, _xOffset + x + w - 1); // CASET
+      _colStart = x;
+      _colEnd = x + w - 1;
+    }
+    sendCommand(0x2B, _yOffset + y, _yOffset + _panelHeight - 1); // RASET, open-ended so later rows can follow
+    sendCommand(0x2C);                      // RAMWR
+    _ramwr = true;
+    _winX = x;
+    _winY = y;
+    _winW = w;
+    _winPixels = 0;
+    ++_windows;
+  }
+
+  // Queues pixels for the current window. bigEndian: already in panel
+  // byte order (MjpegClass output); otherwise RGB565 as stored on the ESP32.
+  void pushPixels(const uint16_t* pixels, uint32_t count, bool bigEndian) {
+    if (_dev == nullptr) {
+      _tft->writePixels((uint16_t*)pixels, count, true, bigEndian);
+      _bytes += count * 2;
+      return;
+    }
+
+    _winPixels += count;
+    while (count > 0) {
+      while (_bufBusy[_fill]) reclaimOne();
+      uint16_t* dst = (uint16_t*)(_bufs[_fill] + _fillLen);
+      uint32_t n = std::min<uint32_t>(count, (PANEL_DMA_BUF_BYTES - _fillLen) / 2);
+      if (bigEndian) {
+        memcpy(dst, pixels, n * 2);
+      } else {
+        for (uint32_t i = 0; i < n; ++i) dst[i] = (pixels[i] >> 8) | (pixels[i] << 8);
+      }
+      _fillLen += n * 2;
+      pixels += n;
+      count -= n;
+      if (_fillLen == PANEL_DMA_BUF_BYTES) queueBuffer();
+    }
+  }
+
+  // Queues whatever is buffered without waiting for it to go out
+  void flush() {
+    if (_dev != nullptr) queueBuffer();
+  }
+
+  // Waits until everything has reached the panel and releases the bus
+  void finish() {
+    if (_dev == nullptr) {
+      if (_open) _tft->endWrite();
+      _open = false;
+      return;
+    }
+    queueBuffer();
+    while (_inflight > 0) reclaimOne();
+    if (_open) digitalWrite(_cs, HIGH);
+    _open = false;
+    _ramwr = false;
+    _colStart = _colEnd = -1; // Adafruit drawing may move the window
+    if (_driverOwnsHost) {
+      // Hand VSPI back with Adafruit's clock and mode in its registers
+      SPI.beginTransaction(SPISettings(_hz, MSBFIRST, SPI_MODE0));
+      SPI.endTransaction();
+      _driverOwnsHost = false;
+    }
+  }
+
+  int getClockHz() { return _hz; }
+  uint64_t getBytes() { return _bytes; }
+  uint32_t getTransactions() { return _transactions; }
+  uint32_t getWindows() { return _windows; }     // windows asked for
+  uint32_t getCoalesced() { return _coalesced; } // of those, merged into the previous one
+  uint32_t getStalls() { return _stalls; }       // waits for a buffer or queue slot
+  uint32_t getStallUs() { return _stallUs; }     // microseconds spent in those waits
+  uint32_t getBytesPerSec() {
+    uint32_t elapsed = millis() - _statsStartMs;
+    return elapsed > 0 ? _bytes * 1000 / elapsed : 0;
+  }
+
+private:
+  Adafruit_ST7789* _tft = nullptr;
+  spi_device_handle_t _dev = nullptr;
+  bool _ownsBus = false;
+  int8_t _cs = -1;
+  int8_t _dc = -1;
+  int _hz = 0;
+  int16_t _panelHeight = 0;
+  int16_t _xOffset = 0; // visible area in the controller's RAM
+  int16_t _yOffset = 0;
+
+  spi_transaction_t _trans[PANEL_QUEUE_DEPTH];
+  int8_t _transBuf[PANEL_QUEUE_DEPTH]; // DMA buffer a slot carries, or -1
+  int _head = 0;
+  int _inflight = 0;
+
+  uint8_t* _bufs[PANEL_DMA_BUFS] = {};
+  volatile bool _bufBusy[PANEL_DMA_BUFS] = {};
+  int _fill = 0;    // buffer being filled
+  int _fillLen = 0; // bytes in it
+
+  bool _open = false;  // CS low (or Adafruit startWrite) since the last finish()
+  bool _driverOwnsHost = false; // the IDF driver has used VSPI since the last finish()
+  bool _ramwr = false; // pixel data goes to the current window
+  int32_t _colStart = -1;
+  int32_t _colEnd = -1;
+  int32_t _winX = 0;
+  int32_t _winY = 0;
+  int32_t _winW = 0;
+  uint32_t _winPixels = 0;
+
+  uint64_t _bytes = 0;
+  uint32_t _transactions = 0;
+  uint32_t _windows = 0;
+  uint32_t _coalesced = 0;
+  uint32_t _stalls = 0;
+  uint32_t _stallUs = 0;
+  uint32_t _statsStartMs = 0;
+
+  // user carries the DC pin and its level for the transaction
+  static void IRAM_ATTR setDC(spi_transaction_t* t) {
+    int v = (int)(intptr_t)t->user;
+    gpio_set_level((gpio_num_t)(v >> 1), v & 1);
+  }
+
+  void* dcLevel(int level) { return (void*)(intptr_t)(_dc << 1 | level); }
+
+  spi_transaction_t* nextSlot() {
+    if (_inflight == PANEL_QUEUE_DEPTH) reclaimOne();
+    spi_transaction_t* t = &_trans[_head];
+    memset(t, 0, sizeof(*t));
+    _transBuf[_head] = -1;
+    return t;
+  }
+
+  void queue(spi_transaction_t* t) {
+    spi_device_queue_trans(_dev, t, portMAX_DELAY);
+    _driverOwnsHost = true;
+    _head = (_head + 1) % PANEL_QUEUE_DEPTH;
+    ++_inflight;
+    ++_transactions;
+    _bytes += t->length / 8;
+  }
+
+  // A command byte, then its parameters as two 16-bit values if given
+  void sendCommand(uint8_t cmd, int32_t a = -1, int32_t b = -1) {
+    spi_transaction_t* t = nextSlot();
+    t->flags = SPI_TRANS_USE_TXDATA;
+    t->length = 8;
+    t->tx_data[0] = cmd;
+    t->user = dcLevel(0);
+    queue(t);
+    if (a < 0) return;
+    t = nextSlot();
+    t->flags = SPI_TRANS_USE_TXDATA;
+    t->length = 32;
+    t->tx_data[0] = a >> 8;
+    t->tx_data[1] = a;
+    t->tx_data[2] = b >> 8;
+    t->tx_data[3] = b;
+    t->user = dcLevel(1);
+    queue(t);
+  }
+
+  void queueBuffer() {
+    if (_fillLen == 0) return;
+    spi_transaction_t* t = nextSlot();
+    t->tx_buffer = _bufs[_fill];
+    t->length = _fillLen * 8;
+    t->user = dcLevel(1);
+    _transBuf[_head] = _fill;
+    _bufBusy[_fill] = true;
+    queue(t);
+    _fill = (_fill + 1) % PANEL_DMA_BUFS;
+    _fillLen = 0;
+  }
+
+  // Collects the oldest transaction, waiting for it if it is still on the bus
+  void reclaimOne() {
+    spi_transaction_t* t;
+    if (spi_device_get_trans_result(_dev, &t, 0) != ESP_OK) {
+      uint32_t start = micros();
+      spi_device_get_trans_result(_dev, &t, portMAX_DELAY);
+      _stallUs += micros() - start;
+      ++_stalls;
+    }
+    int slot = t - _trans;
+    if (_transBuf[slot] >= 0) _bufBusy[_transBuf[slot]] = false;
+    --_inflight;
+  }
+};
+
+#endif // _PANELTRANSPORT_H_
@@ -0,0 +1,340 @@
+#ifndef _RULEENGINE_H_
+#define _RULEENGINE_H_
+
+// Sensor rules that run on the device. Each rule watches one sensor, or a
+// moving average of it, against a threshold and runs actions when the
+// condition has held for a while, and other actions once it clears:
+//
+//   temp > 30 for 60 -> alert led_on else data led_off
+//   avg(light, 5) < 10 hyst 5 -> data
+//
+//   value      temp, humidity, light, or avg(<sensor>, <samples>) over up
+//              to RULE_HISTORY samples
+//   > or <     and the threshold, within +-RULE_MAX_VALUE
+//   hyst H     the rule clears once the value is H back past the
+//              threshold (default 0), so a value hovering around it does
+//              not fire it again and again
+//   for S      seconds the condition must hold, sample after sample
+//   -> ...     actions when it fires; else ... actions when it clears
+//
+// compile() turns the text into an array of fixed-size Rule records, the
+// program, which is what gets stored and loaded. evaluate() only compares
+// numbers and so runs in microseconds; the actions it picks are handed to
+// the caller afterwards. Sensors are sampled by the caller (sample()), and
+// a failed reading (NAN) is left out.
+
+#include <Arduino.h>
+
+#define RULE_MAX 8             // rules in a program
+#define RULE_ACTIONS 3         // actions on each side of a rule
+#define RULE_HISTORY 16        // samples kept per sensor
+#define RULE_MAX_VALUE 1e6f    // largest threshold or hysteresis
+#define RULE_FORMAT 1          // of the stored program; bump when Rule changes
+
+enum RuleSource : uint8_t {
+  RULE_TEMP,
+  RULE_HUMIDITY,
+  RULE_LIGHT,
+  RULE_SOURCES
+};
+
+// One compiled rule; a program is an array of these
+struct Rule {
+  float threshold;
+  float hysteresis;
+  uint16_t holdS;
+  uint8_t source;
+  uint8_t window;              // samples averaged, 1 for the latest
+  uint8_t above;               // 1: value > threshold, 0: value < threshold
+  uint8_t on[RULE_ACTIONS];    // action + 1, 0 past the last
+  uint8_t off[RULE_ACTIONS];
+};
+
+class RuleEngine {
+public:
+  // actions: the names rules may use; an action's number is its index
+  void begin(const char* const* actions, int actionCount) {
+    _actions = actions;
+    _actionCount = actionCount;
+  }
+
+  // Replaces the program with the rules in text, one per line. Leaves it
+  // as it was and sets error (with the line) if one does not compile.
+  bool compile(const String& text, String& error) {
+    Rule rules[RULE_MAX];
+    int count = 0;
+    int line = 0;
+    unsigned int start = 0;
+    while (start < text.length()) {
+      int end = text.indexOf('\n', start);
+      if (end < 0) end = text.length();
+      String src = text.substring(start, end);
+      start = end + 1;
+      line++;
+      src.trim();
+      if (src.length() == 0 || src[0] == '#') continue;
+      if (count == RULE_MAX) {
+        error = "More than " + String(RULE_MAX) + " rules";
+        return false;
+      }
+      const char* why = parse(src.c_str(), rules[count]);
+      if (why != nullptr) {
+        error = "Line " + String(line) + ": " + why;
+        return false;
+      }
+      count++;
+    }
+    install(rules, count);
+    return true;
+  }
+
+  // A program from program()/programSize(), as stored
+  bool load(const uint8_t* data, size_t len) {
+    if (len % sizeof(Rule) != 0 || len / sizeof(Rule) > RULE_MAX) return false;
+    Rule rules[RULE_MAX];
+    int count = len / sizeof(Rule);
+    memcpy(rules, data, len);
+    for (int i = 0; i < count; i++) {
+      if (!valid(rules[i])) return false;
+    }
+    install(rules, count);
+    return true;
+  }
+
+  const uint8_t* program() { return (const uint8_t*)_rules; }
+  size_t programSize() { return _count * sizeof(Rule); }
+  int getRuleCount() { return _count; }
+  bool isActive(int i) { return _state[i].active; }
+
+  // The rule in the form compile() takes
+  String describe(int i) {
+    const Rule& r = _rules[i];
+    String s = r.window > 1 ? "avg(" + String(sourceName(r.source)) + ", " + String(r.window) + ")"
+                            : String(sourceName(r.source));
+    s += r.above ? " > " : " < ";
+    s += format(r.threshold);
+    if (r.hysteresis > 0) s += " hyst " + format(r.hysteresis);
+    if (r.holdS > 0) s += " for " + String(r.holdS);
+    s += " ->" + actionList(r.on);
+    if (r.off[0] != 0) s += " else" + actionList(r.off);
+    return s;
+  }
+
+  void sample(uint8_t source, float value) {
+    if (source >= RULE_SOURCES || isnan(value)) return;
+    _history[source][_next[source]] = value;
+    _next[source] = (_next[source] + 1) % RULE_HISTORY;
+    if (_samples[source] < RULE_HISTORY) _samples[source]++;
+    ++_sampleCount;
+  }
+
+  // Runs every rule against the samples so far. Calls act(action) for the
+  // actions of each rule that fired or cleared, in rule order, once the
+  // rules have all been looked at.
+  void evaluate(uint32_t nowMs, void (*act)(uint8_t action)) {
+    uint32_t start = micros();
+    uint8_t todo[RULE_MAX * RULE_ACTIONS];
+    int n = 0;
+    for (int i = 0; i < _count; i++) {
+      const Rule& r = _rules[i];
+      State& st = _state[i];
+      float v = average(r.source, r.window);
+      if (isnan(v)) continue; // not enough samples yet
+      const uint8_t* actions = nullptr;
+      if (!st.active) {
+        if (r.above ? v > r.threshold : v < r.threshold) {
+          if (!st.holding) {
+            st.holding = true;
+            st.since = nowMs;
+          }
+          if (nowMs - st.since >= (uint32_t)r.holdS * 1000) {
+            st.active = true;
+            actions = r.on;
+            ++_fired;
+          }
+        } else {
+          st.holding = false;
+        }
+      } else if (r.above ? v < r.threshold - r.hysteresis : v > r.threshold + r.hysteresis) {
+        st.active = false;
+        st.holding = false;
+        actions = r.off;
+        ++_cleared;
+      }
+      for (int k = 0; actions != nullptr && k < RULE_ACTIONS && actions[k] != 0; k++) todo[n++] = actions[k] - 1;
+    }
+    ++_evaluations;
+    _lastEvalUs = micros() - start;
+    if (_lastEvalUs > _maxEvalUs) _maxEvalUs = _lastEvalUs;
+    for (int i = 0; i < n; i++) act(todo[i]);
+  }
+
+  void resetStats() {
+    _sampleCount = _evaluations = _fired = _cleared = 0;
+    _lastEvalUs = _maxEvalUs = 0;
+  }
+
+  uint32_t getSamples() { return _sampleCount; }
+  uint32_t getEvaluations() { return _evaluations; }
+  uint32_t getFired() { return _fired; }
+  uint32_t getCleared() { return _cleared; }
+  uint32_t getLastEvalUs() { return _lastEvalUs; }
+  uint32_t getMaxEvalUs() { return _maxEvalUs; }
+
+private:
+  struct State {
+    bool active;
+    bool holding;            // condition true since `since`
+    uint32_t since;
+  };
+
+  const char* const* _actions = nullptr;
+  int _actionCount = 0;
+  Rule _rules[RULE_MAX];
+  State _state[RULE_MAX];
+  int _count = 0;
+  float _history[RULE_SOURCES][RULE_HISTORY];
+  uint8_t _next[RULE_SOURCES] = {0};
+  uint8_t _samples[RULE_SOURCES] = {0};
+
+  uint32_t _sampleCount = 0, _evaluations = 0, _fired = 0, _cleared = 0;
+  uint32_t _lastEvalUs = 0, _maxEvalUs = 0;
+
+  void install(const Rule* rules, int count) {
+    memcpy(_rules, rules, count * sizeof(Rule));
+    memset(_state, 0, sizeof(_state));
+    _count = count;
+  }
+
+  bool valid(const Rule& r) {
+    if (r.source >= RULE_SOURCES || r.window < 1 || r.window > RULE_HISTORY || r.above > 1) return false;
+    if (!(fabsf(r.threshold) <= RULE_MAX_VALUE) || !(r.hysteresis >= 0 && r.hysteresis <= RULE_MAX_VALUE)) return false;
+    if (r.on[0] == 0) return false;
+    for (int k = 0; k < RULE_ACTIONS; k++) {
+      if (r.on[k] > _actionCount || r.off[k] > _actionCount) return false;
+    }
+    return true;
+  }
+
+  // Mean of the last window samples of source, NAN if there are fewer
+  float average(uint8_t source, uint8_t window) {
+    if (_samples[source] < window) return NAN;
+    float sum = 0;
+    int pos = _next[source];
+    for (int k = 0; k < window; k++) {
+      pos = (pos + RULE_HISTORY - 1) % RULE_HISTORY;
+      sum += _history[source][pos];
+    }
+    return sum / window;
+  }
+
+  static const char* sourceName(int s) {
+    static const char* const names[RULE_SOURCES] = {"temp", "humidity", "light"};
+    return names[s];
+  }
+
+  // ----- Compiler -----
+
+  static void skipSpace(const char*& p) {
+    while (*p == ' ' || *p == '\t') p++;
+  }
+
+  // Takes w if it comes next; a name only if the name ends there
+  static bool word(const char*& p, const char* w) {
+    skipSpace(p);
+    size_t n = strlen(w);
+    if (strncmp(p, w, n) != 0) return false;
+    if (isalnum((unsigned char)w[n - 1]) && (isalnum((unsigned char)p[n]) || p[n] == '_')) return false;
+    p += n;
+    return true;
+  }
+
+  static bool number(const char*& p, float& v) {
+    skipSpace(p);
+    char* end;
+    v = strtof(p, &end);
+    if (end == p || !(fabsf(v) <= RULE_MAX_VALUE)) return false; // also NAN and infinity
+    p = end;
+    return true;
+  }
+
+  static int source(const char*& p) {
+    for (int s = 0; s < RULE_SOURCES; s++) {
+      if (word(p, sourceName(s))) return s;
+    }
+    return -1;
+  }
+
+  // Up to RULE_ACTIONS names, up to the end or "else", which sets more
+  const char* actions(const char*& p, uint8_t* out, bool& more) {
+    memset(out, 0, RULE_ACTIONS);
+    int n = 0;
+    more = false;
+    for (;;) {
+      skipSpace(p);
+      if (*p == '\0') break;
+      if (word(p, "else")) {
+        more = true;
+        break;
+      }
+      int a = -1;
+      for (int k = 0; k < _actionCount && a < 0; k++) {
+        if (word(p, _actions[k])) a = k;
+      }
+      if (a < 0) return "unknown action";
+      if (n == RULE_ACTIONS) return "too many actions";
+      out[n++] = a + 1;
+    }
+    return n == 0 ? "no action" : nullptr;
+  }
+
+  // Returns nullptr, or what is wrong with the line
+  const char* parse(const char* p, Rule& r) {
+    memset(&r, 0, sizeof(r));
+    r.window = 1;
+    int s;
+    if (word(p, "avg")) {
+      float window;
+      if (!word(p, "(") || (s = source(p)) < 0 || !word(p, ",") || !number(p, window) || !word(p, ")")) {
+        return "expected avg(<sensor>, <samples>)";
+      }
+      if (window < 1 || window > RULE_HISTORY || window != (int)window) return "average over 1 to 16 samples";
+      r.window = window;
+    } else if ((s = source(p)) < 0) {
+      return "expected temp, humidity, light or avg(...)";
+    }
+    r.source = s;
+    if (word(p, ">")) {
+      r.above = 1;
+    } else if (!word(p, "<")) {
+      return "expected > or <";
+    }
+    if (!number(p, r.threshold)) return "expected a threshold";
+    if (word(p, "hyst") && (!number(p, r.hysteresis) || r.hysteresis < 0)) return "expected hyst <amount>";
+    if (word(p, "for")) {
+      float hold;
+      if (!number(p, hold) || hold < 0 || hold > 65535 || hold != (int)hold) return "expected for <seconds>";
+      r.holdS = hold;
+      word(p, "s");
+    }
+    if (!word(p, "->")) return "expected ->";
+    bool hasElse;
+    const char* why = actions(p, r.on, hasElse);
+    if (why == nullptr && hasElse) why = actions(p, r.off, hasElse);
+    if (why == nullptr && hasElse) why = "else twice";
+    return why;
+  }
+
+  // v is within RULE_MAX_VALUE (number(), valid()), so the cast is defined
+  static String format(float v) {
+    return v == (int)v ? String((int)v) : String(v, 2);
+  }
+
+  String actionList(const uint8_t* list) {
+    String s;
+    for (int k = 0; k < RULE_ACTIONS && list[k] != 0; k++) s += " " + String(_actions[list[k] - 1]);
+    return s;
+  }
+};
+
+#endif
@@ -6,6 +6,8 @@
   2. AnimatedGIF for smooth GIF playback (10+ FPS)
   3. Optimized memory usage
   4. Auto-scaling for any image/GIF size
+  5. DFPlayer Mini audio without blocking (AudioQueue.h)
+  6. Idles at 80 MHz with light sleep, 240 MHz for decoding and playback
   
   Install:
   - Arduino Library Manager -> "JPEGDEC" by bitbank2
@@ -24,108 +26,305 @@
 #include <AnimatedGIF.h>
 #include <Wire.h>
 #include <BH1750.h>
+#include "esp_pm.h"
+#include <esp_now.h>
+#include "PanelConfig.h"
+#include "PanelTransport.h"
+#include "PanelDraw.h"
+#include "PanelAnim.h"
+#include "MjpegClass.h"
+#include "FrameQueue.h"
+#include "AudioQueue.h"
+#include "MediaRelay.h"
+#include "RuleEngine.h"
 
 const char* apSSID = "ESP32-Setup";
 const int LED_PIN = 2;
 const int DHT_PIN = 14;
 #define DHT_TYPE DHT22
 
-// TFT Display pins (ST7789 - 240x320)
+// TFT Display pins (ST7789; size and rotation in PanelConfig.h)
 #define TFT_CS    5
 #define TFT_DC    16
 #define TFT_RST   17
+#define TFT_SCLK  18 // VSPI
+#define TFT_MOSI  23 // VSPI
+
+// DFPlayer Mini on UART2 (GPIO 25/26 are taken by the BH1750)
+#define AUDIO_RX_PIN 32 // from the DFPlayer's TX
+#define AUDIO_TX_PIN 27 // to the DFPlayer's RX, through 1K
 
 WebServer server(80);
 DNSServer dnsServer;
 Preferences prefs;
 DHT dht(DHT_PIN, DHT_TYPE);
 Adafruit_ST7789 tft = Adafruit_ST7789(TFT_CS, TFT_DC, TFT_RST);
+PanelTransport panel; // queued DMA writes for decoded images; see PanelTransport.h
 BH1750 lightMeter;
 
 String storedSSID = "";
 String storedPass = "";
 
-// Image buffers
+// Fast reconnect: after a successful join the AP's BSSID and channel are
+// kept in the "wifiCache" namespace. The next boot joins that AP directly,
+// skipping the scan, and falls back to a normal join if it has not connected
+// within FAST_JOIN_TIMEOUT_MS. The address always comes from DHCP, so the
+// lease is renewed on every boot.
+const unsigned long FAST_JOIN_TIMEOUT_MS = 3000;
+const unsigned long FULL_JOIN_TIMEOUT_MS = 20000;
+struct WifiCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+};
+
+// Boot runs as a state machine: setup() starts the display test, the
+// sensors, the Wi-Fi join and the web server, and loop() moves the display
+// test and the join along (bootStep()). The server answers from the first
+// loop() while the rest is still going.
+enum WifiBoot {
+  WIFI_BOOT_FAST,         // directed join to the cached AP
+  WIFI_BOOT_FULL,         // scan and DHCP
+  WIFI_BOOT_ONLINE,
+  WIFI_BOOT_PROVISIONING  // setup AP and captive portal
+};
+WifiBoot wifiBoot = WIFI_BOOT_PROVISIONING;
+bool portalUp = false; // setup AP and DNS running
+unsigned long wifiBootStart = 0;  // start of the current join attempt
+unsigned long joinStartMs = 0;    // start of the first one
+const unsigned long DISPLAY_TEST_STEP_MS = 500;
+const uint16_t DISPLAY_TEST_COLORS[] = {ST77XX_RED, ST77XX_GREEN, ST77XX_BLUE};
+int displayTest = -1;             // color on screen, -1 once the test is over
+unsigned long displayTestAt = 0;
+
+// Boot timing, reported by /status (millis() since boot)
+const char* joinMethod = "none"; // fast (cached AP), full (scan + DHCP) or ap
+unsigned long joinMs = 0;         // spent joining
+unsigned long servingMs = 0;      // server started
+unsigned long firstRequestMs = 0; // first request answered
+
+// Power: the CPU idles at GOV_MIN_MHZ and light-sleeps whenever every
+// task is waiting (ESP-IDF power management). Requests that upload or
+// draw take it to GOV_MAX_MHZ and keep it there until GOV_HOLD_MS after
+// the last one; GIF/.pan playback and MJPEG streams hold it while they
+// run. If the core is built without power management the clock is
+// switched with setCpuFrequencyMhz() instead, and nothing sleeps.
+const int GOV_MAX_MHZ = 240;
+const int GOV_MIN_MHZ = 80;
+const unsigned long GOV_HOLD_MS = 250;     // chunked uploads stay at full clock
+const unsigned long GOV_IDLE_WAIT_MS = 20; // idle loop() sleeps this long; a request may wait as much
+esp_pm_lock_handle_t govRequestLock = nullptr; // ESP_PM_CPU_FREQ_MAX
+esp_pm_lock_handle_t govMediaLock = nullptr;   // ESP_PM_CPU_FREQ_MAX
+esp_pm_lock_handle_t govAwakeLock = nullptr;   // ESP_PM_NO_LIGHT_SLEEP, for the setup AP and ESP-NOW
+bool govPm = false;
+bool govLightSleep = false;
+bool govBoosted = false;
+int govMedia = 0;                 // playback running
+unsigned long govBoostAt = 0;
+// Reported by /power, since boot or ?reset=1
+unsigned long govBoosts = 0;
+uint64_t govMaxUs = 0;            // at GOV_MAX_MHZ
+uint64_t govMinUs = 0;            // at GOV_MIN_MHZ, idle waits included
+uint64_t govIdleUs = 0;           // in loop()'s idle wait, asleep if nothing else runs
+uint32_t govLastUs = 0;
+uint32_t govWakes = 0;
+uint64_t govWakeSumUs = 0;        // idle waits overran by this much: the wake-up
+uint32_t govWakeMaxUs = 0;
+
+// Image buffers (sized from the upload's first chunk)
 uint8_t* jpegBuffer = nullptr;
 int jpegBufferSize = 0;
+int jpegBufferCapacity = 0;
 const int MAX_JPEG_SIZE = 80000; // 80KB max
 
 // GIF buffer
 uint8_t* gifBuffer = nullptr;
 int gifBufferSize = 0;
+int gifBufferCapacity = 0;
 const int MAX_GIF_SIZE = 150000; // 150KB max for GIFs (reduced for memory constraints)
+const int MAX_GIF_WIDTH = 480;   // AnimatedGIF's line buffer (MAX_WIDTH)
+const int GIF_HEAP_RESERVE = 50000; // left free for decoding and the web server
 bool isPlayingGif = false;
+bool gifLoopRunning = false; // handlePlayGif is on the stack, polling the server
+
+// What the header in an upload's first chunk says about the file
+struct MediaInfo {
+  int width;
+  int height;
+  int scale;         // JPEG: 1, 2, 4 or 8 to fit the panel
+  bool progressive;  // JPEG
+  int frames;        // GIF: images seen in the first chunk
+  bool complete;     // GIF: first chunk reached the trailer, frames is the total
+  bool panelAnim;    // GIF upload: a .pan animation rather than a GIF
+};
+MediaInfo jpegInfo;
+MediaInfo gifInfo;
+
+// /batch: one request runs several display commands in order. Commands
+// are looked up in COMMANDS (Batch section) once, while the body is
+// parsed; each then runs its usual handler, which reads its argument
+// through commandArg() and replies through sendPlain() into batch[].
+const int BATCH_MAX = 16;
+struct Command {
+  const char* name;  // as in the URL, without the slash
+  const char* arg;   // query argument the handler reads, or nullptr
+  void (*handler)();
+  bool draws;        // stops a running GIF
+  bool runsOn;       // keeps going after its reply, so it must come last
+};
+struct BatchEntry {
+  int command;       // index into COMMANDS
+  String arg;
+  int code;          // 0 until it has run
+  String reply;
+  uint32_t us;
+};
+BatchEntry batch[BATCH_MAX];
+int batchCount = 0;
+int batchCurrent = -1;           // entry running, -1 outside a batch
+uint32_t batchStartUs = 0;       // of the entry running
+uint32_t batchBeginUs = 0;       // of the whole batch
+bool batchLocal = false;         // runCommand(): the reply goes to Serial
+
+// ESP-NOW relay (MediaRelay.h): an image or GIF shown here is sent on to
+// the peers set through /relay first, and shown everywhere at once after
+// RELAY_SHOW_LEAD_MS. With listening on, files relayed by another display
+// are shown here. The radio stays awake while the relay runs.
+enum RelayKind : uint8_t {
+  RELAY_IMAGE = 1,
+  RELAY_GIF = 2,  // or .pan
+};
+const uint32_t RELAY_SHOW_LEAD_MS = 100; // for the peers to decode the header and get ready
+MediaRelay relay;
+bool relayStarted = false;
+bool relayListen = false;
+bool relayShowing = false;       // starting a relayed file: not to be relayed again
+SemaphoreHandle_t relaySendLock = nullptr; // one esp_now_send() at a time
+SemaphoreHandle_t relaySendDone = nullptr; // given by the send callback
+volatile bool relaySendOk = false;
+uint32_t relayShowLateUs = 0;    // last switch, after the agreed time
+uint32_t relayShowLateMaxUs = 0;
+
+// Rules (RuleEngine.h): sensor thresholds checked here every
+// RULE_SAMPLE_MS, which run display and LED actions without the app
+// polling. Set through POST /rules; the compiled program is kept in
+// Preferences. An action runs a command from COMMANDS.
+const unsigned long RULE_SAMPLE_MS = 2000; // the DHT22 reads at most every 2 s
+struct RuleAction {
+  const char* name;     // as rules write it
+  const char* command;  // in COMMANDS
+  const char* arg;
+};
+const RuleAction RULE_ACTION_TABLE[] = {
+  {"alert",   "display", "alert"},
+  {"data",    "display", "data"},
+  {"smiley",  "display", "smiley"},
+  {"heart",   "display", "heart"},
+  {"led_on",  "on",      ""},
+  {"led_off", "off",     ""},
+};
+const int RULE_ACTION_COUNT = sizeof(RULE_ACTION_TABLE) / sizeof(RULE_ACTION_TABLE[0]);
+const char* ruleActionNames[RULE_ACTION_COUNT];
+RuleEngine rules;
+unsigned long rulesSampledAt = 0;
 
 // JPEGDEC instance
 JPEGDEC jpeg;
+JpegPreview jpegPreview;       // where previewJPEGFrame() draws
+unsigned long jpegFirstDrawUs = 0; // micros() when a decode first drew, 0 until then
 
 // AnimatedGIF instance
 AnimatedGIF gif;
 
+// Player for .pan animations, which upload and play through the GIF endpoints
+PanelAnim panelAnim;
+
+// DFPlayer commands go through a queue and a task on core 0, so neither
+// the handlers nor the animation loops wait on the UART
+AudioQueue audio;
+
+// MJPEG stream: the upload handler queues frames, a task on the other core
+// decodes them
+const int MJPEG_SLOT_SIZE = 40000;      // 40KB max per frame
+const uint32_t MJPEG_LATENCY_MS = 200;  // frames waiting longer are skipped
+MjpegClass<TftPanel> mjpeg;
+FrameQueue mjpegQueue;
+TaskHandle_t mjpegTask = nullptr;
+bool mjpegActive = false;
+bool mjpegNoMemory = false;
+unsigned long mjpegStartTime = 0;
+unsigned long mjpegElapsed = 0;
+
 // ===== JPEGDEC Callback Function =====
+// Clipped to the panel and queued for DMA (PanelDraw.h)
 int JPEGDraw(JPEGDRAW *pDraw) {
-  tft.startWrite();
-  tft.setAddrWindow(pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight);
-  tft.writePixels((uint16_t*)pDraw->pPixels, pDraw->iWidth * pDraw->iHeight);
-  tft.endWrite();
-  return 1;
+  int more = drawJpegBlock<TftPanel>(panel, pDraw);
+  if (jpegFirstDrawUs == 0) jpegFirstDrawUs = micros();
+  return more;
+}
+
+// The 1/8-scale preview, blown up to the size of the full decode
+int JPEGPreviewDraw(JPEGDRAW *pDraw) {
+  int more = drawJpegPreview<TftPanel>(panel, pDraw);
+  if (jpegFirstDrawUs == 0) jpegFirstDrawUs = micros();
+  return more;
 }
 
 // ===== AnimatedGIF Callback Function =====
+// Palette lookup straight into panel byte order, one queued line at a time;
+// consecutive lines share one address window (PanelDraw.h)
 void GIFDraw(GIFDRAW *pDraw) {
-  uint8_t *s;
-  uint16_t *usPalette, usTemp[320];
-  int x, y, iWidth;
-
-  iWidth = pDraw->iWidth;
-  if (iWidth > 320) iWidth = 320;
-  
-  usPalette = pDraw->pPalette;
-  y = pDraw->iY + pDraw->y; // current line
-  
-  // Skip lines outside display area
-  if (y >= 240) return;
-  
-  s = pDraw->pPixels;
-  
-  // Simplified rendering - ignore transparency for speed
-  // Convert palette indices to RGB565 colors
-  for (x = 0; x < iWidth; x++) {
-    usTemp[x] = usPalette[s[x]];
-  }
-  
-  // Fast bulk write to display
-  tft.startWrite();
-  tft.setAddrWindow(pDraw->iX, y, iWidth, 1);
-  tft.writePixels(usTemp, iWidth);
-  tft.endWrite();
+  drawGifLine<TftPanel>(panel, pDraw);
 }
 
 // ===== TFT Display Functions =====
 void initDisplay() {
   Serial.println("Initializing TFT display...");
   
-  tft.init(240, 320);
-  tft.setRotation(1); // Landscape mode (320x240)
+  TftPanel::begin(tft); // init and rotation (PanelConfig.h)
+  gif.begin(gifPaletteType<TftPanel>());
   
-  // Quick color test
-  tft.fillScreen(ST77XX_RED);
-  delay(500);
-  tft.fillScreen(ST77XX_GREEN);
-  delay(500);
-  tft.fillScreen(ST77XX_BLUE);
-  delay(500);
-  tft.fillScreen(ST77XX_BLACK);
+  if (panel.begin<TftPanel>(&tft, TFT_CS, TFT_DC, TFT_SCLK, TFT_MOSI)) {
+    Serial.print("Panel DMA at ");
+    Serial.print(panel.getClockHz() / 1000000);
+    Serial.println(" MHz");
+  }
+  mjpeg.setTransport(&panel);
   
+  // Quick color test, stepped by displayBootStep()
+  displayTest = 0;
+  displayTestAt = millis();
+  tft.fillScreen(DISPLAY_TEST_COLORS[0]);
+}
+
+void displayBootStep() {
+  if (displayTest < 0 || millis() - displayTestAt < DISPLAY_TEST_STEP_MS) return;
+  displayTestAt = millis();
+  if (++displayTest < 3) {
+    tft.fillScreen(DISPLAY_TEST_COLORS[displayTest]);
+    return;
+  }
+  displayTest = -1;
+  tft.fillScreen(ST77XX_BLACK);
   tft.setTextColor(ST77XX_WHITE);
   tft.setTextSize(4);
   tft.setCursor(30, 80);
   tft.println("READY!");
-  
   Serial.println("TFT Display initialized");
-  delay(2000);
 }
 
+// A handler is about to draw; the color test must not paint over it
+void endDisplayTest() {
+  displayTest = -1;
+}
+
+// Screens are laid out for the 240-pixel short side of the 320x240 panel;
+// this scales a length to the short side of the panel built for
+int panelScale(int v) {
+  return v * min(TftPanel::width, TftPanel::height) / 240;
+}
+
+// Sensor readings, one row each. The rows are spread over the panel's
+// height; the text sizes fit down to the 135-pixel panel.
 void updateDisplay() {
   Serial.println("Updating display...");
   tft.fillScreen(ST77XX_BLACK);
@@ -135,11 +334,11 @@ void updateDisplay() {
   
   tft.setTextSize(3);
   tft.setTextColor(ST77XX_CYAN);
-  tft.setCursor(10, 10);
+  tft.setCursor(10, panelScale(10));
   tft.println("DHT22");
   
   tft.setTextSize(2);
-  tft.setCursor(10, 60);
+  tft.setCursor(10, panelScale(60));
   if (!isnan(t)) {
     tft.setTextColor(ST77XX_GREEN);
     tft.print("Temp: ");
@@ -150,7 +349,7 @@ void updateDisplay() {
     tft.println("Temp: ERROR");
   }
   
-  tft.setCursor(10, 100);
+  tft.setCursor(10, panelScale(100));
   if (!isnan(h)) {
     tft.setTextColor(ST77XX_GREEN);
     tft.print("Humid: ");
@@ -163,7 +362,7 @@ void updateDisplay() {
   
   tft.setTextSize(1);
   tft.setTextColor(ST77XX_YELLOW);
-  tft.setCursor(10, 150);
+  tft.setCursor(10, panelScale(150));
   if (WiFi.status() == WL_CONNECTED) {
     tft.print("WiFi: ");
     tft.println(WiFi.localIP());
@@ -173,13 +372,13 @@ void updateDisplay() {
     tft.println("WiFi: Disconnected");
   }
   
-  tft.setCursor(10, 170);
+  tft.setCursor(10, panelScale(170));
   tft.setTextColor(ST77XX_WHITE);
   tft.print("LED: ");
   tft.println(digitalRead(LED_PIN) ? "ON" : "OFF");
 
   float lux = lightMeter.readLightLevel();
-  tft.setCursor(10, 190);
+  tft.setCursor(10, panelScale(190));
   tft.setTextColor(ST77XX_MAGENTA);
   tft.print("Light: ");
   if (lux >= 0) {
@@ -205,7 +404,7 @@ int base64Decode(const String& input, uint8_t* output, int maxLen) {
   int val = 0;
   int valb = -8;
   
-  for (int i = 0; i < input.length() && outLen < maxLen; i++) {
+  for (unsigned int i = 0; i < input.length() && outLen < maxLen; i++) {
     char c = input[i];
     if (c == '=') break;
     if (c == ' ' || c == '\n' || c == '\r') continue;
@@ -221,6 +420,139 @@ int base64Decode(const String& input, uint8_t* output, int maxLen) {
   return outLen;
 }
 
+// Bytes base64Decode() will produce for input
+int base64DecodedLength(const String& input) {
+  int chars = 0;
+  for (unsigned int i = 0; i < input.length(); i++) {
+    char c = input[i];
+    if (c == '=') break;
+    if (c == ' ' || c == '\n' || c == '\r') continue;
+    chars++;
+  }
+  return chars * 6 / 8;
+}
+
+// File size for an upload whose first chunk has no size argument, as
+// older apps send it: total full chunks like this one. The last chunk may
+// be shorter, so this can only overestimate.
+int uploadSizeEstimate(int total, const String& firstChunk) {
+  int chunk = base64DecodedLength(firstChunk);
+  if (total <= 0 || chunk <= 0) return 0;
+  return total > INT_MAX / chunk ? INT_MAX : total * chunk;
+}
+
+// ===== Header Probing =====
+// The first chunk of an upload carries the file header. Reading it there
+// lets the chunk handlers allocate exactly, pick the decode scale and turn
+// away files they cannot show before the rest is sent.
+
+// Smallest JPEGDEC scale-down (1, 2, 4, 8) that fits the panel, 0 if none
+int jpegScaleFor(int width, int height) {
+  for (int scale = 1; scale <= 8; scale *= 2) {
+    if (width <= TftPanel::width * scale && height <= TftPanel::height * scale) return scale;
+  }
+  return 0;
+}
+
+int jpegScaleOption(int scale) {
+  if (scale == 8) return JPEG_SCALE_EIGHTH;
+  if (scale == 4) return JPEG_SCALE_QUARTER;
+  if (scale == 2) return JPEG_SCALE_HALF;
+  return 0;
+}
+
+// Walks the JPEG markers up to the frame header. Returns "" if the image
+// can be shown (or the header lies beyond this chunk), else the reason.
+String probeJpeg(const uint8_t* buf, int len, MediaInfo& info) {
+  info = MediaInfo();
+  if (len < 2 || buf[0] != 0xFF || buf[1] != 0xD8) return "Not a JPEG file";
+  int pos = 2;
+  while (pos + 4 <= len) {
+    if (buf[pos] != 0xFF) return "Corrupt JPEG header";
+    uint8_t marker = buf[pos + 1];
+    if (marker == 0xFF) { // fill byte
+      pos++;
+      continue;
+    }
+    if (marker == 0xDA || marker == 0xD9) return "JPEG has no frame header";
+    bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+    if (sof) {
+      if (pos + 9 > len) return ""; // header continues in the next chunk
+      info.height = (buf[pos + 5] << 8) | buf[pos + 6];
+      info.width = (buf[pos + 7] << 8) | buf[pos + 8];
+      info.progressive = marker == 0xC2;
+      if (marker != 0xC0 && marker != 0xC1) {
+        return info.progressive ? "Progressive JPEG not supported" : "Unsupported JPEG coding";
+      }
+      if (info.width == 0 || info.height == 0) return "JPEG has no size";
+      info.scale = jpegScaleFor(info.width, info.height);
+      if (info.scale == 0) {
+        return "Image too large to display (" + String(info.width) + "x" + String(info.height) + ", max " +
+               String(TftPanel::width * 8) + "x" + String(TftPanel::height * 8) + ")";
+      }
+      return "";
+    }
+    pos += 2 + ((buf[pos + 2] << 8) | buf[pos + 3]);
+  }
+  return "";
+}
+
+// Reads the GIF logical screen descriptor and counts the images that are
+// already in this chunk. Returns "" if the GIF can be played, else why not.
+String probeGif(const uint8_t* buf, int len, MediaInfo& info) {
+  info = MediaInfo();
+  if (len < 13 || memcmp(buf, "GIF8", 4) != 0 || (buf[4] != '7' && buf[4] != '9') || buf[5] != 'a') {
+    return "Not a GIF file";
+  }
+  info.width = buf[6] | (buf[7] << 8);
+  info.height = buf[8] | (buf[9] << 8);
+  if (info.width == 0 || info.height == 0) return "GIF has no size";
+  if (info.width > MAX_GIF_WIDTH) {
+    return "GIF too wide (" + String(info.width) + "px, max " + String(MAX_GIF_WIDTH) + ")";
+  }
+  int pos = 13;
+  if (buf[10] & 0x80) pos += 3 << ((buf[10] & 7) + 1); // global color table
+  while (pos < len) {
+    uint8_t block = buf[pos++];
+    if (block == 0x3B) { // trailer
+      info.complete = true;
+      break;
+    }
+    if (block == 0x2C) { // image descriptor
+      if (pos + 9 > len) break;
+      uint8_t packed = buf[pos + 8];
+      pos += 9;
+      if (packed & 0x80) pos += 3 << ((packed & 7) + 1); // local color table
+      pos++; // LZW minimum code size
+      info.frames++;
+    } else if (block == 0x21) { // extension
+      pos++; // label
+    } else {
+      return "Corrupt GIF data";
+    }
+    while (pos < len && buf[pos] != 0) pos += buf[pos] + 1; // data sub-blocks
+    pos++;
+  }
+  return "";
+}
+
+// Reads a .pan header (see PanelAnim.h). Returns "" if the animation can
+// be played, else why not.
+String probePanelAnim(const uint8_t* buf, int len, MediaInfo& info) {
+  info = MediaInfo();
+  if (!PanelAnim::parseHeader(buf, len, info.width, info.height, info.frames)) {
+    return "Not a panel animation";
+  }
+  info.panelAnim = true;
+  info.complete = true; // the header has the frame count
+  if (info.width == 0 || info.height == 0 || info.frames == 0) return "Animation is empty";
+  if (info.width > TftPanel::width || info.height > TftPanel::height) {
+    return "Animation larger than the panel (" + String(info.width) + "x" + String(info.height) + ", max " +
+           String(TftPanel::width) + "x" + String(TftPanel::height) + ")";
+  }
+  return "";
+}
+
 // ===== Helper function to decode and display a JPEG frame =====
 bool decodeJPEGFrame(uint8_t* buffer, int size, int offsetX = 0, int offsetY = 0) {
   int result = jpeg.openRAM(buffer, size, JPEGDraw);
@@ -228,42 +560,453 @@ bool decodeJPEGFrame(uint8_t* buffer, int size, int offsetX = 0, int offsetY = 0
   if (result != 1) {
     return false;
   }
+  jpeg.setPixelType(jpegPixelType<TftPanel>()); // openRAM resets it
   
   int width = jpeg.getWidth();
   int height = jpeg.getHeight();
   
-  // Calculate scale
-  int scale = 1;
-  if (width > 320 || height > 240) {
-    int scaleW = (width + 319) / 320;
-    int scaleH = (height + 239) / 240;
-    scale = max(scaleW, scaleH);
-    if (scale > 8) scale = 8;
-  }
+  // Calculate scale (beyond 1/8 the image is clipped)
+  int scale = jpegScaleFor(width, height);
+  if (scale == 0) scale = 8;
   
   // Center on display
-  if (scale > 1) {
-    width /= scale;
-    height /= scale;
-  }
-  int x = offsetX + (320 - width) / 2;
-  int y = offsetY + (240 - height) / 2;
+  width /= scale;
+  height /= scale;
+  int x = offsetX + (TftPanel::width - width) / 2;
+  int y = offsetY + (TftPanel::height - height) / 2;
   if (x < 0) x = 0;
   if (y < 0) y = 0;
   
-  result = jpeg.decode(x, y, scale > 1 ? JPEG_SCALE_HALF : 0);
+  result = jpeg.decode(x, y, jpegScaleOption(scale));
+  jpeg.close();
+  panel.finish();
+  
+  return (result == 1);
+}
+
+// A DC-only 1/8 decode drawn where decodeJPEGFrame() will draw the image
+// and at its size, so a photo shows in a fraction of the full decode's
+// time; the full decode then replaces it one MCU row at a time. False,
+// having drawn nothing, for images the full decode shows at 1/8 anyway.
+bool previewJPEGFrame(uint8_t* buffer, int size) {
+  if (jpeg.openRAM(buffer, size, JPEGPreviewDraw) != 1) {
+    return false;
+  }
+  jpeg.setPixelType(jpegPixelType<TftPanel>());
+  jpeg.setUserPointer(&jpegPreview); // after openRAM, which clears it
+  
+  int width = jpeg.getWidth();
+  int height = jpeg.getHeight();
+  int scale = jpegScaleFor(width, height);
+  if (scale == 0 || scale == 8) {
+    jpeg.close();
+    return false;
+  }
+  
+  // Same placement as decodeJPEGFrame()
+  jpegPreview.w = width / scale;
+  jpegPreview.h = height / scale;
+  jpegPreview.x = max(0, (TftPanel::width - jpegPreview.w) / 2);
+  jpegPreview.y = max(0, (TftPanel::height - jpegPreview.h) / 2);
+  jpegPreview.zoom = 8 / scale;
+  
+  int result = jpeg.decode(0, 0, JPEG_SCALE_EIGHTH);
   jpeg.close();
+  panel.finish();
   
   return (result == 1);
 }
 
+// Blacks out the panel around the w x h area at (x, y)
+void clearAround(int x, int y, int w, int h) {
+  w = min(w, TftPanel::width - x);
+  h = min(h, TftPanel::height - y);
+  if (y > 0) tft.fillRect(0, 0, TftPanel::width, y, ST77XX_BLACK);
+  if (y + h < TftPanel::height) tft.fillRect(0, y + h, TftPanel::width, TftPanel::height - y - h, ST77XX_BLACK);
+  if (x > 0) tft.fillRect(0, y, x, h, ST77XX_BLACK);
+  if (x + w < TftPanel::width) tft.fillRect(x + w, y, TftPanel::width - x - w, h, ST77XX_BLACK);
+}
+
+// ===== Power Governor =====
+void initGovernor() {
+  esp_pm_config_esp32_t pm = {GOV_MAX_MHZ, GOV_MIN_MHZ, true};
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err == ESP_ERR_NOT_SUPPORTED) {
+    pm.light_sleep_enable = false; // no tickless idle in this build
+    err = esp_pm_configure(&pm);
+  }
+  govPm = err == ESP_OK &&
+          esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "request", &govRequestLock) == ESP_OK &&
+          esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "media", &govMediaLock) == ESP_OK &&
+          esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "softap", &govAwakeLock) == ESP_OK;
+  govLightSleep = govPm && pm.light_sleep_enable;
+  if (!govPm) {
+    setCpuFrequencyMhz(GOV_MIN_MHZ);
+  }
+  govLastUs = micros();
+  Serial.print("Power management: ");
+  Serial.println(govPm ? (govLightSleep ? "locks, light sleep" : "locks, no light sleep") : "fixed clock");
+}
+
+bool govAtMax() {
+  return govBoosted || govMedia > 0;
+}
+
+// Charges the time since the last change to the clock it ran at
+void govAccount() {
+  uint32_t now = micros();
+  if (govAtMax()) {
+    govMaxUs += now - govLastUs;
+  } else {
+    govMinUs += now - govLastUs;
+  }
+  govLastUs = now;
+}
+
+// Full clock for a request that decodes, draws or takes an upload
+void cpuBoost() {
+  govBoostAt = millis();
+  if (govBoosted) return;
+  govAccount();
+  if (govPm) {
+    esp_pm_lock_acquire(govRequestLock);
+  } else if (!govAtMax()) {
+    setCpuFrequencyMhz(GOV_MAX_MHZ);
+  }
+  govBoosted = true;
+  ++govBoosts;
+}
+
+void cpuRelease() {
+  govAccount();
+  govBoosted = false;
+  if (govPm) {
+    esp_pm_lock_release(govRequestLock);
+  } else if (!govAtMax()) {
+    setCpuFrequencyMhz(GOV_MIN_MHZ);
+  }
+}
+
+// Playback holds full clock from mediaStart() to mediaEnd()
+void mediaStart() {
+  govAccount();
+  if (govMedia++ > 0) return;
+  if (govPm) {
+    esp_pm_lock_acquire(govMediaLock);
+  } else if (!govBoosted) {
+    setCpuFrequencyMhz(GOV_MAX_MHZ);
+  }
+}
+
+void mediaEnd() {
+  if (govMedia == 0) return;
+  govAccount();
+  if (--govMedia > 0) return;
+  if (govPm) {
+    esp_pm_lock_release(govMediaLock);
+  } else if (!govBoosted) {
+    setCpuFrequencyMhz(GOV_MIN_MHZ);
+  }
+}
+
+// Called from loop(). Drops the clock once requests stop, then waits out
+// idle time in delay() so the idle task can light-sleep. A request that
+// arrives meanwhile waits for the rest of the delay and the wake-up.
+void governorStep() {
+  if (govBoosted && millis() - govBoostAt >= GOV_HOLD_MS) {
+    cpuRelease();
+  }
+  if (displayTest >= 0 || wifiBoot == WIFI_BOOT_FAST || wifiBoot == WIFI_BOOT_FULL) {
+    return; // booting: bootStep() wants every loop
+  }
+  if (govAtMax()) {
+    delay(1); // ready for the next chunk
+    return;
+  }
+  uint32_t start = micros();
+  delay(GOV_IDLE_WAIT_MS);
+  uint32_t waited = micros() - start;
+  uint32_t late = waited > GOV_IDLE_WAIT_MS * 1000 ? waited - GOV_IDLE_WAIT_MS * 1000 : 0;
+  govIdleUs += waited;
+  govWakeSumUs += late;
+  if (late > govWakeMaxUs) govWakeMaxUs = late;
+  ++govWakes;
+}
+
+// GET /power[?reset=1]: time at each clock and the idle wake-up cost
+void handlePower() {
+  govAccount();
+  String s = "mode:" + String(govPm ? "pm" : "fixed") + "\n";
+  s += "light_sleep:" + String(govLightSleep ? 1 : 0) + "\n";
+  s += "mhz:" + String(getCpuFrequencyMhz()) + "\n";
+  s += "idle_wait_ms:" + String(GOV_IDLE_WAIT_MS) + "\n";
+  s += "boosts:" + String(govBoosts) + "\n";
+  s += "max_clock_ms:" + String((uint32_t)(govMaxUs / 1000)) + "\n";
+  s += "min_clock_ms:" + String((uint32_t)(govMinUs / 1000)) + "\n";
+  s += "idle_ms:" + String((uint32_t)(govIdleUs / 1000)) + "\n";
+  s += "wake_us:" + String(govWakes > 0 ? (uint32_t)(govWakeSumUs / govWakes) : 0) + "\n";
+  s += "max_wake_us:" + String(govWakeMaxUs);
+  if (server.arg("reset") == "1") {
+    govBoosts = 0;
+    govMaxUs = govMinUs = govIdleUs = 0;
+    govWakes = 0;
+    govWakeSumUs = 0;
+    govWakeMaxUs = 0;
+  }
+  sendPlain(200, s);
+}
+
+// ===== ESP-NOW Relay =====
+// ESP-NOW callbacks run in the Wi-Fi task: packets go to the relay's queue
+void relayOnReceive(const uint8_t* mac, const uint8_t* data, int len) {
+  relay.onReceive(mac, data, len);
+}
+
+void relayOnSent(const uint8_t* mac, esp_now_send_status_t status) {
+  (void)mac; // only one send is in flight (relaySendLock)
+  relaySendOk = status == ESP_NOW_SEND_SUCCESS;
+  xSemaphoreGive(relaySendDone);
+}
+
+// MediaRelay's SendFn. Called from loop() (a transfer) and from the relay
+// task (replies), so the lock keeps their send callbacks apart.
+bool relaySend(void* ctx, const uint8_t* mac, const uint8_t* data, int len) {
+  (void)ctx; // the ESP-NOW state is global
+  xSemaphoreTake(relaySendLock, portMAX_DELAY);
+  if (!esp_now_is_peer_exist(mac)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = 0; // the station's
+    peer.ifidx = WIFI_IF_STA;
+    esp_now_add_peer(&peer);
+  }
+  xSemaphoreTake(relaySendDone, 0);
+  bool ok = esp_now_send(mac, data, len) == ESP_OK &&
+            xSemaphoreTake(relaySendDone, pdMS_TO_TICKS(50)) == pdTRUE && relaySendOk;
+  xSemaphoreGive(relaySendLock);
+  return ok;
+}
+
+bool parseMac(const String& text, uint8_t* mac) {
+  unsigned int b[6];
+  char extra;
+  if (sscanf(text.c_str(), "%x:%x:%x:%x:%x:%x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &extra) != 6) return false;
+  for (int i = 0; i < 6; i++) {
+    if (b[i] > 0xFF) return false;
+    mac[i] = b[i];
+  }
+  return true;
+}
+
+// "AA:BB:CC:DD:EE:FF,..." or "" for none. Changes nothing if one is bad.
+bool setRelayPeers(const String& list) {
+  uint8_t macs[RELAY_MAX_PEERS][6];
+  int count = 0;
+  unsigned int start = 0;
+  while (start < list.length()) {
+    int end = list.indexOf(',', start);
+    if (end < 0) end = list.length();
+    String mac = list.substring(start, end);
+    start = end + 1;
+    mac.trim();
+    if (mac.length() == 0) continue;
+    if (count == RELAY_MAX_PEERS || !parseMac(mac, macs[count])) return false;
+    count++;
+  }
+  relay.clearPeers();
+  for (int i = 0; i < count; i++) relay.addPeer(macs[i]);
+  return true;
+}
+
+String relayPeerList() {
+  String s;
+  for (int i = 0; i < relay.getPeerCount(); i++) {
+    const uint8_t* m = relay.getPeer(i);
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", m[0], m[1], m[2], m[3], m[4], m[5]);
+    if (i > 0) s += ",";
+    s += buf;
+  }
+  return s;
+}
+
+void loadRelay() {
+  prefs.begin("relay", true);
+  String peers = prefs.getString("peers", "");
+  relayListen = prefs.getBool("listen", false);
+  prefs.end();
+  setRelayPeers(peers);
+  relay.setListening(relayListen);
+}
+
+// Once the station is online, if there is a group to send to or listening
+// is on. ESP-NOW shares the station's channel.
+void startRelay() {
+  if (relayStarted || wifiBoot != WIFI_BOOT_ONLINE) return;
+  if (relay.getPeerCount() == 0 && !relayListen) return;
+  relaySendLock = xSemaphoreCreateMutex();
+  relaySendDone = xSemaphoreCreateBinary();
+  if (esp_now_init() != ESP_OK || relaySendLock == nullptr || relaySendDone == nullptr) {
+    Serial.println("ERROR: ESP-NOW could not start");
+    return;
+  }
+  esp_now_register_recv_cb(relayOnReceive);
+  esp_now_register_send_cb(relayOnSent);
+  if (!relay.begin(relaySend, nullptr, 0)) {
+    Serial.println("ERROR: relay task could not start");
+    esp_now_deinit();
+    return;
+  }
+  relayStarted = true;
+  if (govPm) {
+    esp_pm_lock_acquire(govAwakeLock); // a sleeping radio misses packets
+  }
+  Serial.println("ESP-NOW relay: " + String(relay.getPeerCount()) + " peer(s), listening " + String(relayListen ? "on" : "off"));
+}
+
+// Waits for the agreed switch: delay() for most of it, then a busy wait
+void relayWaitUntil(uint32_t at) {
+  int32_t left = at - micros();
+  if (left > 2000) delay((left - 1000) / 1000);
+  left = at - micros();
+  if (left > 0) delayMicroseconds(left);
+  relayShowLateUs = micros() - at;
+  if (relayShowLateUs > relayShowLateMaxUs) relayShowLateMaxUs = relayShowLateUs;
+}
+
+// Leader: sends a file about to be shown here to the group, and returns
+// when the group shows it
+void relayToGroup(uint8_t kind, const uint8_t* data, int size) {
+  if (relayShowing) {
+    relayShowing = false; // only this file; an upload during its GIF loop is relayed
+    return;
+  }
+  if (!relayStarted || relay.getPeerCount() == 0) return;
+  bool ok = relay.transfer(kind, data, size);
+  Serial.printf("Relayed %d bytes to %d/%d peer(s) in %lu ms, %d round(s)\n", size, relay.getLastPeersOk(),
+                relay.getPeerCount(), (unsigned long)(relay.getLastUs() / 1000), relay.getLastRounds());
+  if (relay.getLastPeersOk() == 0) return;
+  if (!ok) Serial.println("Some peers did not get it");
+  relayWaitUntil(relay.show(RELAY_SHOW_LEAD_MS));
+}
+
+// Peer, from loop(): installs a relayed file as if it had been uploaded,
+// and shows it at the leader's time. Left for a later loop() while the
+// time is further off than an idle wait.
+void relayStep() {
+  if (!relay.showPending()) return;
+  if ((int32_t)(relay.showAt() - micros()) > (int32_t)(GOV_IDLE_WAIT_MS + 5) * 1000) return;
+  uint8_t* data;
+  uint32_t size;
+  uint8_t kind;
+  if (!relay.takeFile(&data, &size, &kind)) return;
+  uint32_t at = relay.showAt();
+  cpuBoost();
+  String error;
+  const char* command;
+  if (kind == RELAY_IMAGE) {
+    free(jpegBuffer);
+    jpegBuffer = data;
+    jpegBufferSize = jpegBufferCapacity = size;
+    error = size > (uint32_t)MAX_JPEG_SIZE ? String("Image too large") : probeJpeg(data, size, jpegInfo);
+    command = "displayImage";
+  } else {
+    free(gifBuffer);
+    free(jpegBuffer);
+    jpegBuffer = nullptr;
+    jpegBufferSize = 0;
+    gifBuffer = data;
+    gifBufferSize = gifBufferCapacity = size;
+    bool isPanelAnim = size >= 4 && memcmp(data, "PAN1", 4) == 0;
+    error = isPanelAnim ? probePanelAnim(data, size, gifInfo) : probeGif(data, size, gifInfo);
+    command = "playGif";
+  }
+  if (error.length() > 0) {
+    Serial.println("Relayed file rejected: " + error);
+    if (kind == RELAY_IMAGE) {
+      free(jpegBuffer);
+      jpegBuffer = nullptr;
+      jpegBufferSize = 0;
+    } else {
+      free(gifBuffer);
+      gifBuffer = nullptr;
+      gifBufferSize = 0;
+    }
+    return;
+  }
+  relayWaitUntil(at);
+  relayShowing = true; // cleared by the handler's relayToGroup()
+  runCommand(command, "");
+  relayShowing = false; // in case the handler failed before it
+}
+
+// GET /relay[?peers=MAC,MAC&listen=0|1&reset=1]: the group this display
+// relays to, whether it takes relayed files, and the counters of both
+void handleRelay() {
+  if (server.hasArg("peers") || server.hasArg("listen")) {
+    if (server.hasArg("peers") && !setRelayPeers(server.arg("peers"))) {
+      sendPlain(400, "Bad peer list (up to " + String(RELAY_MAX_PEERS) + " MACs, comma separated)");
+      return;
+    }
+    if (server.hasArg("listen")) {
+      relayListen = server.arg("listen") == "1";
+      relay.setListening(relayListen);
+    }
+    prefs.begin("relay", false);
+    prefs.putString("peers", relayPeerList());
+    prefs.putBool("listen", relayListen);
+    prefs.end();
+    startRelay();
+  }
+  String s = "started:" + String(relayStarted ? 1 : 0) + "\n";
+  s += "mac:" + WiFi.macAddress() + "\n";
+  s += "peers:" + relayPeerList() + "\n";
+  s += "listen:" + String(relayListen ? 1 : 0) + "\n";
+  s += "transfers:" + String(relay.getTransfers()) + "\n";
+  s += "sent:" + String(relay.getSent()) + "\n";
+  s += "send_failures:" + String(relay.getSendFailures()) + "\n";
+  s += "repairs:" + String(relay.getRepairs()) + "\n";
+  s += "last_bytes:" + String(relay.getLastBytes()) + "\n";
+  s += "last_us:" + String(relay.getLastUs()) + "\n";
+  s += "last_rounds:" + String(relay.getLastRounds()) + "\n";
+  s += "last_repairs:" + String(relay.getLastRepairs()) + "\n";
+  s += "last_peers_ok:" + String(relay.getLastPeersOk()) + "\n";
+  s += "last_show_us:" + String(relay.getLastShowAt()) + "\n";
+  s += "received:" + String(relay.getReceived()) + "\n";
+  s += "recovered:" + String(relay.getRecovered()) + "\n";
+  s += "nacks:" + String(relay.getNacks()) + "\n";
+  s += "bad_files:" + String(relay.getBadFiles()) + "\n";
+  s += "no_memory:" + String(relay.getNoMemory()) + "\n";
+  s += "overflows:" + String(relay.getOverflows()) + "\n";
+  s += "show_late_us:" + String(relayShowLateUs) + "\n";
+  s += "max_show_late_us:" + String(relayShowLateMaxUs);
+  if (server.arg("reset") == "1") {
+    relay.resetStats();
+    relayShowLateUs = relayShowLateMaxUs = 0;
+  }
+  sendPlain(200, s);
+}
+
 // ===== Web Server Handlers =====
+void noteRequest() {
+  if (firstRequestMs == 0) firstRequestMs = millis();
+}
+
 void sendPlain(int code, const String &body) {
+  if (batchCurrent >= 0) {
+    batchReply(code, body);
+    return;
+  }
+  noteRequest();
   server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(code, "text/plain", body);
 }
 
 void handleRoot() {
+  if (wifiBoot != WIFI_BOOT_ONLINE) { // a client of the setup AP
+    handleRootAP();
+    return;
+  }
   sendPlain(200, "ESP32 ready with JPEGDEC + AnimatedGIF");
 }
 
@@ -278,14 +1021,23 @@ void handleOff() {
 }
 
 void handleStatus() {
+  noteRequest();
   String s = "mode:";
-  s += (WiFi.getMode() == WIFI_AP) ? "AP" : "STA";
+  s += WiFi.getMode() == WIFI_AP ? "AP" : WiFi.getMode() == WIFI_AP_STA ? "AP_STA" : "STA";
   s += "\n";
   if (WiFi.status() == WL_CONNECTED) {
     s += "ip: " + WiFi.localIP().toString();
   } else {
     s += "not connected";
   }
+  s += "\nwifi:";
+  s += wifiBoot == WIFI_BOOT_ONLINE ? "online" : wifiBoot == WIFI_BOOT_PROVISIONING ? "provisioning" : "joining";
+  s += "\ndisplay:";
+  s += displayTest >= 0 ? "testing" : "ready";
+  s += "\njoin:" + String(joinMethod);
+  s += "\njoin_ms:" + String(joinMs);
+  s += "\nserving_ms:" + String(servingMs);
+  s += "\nfirst_request_ms:" + String(firstRequestMs);
   sendPlain(200, s);
 }
 
@@ -314,7 +1066,9 @@ void handleLight() {
 }
 
 void handleDisplay() {
-  String mode = server.arg("mode");
+  cpuBoost();
+  String mode = commandArg("mode");
+  endDisplayTest();
   
   if (mode == "smiley") {
     displaySmiley();
@@ -334,44 +1088,52 @@ void handleDisplay() {
 }
 
 void displaySmiley() {
+  const int cx = TftPanel::width / 2, cy = TftPanel::height / 2;
   tft.fillScreen(ST77XX_BLACK);
-  tft.fillCircle(160, 120, 80, ST77XX_YELLOW);
-  tft.fillCircle(130, 100, 10, ST77XX_BLACK);
-  tft.fillCircle(190, 100, 10, ST77XX_BLACK);
+  tft.fillCircle(cx, cy, panelScale(80), ST77XX_YELLOW);
+  tft.fillCircle(cx - panelScale(30), cy - panelScale(20), panelScale(10), ST77XX_BLACK);
+  tft.fillCircle(cx + panelScale(30), cy - panelScale(20), panelScale(10), ST77XX_BLACK);
   for (int i = 0; i < 180; i += 5) {
     float angle1 = (i * 3.14159) / 180.0;
     float angle2 = ((i + 5) * 3.14159) / 180.0;
-    int x1 = 160 + 50 * cos(angle1);
-    int y1 = 120 + 30 * sin(angle1);
-    int x2 = 160 + 50 * cos(angle2);
-    int y2 = 120 + 30 * sin(angle2);
+    int x1 = cx + panelScale(50) * cos(angle1);
+    int y1 = cy + panelScale(30) * sin(angle1);
+    int x2 = cx + panelScale(50) * cos(angle2);
+    int y2 = cy + panelScale(30) * sin(angle2);
     tft.drawLine(x1, y1, x2, y2, ST77XX_BLACK);
   }
 }
 
 void displayHeart() {
+  const int cx = TftPanel::width / 2, cy = TftPanel::height / 2;
   tft.fillScreen(ST77XX_BLACK);
-  tft.fillCircle(140, 100, 40, ST77XX_RED);
-  tft.fillCircle(180, 100, 40, ST77XX_RED);
-  tft.fillTriangle(100, 110, 220, 110, 160, 180, ST77XX_RED);
+  tft.fillCircle(cx - panelScale(20), cy - panelScale(20), panelScale(40), ST77XX_RED);
+  tft.fillCircle(cx + panelScale(20), cy - panelScale(20), panelScale(40), ST77XX_RED);
+  tft.fillTriangle(cx - panelScale(60), cy - panelScale(10), cx + panelScale(60), cy - panelScale(10),
+                   cx, cy + panelScale(60), ST77XX_RED);
 }
 
 void displayAlert() {
+  // "ALERT!" centred: 6 characters of 6x8 pixels, at up to 5x
+  const int size = min(5, TftPanel::width / 36);
+  const int x = (TftPanel::width - 36 * size) / 2;
+  const int y = (TftPanel::height - 8 * size) / 2;
   tft.fillScreen(ST77XX_RED);
-  tft.setTextSize(5);
+  tft.setTextSize(size);
   tft.setTextColor(ST77XX_WHITE);
-  tft.setCursor(50, 90);
+  tft.setCursor(x, y);
   tft.println("ALERT!");
   delay(200);
   tft.fillScreen(ST77XX_BLACK);
   delay(200);
   tft.fillScreen(ST77XX_RED);
-  tft.setCursor(50, 90);
+  tft.setCursor(x, y);
   tft.println("ALERT!");
 }
 
 // ===== Image Upload Handlers =====
 void handleImageChunk() {
+  cpuBoost();
   if (!server.hasArg("index") || !server.hasArg("total") || !server.hasArg("data")) {
     sendPlain(400, "Missing parameters");
     return;
@@ -381,35 +1143,62 @@ void handleImageChunk() {
   int total = server.arg("total").toInt();
   String data = server.arg("data");
   
-  // First chunk - allocate buffer
+  // First chunk - size the buffer from the declared file size and check
+  // the header before the rest is sent
   if (index == 0) {
     if (jpegBuffer != nullptr) {
       free(jpegBuffer);
+      jpegBuffer = nullptr;
     }
-    jpegBuffer = (uint8_t*)malloc(MAX_JPEG_SIZE);
+    jpegBufferSize = 0;
+    // Without a size, a file that may not fit is refused here rather than
+    // partway through
+    int size = server.hasArg("size") ? server.arg("size").toInt() : uploadSizeEstimate(total, data);
+    if (size <= 0 || size > MAX_JPEG_SIZE) {
+      sendPlain(413, "Image too large (" + String(size) + " bytes, max " + String(MAX_JPEG_SIZE) + ")");
+      return;
+    }
+    jpegBuffer = (uint8_t*)malloc(size);
     if (jpegBuffer == nullptr) {
       sendPlain(500, "Out of memory");
       return;
     }
-    jpegBufferSize = 0;
+    jpegBufferCapacity = size;
     Serial.println("Starting image reception...");
     Serial.print("Free heap: ");
     Serial.println(ESP.getFreeHeap());
+  } else if (jpegBuffer == nullptr) {
+    sendPlain(400, "No upload in progress");
+    return;
   }
   
   // Decode this chunk from base64 and append to buffer
-  int chunkLen = data.length();
-  int decodedSize = (chunkLen * 3) / 4 + 10;
+  int decodedSize = base64DecodedLength(data);
   
-  if (jpegBufferSize + decodedSize > MAX_JPEG_SIZE) {
-    sendPlain(500, "Image too large");
+  if (jpegBufferSize + decodedSize > jpegBufferCapacity) {
+    sendPlain(413, "Image too large");
     free(jpegBuffer);
     jpegBuffer = nullptr;
     return;
   }
   
-  int decoded = base64Decode(data, jpegBuffer + jpegBufferSize, MAX_JPEG_SIZE - jpegBufferSize);
+  int decoded = base64Decode(data, jpegBuffer + jpegBufferSize, jpegBufferCapacity - jpegBufferSize);
   jpegBufferSize += decoded;
+
+  if (index == 0) {
+    String error = probeJpeg(jpegBuffer, jpegBufferSize, jpegInfo);
+    if (error.length() > 0) {
+      Serial.println("Rejected: " + error);
+      sendPlain(415, error);
+      free(jpegBuffer);
+      jpegBuffer = nullptr;
+      jpegBufferSize = 0;
+      return;
+    }
+    if (jpegInfo.width > 0) {
+      Serial.printf("JPEG %dx%d, %d bytes, scale 1/%d\n", jpegInfo.width, jpegInfo.height, jpegBufferCapacity, jpegInfo.scale);
+    }
+  }
   
   Serial.print("Chunk ");
   Serial.print(index + 1);
@@ -422,31 +1211,52 @@ void handleImageChunk() {
 }
 
 void handleDisplayImage() {
+  cpuBoost();
   if (jpegBuffer == nullptr || jpegBufferSize == 0) {
     sendPlain(400, "No image data");
     return;
   }
+  // Before the reply: the uploader waits out the transfer and
+  // RELAY_SHOW_LEAD_MS (see Relay in the README)
+  relayToGroup(RELAY_IMAGE, jpegBuffer, jpegBufferSize);
   
   Serial.print("Decoding JPEG with JPEGDEC... Size: ");
   Serial.println(jpegBufferSize);
   
-  tft.fillScreen(ST77XX_BLACK);
+  endDisplayTest();
   
-  unsigned long startTime = millis();
+  // A preview first (?preview=0 skips it), then the full decode over it
+  unsigned long startUs = micros();
+  jpegFirstDrawUs = 0;
+  bool previewed = commandArg("preview") != "0" && previewJPEGFrame(jpegBuffer, jpegBufferSize);
+  unsigned long previewUs = micros() - startUs;
+  if (previewed) {
+    clearAround(jpegPreview.x, jpegPreview.y, jpegPreview.w, jpegPreview.h);
+  } else {
+    tft.fillScreen(ST77XX_BLACK);
+  }
   
   bool success = decodeJPEGFrame(jpegBuffer, jpegBufferSize);
   
-  unsigned long decodeTime = millis() - startTime;
+  unsigned long finalUs = micros() - startUs;
+  unsigned long decodeTime = finalUs / 1000;
   
   if (success) {
+    // One line, so /batch can quote it as this command's reply
+    String timing = "first_pixel_ms:" + String((jpegFirstDrawUs - startUs) / 1000.0, 1);
+    if (previewed) timing += " preview_ms:" + String(previewUs / 1000.0, 1);
+    timing += " final_ms:" + String(finalUs / 1000.0, 1);
     Serial.print("JPEG decoded successfully in ");
     Serial.print(decodeTime);
-    Serial.println(" ms");
+    Serial.print(" ms, first pixel after ");
+    Serial.print((jpegFirstDrawUs - startUs) / 1000.0, 1);
+    Serial.println(previewed ? " ms (preview)" : " ms");
     Serial.print("Free heap after: ");
     Serial.println(ESP.getFreeHeap());
-    sendPlain(200, "Image displayed in " + String(decodeTime) + "ms");
+    sendPlain(200, "Image displayed in " + String(decodeTime) + "ms " + timing);
   } else {
     Serial.println("JPEG decode failed");
+    tft.fillScreen(ST77XX_BLACK);
     tft.setTextSize(2);
     tft.setTextColor(ST77XX_RED);
     tft.setCursor(10, 100);
@@ -462,6 +1272,7 @@ void handleDisplayImage() {
 
 // ===== GIF Upload Handlers =====
 void handleGifChunk() {
+  cpuBoost();
   Serial.println("=== GIF Chunk Handler Called ===");
   Serial.print("Method: ");
   Serial.println(server.method() == HTTP_POST ? "POST" : "GET");
@@ -513,7 +1324,8 @@ void handleGifChunk() {
     return;
   }
   
-  // First chunk - allocate buffer
+  // First chunk - size the buffer from the declared file size and check
+  // the header before the rest is sent
   if (index == 0) {
     // Free any existing buffers first
     if (gifBuffer != nullptr) {
@@ -524,62 +1336,70 @@ void handleGifChunk() {
       free(jpegBuffer);
       jpegBuffer = nullptr;
     }
+    gifBufferSize = 0;
     
     Serial.println("Starting GIF reception...");
     Serial.print("Free heap before allocation: ");
-    unsigned long freeHeap = ESP.getFreeHeap();
+    unsigned long freeHeap = ESP.getMaxAllocHeap();
     Serial.println(freeHeap);
     
-    // Calculate needed size: total chunks * avg chunk size + buffer
-    // For safety, allocate MAX_GIF_SIZE or free heap - 50KB (whichever is smaller)
-    int allocSize = MAX_GIF_SIZE;
-    if (freeHeap < (MAX_GIF_SIZE + 50000)) {
-      allocSize = freeHeap - 50000; // Leave 50KB for other operations
-      Serial.print("Adjusting allocation size to: ");
-      Serial.println(allocSize);
+    // Without a size, as for images
+    int size = server.hasArg("size") ? server.arg("size").toInt() : uploadSizeEstimate(total, data);
+    if (size <= 0 || size > MAX_GIF_SIZE) {
+      sendPlain(413, "GIF too large (" + String(size) + " bytes, max " + String(MAX_GIF_SIZE) + ")");
+      return;
+    }
+    if ((unsigned long)size + GIF_HEAP_RESERVE > freeHeap) {
+      sendPlain(413, "Not enough memory for GIF (" + String(size) + " bytes, " + String(freeHeap) + " free)");
+      return;
     }
     
     Serial.print("Trying to allocate: ");
-    Serial.println(allocSize);
+    Serial.println(size);
     
-    gifBuffer = (uint8_t*)malloc(allocSize);
+    gifBuffer = (uint8_t*)malloc(size);
     if (gifBuffer == nullptr) {
       Serial.println("ERROR: Failed to allocate GIF buffer!");
-      Serial.print("Free heap: ");
-      Serial.println(ESP.getFreeHeap());
-      
-      // Try smaller allocation
-      allocSize = 100000; // Try 100KB
-      Serial.print("Retrying with smaller size: ");
-      Serial.println(allocSize);
-      gifBuffer = (uint8_t*)malloc(allocSize);
-      
-      if (gifBuffer == nullptr) {
-        Serial.println("ERROR: Still failed!");
-        sendPlain(500, "Out of memory for GIF");
-        return;
-      }
+      sendPlain(500, "Out of memory for GIF");
+      return;
     }
-    
-    gifBufferSize = 0;
+    gifBufferCapacity = size;
     Serial.println("GIF buffer allocated successfully!");
     Serial.print("Free heap after allocation: ");
     Serial.println(ESP.getFreeHeap());
+  } else if (gifBuffer == nullptr) {
+    sendPlain(400, "No upload in progress");
+    return;
   }
   
   // Decode this chunk from base64 and append to buffer
-  int chunkLen = data.length();
-  int decodedSize = (chunkLen * 3) / 4 + 10;
+  int decodedSize = base64DecodedLength(data);
   
-  if (gifBufferSize + decodedSize > MAX_GIF_SIZE) {
-    sendPlain(500, "GIF too large");
+  if (gifBufferSize + decodedSize > gifBufferCapacity) {
+    sendPlain(413, "GIF too large");
     free(gifBuffer);
     gifBuffer = nullptr;
     return;
   }
   
-  int decoded = base64Decode(data, gifBuffer + gifBufferSize, MAX_GIF_SIZE - gifBufferSize);
+  int decoded = base64Decode(data, gifBuffer + gifBufferSize, gifBufferCapacity - gifBufferSize);
   gifBufferSize += decoded;
+
+  if (index == 0) {
+    bool isPanelAnim = gifBufferSize >= 4 && memcmp(gifBuffer, "PAN1", 4) == 0;
+    String error = isPanelAnim ? probePanelAnim(gifBuffer, gifBufferSize, gifInfo)
+                               : probeGif(gifBuffer, gifBufferSize, gifInfo);
+    if (error.length() > 0) {
+      Serial.println("Rejected: " + error);
+      sendPlain(415, error);
+      free(gifBuffer);
+      gifBuffer = nullptr;
+      gifBufferSize = 0;
+      return;
+    }
+    Serial.printf("%s %dx%d, %d bytes, %d%s frame(s)\n", gifInfo.panelAnim ? "Animation" : "GIF", gifInfo.width, gifInfo.height, gifBufferCapacity,
+                  gifInfo.frames, gifInfo.complete ? "" : "+");
+  }
   
   Serial.print("GIF Chunk ");
   Serial.print(index + 1);
@@ -592,6 +1412,10 @@ void handleGifChunk() {
 }
 
 void handlePlayGif() {
+  if (gifLoopRunning) {
+    sendPlain(409, "Already playing");
+    return;
+  }
   if (gifBuffer == nullptr || gifBufferSize == 0) {
     sendPlain(400, "No GIF data");
     return;
@@ -599,51 +1423,76 @@ void handlePlayGif() {
   
   Serial.print("Playing GIF... Size: ");
   Serial.println(gifBufferSize);
+  // Before the reply, as in handleDisplayImage()
+  relayToGroup(RELAY_GIF, gifBuffer, gifBufferSize);
   
+  mediaStart();
+  gifLoopRunning = true;
+  endDisplayTest();
   tft.fillScreen(ST77XX_BLACK);
   
-  if (gif.open(gifBuffer, gifBufferSize, GIFDraw)) {
+  if (gifInfo.panelAnim) {
+    playPanelAnim();
+  } else if (gif.open(gifBuffer, gifBufferSize, GIFDraw)) {
     Serial.println("GIF opened successfully");
     Serial.print("Canvas size: ");
     Serial.print(gif.getCanvasWidth());
     Serial.print("x");
     Serial.println(gif.getCanvasHeight());
     
-    isPlayingGif = true;
-    sendPlain(200, "GIF playing");
+    if (gifInfo.complete && gifInfo.frames == 1) {
+      // A still image: draw it once rather than redrawing it in a loop
+      gif.playFrame(false, NULL);
+      panel.finish();
+      gif.close();
+      Serial.println("Single-frame GIF displayed");
+      sendPlain(200, "GIF displayed");
+    } else {
+      isPlayingGif = true;
+      sendPlain(200, "GIF playing");
     
-    // Play GIF in loop (will be stopped by handleStopGif)
-    int frameCount = 0;
-    unsigned long startTime = millis();
+      // Play GIF in loop (will be stopped by handleStopGif)
+      int frameCount = 0;
+      int frameIndex = 0; // of the frame about to be drawn, for audio triggers
+      unsigned long framesPlayed = 0; // not reset per loop, so short GIFs still poll
+      unsigned long startTime = millis();
     
-    while (isPlayingGif) {
-      int result = gif.playFrame(true, NULL);
-      if (result == 0) { // End of animation
-        gif.reset(); // Loop the animation
+      while (isPlayingGif) {
+        audio.frameShown(frameIndex);
+        int result = gif.playFrame(true, NULL);
+        frameIndex = result == 0 ? 0 : frameIndex + 1;
+        if (result == 0) { // End of animation
+          gif.reset(); // Loop the animation
         
-        // Calculate and print FPS
-        unsigned long elapsed = millis() - startTime;
-        if (elapsed > 0) {
-          float fps = (frameCount * 1000.0) / elapsed;
-          Serial.print("FPS: ");
-          Serial.println(fps);
+          // Calculate and print FPS
+          unsigned long elapsed = millis() - startTime;
+          if (elapsed > 0) {
+            float fps = (frameCount * 1000.0) / elapsed;
+            Serial.print("FPS: ");
+            Serial.println(fps);
+          }
+          frameCount = 0;
+          startTime = millis();
         }
-        frameCount = 0;
-        startTime = millis();
-      }
-      frameCount++;
+        frameCount++;
+        framesPlayed++;
       
-      // Minimal delay for smoother playback
-      delay(10); // ~100 FPS max, actual speed depends on GIF
+        // Minimal delay for smoother playback
+        delay(10); // ~100 FPS max, actual speed depends on GIF
       
-      // Periodically check for stop command (every 10 frames)
-      if (frameCount % 10 == 0) {
-        server.handleClient();
+        // Periodically check for stop command (every 10 frames)
+        if (framesPlayed % 10 == 0) {
+          panel.finish(); // handlers may draw through tft
+          server.handleClient();
+          rulesStep();
+        }
+        if (relay.showPending()) isPlayingGif = false; // loop() shows the relayed file
       }
-    }
     
-    gif.close();
-    Serial.println("GIF playback finished");
+      panel.finish();
+      gif.close();
+      Serial.println("GIF playback finished");
+    }
     
   } else {
     Serial.println("Failed to open GIF");
@@ -654,24 +1503,300 @@ void handlePlayGif() {
     sendPlain(500, "Failed to open GIF");
   }
   
+  gifLoopRunning = false;
+  mediaEnd();
+  
   // Free memory
   free(gifBuffer);
   gifBuffer = nullptr;
   gifBufferSize = 0;
 }
 
+// Plays the .pan animation in gifBuffer, centered, until /stopGif. Same
+// loop as the GIF one, but frames are only copied to the bus.
+void playPanelAnim() {
+  if (!panelAnim.open(gifBuffer, gifBufferSize)) {
+    sendPlain(500, "Failed to open animation");
+    return;
+  }
+  int x = (TftPanel::width - panelAnim.getWidth()) / 2;
+  int y = (TftPanel::height - panelAnim.getHeight()) / 2;
+  
+  if (panelAnim.getFrameCount() == 1) {
+    panelAnim.playFrame(panel, x, y, false);
+    panel.finish();
+    panelAnim.close();
+    sendPlain(200, "Animation displayed");
+    return;
+  }
+  
+  isPlayingGif = true;
+  sendPlain(200, "Animation playing");
+  
+  unsigned long framesPlayed = 0;
+  int frameIndex = 0; // of the frame about to be drawn, for audio triggers
+  unsigned long startTime = millis();
+  while (isPlayingGif) {
+    audio.frameShown(frameIndex);
+    int result = panelAnim.playFrame(panel, x, y, true);
+    frameIndex = result == 0 ? 0 : frameIndex + 1;
+    if (result < 0) {
+      Serial.println("Animation data is damaged");
+      break;
+    }
+    framesPlayed++;
+    if (result == 0) {
+      panelAnim.reset();
+      unsigned long elapsed = millis() - startTime;
+      if (elapsed > 0) {
+        Serial.print("FPS: ");
+        Serial.println(panelAnim.getFrameCount() * 1000.0 / elapsed);
+      }
+      startTime = millis();
+    }
+    if (framesPlayed % 10 == 0) {
+      panel.finish(); // handlers may draw through tft
+      server.handleClient();
+      rulesStep();
+    }
+    if (relay.showPending()) isPlayingGif = false; // loop() shows the relayed file
+  }
+  
+  isPlayingGif = false;
+  panel.finish();
+  panelAnim.close();
+  Serial.println("Animation playback finished");
+}
+
 void handleStopGif() {
   isPlayingGif = false;
   sendPlain(200, "GIF stopped");
 }
 
+// ===== MJPEG Stream Handlers =====
+// POST /mjpeg with a raw body of concatenated JPEGs, either bare or framed
+// as multipart/x-mixed-replace parts. Send it as application/octet-stream
+// (WebServer parses multipart/* content types as forms). The upload only
+// queues frames; mjpegDecodeTask draws them on core 0. When frames come in
+// faster than they decode, the queue keeps the newest and drops the rest,
+// so the panel stays within MJPEG_LATENCY_MS of the sender.
+void mjpegDecodeTask(void* param) {
+  (void)param; // the queue and decoder are globals
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    FrameQueue::Frame* frame;
+    while ((frame = mjpegQueue.acquire()) != nullptr) {
+      mjpegQueue.release(frame, mjpeg.drawJpg(frame->data, frame->len));
+    }
+    panel.finish(); // caught up: let the bus drain
+  }
+}
+
+void handleMjpegUpload() {
+  HTTPRaw& raw = server.raw();
+
+  if (raw.status == RAW_START) {
+    mjpegNoMemory = false;
+    isPlayingGif = false;
+    if (gifBuffer != nullptr) {
+      free(gifBuffer);
+      gifBuffer = nullptr;
+      gifBufferSize = 0;
+    }
+    if (mjpegTask == nullptr) {
+      xTaskCreatePinnedToCore(mjpegDecodeTask, "mjpegDecode", 8192, nullptr, 1, &mjpegTask, 0);
+    }
+    if (mjpegTask == nullptr || !mjpegQueue.begin(MJPEG_SLOT_SIZE, MJPEG_LATENCY_MS) ||
+        !mjpeg.setup(&tft, 0, 0)) {
+      Serial.println("ERROR: Failed to allocate MJPEG buffers!");
+      mjpeg.end();
+      mjpegQueue.end();
+      mjpegNoMemory = true;
+      return;
+    }
+    // Frames with restart markers (host/tools/mjpack) decode their bottom
+    // half on core 1 while mjpegDecodeTask does the top half
+    if (!mjpeg.beginSlices(1)) {
+      Serial.println("MJPEG slice task unavailable, decoding on one core");
+    }
+    endDisplayTest();
+    tft.fillScreen(ST77XX_BLACK);
+    mjpeg.resetStats();
+    mjpegActive = true;
+    mediaStart();
+    mjpegStartTime = millis();
+    Serial.println("MJPEG stream started");
+  } else if (raw.status == RAW_WRITE) {
+    if (mjpegActive && mjpegQueue.pushJpegStream(raw.buf, raw.currentSize) > 0) {
+      xTaskNotifyGive(mjpegTask);
+    }
+  } else if (raw.status == RAW_END || raw.status == RAW_ABORTED) {
+    if (mjpegActive) {
+      mjpegQueue.finish();
+      while (!mjpegQueue.idle()) {
+        delay(1); // let the decoder show what is already queued
+      }
+      mjpegElapsed = millis() - mjpegStartTime;
+      Serial.print(raw.status == RAW_END ? "MJPEG stream ended: " : "MJPEG stream aborted: ");
+      Serial.println(mjpegStats());
+      mediaEnd();
+    }
+    mjpegActive = false;
+    mjpeg.end();
+    mjpegQueue.end();
+  }
+}
+
+String mjpegStats() {
+  unsigned long elapsed = mjpegActive ? millis() - mjpegStartTime : mjpegElapsed;
+  uint32_t frames = mjpeg.getDrawnFrames();
+  String s = "frames:" + String(frames) + "\n";
+  s += "dropped:" + String(mjpegQueue.getDropped()) + "\n";
+  s += "fps:" + String(elapsed > 0 ? frames * 1000.0 / elapsed : 0.0, 1) + "\n";
+  s += "decode_ms:" + String(frames > 0 ? mjpeg.getTotalDecodeTime() / 1000.0 / frames : 0.0, 1) + "\n";
+  s += "last_decode_ms:" + String(mjpeg.getLastDecodeTime() / 1000.0, 1) + "\n";
+  s += "sliced:" + String(mjpeg.getSlicedFrames()) + "\n";
+  s += "slice_wait_ms:" + String(frames > 0 ? mjpeg.getSliceWaitTime() / 1000.0 / frames : 0.0, 1) + "\n";
+  s += "received:" + String(mjpegQueue.getReceived()) + "\n";
+  s += "dropped_late:" + String(mjpegQueue.getDroppedLate()) + "\n";
+  s += "dropped_overflow:" + String(mjpegQueue.getDroppedOverflow()) + "\n";
+  s += "dropped_bad:" + String(mjpegQueue.getDroppedBad()) + "\n";
+  s += "latency_ms:" + String(mjpegQueue.getAvgLatency() / 1000.0, 1) + "\n";
+  s += "max_latency_ms:" + String(mjpegQueue.getMaxLatency() / 1000.0, 1) + "\n";
+  s += "max_queue:" + String(mjpegQueue.getMaxDepth());
+  return s;
+}
+
+void handleMjpeg() {
+  if (mjpegNoMemory) {
+    sendPlain(500, "Out of memory for MJPEG");
+    return;
+  }
+  if (mjpegQueue.getReceived() == 0 && mjpegQueue.getDropped() == 0) {
+    sendPlain(400, "No MJPEG frames received");
+    return;
+  }
+  sendPlain(200, mjpegStats());
+}
+
+void handleMjpegStats() {
+  sendPlain(200, mjpegStats());
+}
+
+// ===== Panel transport stats =====
+// GET /panelStats[?reset=1]: traffic through PanelTransport since boot or
+// the last reset
+void handlePanelStats() {
+  String s = "dma:" + String(panel.usingDma() ? 1 : 0) + "\n";
+  s += "spi_mhz:" + String(panel.getClockHz() / 1000000) + "\n";
+  s += "bytes:" + String((uint32_t)panel.getBytes()) + "\n";
+  s += "bytes_per_sec:" + String(panel.getBytesPerSec()) + "\n";
+  s += "transactions:" + String(panel.getTransactions()) + "\n";
+  s += "windows:" + String(panel.getWindows()) + "\n";
+  s += "coalesced:" + String(panel.getCoalesced()) + "\n";
+  s += "stalls:" + String(panel.getStalls()) + "\n";
+  s += "stall_ms:" + String(panel.getStallUs() / 1000.0, 1);
+  if (server.arg("reset") == "1") {
+    panel.resetStats();
+  }
+  sendPlain(200, s);
+}
+
+// ===== Audio (DFPlayer Mini) =====
+// Every handler only queues; GET /audio/status shows how the commands went
+void handleAudioPlay() {
+  int track = server.arg("track").toInt();
+  if (track <= 0) {
+    sendPlain(400, "Missing track (1 = /MP3/0001.mp3)");
+    return;
+  }
+  if (!audio.post(AudioQueue::PLAY_TRACK, track)) {
+    sendPlain(503, "Audio queue full");
+    return;
+  }
+  sendPlain(200, "Playing track " + String(track));
+}
+
+void handleAudioVolume() {
+  if (!server.hasArg("v")) {
+    sendPlain(400, "Missing v (0-30)");
+    return;
+  }
+  int v = constrain(server.arg("v").toInt(), 0, 30);
+  if (!audio.post(AudioQueue::VOLUME, v)) {
+    sendPlain(503, "Audio queue full");
+    return;
+  }
+  sendPlain(200, "Volume " + String(v));
+}
+
+void postAudio(uint8_t cmd, const char* done) {
+  if (!audio.post(cmd, 0)) {
+    sendPlain(503, "Audio queue full");
+    return;
+  }
+  sendPlain(200, done);
+}
+
+void handleAudioStop() { postAudio(AudioQueue::STOP, "Stopped"); }
+void handleAudioPause() { postAudio(AudioQueue::PAUSE, "Paused"); }
+void handleAudioResume() { postAudio(AudioQueue::RESUME, "Resumed"); }
+
+// GET /audio/trigger?frame=F&track=T plays T whenever frame F (0 = first)
+// of a GIF or .pan animation is shown; ?clear=1 removes all triggers
+void handleAudioTrigger() {
+  if (server.arg("clear") == "1") {
+    audio.clearTriggers();
+  } else if (server.hasArg("frame")) {
+    int frame = server.arg("frame").toInt();
+    int track = server.arg("track").toInt();
+    if (frame < 0 || track <= 0) {
+      sendPlain(400, "Need frame >= 0 and track >= 1");
+      return;
+    }
+    if (!audio.addTrigger(frame, track)) {
+      sendPlain(400, "Too many triggers");
+      return;
+    }
+  }
+  String s = "triggers:" + String(audio.getTriggerCount());
+  for (int i = 0; i < audio.getTriggerCount(); ++i) {
+    s += "\nframe " + String(audio.getTriggerFrame(i)) + ": track " + String(audio.getTriggerTrack(i));
+  }
+  sendPlain(200, s);
+}
+
+// GET /audio/status[?reset=1]
+void handleAudioStatus() {
+  String s = "online:" + String(audio.isOnline() ? 1 : 0) + "\n";
+  s += "queued:" + String(audio.getQueued()) + "\n";
+  s += "posted:" + String(audio.getPosted()) + "\n";
+  s += "sent:" + String(audio.getSent()) + "\n";
+  s += "acked:" + String(audio.getAcked()) + "\n";
+  s += "retries:" + String(audio.getRetries()) + "\n";
+  s += "failed:" + String(audio.getFailed()) + "\n";
+  s += "dropped:" + String(audio.getDropped()) + "\n";
+  s += "last_error:" + String(audio.getLastError()) + "\n";
+  s += "last_finished:" + String(audio.getLastFinished()) + "\n";
+  s += "ack_ms:" + String(audio.getAvgAck() / 1000.0, 1) + "\n";
+  s += "triggers_fired:" + String(audio.getTriggersFired()) + "\n";
+  s += "triggers_late:" + String(audio.getTriggersLate()) + "\n";
+  s += "max_skew_ms:" + String(audio.getMaxSkew() / 1000.0, 1);
+  if (server.arg("reset") == "1") {
+    audio.resetStats();
+  }
+  sendPlain(200, s);
+}
+
 void handleDisplayText() {
-  String text = server.arg("text");
+  String text = commandArg("text");
   if (text.length() == 0) {
     sendPlain(400, "Missing text parameter");
     return;
   }
   
+  cpuBoost();
+  endDisplayTest();
   tft.fillScreen(ST77XX_BLACK);
   tft.setTextSize(3);
   tft.setTextColor(ST77XX_WHITE);
@@ -681,6 +1806,255 @@ void handleDisplayText() {
   sendPlain(200, "Text displayed");
 }
 
+// ===== Batch =====
+// The commands /batch can run, sorted by name for findCommand()
+const Command COMMANDS[] = {
+  {"display",      "mode",    handleDisplay,      true,  false},
+  {"displayImage", "preview", handleDisplayImage, true,  false},
+  {"displayText",  "text",    handleDisplayText,  true,  false},
+  {"off",          nullptr,   handleOff,          false, false},
+  {"on",           nullptr,   handleOn,           false, false},
+  {"playGif",      nullptr,   handlePlayGif,      true,  true},
+  {"stopGif",      nullptr,   handleStopGif,      false, false},
+};
+const int COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+// Index in COMMANDS of the command called name, or -1
+int findCommand(const String& name) {
+  int lo = 0;
+  int hi = COMMAND_COUNT - 1;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    int c = strcmp(name.c_str(), COMMANDS[mid].name);
+    if (c == 0) return mid;
+    if (c < 0) {
+      hi = mid - 1;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return -1;
+}
+
+// The running command's argument: its batch line's, or the query's
+String commandArg(const char* name) {
+  if (batchCurrent >= 0) return batch[batchCurrent].arg;
+  return server.arg(name);
+}
+
+// One command per line, "name [argument]", the argument being the rest of
+// the line. Fills batch[], or sets error and leaves nothing to run.
+bool parseBatch(const String& body, String& error) {
+  batchCount = 0;
+  unsigned int start = 0;
+  while (start < body.length()) {
+    int end = body.indexOf('\n', start);
+    if (end < 0) end = body.length();
+    String line = body.substring(start, end);
+    start = end + 1;
+    line.trim();
+    if (line.length() == 0) continue;
+    
+    int space = line.indexOf(' ');
+    String name = space < 0 ? line : line.substring(0, space);
+    String arg = space < 0 ? String("") : line.substring(space + 1);
+    arg.trim();
+    int c = findCommand(name);
+    if (c < 0) {
+      error = "Unknown command: " + name;
+      return false;
+    }
+    if (COMMANDS[c].arg == nullptr && arg.length() > 0) {
+      error = name + " takes no argument";
+      return false;
+    }
+    if (batchCount == BATCH_MAX) {
+      error = "More than " + String(BATCH_MAX) + " commands";
+      return false;
+    }
+    if (batchCount > 0 && COMMANDS[batch[batchCount - 1].command].runsOn) {
+      error = String(COMMANDS[batch[batchCount - 1].command].name) + " must be the last command";
+      return false;
+    }
+    BatchEntry& e = batch[batchCount++];
+    e.command = c;
+    e.arg = arg;
+    e.code = 0;
+    e.reply = "";
+    e.us = 0;
+  }
+  if (batchCount == 0) {
+    error = "No commands";
+    return false;
+  }
+  return true;
+}
+
+// sendPlain() while a batch runs: the reply goes into the batch's response
+void batchReply(int code, const String& body) {
+  BatchEntry& e = batch[batchCurrent];
+  e.code = code;
+  e.reply = body;
+  e.us = micros() - batchStartUs;
+  if (COMMANDS[e.command].runsOn) sendBatch(); // before it plays on
+}
+
+// Totals, then "index name code time reply" for each command. Commands
+// after one that failed did not run and show code 0.
+void sendBatch() {
+  int code = 200;
+  int failed = 0;
+  int skipped = 0;
+  String lines;
+  for (int i = 0; i < batchCount; i++) {
+    const BatchEntry& e = batch[i];
+    lines += "\n" + String(i) + " " + COMMANDS[e.command].name + " " + String(e.code);
+    if (e.code == 0) {
+      skipped++;
+      lines += " - skipped";
+      continue;
+    }
+    lines += " " + String(e.us) + "us " + e.reply;
+    if (e.code != 200) {
+      failed++;
+      code = e.code;
+    }
+  }
+  String s = "commands:" + String(batchCount) + "\n";
+  s += "failed:" + String(failed) + "\n";
+  s += "skipped:" + String(skipped) + "\n";
+  s += "total_us:" + String((uint32_t)(micros() - batchBeginUs));
+  s += lines;
+  batchCurrent = -1;
+  if (batchLocal) {
+    batchLocal = false;
+    Serial.println(s);
+    return;
+  }
+  sendPlain(code, s);
+}
+
+// POST /batch, e.g. "on\ndisplay smiley\ndisplayText Hello". The body is
+// checked before anything runs. The commands then run in order through
+// their usual handlers, with no GIF frame or other request in between,
+// and the first one that fails ends the batch. playGif may only come
+// last: the response goes out before it starts playing.
+void handleBatch() {
+  String error;
+  if (!parseBatch(server.arg("plain"), error)) {
+    sendPlain(400, error);
+    return;
+  }
+  for (int i = 0; i < batchCount; i++) {
+    if (COMMANDS[batch[i].command].draws) isPlayingGif = false; // the batch owns the panel
+  }
+  
+  batchBeginUs = micros();
+  for (int i = 0; i < batchCount; i++) {
+    const Command& c = COMMANDS[batch[i].command];
+    batchCurrent = i;
+    batchStartUs = micros();
+    c.handler();
+    if (c.runsOn) return; // already answered from batchReply()
+    if (batch[i].code != 200) break;
+  }
+  sendBatch();
+}
+
+// Runs one command from COMMANDS outside a request, as a batch of one
+// whose response is logged
+void runCommand(const char* name, const char* arg) {
+  int c = findCommand(name);
+  if (c < 0) return;
+  if (COMMANDS[c].draws) isPlayingGif = false;
+  BatchEntry& e = batch[0];
+  e.command = c;
+  e.arg = arg;
+  e.code = 0;
+  e.reply = "";
+  e.us = 0;
+  batchCount = 1;
+  batchLocal = true;
+  batchBeginUs = batchStartUs = micros();
+  batchCurrent = 0;
+  COMMANDS[c].handler();
+  if (!COMMANDS[c].runsOn) sendBatch();
+}
+
+// ===== Rules =====
+void ruleAction(uint8_t action) {
+  const RuleAction& a = RULE_ACTION_TABLE[action];
+  Serial.println(String("Rule action: ") + a.name);
+  runCommand(a.command, a.arg);
+}
+
+void loadRules() {
+  for (int i = 0; i < RULE_ACTION_COUNT; i++) ruleActionNames[i] = RULE_ACTION_TABLE[i].name;
+  rules.begin(ruleActionNames, RULE_ACTION_COUNT);
+  uint8_t program[RULE_MAX * sizeof(Rule)];
+  size_t len = 0;
+  prefs.begin("rules", true);
+  if (prefs.getUChar("format", 0) == RULE_FORMAT && prefs.isKey("program")) {
+    len = prefs.getBytes("program", program, sizeof(program));
+  }
+  prefs.end();
+  if (len > 0 && !rules.load(program, len)) {
+    Serial.println("Stored rules do not load, ignored");
+  } else if (rules.getRuleCount() > 0) {
+    Serial.println("Rules: " + String(rules.getRuleCount()));
+  }
+}
+
+// Called from loop() and the animation loops: samples the sensors every
+// RULE_SAMPLE_MS and runs the rules. Without rules nothing is read.
+void rulesStep() {
+  if (rules.getRuleCount() == 0 || millis() - rulesSampledAt < RULE_SAMPLE_MS) return;
+  rulesSampledAt = millis();
+  rules.sample(RULE_TEMP, dht.readTemperature());
+  rules.sample(RULE_HUMIDITY, dht.readHumidity());
+  float lux = lightMeter.readLightLevel();
+  rules.sample(RULE_LIGHT, lux >= 0 ? lux : NAN);
+  rules.evaluate(rulesSampledAt, ruleAction);
+}
+
+// POST /rules with one rule per line (see RuleEngine.h) replaces them; an
+// empty body removes them. GET /rules[?reset=1] lists them, compiled back,
+// with their state and the counters.
+void handleRules() {
+  if (server.method() == HTTP_POST) {
+    String error;
+    if (!rules.compile(server.arg("plain"), error)) {
+      sendPlain(400, error);
+      return;
+    }
+    prefs.begin("rules", false);
+    prefs.putUChar("format", RULE_FORMAT);
+    if (rules.programSize() > 0) {
+      prefs.putBytes("program", rules.program(), rules.programSize());
+    } else {
+      prefs.remove("program");
+    }
+    prefs.end();
+    rulesSampledAt = millis() - RULE_SAMPLE_MS; // first sample on the next loop()
+  }
+  String s = "rules:" + String(rules.getRuleCount()) + "\n";
+  s += "program_bytes:" + String(rules.programSize()) + "\n";
+  s += "sample_ms:" + String(RULE_SAMPLE_MS) + "\n";
+  s += "samples:" + String(rules.getSamples()) + "\n";
+  s += "evaluations:" + String(rules.getEvaluations()) + "\n";
+  s += "fired:" + String(rules.getFired()) + "\n";
+  s += "cleared:" + String(rules.getCleared()) + "\n";
+  s += "eval_us:" + String(rules.getLastEvalUs()) + "\n";
+  s += "max_eval_us:" + String(rules.getMaxEvalUs());
+  for (int i = 0; i < rules.getRuleCount(); i++) {
+    s += "\n" + String(i) + (rules.isActive(i) ? " active " : " idle ") + rules.describe(i);
+  }
+  if (server.arg("reset") == "1") {
+    rules.resetStats();
+  }
+  sendPlain(200, s);
+}
+
 void startWebServer() {
   server.on("/", handleRoot);
   server.on("/on", handleOn);
@@ -692,23 +2066,44 @@ void startWebServer() {
   server.on("/imageChunk", handleImageChunk);
   server.on("/displayImage", handleDisplayImage);
   server.on("/displayText", handleDisplayText);
+
+  // Audio - queued, never waits on the DFPlayer
+  server.on("/audio/play", handleAudioPlay);
+  server.on("/audio/stop", handleAudioStop);
+  server.on("/audio/pause", handleAudioPause);
+  server.on("/audio/resume", handleAudioResume);
+  server.on("/audio/volume", handleAudioVolume);
+  server.on("/audio/trigger", handleAudioTrigger);
+  server.on("/audio/status", handleAudioStatus);
+  server.on("/power", handlePower);
+  server.on("/relay", handleRelay);
+  server.on("/rules", handleRules);
   
   // GIF endpoints - support both GET and POST
   server.on("/gifChunk", HTTP_GET, handleGifChunk);
   server.on("/gifChunk", HTTP_POST, handleGifChunk);
   server.on("/playGif", handlePlayGif);
   server.on("/stopGif", handleStopGif);
+  server.on("/batch", HTTP_POST, handleBatch);
+
+  // MJPEG streaming - raw POST body
+  server.on("/mjpeg", HTTP_POST, handleMjpeg, handleMjpegUpload);
+  server.on("/mjpegStats", handleMjpegStats);
+  server.on("/panelStats", handlePanelStats);
+  server.on("/save", HTTP_POST, handleSave);
   
   server.on("/reset", [](){
     prefs.begin("wifi", false);
     prefs.clear();
     prefs.end();
+    clearWifiCache();
     sendPlain(200, "Resetting...");
     delay(500);
     ESP.restart();
   });
   
   server.begin();
+  servingMs = millis();
   Serial.println("Webserver started with JPEGDEC + AnimatedGIF");
 }
 
@@ -735,14 +2130,18 @@ void handleSave() {
   prefs.putString("ssid", ssid);
   prefs.putString("pass", pass);
   prefs.end();
+  clearWifiCache(); // the cached AP belongs to the old network
   server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(200, "text/html", "Saved. Rebooting...");
   delay(500);
   ESP.restart();
 }
 
-void startAP() {
-  WiFi.mode(WIFI_AP);
+// The setup AP and its captive portal. Up for the whole join as well as in
+// provisioning, so wrong credentials can be replaced without waiting out
+// FULL_JOIN_TIMEOUT_MS.
+void startPortal() {
+  if (portalUp) return;
   IPAddress apIP(192,168,4,1);
   IPAddress gateway = apIP;
   IPAddress subnet(255,255,255,0);
@@ -750,51 +2149,135 @@ void startAP() {
   WiFi.softAP(apSSID);
   dnsServer.start(53, "*", apIP);
   Serial.print("AP '"); Serial.print(apSSID); Serial.print("' IP: "); Serial.println(WiFi.softAPIP());
-  server.on("/", handleRootAP);
-  server.on("/save", HTTP_POST, handleSave);
-  server.begin();
+  portalUp = true;
+  if (govPm) {
+    esp_pm_lock_acquire(govAwakeLock); // the soft AP cannot sleep
+  }
+}
+
+// Once joined: the station alone from here on
+void stopPortal() {
+  if (!portalUp) return;
+  dnsServer.stop();
+  WiFi.softAPdisconnect();
+  WiFi.mode(WIFI_STA);
+  portalUp = false;
+  if (govPm) {
+    esp_pm_lock_release(govAwakeLock);
+  }
+}
+
+void startAP() {
+  WiFi.disconnect();
+  WiFi.mode(WIFI_AP);
+  startPortal();
+  wifiBoot = WIFI_BOOT_PROVISIONING;
+  joinMethod = "ap";
+}
+
+bool loadWifiCache(WifiCache &c) {
+  prefs.begin("wifiCache", true);
+  size_t n = prefs.getBytes("net", &c, sizeof(c));
+  prefs.end();
+  return n == sizeof(c) && c.channel > 0;
+}
+
+// Called once connected; only writes when something changed, so NVS is
+// not written on every boot
+void saveWifiCache() {
+  WifiCache c;
+  memset(&c, 0, sizeof(c));
+  memcpy(c.bssid, WiFi.BSSID(), 6);
+  c.channel = WiFi.channel();
+  WifiCache old;
+  if (loadWifiCache(old) && memcmp(&old, &c, sizeof(c)) == 0) return;
+  prefs.begin("wifiCache", false);
+  prefs.putBytes("net", &c, sizeof(c));
+  prefs.end();
+  Serial.println("Saved AP for fast reconnect");
 }
 
-void tryConnectFromPreferences() {
+void clearWifiCache() {
+  prefs.begin("wifiCache", false);
+  prefs.clear();
+  prefs.end();
+}
+
+// Starts joining the stored network, or the setup AP if there is none.
+// The join goes on in the background; wifiBootStep() follows it.
+void startWiFi() {
   prefs.begin("wifi", true);
   storedSSID = prefs.getString("ssid", "");
   storedPass = prefs.getString("pass", "");
   prefs.end();
 
-  if (storedSSID.length() > 0) {
-    Serial.print("Found stored SSID: "); Serial.println(storedSSID);
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
-    unsigned long start = millis();
-    const unsigned long timeout = 20000;
-    while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(200);
-      digitalWrite(LED_PIN, LOW);
-      delay(300);
-      Serial.print('.');
-    }
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println();
-      Serial.print("Connected, IP: "); Serial.println(WiFi.localIP());
-      startWebServer();
-    } else {
-      Serial.println();
-      Serial.println("Failed to connect, starting AP");
-      startAP();
-    }
+  if (storedSSID.length() == 0) {
+    startAP();
+    return;
+  }
+  Serial.print("Found stored SSID: "); Serial.println(storedSSID);
+  // The portal's AP comes up next to the station, so the device can be
+  // reached while the station has no address yet
+  WiFi.mode(WIFI_AP_STA);
+  startPortal();
+  joinStartMs = wifiBootStart = millis();
+  WifiCache cache;
+  if (loadWifiCache(cache)) {
+    // straight to the cached AP on its channel
+    WiFi.begin(storedSSID.c_str(), storedPass.c_str(), cache.channel, cache.bssid);
+    wifiBoot = WIFI_BOOT_FAST;
   } else {
+    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
+    wifiBoot = WIFI_BOOT_FULL;
+  }
+}
+
+void wifiBootStep() {
+  if (wifiBoot != WIFI_BOOT_FAST && wifiBoot != WIFI_BOOT_FULL) return;
+  wl_status_t st = WiFi.status();
+  unsigned long elapsed = millis() - wifiBootStart;
+  if (st == WL_CONNECTED) {
+    joinMethod = wifiBoot == WIFI_BOOT_FAST ? "fast" : "full";
+    joinMs = millis() - joinStartMs;
+    wifiBoot = WIFI_BOOT_ONLINE;
+    digitalWrite(LED_PIN, LOW);
+    Serial.print("Connected ("); Serial.print(joinMethod); Serial.print(", ");
+    Serial.print(joinMs); Serial.print(" ms), IP: "); Serial.println(WiFi.localIP());
+    saveWifiCache();
+    stopPortal();
+    startRelay();
+    return;
+  }
+  if (wifiBoot == WIFI_BOOT_FAST &&
+      (elapsed >= FAST_JOIN_TIMEOUT_MS || st == WL_NO_SSID_AVAIL || st == WL_CONNECT_FAILED)) {
+    Serial.println("Cached AP did not answer, scanning");
+    WiFi.disconnect();
+    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
+    wifiBoot = WIFI_BOOT_FULL;
+    wifiBootStart = millis();
+    return;
+  }
+  if (wifiBoot == WIFI_BOOT_FULL && elapsed >= FULL_JOIN_TIMEOUT_MS) {
+    Serial.println("Failed to connect, starting AP");
+    digitalWrite(LED_PIN, LOW);
     startAP();
+    return;
   }
+  digitalWrite(LED_PIN, elapsed % 500 < 200 ? HIGH : LOW); // blink while joining
+}
+
+void bootStep() {
+  displayBootStep();
+  wifiBootStep();
 }
 
 void setup() {
   pinMode(LED_PIN, OUTPUT);
   digitalWrite(LED_PIN, LOW);
   Serial.begin(115200);
-  delay(1000);
   Serial.println("--- ESP32 with JPEGDEC Image Display ---");
   
+  initGovernor();
   initDisplay();
   dht.begin();
 
@@ -805,6 +2288,12 @@ void setup() {
   } else {
     Serial.println("ERROR: BH1750 initialization failed!");
   }
+
+  if (audio.begin(Serial2, AUDIO_RX_PIN, AUDIO_TX_PIN, 0)) {
+    Serial.println("DFPlayer queue started on UART2 (RX=32, TX=27)");
+  } else {
+    Serial.println("ERROR: DFPlayer queue could not start");
+  }
   
   Serial.println("DHT22 initialized");
   Serial.print("Total heap: ");
@@ -812,12 +2301,21 @@ void setup() {
   Serial.print("Free heap: ");
   Serial.println(ESP.getFreeHeap());
   
-  tryConnectFromPreferences();
+  loadRelay(); // ESP-NOW starts once the station is online
+  loadRules();
+  
+  // Nothing here waits: the display test and the join finish in loop()
+  startWiFi();
+  startWebServer();
 }
 
 void loop() {
   server.handleClient();
-  if (WiFi.getMode() == WIFI_AP) {
+  if (portalUp) {
     dnsServer.processNextRequest();
   }
+  bootStep();
+  relayStep();
+  rulesStep();
+  governorStep();
 }
\ No newline at end of file
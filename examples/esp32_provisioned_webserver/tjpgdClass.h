@@ -1,790 +1,842 @@
-/*
-  ESP32 with JPEGDEC + AnimatedGIF Display
-  
-  Features:
-  1. JPEGDEC for fast static image display
-  2. AnimatedGIF for smooth GIF playback (10+ FPS)
-  3. Optimized memory usage
-  4. Auto-scaling for any image/GIF size
-  
-  Install:
-  - Arduino Library Manager -> "JPEGDEC" by bitbank2
-  - Arduino Library Manager -> "AnimatedGIF" by bitbank2 (v2.2.0+)
-*/
-
-#include <WiFi.h>
-#include <WebServer.h>
-#include <Preferences.h>
-#include <DNSServer.h>
-#include <DHT.h>
-#include <Adafruit_GFX.h>
-#include <Adafruit_ST7789.h>
-#include <SPI.h>
-#include <JPEGDEC.h>
-#include <AnimatedGIF.h>
-
-const char* apSSID = "ESP32-Setup";
-const int LED_PIN = 2;
-const int DHT_PIN = 14;
-#define DHT_TYPE DHT22
-
-// TFT Display pins (ST7789 - 240x320)
-#define TFT_CS    5
-#define TFT_DC    16
-#define TFT_RST   17
-
-WebServer server(80);
-DNSServer dnsServer;
-Preferences prefs;
-DHT dht(DHT_PIN, DHT_TYPE);
-Adafruit_ST7789 tft = Adafruit_ST7789(TFT_CS, TFT_DC, TFT_RST);
-
-String storedSSID = "";
-String storedPass = "";
-
-// Image buffers
-uint8_t* jpegBuffer = nullptr;
-int jpegBufferSize = 0;
-const int MAX_JPEG_SIZE = 80000; // 80KB max
-
-// GIF buffer
-uint8_t* gifBuffer = nullptr;
-int gifBufferSize = 0;
-const int MAX_GIF_SIZE = 150000; // 150KB max for GIFs (reduced for memory constraints)
-bool isPlayingGif = false;
-
-// JPEGDEC instance
-JPEGDEC jpeg;
-
-// AnimatedGIF instance
-AnimatedGIF gif;
-
-// ===== JPEGDEC Callback Function =====
-int JPEGDraw(JPEGDRAW *pDraw) {
-  tft.startWrite();
-  tft.setAddrWindow(pDraw->x, pDraw->y, pDraw->iWidth, pDraw->iHeight);
-  tft.writePixels((uint16_t*)pDraw->pPixels, pDraw->iWidth * pDraw->iHeight);
-  tft.endWrite();
-  return 1;
-}
-
-// ===== AnimatedGIF Callback Function =====
-void GIFDraw(GIFDRAW *pDraw) {
-  uint8_t *s;
-  uint16_t *usPalette, usTemp[320];
-  int x, y, iWidth;
-
-  iWidth = pDraw->iWidth;
-  if (iWidth > 320) iWidth = 320;
-  
-  usPalette = pDraw->pPalette;
-  y = pDraw->iY + pDraw->y; // current line
-  
-  // Skip lines outside display area
-  if (y >= 240) return;
-  
-  s = pDraw->pPixels;
-  
-  // Simplified rendering - ignore transparency for speed
-  // Convert palette indices to RGB565 colors
-  for (x = 0; x < iWidth; x++) {
-    usTemp[x] = usPalette[s[x]];
-  }
-  
-  // Fast bulk write to display
-  tft.startWrite();
-  tft.setAddrWindow(pDraw->iX, y, iWidth, 1);
-  tft.writePixels(usTemp, iWidth);
-  tft.endWrite();
-}
-
-// ===== TFT Display Functions =====
-void initDisplay() {
-  Serial.println("Initializing TFT display...");
-  
-  tft.init(240, 320);
-  tft.setRotation(1); // Landscape mode (320x240)
-  
-  // Quick color test
-  tft.fillScreen(ST77XX_RED);
-  delay(500);
-  tft.fillScreen(ST77XX_GREEN);
-  delay(500);
-  tft.fillScreen(ST77XX_BLUE);
-  delay(500);
-  tft.fillScreen(ST77XX_BLACK);
-  
-  tft.setTextColor(ST77XX_WHITE);
-  tft.setTextSize(4);
-  tft.setCursor(30, 80);
-  tft.println("READY!");
-  
-  Serial.println("TFT Display initialized");
-  delay(2000);
-}
-
-void updateDisplay() {
-  Serial.println("Updating display...");
-  tft.fillScreen(ST77XX_BLACK);
-  
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
-  
-  tft.setTextSize(3);
-  tft.setTextColor(ST77XX_CYAN);
-  tft.setCursor(10, 10);
-  tft.println("DHT22");
-  
-  tft.setTextSize(2);
-  tft.setCursor(10, 60);
-  if (!isnan(t)) {
-    tft.setTextColor(ST77XX_GREEN);
-    tft.print("Temp: ");
-    tft.print(t, 1);
-    tft.println(" C");
-  } else {
-    tft.setTextColor(ST77XX_RED);
-    tft.println("Temp: ERROR");
+#ifndef _TJPGDCLASS_H_
+#define _TJPGDCLASS_H_
+#pragma GCC optimize("O3")
+
+/*----------------------------------------------------------------------------/
+/ TJpgD - Tiny JPEG Decompressor, class edition used by MjpegClass
+/-----------------------------------------------------------------------------/
+/ Baseline (SOF0) only. Supports grayscale and YCbCr with luma sampling
+/ 1x1, 2x1, 1x2 and 2x2, restart intervals and 1/2, 1/4, 1/8 output scaling.
+/ Output is RGB888, one MCU at a time, through the output callback; the line
+/ callback is invoked once every MCU row has been output.
+/----------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+class TJpgD
+{
+public:
+  enum JRESULT
+  {
+    JDR_OK = 0, // Succeeded
+    JDR_INTR,   // Interrupted by output function
+    JDR_INP,    // Device error or wrong termination of input stream
+    JDR_MEM1,   // Insufficient memory pool for the image
+    JDR_MEM2,   // Insufficient stream input buffer
+    JDR_PAR,    // Parameter error
+    JDR_FMT1,   // Data format error (may be damaged data)
+    JDR_FMT2,   // Right format but not supported
+    JDR_FMT3    // Not supported JPEG standard
+  };
+
+  struct JRECT
+  {
+    uint_fast16_t left, right, top, bottom;
+  };
+
+  typedef uint32_t (*input_func_t)(TJpgD *jdec, uint8_t *buf, uint32_t len);
+  typedef uint32_t (*output_func_t)(TJpgD *jdec, void *bitmap, JRECT *rect);
+  typedef uint32_t (*line_func_t)(TJpgD *jdec, uint32_t y, uint32_t h);
+
+  uint16_t width = 0;  // Size of the input image (pixel)
+  uint16_t height = 0;
+  uint8_t msx = 1;     // MCU size in unit of block (width, height)
+  uint8_t msy = 1;
+  uint8_t ncomp = 0;   // Number of color components 1:grayscale, 3:color
+  uint16_t nrst = 0;   // Restart interval (MCUs), 0 when not used
+  void *device = nullptr; // Pointer to I/O device identifier for the session
+
+  JRESULT prepare(input_func_t infunc, void *dev)
+  {
+    if (!infunc)
+      return JDR_PAR;
+    _infunc = infunc;
+    device = dev;
+    _dctr = 0;
+    _dptr = 0;
+    _eof = false;
+    nrst = 0;
+    width = height = 0;
+    ncomp = 0;
+    memset(_hvalid, 0, sizeof(_hvalid));
+    memset(_qvalid, 0, sizeof(_qvalid));
+
+    if (getByte() != 0xFF || getByte() != 0xD8)
+      return JDR_FMT1; // Not a JPEG (no SOI)
+
+    for (;;)
+    {
+      int c = getByte();
+      if (c < 0)
+        return JDR_INP;
+      if (c != 0xFF)
+        return JDR_FMT1;
+      int marker;
+      do
+      {
+        marker = getByte();
+      } while (marker == 0xFF);
+      if (marker < 0)
+        return JDR_INP;
+
+      int len = getWord();
+      if (len < 2)
+        return JDR_FMT1;
+      len -= 2;
+
+      JRESULT res = JDR_OK;
+      switch (marker)
+      {
+      case 0xC0: // SOF0 (baseline)
+        res = parseSOF(len);
+        break;
+      case 0xC4: // DHT
+        res = parseDHT(len);
+        break;
+      case 0xDB: // DQT
+        res = parseDQT(len);
+        break;
+      case 0xDD: // DRI
+        nrst = getWord();
+        len -= 2;
+        while (len-- > 0)
+          getByte();
+        break;
+      case 0xDA: // SOS
+        res = parseSOS(len);
+        if (res != JDR_OK)
+          return res;
+        return finishPrepare();
+      case 0xC1: case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+      case 0xD9:
+        return JDR_FMT3; // Unsupported JPEG process or early EOI
+      default: // APPn, COM and others
+        while (len-- > 0)
+        {
+          if (getByte() < 0)
+            return JDR_INP;
+        }
+        break;
+      }
+      if (res != JDR_OK)
+        return res;
+    }
   }
-  
-  tft.setCursor(10, 100);
-  if (!isnan(h)) {
-    tft.setTextColor(ST77XX_GREEN);
-    tft.print("Humid: ");
-    tft.print(h, 1);
-    tft.println(" %");
-  } else {
-    tft.setTextColor(ST77XX_RED);
-    tft.println("Humid: ERROR");
+
+  JRESULT decomp(output_func_t outfunc, line_func_t linefunc, uint8_t scale = 0)
+  {
+    if (scale > 3 || !width)
+      return JDR_PAR;
+    return decompRows(outfunc, linefunc, scale, 0, mcuRows());
   }
-  
-  tft.setTextSize(1);
-  tft.setTextColor(ST77XX_YELLOW);
-  tft.setCursor(10, 150);
-  if (WiFi.status() == WL_CONNECTED) {
-    tft.print("WiFi: ");
-    tft.println(WiFi.localIP());
-  } else if (WiFi.getMode() == WIFI_AP) {
-    tft.println("WiFi: AP Mode");
-  } else {
-    tft.println("WiFi: Disconnected");
+
+  // MCU rows in the prepared image
+  uint32_t mcuRows() const
+  {
+    return (height + msy * 8 - 1) / (msy * 8);
   }
-  
-  tft.setCursor(10, 170);
-  tft.setTextColor(ST77XX_WHITE);
-  tft.print("LED: ");
-  tft.println(digitalRead(LED_PIN) ? "ON" : "OFF");
-}
-
-// ===== Base64 Decoder =====
-uint8_t base64DecodeChar(char c) {
-  if (c >= 'A' && c <= 'Z') return c - 'A';
-  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
-  if (c >= '0' && c <= '9') return c - '0' + 52;
-  if (c == '+') return 62;
-  if (c == '/') return 63;
-  return 0;
-}
-
-int base64Decode(const String& input, uint8_t* output, int maxLen) {
-  int outLen = 0;
-  int val = 0;
-  int valb = -8;
-  
-  for (int i = 0; i < input.length() && outLen < maxLen; i++) {
-    char c = input[i];
-    if (c == '=') break;
-    if (c == ' ' || c == '\n' || c == '\r') continue;
-    
-    val = (val << 6) | base64DecodeChar(c);
-    valb += 6;
-    
-    if (valb >= 0) {
-      output[outLen++] = (val >> valb) & 0xFF;
-      valb -= 8;
+
+  // Restart intervals make the image decodable in independent slices. For
+  // a prepared image held in memory, finds the RSTn marker that starts an
+  // MCU row and lies closest to the middle of the entropy-coded data.
+  // Returns its offset in jpg and sets row to the first MCU row after it,
+  // or -1 when there is no such marker (no restart interval, markers out
+  // of sequence, or the image is a single MCU row).
+  int32_t findRestartSplit(const uint8_t *jpg, int32_t len, uint32_t &row) const
+  {
+    const uint32_t mcusPerRow = (width + msx * 8 - 1) / (msx * 8);
+    if (!nrst || !width)
+      return -1;
+    // Skip marker segments up to the end of the SOS header
+    int32_t pos = 2;
+    for (;;)
+    {
+      if (pos + 4 > len || jpg[pos] != 0xFF)
+        return -1;
+      uint8_t m = jpg[pos + 1];
+      pos += 2 + (jpg[pos + 2] << 8 | jpg[pos + 3]);
+      if (m == 0xDA)
+        break;
     }
+    const int32_t mid = pos + (len - pos) / 2;
+    int32_t best = -1;
+    uint32_t bestRow = 0, interval = 0;
+    while (pos + 1 < len)
+    {
+      const uint8_t *ff = (const uint8_t *)memchr(jpg + pos, 0xFF, len - 1 - pos);
+      if (!ff)
+        break;
+      pos = ff - jpg;
+      uint8_t m = jpg[pos + 1];
+      if (m < 0xD0 || m > 0xD7)
+      {
+        if (m != 0x00 && m != 0xFF)
+          break; // EOI or anything else ends the scan
+        pos += (m == 0x00) ? 2 : 1;
+        continue;
+      }
+      if (m != 0xD0 + (interval & 7))
+        return -1;
+      uint32_t mcu = ++interval * nrst;
+      if (mcu % mcusPerRow == 0 && mcu / mcusPerRow < mcuRows())
+      {
+        if (best < 0 || abs(pos - mid) < abs(best - mid))
+        {
+          best = pos;
+          bestRow = mcu / mcusPerRow;
+        }
+        if (pos > mid)
+          break; // later markers are only further away
+      }
+      pos += 2;
+    }
+    row = bestRow;
+    return best;
   }
-  return outLen;
-}
-
-// ===== Helper function to decode and display a JPEG frame =====
-bool decodeJPEGFrame(uint8_t* buffer, int size, int offsetX = 0, int offsetY = 0) {
-  int result = jpeg.openRAM(buffer, size, JPEGDraw);
-  
-  if (result != 1) {
-    return false;
-  }
-  
-  int width = jpeg.getWidth();
-  int height = jpeg.getHeight();
-  
-  // Calculate scale
-  int scale = 1;
-  if (width > 320 || height > 240) {
-    int scaleW = (width + 319) / 320;
-    int scaleH = (height + 239) / 240;
-    scale = max(scaleW, scaleH);
-    if (scale > 8) scale = 8;
+
+  // Point a copy of a prepared decoder at another position in the same
+  // image: infunc must deliver the stream from the RSTn marker found by
+  // findRestartSplit(). decompSlice() then decodes from that row on while
+  // the original decodes the rows above it.
+  void rewind(input_func_t infunc, void *dev)
+  {
+    _infunc = infunc;
+    device = dev;
+    _dctr = 0;
+    _dptr = 0;
+    _eof = false;
+    resetEntropy();
   }
-  
-  // Center on display
-  if (scale > 1) {
-    width /= scale;
-    height /= scale;
+
+  // Decode MCU rows [rowBegin, rowEnd) only; the input must be positioned
+  // at rowBegin (right after prepare() for row 0, see rewind() otherwise)
+  JRESULT decompSlice(output_func_t outfunc, line_func_t linefunc, uint8_t scale, uint32_t rowBegin, uint32_t rowEnd)
+  {
+    if (scale > 3 || !width || rowBegin > rowEnd || rowEnd > mcuRows())
+      return JDR_PAR;
+    return decompRows(outfunc, linefunc, scale, rowBegin, rowEnd);
   }
-  int x = offsetX + (320 - width) / 2;
-  int y = offsetY + (240 - height) / 2;
-  if (x < 0) x = 0;
-  if (y < 0) y = 0;
-  
-  result = jpeg.decode(x, y, scale > 1 ? JPEG_SCALE_HALF : 0);
-  jpeg.close();
-  
-  return (result == 1);
-}
-
-// ===== Web Server Handlers =====
-void sendPlain(int code, const String &body) {
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.send(code, "text/plain", body);
-}
-
-void handleRoot() {
-  sendPlain(200, "ESP32 ready with JPEGDEC + AnimatedGIF");
-}
-
-void handleOn() {
-  digitalWrite(LED_PIN, HIGH);
-  sendPlain(200, "ON");
-}
-
-void handleOff() {
-  digitalWrite(LED_PIN, LOW);
-  sendPlain(200, "OFF");
-}
-
-void handleStatus() {
-  String s = "mode:";
-  s += (WiFi.getMode() == WIFI_AP) ? "AP" : "STA";
-  s += "\n";
-  if (WiFi.status() == WL_CONNECTED) {
-    s += "ip: " + WiFi.localIP().toString();
-  } else {
-    s += "not connected";
+
+private:
+  static const int FAST_BITS = 9;
+  static const int INBUF_SIZE = 512;
+
+  struct Huff
+  {
+    uint16_t fast[1 << FAST_BITS]; // (length << 8 | value), 0 when longer than FAST_BITS
+    int32_t maxcode[18];
+    int32_t valptr[17];
+    uint16_t mincode[17];
+    uint8_t vals[256];
+  };
+
+  input_func_t _infunc = nullptr;
+  uint8_t _inbuf[INBUF_SIZE];
+  uint32_t _dptr = 0;
+  uint32_t _dctr = 0;
+  bool _eof = false;
+
+  uint32_t _bitbuf = 0;
+  int _bitcnt = 0;
+  int _marker = 0; // marker hit inside entropy data
+
+  Huff _huff[2][2]; // [dc/ac][table id]
+  bool _hvalid[2][2];
+  int32_t _qtbl[4][64]; // natural order
+  bool _qvalid[4];
+
+  uint8_t _compId[3];
+  uint8_t _qsel[3];
+  uint8_t _dcsel[3];
+  uint8_t _acsel[3];
+  int32_t _dcpred[3];
+
+  int16_t _coef[64];
+  uint8_t _blk[6][64];              // decoded blocks of the current MCU
+  uint8_t _rgb[16 * 16 * 3];        // RGB888 output of the current MCU
+
+  static const uint8_t *zigzag()
+  {
+    static const uint8_t zz[64 + 16] = {
+      0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+      12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+      35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+      58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+      // overrun guard for corrupt run lengths
+      63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63, 63
+    };
+    return zz;
   }
-  sendPlain(200, s);
-}
-
-void handleDHT() {
-  float h = dht.readHumidity();
-  float t = dht.readTemperature();
-  
-  if (isnan(h) || isnan(t)) {
-    sendPlain(500, "Failed to read from DHT sensor");
-    return;
+
+  int getByte()
+  {
+    if (!_dctr)
+    {
+      if (_eof)
+        return -1;
+      _dptr = 0;
+      _dctr = _infunc(this, _inbuf, INBUF_SIZE);
+      if (!_dctr)
+      {
+        _eof = true;
+        return -1;
+      }
+    }
+    --_dctr;
+    return _inbuf[_dptr++];
   }
-  
-  String response = "temperature:" + String(t, 1) + "\n";
-  response += "humidity:" + String(h, 1);
-  sendPlain(200, response);
-}
-
-void handleDisplay() {
-  String mode = server.arg("mode");
-  
-  if (mode == "smiley") {
-    displaySmiley();
-    sendPlain(200, "Displaying smiley");
-  } else if (mode == "heart") {
-    displayHeart();
-    sendPlain(200, "Displaying heart");
-  } else if (mode == "alert") {
-    displayAlert();
-    sendPlain(200, "Displaying alert");
-  } else if (mode == "data") {
-    updateDisplay();
-    sendPlain(200, "Displaying sensor data");
-  } else {
-    sendPlain(400, "Unknown mode");
+
+  int getWord()
+  {
+    int hi = getByte();
+    int lo = getByte();
+    if (hi < 0 || lo < 0)
+      return -1;
+    return (hi << 8) | lo;
   }
-}
-
-void displaySmiley() {
-  tft.fillScreen(ST77XX_BLACK);
-  tft.fillCircle(160, 120, 80, ST77XX_YELLOW);
-  tft.fillCircle(130, 100, 10, ST77XX_BLACK);
-  tft.fillCircle(190, 100, 10, ST77XX_BLACK);
-  for (int i = 0; i < 180; i += 5) {
-    float angle1 = (i * 3.14159) / 180.0;
-    float angle2 = ((i + 5) * 3.14159) / 180.0;
-    int x1 = 160 + 50 * cos(angle1);
-    int y1 = 120 + 30 * sin(angle1);
-    int x2 = 160 + 50 * cos(angle2);
-    int y2 = 120 + 30 * sin(angle2);
-    tft.drawLine(x1, y1, x2, y2, ST77XX_BLACK);
+
+  JRESULT parseSOF(int len)
+  {
+    if (len < 6)
+      return JDR_FMT1;
+    if (getByte() != 8)
+      return JDR_FMT3; // 12-bit precision
+    height = getWord();
+    width = getWord();
+    ncomp = getByte();
+    len -= 6;
+    if (!width || !height)
+      return JDR_FMT1;
+    if (ncomp != 1 && ncomp != 3)
+      return JDR_FMT3;
+    if (len < ncomp * 3)
+      return JDR_FMT1;
+    for (int i = 0; i < ncomp; ++i)
+    {
+      _compId[i] = getByte();
+      int samp = getByte();
+      _qsel[i] = getByte() & 3;
+      if (i == 0)
+      {
+        msx = samp >> 4;
+        msy = samp & 15;
+        if (msx < 1 || msx > 2 || msy < 1 || msy > 2)
+          return JDR_FMT3;
+      }
+      else if (samp != 0x11)
+      {
+        return JDR_FMT3; // chroma must not be subsampled itself
+      }
+    }
+    len -= ncomp * 3;
+    if (ncomp == 1)
+      msx = msy = 1; // single component scans are never interleaved
+    while (len-- > 0)
+      getByte();
+    return JDR_OK;
   }
-}
-
-void displayHeart() {
-  tft.fillScreen(ST77XX_BLACK);
-  tft.fillCircle(140, 100, 40, ST77XX_RED);
-  tft.fillCircle(180, 100, 40, ST77XX_RED);
-  tft.fillTriangle(100, 110, 220, 110, 160, 180, ST77XX_RED);
-}
-
-void displayAlert() {
-  tft.fillScreen(ST77XX_RED);
-  tft.setTextSize(5);
-  tft.setTextColor(ST77XX_WHITE);
-  tft.setCursor(50, 90);
-  tft.println("ALERT!");
-  delay(200);
-  tft.fillScreen(ST77XX_BLACK);
-  delay(200);
-  tft.fillScreen(ST77XX_RED);
-  tft.setCursor(50, 90);
-  tft.println("ALERT!");
-}
-
-// ===== Image Upload Handlers =====
-void handleImageChunk() {
-  if (!server.hasArg("index") || !server.hasArg("total") || !server.hasArg("data")) {
-    sendPlain(400, "Missing parameters");
-    return;
+
+  JRESULT parseDQT(int len)
+  {
+    const uint8_t *zz = zigzag();
+    while (len > 0)
+    {
+      int pq = getByte();
+      if (pq < 0)
+        return JDR_INP;
+      int id = pq & 3;
+      bool wide = (pq >> 4) != 0;
+      --len;
+      for (int k = 0; k < 64; ++k)
+      {
+        _qtbl[id][zz[k]] = wide ? getWord() : getByte();
+      }
+      len -= wide ? 128 : 64;
+      _qvalid[id] = true;
+    }
+    return len == 0 ? JDR_OK : JDR_FMT1;
   }
-  
-  int index = server.arg("index").toInt();
-  int total = server.arg("total").toInt();
-  String data = server.arg("data");
-  
-  // First chunk - allocate buffer
-  if (index == 0) {
-    if (jpegBuffer != nullptr) {
-      free(jpegBuffer);
+
+  JRESULT parseDHT(int len)
+  {
+    while (len > 16)
+    {
+      int tc = getByte();
+      if (tc < 0)
+        return JDR_INP;
+      int cls = (tc >> 4) & 1;
+      int id = tc & 15;
+      if (id > 1)
+        return JDR_FMT3;
+      Huff &h = _huff[cls][id];
+      uint8_t counts[17];
+      int total = 0;
+      for (int i = 1; i <= 16; ++i)
+      {
+        counts[i] = getByte();
+        total += counts[i];
+      }
+      len -= 17;
+      if (total > 256 || total > len)
+        return JDR_FMT1;
+      for (int i = 0; i < total; ++i)
+        h.vals[i] = getByte();
+      len -= total;
+      buildHuff(h, counts);
+      _hvalid[cls][id] = true;
     }
-    jpegBuffer = (uint8_t*)malloc(MAX_JPEG_SIZE);
-    if (jpegBuffer == nullptr) {
-      sendPlain(500, "Out of memory");
-      return;
+    return len == 0 ? JDR_OK : JDR_FMT1;
+  }
+
+  static void buildHuff(Huff &h, const uint8_t *counts)
+  {
+    memset(h.fast, 0, sizeof(h.fast));
+    int code = 0;
+    int k = 0;
+    for (int l = 1; l <= 16; ++l)
+    {
+      h.valptr[l] = k;
+      h.mincode[l] = code;
+      for (int i = 0; i < counts[l]; ++i, ++k, ++code)
+      {
+        if (l <= FAST_BITS)
+        {
+          int shift = FAST_BITS - l;
+          int base = code << shift;
+          for (int j = 0; j < (1 << shift); ++j)
+            h.fast[base + j] = (uint16_t)((l << 8) | h.vals[k]);
+        }
+      }
+      h.maxcode[l] = counts[l] ? code - 1 : -1;
+      code <<= 1;
     }
-    jpegBufferSize = 0;
-    Serial.println("Starting image reception...");
-    Serial.print("Free heap: ");
-    Serial.println(ESP.getFreeHeap());
+    h.maxcode[17] = 0x7FFFFFFF;
   }
-  
-  // Decode this chunk from base64 and append to buffer
-  int chunkLen = data.length();
-  int decodedSize = (chunkLen * 3) / 4 + 10;
-  
-  if (jpegBufferSize + decodedSize > MAX_JPEG_SIZE) {
-    sendPlain(500, "Image too large");
-    free(jpegBuffer);
-    jpegBuffer = nullptr;
-    return;
+
+  JRESULT parseSOS(int len)
+  {
+    int ns = getByte();
+    if (ns != ncomp)
+      return JDR_FMT3; // non-interleaved scans of color images
+    for (int i = 0; i < ns; ++i)
+    {
+      int id = getByte();
+      int tbl = getByte();
+      int ci = 0;
+      while (ci < ncomp && _compId[ci] != id)
+        ++ci;
+      if (ci == ncomp)
+        return JDR_FMT1;
+      _dcsel[ci] = (tbl >> 4) & 1;
+      _acsel[ci] = tbl & 1;
+    }
+    len -= 1 + ns * 2;
+    while (len-- > 0)
+      getByte();
+    return JDR_OK;
   }
-  
-  int decoded = base64Decode(data, jpegBuffer + jpegBufferSize, MAX_JPEG_SIZE - jpegBufferSize);
-  jpegBufferSize += decoded;
-  
-  Serial.print("Chunk ");
-  Serial.print(index + 1);
-  Serial.print("/");
-  Serial.print(total);
-  Serial.print(" - Buffer size: ");
-  Serial.println(jpegBufferSize);
-  
-  sendPlain(200, "OK");
-}
-
-void handleDisplayImage() {
-  if (jpegBuffer == nullptr || jpegBufferSize == 0) {
-    sendPlain(400, "No image data");
-    return;
+
+  JRESULT finishPrepare()
+  {
+    if (!ncomp)
+      return JDR_FMT1;
+    for (int i = 0; i < ncomp; ++i)
+    {
+      if (!_qvalid[_qsel[i]] || !_hvalid[0][_dcsel[i]] || !_hvalid[1][_acsel[i]])
+        return JDR_FMT1;
+    }
+    resetEntropy();
+    return JDR_OK;
   }
-  
-  Serial.print("Decoding JPEG with JPEGDEC... Size: ");
-  Serial.println(jpegBufferSize);
-  
-  tft.fillScreen(ST77XX_BLACK);
-  
-  unsigned long startTime = millis();
-  
-  bool success = decodeJPEGFrame(jpegBuffer, jpegBufferSize);
-  
-  unsigned long decodeTime = millis() - startTime;
-  
-  if (success) {
-    Serial.print("JPEG decoded successfully in ");
-    Serial.print(decodeTime);
-    Serial.println(" ms");
-    Serial.print("Free heap after: ");
-    Serial.println(ESP.getFreeHeap());
-    sendPlain(200, "Image displayed in " + String(decodeTime) + "ms");
-  } else {
-    Serial.println("JPEG decode failed");
-    tft.setTextSize(2);
-    tft.setTextColor(ST77XX_RED);
-    tft.setCursor(10, 100);
-    tft.println("Decode Failed!");
-    sendPlain(500, "Decode failed");
+
+  void resetEntropy()
+  {
+    _bitbuf = 0;
+    _bitcnt = 0;
+    _marker = 0;
+    _dcpred[0] = _dcpred[1] = _dcpred[2] = 0;
   }
-  
-  // Free memory
-  free(jpegBuffer);
-  jpegBuffer = nullptr;
-  jpegBufferSize = 0;
-}
-
-// ===== GIF Upload Handlers =====
-void handleGifChunk() {
-  Serial.println("=== GIF Chunk Handler Called ===");
-  Serial.print("Method: ");
-  Serial.println(server.method() == HTTP_POST ? "POST" : "GET");
-  
-  // Support both GET (with query params) and POST (with body)
-  String data;
-  int index = 0;
-  int total = 0;
-  
-  if (server.method() == HTTP_POST) {
-    // POST request - data in body
-    if (!server.hasArg("index") || !server.hasArg("total")) {
-      Serial.println("ERROR: Missing index/total parameters");
-      sendPlain(400, "Missing index/total parameters");
-      return;
-    }
-    index = server.arg("index").toInt();
-    total = server.arg("total").toInt();
-    
-    // Try multiple ways to get POST body
-    if (server.hasArg("plain")) {
-      data = server.arg("plain");
-      Serial.println("Got data from arg('plain')");
-    } else {
-      // Try getting raw body
-      data = server.arg(0); // First argument
-      Serial.println("Got data from arg(0)");
-    }
-    
-    Serial.print("POST body length: ");
-    Serial.println(data.length());
-  } else {
-    // GET request - data in query params (legacy)
-    if (!server.hasArg("index") || !server.hasArg("total") || !server.hasArg("data")) {
-      Serial.println("ERROR: Missing parameters");
-      sendPlain(400, "Missing parameters");
-      return;
+
+  void fillBits()
+  {
+    while (_bitcnt <= 24)
+    {
+      int c = 0;
+      if (!_marker)
+      {
+        c = getByte();
+        if (c == 0xFF)
+        {
+          int c2 = getByte();
+          while (c2 == 0xFF)
+            c2 = getByte();
+          if (c2 != 0)
+          {
+            _marker = c2 < 0 ? 0xD9 : c2; // stop feeding data at any marker
+            c = 0;
+          }
+        }
+        else if (c < 0)
+        {
+          _marker = 0xD9;
+          c = 0;
+        }
+      }
+      _bitbuf |= (uint32_t)c << (24 - _bitcnt);
+      _bitcnt += 8;
     }
-    index = server.arg("index").toInt();
-    total = server.arg("total").toInt();
-    data = server.arg("data");
-    Serial.print("GET data length: ");
-    Serial.println(data.length());
   }
-  
-  if (data.length() == 0) {
-    Serial.println("ERROR: No data received!");
-    sendPlain(400, "No data received");
-    return;
+
+  inline int getBits(int n)
+  {
+    if (_bitcnt < n)
+      fillBits();
+    int v = _bitbuf >> (32 - n);
+    _bitbuf <<= n;
+    _bitcnt -= n;
+    return v;
   }
-  
-  // First chunk - allocate buffer
-  if (index == 0) {
-    // Free any existing buffers first
-    if (gifBuffer != nullptr) {
-      free(gifBuffer);
-      gifBuffer = nullptr;
-    }
-    if (jpegBuffer != nullptr) {
-      free(jpegBuffer);
-      jpegBuffer = nullptr;
-    }
-    
-    Serial.println("Starting GIF reception...");
-    Serial.print("Free heap before allocation: ");
-    unsigned long freeHeap = ESP.getFreeHeap();
-    Serial.println(freeHeap);
-    
-    // Calculate needed size: total chunks * avg chunk size + buffer
-    // For safety, allocate MAX_GIF_SIZE or free heap - 50KB (whichever is smaller)
-    int allocSize = MAX_GIF_SIZE;
-    if (freeHeap < (MAX_GIF_SIZE + 50000)) {
-      allocSize = freeHeap - 50000; // Leave 50KB for other operations
-      Serial.print("Adjusting allocation size to: ");
-      Serial.println(allocSize);
+
+  inline int decodeHuff(const Huff &h)
+  {
+    if (_bitcnt < 16)
+      fillBits();
+    int look = _bitbuf >> (32 - FAST_BITS);
+    int e = h.fast[look];
+    if (e)
+    {
+      int l = e >> 8;
+      _bitbuf <<= l;
+      _bitcnt -= l;
+      return e & 0xFF;
     }
-    
-    Serial.print("Trying to allocate: ");
-    Serial.println(allocSize);
-    
-    gifBuffer = (uint8_t*)malloc(allocSize);
-    if (gifBuffer == nullptr) {
-      Serial.println("ERROR: Failed to allocate GIF buffer!");
-      Serial.print("Free heap: ");
-      Serial.println(ESP.getFreeHeap());
-      
-      // Try smaller allocation
-      allocSize = 100000; // Try 100KB
-      Serial.print("Retrying with smaller size: ");
-      Serial.println(allocSize);
-      gifBuffer = (uint8_t*)malloc(allocSize);
-      
-      if (gifBuffer == nullptr) {
-        Serial.println("ERROR: Still failed!");
-        sendPlain(500, "Out of memory for GIF");
-        return;
-      }
+    int l = FAST_BITS + 1;
+    int code = _bitbuf >> (32 - l);
+    while (l <= 16 && code > h.maxcode[l])
+    {
+      ++l;
+      code = _bitbuf >> (32 - l);
     }
-    
-    gifBufferSize = 0;
-    Serial.println("GIF buffer allocated successfully!");
-    Serial.print("Free heap after allocation: ");
-    Serial.println(ESP.getFreeHeap());
+    if (l > 16)
+      return -1;
+    _bitbuf <<= l;
+    _bitcnt -= l;
+    return h.vals[h.valptr[l] + code - h.mincode[l]];
   }
-  
-  // Decode this chunk from base64 and append to buffer
-  int chunkLen = data.length();
-  int decodedSize = (chunkLen * 3) / 4 + 10;
-  
-  if (gifBufferSize + decodedSize > MAX_GIF_SIZE) {
-    sendPlain(500, "GIF too large");
-    free(gifBuffer);
-    gifBuffer = nullptr;
-    return;
+
+  static inline int extend(int v, int s)
+  {
+    return v < (1 << (s - 1)) ? v - (1 << s) + 1 : v;
   }
-  
-  int decoded = base64Decode(data, gifBuffer + gifBufferSize, MAX_GIF_SIZE - gifBufferSize);
-  gifBufferSize += decoded;
-  
-  Serial.print("GIF Chunk ");
-  Serial.print(index + 1);
-  Serial.print("/");
-  Serial.print(total);
-  Serial.print(" - Buffer size: ");
-  Serial.println(gifBufferSize);
-  
-  sendPlain(200, "OK");
-}
-
-void handlePlayGif() {
-  if (gifBuffer == nullptr || gifBufferSize == 0) {
-    sendPlain(400, "No GIF data");
-    return;
+
+  JRESULT restart()
+  {
+    // Discard bits up to the marker, then accept any RSTn
+    while (!_marker)
+    {
+      _bitcnt = 0;
+      fillBits();
+    }
+    if (_marker < 0xD0 || _marker > 0xD7)
+      return JDR_FMT1;
+    resetEntropy();
+    return JDR_OK;
   }
-  
-  Serial.print("Playing GIF... Size: ");
-  Serial.println(gifBufferSize);
-  
-  tft.fillScreen(ST77XX_BLACK);
-  
-  if (gif.open(gifBuffer, gifBufferSize, GIFDraw)) {
-    Serial.println("GIF opened successfully");
-    Serial.print("Canvas size: ");
-    Serial.print(gif.getCanvasWidth());
-    Serial.print("x");
-    Serial.println(gif.getCanvasHeight());
-    
-    isPlayingGif = true;
-    sendPlain(200, "GIF playing");
-    
-    // Play GIF in loop (will be stopped by handleStopGif)
-    int frameCount = 0;
-    unsigned long startTime = millis();
-    
-    while (isPlayingGif) {
-      int result = gif.playFrame(true, NULL);
-      if (result == 0) { // End of animation
-        gif.reset(); // Loop the animation
-        
-        // Calculate and print FPS
-        unsigned long elapsed = millis() - startTime;
-        if (elapsed > 0) {
-          float fps = (frameCount * 1000.0) / elapsed;
-          Serial.print("FPS: ");
-          Serial.println(fps);
-        }
-        frameCount = 0;
-        startTime = millis();
+
+  // Decode one block into _blk[b]. With dcOnly the IDCT is skipped and the
+  // block is filled with its DC level (used by the 1/8 scale).
+  JRESULT decodeBlock(int ci, int b, bool dcOnly)
+  {
+    const Huff &dc = _huff[0][_dcsel[ci]];
+    const Huff &ac = _huff[1][_acsel[ci]];
+    const int32_t *q = _qtbl[_qsel[ci]];
+    const uint8_t *zz = zigzag();
+
+    int s = decodeHuff(dc);
+    if (s < 0 || s > 11)
+      return JDR_FMT1;
+    int diff = s ? extend(getBits(s), s) : 0;
+    _dcpred[ci] += diff;
+
+    memset(_coef, 0, sizeof(_coef));
+    _coef[0] = (int16_t)(_dcpred[ci] * q[0]);
+    bool acZero = true;
+    for (int k = 1; k < 64;)
+    {
+      int rs = decodeHuff(ac);
+      if (rs < 0)
+        return JDR_FMT1;
+      int r = rs >> 4;
+      s = rs & 15;
+      if (!s)
+      {
+        if (r != 15)
+          break; // EOB
+        k += 16;
+        continue;
       }
-      frameCount++;
-      
-      // Minimal delay for smoother playback
-      delay(10); // ~100 FPS max, actual speed depends on GIF
-      
-      // Periodically check for stop command (every 10 frames)
-      if (frameCount % 10 == 0) {
-        server.handleClient();
+      k += r;
+      int v = extend(getBits(s), s);
+      if (!dcOnly && k < 64)
+      {
+        int n = zz[k];
+        _coef[n] = (int16_t)(v * q[n]);
+        acZero = false;
       }
+      ++k;
     }
-    
-    gif.close();
-    Serial.println("GIF playback finished");
-    
-  } else {
-    Serial.println("Failed to open GIF");
-    tft.setTextSize(2);
-    tft.setTextColor(ST77XX_RED);
-    tft.setCursor(10, 100);
-    tft.println("GIF Failed!");
-    sendPlain(500, "Failed to open GIF");
-  }
-  
-  // Free memory
-  free(gifBuffer);
-  gifBuffer = nullptr;
-  gifBufferSize = 0;
-}
-
-void handleStopGif() {
-  isPlayingGif = false;
-  sendPlain(200, "GIF stopped");
-}
-
-void handleDisplayText() {
-  String text = server.arg("text");
-  if (text.length() == 0) {
-    sendPlain(400, "Missing text parameter");
-    return;
+
+    uint8_t *dst = _blk[b];
+    if (dcOnly || acZero)
+    {
+      int dcv = clamp(((_coef[0] + 4) >> 3) + 128);
+      memset(dst, dcv, 64);
+      return JDR_OK;
+    }
+    idct(_coef, dst);
+    return JDR_OK;
   }
-  
-  tft.fillScreen(ST77XX_BLACK);
-  tft.setTextSize(3);
-  tft.setTextColor(ST77XX_WHITE);
-  tft.setCursor(10, 100);
-  tft.println(text);
-  
-  sendPlain(200, "Text displayed");
-}
-
-void startWebServer() {
-  server.on("/", handleRoot);
-  server.on("/on", handleOn);
-  server.on("/off", handleOff);
-  server.on("/status", handleStatus);
-  server.on("/dht", handleDHT);
-  server.on("/display", handleDisplay);
-  server.on("/imageChunk", handleImageChunk);
-  server.on("/displayImage", handleDisplayImage);
-  server.on("/displayText", handleDisplayText);
-  
-  // GIF endpoints - support both GET and POST
-  server.on("/gifChunk", HTTP_GET, handleGifChunk);
-  server.on("/gifChunk", HTTP_POST, handleGifChunk);
-  server.on("/playGif", handlePlayGif);
-  server.on("/stopGif", handleStopGif);
-  
-  server.on("/reset", [](){
-    prefs.begin("wifi", false);
-    prefs.clear();
-    prefs.end();
-    sendPlain(200, "Resetting...");
-    delay(500);
-    ESP.restart();
-  });
-  
-  server.begin();
-  Serial.println("Webserver started with JPEGDEC + AnimatedGIF");
-}
-
-void handleRootAP() {
-  String html = "<html><body><h2>Device WiFi Setup</h2>";
-  html += "<form method='POST' action='/save'>";
-  html += "SSID: <input name='ssid' /><br/>";
-  html += "Password: <input name='pass' type='password' /><br/>";
-  html += "<button type='submit'>Save & Connect</button>";
-  html += "</form></body></html>";
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.send(200, "text/html", html);
-}
-
-void handleSave() {
-  String ssid = server.arg("ssid");
-  String pass = server.arg("pass");
-  if (ssid.length() == 0) {
-    server.sendHeader("Access-Control-Allow-Origin", "*");
-    server.send(400, "text/plain", "Missing ssid");
-    return;
+
+  static inline uint8_t clamp(int v)
+  {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
   }
-  prefs.begin("wifi", false);
-  prefs.putString("ssid", ssid);
-  prefs.putString("pass", pass);
-  prefs.end();
-  server.sendHeader("Access-Control-Allow-Origin", "*");
-  server.send(200, "text/html", "Saved. Rebooting...");
-  delay(500);
-  ESP.restart();
-}
-
-void startAP() {
-  WiFi.mode(WIFI_AP);
-  IPAddress apIP(192,168,4,1);
-  IPAddress gateway = apIP;
-  IPAddress subnet(255,255,255,0);
-  WiFi.softAPConfig(apIP, gateway, subnet);
-  WiFi.softAP(apSSID);
-  dnsServer.start(53, "*", apIP);
-  Serial.print("AP '"); Serial.print(apSSID); Serial.print("' IP: "); Serial.println(WiFi.softAPIP());
-  server.on("/", handleRootAP);
-  server.on("/save", HTTP_POST, handleSave);
-  server.begin();
-}
-
-void tryConnectFromPreferences() {
-  prefs.begin("wifi", true);
-  storedSSID = prefs.getString("ssid", "");
-  storedPass = prefs.getString("pass", "");
-  prefs.end();
-
-  if (storedSSID.length() > 0) {
-    Serial.print("Found stored SSID: "); Serial.println(storedSSID);
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
-    unsigned long start = millis();
-    const unsigned long timeout = 20000;
-    while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
-      digitalWrite(LED_PIN, HIGH);
-      delay(200);
-      digitalWrite(LED_PIN, LOW);
-      delay(300);
-      Serial.print('.');
+
+  // Integer IDCT (libjpeg "islow" algorithm, 13-bit constants)
+  static void idct(const int16_t *in, uint8_t *out)
+  {
+    const int CB = 13, P1 = 2;
+    int32_t ws[64];
+    for (int c = 0; c < 8; ++c)
+    {
+      const int16_t *s = in + c;
+      int32_t *w = ws + c;
+      if (!s[8] && !s[16] && !s[24] && !s[32] && !s[40] && !s[48] && !s[56])
+      {
+        int32_t dcval = (int32_t)s[0] << P1;
+        for (int r = 0; r < 8; ++r)
+          w[r * 8] = dcval;
+        continue;
+      }
+      int32_t z2 = s[16], z3 = s[48];
+      int32_t z1 = (z2 + z3) * 4433;
+      int32_t tmp2 = z1 - z3 * 15137;
+      int32_t tmp3 = z1 + z2 * 6270;
+      z2 = s[0];
+      z3 = s[32];
+      int32_t tmp0 = (z2 + z3) << CB;
+      int32_t tmp1 = (z2 - z3) << CB;
+      int32_t t10 = tmp0 + tmp3, t13 = tmp0 - tmp3, t11 = tmp1 + tmp2, t12 = tmp1 - tmp2;
+
+      tmp0 = s[56];
+      tmp1 = s[40];
+      tmp2 = s[24];
+      tmp3 = s[8];
+      z1 = tmp0 + tmp3;
+      z2 = tmp1 + tmp2;
+      z3 = tmp0 + tmp2;
+      int32_t z4 = tmp1 + tmp3;
+      int32_t z5 = (z3 + z4) * 9633;
+      tmp0 *= 2446;
+      tmp1 *= 16819;
+      tmp2 *= 25172;
+      tmp3 *= 12299;
+      z1 *= -7373;
+      z2 *= -20995;
+      z3 = z3 * -16069 + z5;
+      z4 = z4 * -3196 + z5;
+      tmp0 += z1 + z3;
+      tmp1 += z2 + z4;
+      tmp2 += z2 + z3;
+      tmp3 += z1 + z4;
+
+      const int sh = CB - P1;
+      const int32_t rnd = 1 << (sh - 1);
+      w[0] = (t10 + tmp3 + rnd) >> sh;
+      w[56] = (t10 - tmp3 + rnd) >> sh;
+      w[8] = (t11 + tmp2 + rnd) >> sh;
+      w[48] = (t11 - tmp2 + rnd) >> sh;
+      w[16] = (t12 + tmp1 + rnd) >> sh;
+      w[40] = (t12 - tmp1 + rnd) >> sh;
+      w[24] = (t13 + tmp0 + rnd) >> sh;
+      w[32] = (t13 - tmp0 + rnd) >> sh;
+    }
+
+    const int sh = CB + P1 + 3;
+    const int32_t rnd = (1 << (sh - 1)) + (128 << sh);
+    for (int r = 0; r < 8; ++r)
+    {
+      const int32_t *w = ws + r * 8;
+      uint8_t *o = out + r * 8;
+      int32_t z2 = w[2], z3 = w[6];
+      int32_t z1 = (z2 + z3) * 4433;
+      int32_t tmp2 = z1 - z3 * 15137;
+      int32_t tmp3 = z1 + z2 * 6270;
+      int32_t tmp0 = (w[0] + w[4]) << CB;
+      int32_t tmp1 = (w[0] - w[4]) << CB;
+      int32_t t10 = tmp0 + tmp3, t13 = tmp0 - tmp3, t11 = tmp1 + tmp2, t12 = tmp1 - tmp2;
+
+      tmp0 = w[7];
+      tmp1 = w[5];
+      tmp2 = w[3];
+      tmp3 = w[1];
+      z1 = tmp0 + tmp3;
+      z2 = tmp1 + tmp2;
+      z3 = tmp0 + tmp2;
+      int32_t z4 = tmp1 + tmp3;
+      int32_t z5 = (z3 + z4) * 9633;
+      tmp0 *= 2446;
+      tmp1 *= 16819;
+      tmp2 *= 25172;
+      tmp3 *= 12299;
+      z1 *= -7373;
+      z2 *= -20995;
+      z3 = z3 * -16069 + z5;
+      z4 = z4 * -3196 + z5;
+      tmp0 += z1 + z3;
+      tmp1 += z2 + z4;
+      tmp2 += z2 + z3;
+      tmp3 += z1 + z4;
+
+      o[0] = clamp((t10 + tmp3 + rnd) >> sh);
+      o[7] = clamp((t10 - tmp3 + rnd) >> sh);
+      o[1] = clamp((t11 + tmp2 + rnd) >> sh);
+      o[6] = clamp((t11 - tmp2 + rnd) >> sh);
+      o[2] = clamp((t12 + tmp1 + rnd) >> sh);
+      o[5] = clamp((t12 - tmp1 + rnd) >> sh);
+      o[3] = clamp((t13 + tmp0 + rnd) >> sh);
+      o[4] = clamp((t13 - tmp0 + rnd) >> sh);
     }
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println();
-      Serial.print("Connected, IP: "); Serial.println(WiFi.localIP());
-      startWebServer();
-    } else {
-      Serial.println();
-      Serial.println("Failed to connect, starting AP");
-      startAP();
+  }
+
+  // Convert the decoded MCU to RGB888 at 1/(1 << scale) size into _rgb.
+  // Returns the scaled MCU width; rows are packed at that stride.
+  int colorConvert(uint8_t scale)
+  {
+    const int mw = msx * 8, mh = msy * 8;
+    const int step = 1 << scale;
+    const int ow = mw >> scale, oh = mh >> scale;
+    const int nY = msx * msy;
+    uint8_t *d = _rgb;
+    for (int oy = 0; oy < oh; ++oy)
+    {
+      for (int ox = 0; ox < ow; ++ox)
+      {
+        int sx = ox * step, sy = oy * step;
+        int yy, cb = 128, cr = 128;
+        if (step == 1)
+        {
+          yy = _blk[(sy >> 3) * msx + (sx >> 3)][(sy & 7) * 8 + (sx & 7)];
+        }
+        else if (step == 8)
+        {
+          yy = _blk[(sy >> 3) * msx + (sx >> 3)][0]; // block is flat at 1/8
+        }
+        else
+        {
+          int acc = 0;
+          for (int j = 0; j < step; ++j)
+            for (int i = 0; i < step; ++i)
+            {
+              int px = sx + i, py = sy + j;
+              acc += _blk[(py >> 3) * msx + (px >> 3)][(py & 7) * 8 + (px & 7)];
+            }
+          yy = acc >> (scale * 2);
+        }
+        if (ncomp == 3)
+        {
+          int cx = (sx / msx) + (step / msx >> 1);
+          int cy = (sy / msy) + (step / msy >> 1);
+          if (cx > 7) cx = 7;
+          if (cy > 7) cy = 7;
+          cb = _blk[nY][cy * 8 + cx] - 128;
+          cr = _blk[nY + 1][cy * 8 + cx] - 128;
+          d[0] = clamp(yy + ((91881 * cr) >> 16));
+          d[1] = clamp(yy - ((22554 * cb + 46802 * cr) >> 16));
+          d[2] = clamp(yy + ((116130 * cb) >> 16));
+        }
+        else
+        {
+          d[0] = d[1] = d[2] = yy;
+        }
+        d += 3;
+      }
     }
-  } else {
-    startAP();
+    return ow;
   }
-}
-
-void setup() {
-  pinMode(LED_PIN, OUTPUT);
-  digitalWrite(LED_PIN, LOW);
-  Serial.begin(115200);
-  delay(1000);
-  Serial.println("--- ESP32 with JPEGDEC Image Display ---");
-  
-  initDisplay();
-  dht.begin();
-  
-  Serial.println("DHT22 initialized");
-  Serial.print("Total heap: ");
-  Serial.println(ESP.getHeapSize());
-  Serial.print("Free heap: ");
-  Serial.println(ESP.getFreeHeap());
-  
-  tryConnectFromPreferences();
-}
-
-void loop() {
-  server.handleClient();
-  if (WiFi.getMode() == WIFI_AP) {
-    dnsServer.processNextRequest();
+
+protected:
+  // Decode MCU rows [rowBegin, rowEnd). The entropy decoder must be
+  // positioned at the start of rowBegin.
+  JRESULT decompRows(output_func_t outfunc, line_func_t linefunc, uint8_t scale, uint32_t rowBegin, uint32_t rowEnd)
+  {
+    const uint32_t mw = msx * 8, mh = msy * 8;
+    const uint32_t mcusPerRow = (width + mw - 1) / mw;
+    const uint32_t nY = msx * msy;
+    const bool dcOnly = (scale == 3);
+    uint32_t mcuCount = rowBegin * mcusPerRow;
+
+    for (uint32_t row = rowBegin; row < rowEnd; ++row)
+    {
+      uint32_t y = row * mh;
+      for (uint32_t col = 0; col < mcusPerRow; ++col)
+      {
+        if (nrst && mcuCount && (mcuCount % nrst) == 0)
+        {
+          JRESULT r = restart();
+          if (r != JDR_OK)
+            return r;
+        }
+        ++mcuCount;
+
+        for (uint32_t b = 0; b < nY; ++b)
+        {
+          JRESULT r = decodeBlock(0, b, dcOnly);
+          if (r != JDR_OK)
+            return r;
+        }
+        if (ncomp == 3)
+        {
+          JRESULT r = decodeBlock(1, nY, dcOnly);
+          if (r == JDR_OK)
+            r = decodeBlock(2, nY + 1, dcOnly);
+          if (r != JDR_OK)
+            return r;
+        }
+
+        uint32_t x = col * mw;
+        int ow = colorConvert(scale);
+        JRECT rect;
+        rect.left = x >> scale;
+        rect.top = y >> scale;
+        uint32_t rw = (x + mw > width ? width - x : mw);
+        uint32_t rh = (y + mh > height ? height - y : mh);
+        rw = (rw + (1 << scale) - 1) >> scale;
+        rh = (rh + (1 << scale) - 1) >> scale;
+        rect.right = rect.left + rw - 1;
+        rect.bottom = rect.top + rh - 1;
+        if ((int)rw != ow)
+        {
+          // Pack the clipped MCU so the bitmap stride equals the rect width
+          for (uint32_t j = 1; j < rh; ++j)
+            memmove(_rgb + j * rw * 3, _rgb + j * ow * 3, rw * 3);
+        }
+        if (!outfunc(this, _rgb, &rect))
+          return JDR_INTR;
+      }
+      if (linefunc)
+      {
+        uint32_t top = y >> scale;
+        uint32_t bottom = ((y + mh > height ? height : y + mh) + (1 << scale) - 1) >> scale;
+        if (!linefunc(this, top, bottom - top))
+          return JDR_INTR;
+      }
+    }
+    return JDR_OK;
   }
-}
\ No newline at end of file
+};
+
+#endif // _TJPGDCLASS_H_
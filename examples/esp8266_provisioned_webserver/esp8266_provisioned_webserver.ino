@@ -5,6 +5,11 @@
   - If connection fails or no creds, starts AP + captive portal to accept SSID/password
   - Stores credentials in EEPROM
   - /reset clears stored credentials and reboots into provisioning AP
+  - After a successful join the AP's BSSID and channel are cached in
+    EEPROM; the next boot joins that AP directly (no scan) and falls back to
+    a normal join if that fails. The address always comes from DHCP.
+  - Once joined, the radio and CPU light-sleep between requests: loop()
+    waits IDLE_WAIT_MS in delay(), which is where the core sleeps
 
   Notes:
   - LED_BUILTIN is usually inverted on many ESP8266 boards (LOW = ON)
@@ -18,6 +23,11 @@
 
 const char* apSSID = "ESP8266-Setup";
 const int EEPROM_SIZE = 512;
+const int CACHE_ADDR = 256;       // after the credentials (at most 202 bytes)
+const uint8_t CACHE_MAGIC = 0xA5;
+const unsigned long FAST_JOIN_TIMEOUT_MS = 3000;
+const unsigned long FULL_JOIN_TIMEOUT_MS = 20000;
+const unsigned long IDLE_WAIT_MS = 20; // the most a request waits for loop()
 
 ESP8266WebServer server(80);
 DNSServer dnsServer;
@@ -25,7 +35,25 @@ DNSServer dnsServer;
 String storedSSID = "";
 String storedPass = "";
 
+// Where the last successful join went, kept at CACHE_ADDR
+struct WifiCache {
+  uint8_t magic;
+  uint8_t channel;
+  uint8_t bssid[6];
+};
+
+// Boot timing, reported by /status (millis() since boot)
+const char* joinMethod = "none"; // fast (cached AP), full (scan + DHCP) or ap
+unsigned long joinMs = 0;         // spent joining
+unsigned long servingMs = 0;      // server started
+unsigned long firstRequestMs = 0; // first request answered
+
+void noteRequest() {
+  if (firstRequestMs == 0) firstRequestMs = millis();
+}
+
 void sendPlain(int code, const String &body) {
+  noteRequest();
   server.sendHeader("Access-Control-Allow-Origin", "*");
   server.send(code, "text/plain", body);
 }
@@ -45,6 +73,7 @@ void handleOff() {
 }
 
 void handleStatus() {
+  noteRequest();
   String s = "mode:";
   s += (WiFi.getMode() == WIFI_AP) ? "AP" : "STA";
   s += "\n";
@@ -53,6 +82,10 @@ void handleStatus() {
   } else {
     s += "not connected";
   }
+  s += "\njoin:" + String(joinMethod);
+  s += "\njoin_ms:" + String(joinMs);
+  s += "\nserving_ms:" + String(servingMs);
+  s += "\nfirst_request_ms:" + String(firstRequestMs);
   sendPlain(200, s);
 }
 
@@ -69,6 +102,7 @@ void startWebServer() {
     int addr = 0;
     EEPROM.write(addr++, 0); // ssid len 0
     EEPROM.write(addr++, 0); // pass len 0
+    EEPROM.write(CACHE_ADDR, 0); // forget the cached AP
     EEPROM.commit();
     EEPROM.end();
     sendPlain(200, "Resetting to provisioning mode...");
@@ -76,6 +110,7 @@ void startWebServer() {
     ESP.restart();
   });
   server.begin();
+  servingMs = millis();
   Serial.println("Webserver started");
 }
 
@@ -105,6 +140,7 @@ void handleSave() {
   for (int i = 0; i < ssid.length(); ++i) EEPROM.write(addr++, ssid[i]);
   EEPROM.write(addr++, pass.length());
   for (int i = 0; i < pass.length(); ++i) EEPROM.write(addr++, pass[i]);
+  EEPROM.write(CACHE_ADDR, 0); // the cached AP belongs to the old network
   EEPROM.commit();
   EEPROM.end();
   server.sendHeader("Access-Control-Allow-Origin", "*");
@@ -127,6 +163,45 @@ void startAP() {
   server.on("/", handleRootAP);
   server.on("/save", HTTP_POST, handleSave);
   server.begin();
+  servingMs = millis();
+}
+
+bool loadWifiCache(WifiCache &c) {
+  EEPROM.begin(EEPROM_SIZE);
+  EEPROM.get(CACHE_ADDR, c);
+  EEPROM.end();
+  return c.magic == CACHE_MAGIC && c.channel > 0;
+}
+
+// Called once connected; only writes when something changed, so the
+// flash is not worn by every boot
+void saveWifiCache() {
+  WifiCache c;
+  memset(&c, 0, sizeof(c));
+  c.magic = CACHE_MAGIC;
+  c.channel = WiFi.channel();
+  memcpy(c.bssid, WiFi.BSSID(), 6);
+  WifiCache old;
+  if (loadWifiCache(old) && memcmp(&old, &c, sizeof(c)) == 0) return;
+  EEPROM.begin(EEPROM_SIZE);
+  EEPROM.put(CACHE_ADDR, c);
+  EEPROM.commit();
+  EEPROM.end();
+  Serial.println("Saved AP for fast reconnect");
+}
+
+// Waits for the join, blinking the LED. With failFast, gives up as soon as
+// the join is refused instead of waiting out the timeout.
+bool waitForWiFi(unsigned long timeout, bool failFast) {
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
+    wl_status_t st = WiFi.status();
+    if (failFast && (st == WL_NO_SSID_AVAIL || st == WL_CONNECT_FAILED)) break;
+    digitalWrite(LED_BUILTIN, (millis() - start) % 500 < 200 ? LOW : HIGH);
+    delay(10);
+  }
+  digitalWrite(LED_BUILTIN, HIGH);
+  return WiFi.status() == WL_CONNECTED;
 }
 
 void tryConnectFromEEPROM() {
@@ -151,27 +226,39 @@ void tryConnectFromEEPROM() {
   if (storedSSID.length() > 0) {
     Serial.print("Found stored SSID: "); Serial.println(storedSSID);
     WiFi.mode(WIFI_STA);
-    WiFi.begin(storedSSID.c_str(), storedPass.c_str());
     unsigned long start = millis();
-    const unsigned long timeout = 20000;
-    while (WiFi.status() != WL_CONNECTED && (millis() - start) < timeout) {
-      // blink LED while attempting to connect
-      digitalWrite(LED_BUILTIN, LOW);
-      delay(200);
-      digitalWrite(LED_BUILTIN, HIGH);
-      delay(300);
-      Serial.print('.');
+    bool connected = false;
+    WifiCache cache;
+    if (loadWifiCache(cache)) {
+      // straight to the cached AP on its channel
+      WiFi.begin(storedSSID.c_str(), storedPass.c_str(), cache.channel, cache.bssid);
+      connected = waitForWiFi(FAST_JOIN_TIMEOUT_MS, true);
+      if (connected) {
+        joinMethod = "fast";
+      } else {
+        Serial.println("Cached AP did not answer, scanning");
+        WiFi.disconnect();
+      }
     }
-    if (WiFi.status() == WL_CONNECTED) {
-      Serial.println();
-      Serial.print("Connected, IP: "); Serial.println(WiFi.localIP());
+    if (!connected) {
+      WiFi.begin(storedSSID.c_str(), storedPass.c_str());
+      connected = waitForWiFi(FULL_JOIN_TIMEOUT_MS, false);
+      if (connected) joinMethod = "full";
+    }
+    joinMs = millis() - start;
+    if (connected) {
+      Serial.print("Connected ("); Serial.print(joinMethod); Serial.print(", ");
+      Serial.print(joinMs); Serial.print(" ms), IP: "); Serial.println(WiFi.localIP());
+      saveWifiCache();
+      WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
       startWebServer();
     } else {
-      Serial.println();
       Serial.println("Failed to connect, starting AP provisioning");
+      joinMethod = "ap";
       startAP();
     }
   } else {
+    joinMethod = "ap";
     startAP();
   }
 }
@@ -191,5 +278,7 @@ void loop() {
   // when in AP/captive mode we need the DNS server to process requests
   if (WiFi.getMode() == WIFI_AP) {
     dnsServer.processNextRequest();
+  } else {
+    delay(IDLE_WAIT_MS); // light sleep until the next request can be served
   }
 }
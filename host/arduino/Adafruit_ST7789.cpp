@@ -0,0 +1,368 @@
+#include "Adafruit_ST7789.h"
+
+#include <algorithm>
+
+#include "HostInternal.h"
+#include "HostSim.h"
+
+// ----- Adafruit_GFX -----
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  drawFastHLine(x, y, w, color);
+  drawFastHLine(x, y + h - 1, w, color);
+  drawFastVLine(x, y, h, color);
+  drawFastVLine(x + w - 1, y, h, color);
+}
+
+void Adafruit_GFX::drawTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  drawLine(x0, y0, x1, y1, color);
+  drawLine(x1, y1, x2, y2, color);
+  drawLine(x2, y2, x0, y0, color);
+}
+
+void Adafruit_GFX::setRotation(uint8_t r) {
+  rotation = r & 3;
+  _width = (rotation & 1) ? HEIGHT : WIDTH;
+  _height = (rotation & 1) ? WIDTH : HEIGHT;
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+  if (c == '\n') {
+    cursor_x = 0;
+    cursor_y += textsize_y * 8;
+  } else if (c != '\r') {
+    if (wrap && (cursor_x + textsize_x * 6) > _width) {
+      cursor_x = 0;
+      cursor_y += textsize_y * 8;
+    }
+    drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize_x, textsize_y);
+    cursor_x += textsize_x * 6;
+  }
+  return 1;
+}
+
+// ----- Adafruit_ST7789 -----
+
+static std::vector<Adafruit_ST7789 *> &busPanels() {
+  static std::vector<Adafruit_ST7789 *> panels;
+  return panels;
+}
+
+Adafruit_ST7789::Adafruit_ST7789(int8_t cs, int8_t dc, int8_t)
+    : Adafruit_GFX(240, 320), csPin_(cs), dcPin_(dc) {
+  busPanels().push_back(this);
+}
+
+Adafruit_ST7789::Adafruit_ST7789(int8_t cs, int8_t dc, int8_t, int8_t, int8_t)
+    : Adafruit_GFX(240, 320), csPin_(cs), dcPin_(dc) {
+  busPanels().push_back(this);
+}
+
+Adafruit_ST7789::~Adafruit_ST7789() {
+  std::vector<Adafruit_ST7789 *> &panels = busPanels();
+  panels.erase(std::remove(panels.begin(), panels.end(), this), panels.end());
+}
+
+void Adafruit_ST7789::init(uint16_t width, uint16_t height, uint8_t) {
+  WIDTH = _width = width;
+  HEIGHT = _height = height;
+  rotation = 0;
+  fb_.assign((size_t)width * height, 0);
+  // RAM offsets as Adafruit_ST7789::init() sets them
+  if (width == 240 && height == 240) {
+    rowStart_ = 320 - height;
+    rowStart2_ = 0;
+    colStart_ = colStart2_ = 240 - width;
+  } else {
+    rowStart_ = rowStart2_ = (320 - height) / 2;
+    colStart_ = (width == 135) ? (240 - width + 1) / 2 : (240 - width) / 2;
+    colStart2_ = (240 - width) / 2;
+  }
+  xStart_ = colStart_;
+  yStart_ = rowStart_;
+  // Reset, SWRESET, SLPOUT, COLMOD, MADCTL, CASET, RASET, INVON, NORON, DISPON
+  startWrite();
+  for (int i = 0; i < 10; ++i) sendCommand(i == 3 || i == 4 ? 1 : (i == 5 || i == 6 ? 4 : 0));
+  endWrite();
+  host::advanceUs(150000 + 10000 + 500000); // reset and sleep-out delays in the driver
+}
+
+void Adafruit_ST7789::setRotation(uint8_t r) {
+  Adafruit_GFX::setRotation(r);
+  switch (rotation) {
+  case 0: xStart_ = colStart_; yStart_ = rowStart_; break;
+  case 1: xStart_ = rowStart_; yStart_ = colStart2_; break;
+  case 2: xStart_ = colStart2_; yStart_ = rowStart2_; break;
+  default: xStart_ = rowStart2_; yStart_ = colStart_; break;
+  }
+  startWrite();
+  sendCommand(1); // MADCTL
+  endWrite();
+}
+
+void Adafruit_ST7789::sendCommand(uint32_t paramBytes) {
+  stats_.commandBytes += 1;
+  stats_.busUs += 8.0 * 1e6 / spiHz + cmdOverheadUs;
+  sendData(paramBytes);
+}
+
+void Adafruit_ST7789::sendData(uint64_t bytes) {
+  stats_.dataBytes += bytes;
+  stats_.busUs += bytes * 8.0 * 1e6 / spiHz;
+}
+
+void Adafruit_ST7789::startWrite() {
+  host::internal::spiWaitIdle();
+  ++stats_.transactions;
+  stats_.busUs += txnOverheadUs;
+  chargeBusTime(txnOverheadUs);
+}
+
+void Adafruit_ST7789::endWrite() {}
+
+void Adafruit_ST7789::chargeBusTime(double us) {
+  owedUs_ += us;
+  if (owedUs_ >= 1.0) {
+    uint64_t whole = (uint64_t)owedUs_;
+    host::advanceUs(whole);
+    owedUs_ -= whole;
+  }
+}
+
+void Adafruit_ST7789::setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h) {
+  ++stats_.addrWindows;
+  double before = stats_.busUs;
+  sendCommand(4); // CASET
+  sendCommand(4); // RASET
+  sendCommand(0); // RAMWR
+  winX0_ = curX_ = x;
+  winY0_ = curY_ = y;
+  winX1_ = x + (w ? w - 1 : 0);
+  winY1_ = y + (h ? h - 1 : 0);
+  chargeBusTime(stats_.busUs - before);
+}
+
+void Adafruit_ST7789::putPixel(uint16_t color) {
+  if (curX_ < _width && curY_ < _height) fb_[(size_t)curY_ * _width + curX_] = color;
+  if (++curX_ > winX1_) {
+    curX_ = winX0_;
+    if (++curY_ > winY1_) curY_ = winY0_;
+  }
+}
+
+void Adafruit_ST7789::writePixels(uint16_t *colors, uint32_t len, bool, bool bigEndian) {
+  double before = stats_.busUs;
+  for (uint32_t i = 0; i < len; ++i) {
+    uint16_t c = colors[i];
+    putPixel(bigEndian ? (uint16_t)(c << 8 | c >> 8) : c);
+  }
+  stats_.pixels += len;
+  sendData((uint64_t)len * 2);
+  chargeBusTime(stats_.busUs - before);
+}
+
+void Adafruit_ST7789::writeColor(uint16_t color, uint32_t len) {
+  double before = stats_.busUs;
+  for (uint32_t i = 0; i < len; ++i) putPixel(color);
+  stats_.pixels += len;
+  sendData((uint64_t)len * 2);
+  chargeBusTime(stats_.busUs - before);
+}
+
+void Adafruit_ST7789::writePixel(int16_t x, int16_t y, uint16_t color) {
+  if (x < 0 || y < 0 || x >= _width || y >= _height) return;
+  setAddrWindow(x, y, 1, 1);
+  writeColor(color, 1);
+}
+
+void Adafruit_ST7789::writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if (w < 0) { x += w + 1; w = -w; }
+  if (h < 0) { y += h + 1; h = -h; }
+  if (x < 0) { w += x; x = 0; }
+  if (y < 0) { h += y; y = 0; }
+  if (x + w > _width) w = _width - x;
+  if (y + h > _height) h = _height - y;
+  if (w <= 0 || h <= 0) return;
+  setAddrWindow(x, y, w, h);
+  writeColor(color, (uint32_t)w * h);
+}
+
+void Adafruit_ST7789::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  startWrite();
+  writePixel(x, y, color);
+  endWrite();
+}
+
+void Adafruit_ST7789::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  startWrite();
+  writeFillRect(x, y, w, h, color);
+  endWrite();
+}
+
+void Adafruit_ST7789::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  if (x0 == x1) {
+    if (y0 > y1) std::swap(y0, y1);
+    fillRect(x0, y0, 1, y1 - y0 + 1, color);
+    return;
+  }
+  if (y0 == y1) {
+    if (x0 > x1) std::swap(x0, x1);
+    fillRect(x0, y0, x1 - x0 + 1, 1, color);
+    return;
+  }
+  startWrite();
+  bool steep = std::abs(y1 - y0) > std::abs(x1 - x0);
+  if (steep) { std::swap(x0, y0); std::swap(x1, y1); }
+  if (x0 > x1) { std::swap(x0, x1); std::swap(y0, y1); }
+  int16_t dx = x1 - x0, dy = std::abs(y1 - y0);
+  int16_t err = dx / 2, ystep = y0 < y1 ? 1 : -1;
+  for (; x0 <= x1; ++x0) {
+    if (steep) writePixel(y0, x0, color);
+    else writePixel(x0, y0, color);
+    err -= dy;
+    if (err < 0) { y0 += ystep; err += dx; }
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+  startWrite();
+  int16_t f = 1 - r, ddx = 1, ddy = -2 * r, x = 0, y = r;
+  writePixel(x0, y0 + r, color);
+  writePixel(x0, y0 - r, color);
+  writePixel(x0 + r, y0, color);
+  writePixel(x0 - r, y0, color);
+  while (x < y) {
+    if (f >= 0) { --y; ddy += 2; f += ddy; }
+    ++x; ddx += 2; f += ddx;
+    writePixel(x0 + x, y0 + y, color); writePixel(x0 - x, y0 + y, color);
+    writePixel(x0 + x, y0 - y, color); writePixel(x0 - x, y0 - y, color);
+    writePixel(x0 + y, y0 + x, color); writePixel(x0 - y, y0 + x, color);
+    writePixel(x0 + y, y0 - x, color); writePixel(x0 - y, y0 - x, color);
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) {
+  // Same vertical-span decomposition as Adafruit's fillCircleHelper
+  startWrite();
+  writeFillRect(x0, y0 - r, 1, 2 * r + 1, color);
+  int16_t f = 1 - r, ddx = 1, ddy = -2 * r, x = 0, y = r, px = x, py = y;
+  while (x < y) {
+    if (f >= 0) { --y; ddy += 2; f += ddy; }
+    ++x; ddx += 2; f += ddx;
+    if (x < (y + 1)) {
+      writeFillRect(x0 + x, y0 - y, 1, 2 * y + 1, color);
+      writeFillRect(x0 - x, y0 - y, 1, 2 * y + 1, color);
+    }
+    if (y != py) {
+      writeFillRect(x0 + py, y0 - px, 1, 2 * px + 1, color);
+      writeFillRect(x0 - py, y0 - px, 1, 2 * px + 1, color);
+      py = y;
+    }
+    px = x;
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) {
+  if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+  if (y1 > y2) { std::swap(y2, y1); std::swap(x2, x1); }
+  if (y0 > y1) { std::swap(y0, y1); std::swap(x0, x1); }
+  startWrite();
+  for (int y = y0; y <= y2; ++y) {
+    auto edge = [](int ya, int xa, int yb, int xb, int yy) {
+      return yb == ya ? xa : xa + (xb - xa) * (yy - ya) / (yb - ya);
+    };
+    int a = edge(y0, x0, y2, x2, y);
+    int b = y < y1 ? edge(y0, x0, y1, x1, y) : edge(y1, x1, y2, x2, y);
+    if (a > b) std::swap(a, b);
+    writeFillRect(a, y, b - a + 1, 1, color);
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::drawRGBBitmap(int16_t x, int16_t y, uint16_t *bitmap, int16_t w, int16_t h) {
+  startWrite();
+  for (int16_t j = 0; j < h; ++j) {
+    for (int16_t i = 0; i < w; ++i) writePixel(x + i, y + j, bitmap[j * w + i]);
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t sx, uint8_t sy) {
+  // No font table on the host: each column gets a fixed pseudo-random
+  // 7-bit pattern (about half the pixels lit, like the 5x7 classic font)
+  // so the per-pixel traffic of Adafruit's drawChar is reproduced.
+  startWrite();
+  for (int i = 0; i < 6; ++i) {
+    uint8_t line = 0;
+    if (i < 5 && c > ' ') line = (uint8_t)(((c * 2654435761u) >> (i * 5)) & 0x7F);
+    for (int j = 0; j < 8; ++j, line >>= 1) {
+      bool on = line & 1;
+      if (!on && bg == color) continue;
+      uint16_t col = on ? color : bg;
+      if (sx == 1 && sy == 1) writePixel(x + i, y + j, col);
+      else writeFillRect(x + i * sx, y + j * sy, sx, sy, col);
+    }
+  }
+  endWrite();
+}
+
+void Adafruit_ST7789::hostBusTransfer(const uint8_t *data, size_t len, double busUs) {
+  for (Adafruit_ST7789 *p : busPanels()) {
+    if (p->csPin_ < 0 || host::pinState(p->csPin_) == LOW) {
+      p->busReceive(p->dcPin_ < 0 || host::pinState(p->dcPin_) == HIGH, data, len, busUs);
+    }
+  }
+}
+
+void Adafruit_ST7789::busReceive(bool dc, const uint8_t *data, size_t len, double busUs) {
+  ++stats_.queuedTransfers;
+  stats_.busUs += busUs;
+  if (!dc) {
+    stats_.commandBytes += len;
+    if (len == 0) return;
+    busCmd_ = data[len - 1];
+    busParamCount_ = 0;
+    busPixelHalf_ = false;
+    if (busCmd_ == 0x2C) { // RAMWR
+      ++stats_.addrWindows;
+      curX_ = winX0_;
+      curY_ = winY0_;
+    }
+    return;
+  }
+  stats_.dataBytes += len;
+  for (size_t i = 0; i < len; ++i) {
+    uint8_t b = data[i];
+    if (busCmd_ == 0x2A || busCmd_ == 0x2B) { // CASET, RASET
+      if (busParamCount_ < 4) busParams_[busParamCount_++] = b;
+      if (busParamCount_ == 4) {
+        int lo = busParams_[0] << 8 | busParams_[1], hi = busParams_[2] << 8 | busParams_[3];
+        // RAM to logical coordinates; anything before the visible area
+        // wraps to a large value and is dropped by putPixel()
+        if (busCmd_ == 0x2A) { winX0_ = lo - xStart_; winX1_ = hi - xStart_; }
+        else { winY0_ = lo - yStart_; winY1_ = hi - yStart_; }
+      }
+    } else if (busCmd_ == 0x2C) {
+      if (!busPixelHalf_) {
+        busPixelHi_ = b;
+        busPixelHalf_ = true;
+      } else {
+        putPixel((uint16_t)(busPixelHi_ << 8 | b));
+        ++stats_.pixels;
+        busPixelHalf_ = false;
+      }
+    }
+  }
+}
+
+uint32_t Adafruit_ST7789::hostChecksum() const {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (uint16_t p : fb_) {
+    h = (h ^ (p & 0xFF)) * 16777619u;
+    h = (h ^ (p >> 8)) * 16777619u;
+  }
+  return h;
+}
@@ -0,0 +1,108 @@
+// Host stand-in for Adafruit_ST7789 on hardware SPI. Keeps a framebuffer
+// and accounts every transaction the real driver would put on the bus:
+// startWrite/endWrite pairs (CS toggles), address windows (CASET, RASET
+// and RAMWR: 3 command bytes plus 8 parameter bytes) and pixel data.
+// Bus time is estimated from the byte counts at spiHz plus a fixed cost
+// per transaction and per command, and is charged to the sketch clock
+// because the Adafruit write path blocks until the bus is idle.
+//
+// The panel also listens on the SPI master stand-in (driver/spi_master.h):
+// bytes queued there while its CS pin is low are decoded as ST7789
+// commands (CASET, RASET, RAMWR) and pixel data, with DC read from its DC
+// pin. Like the real controller, those windows are in RAM coordinates:
+// panels smaller than 240x320 sit at the offsets init() and setRotation()
+// pick (the same ones the Adafruit driver uses), and bytes outside the
+// visible area are lost.
+#pragma once
+
+#include <vector>
+
+#include "Adafruit_GFX.h"
+#include "SPI.h"
+
+#define ST77XX_BLACK 0x0000
+#define ST77XX_WHITE 0xFFFF
+#define ST77XX_RED 0xF800
+#define ST77XX_GREEN 0x07E0
+#define ST77XX_BLUE 0x001F
+#define ST77XX_CYAN 0x07FF
+#define ST77XX_MAGENTA 0xF81F
+#define ST77XX_YELLOW 0xFFE0
+#define ST77XX_ORANGE 0xFC00
+
+struct PanelStats {
+  uint64_t transactions = 0;   // startWrite() calls
+  uint64_t addrWindows = 0;    // setAddrWindow() calls
+  uint64_t commandBytes = 0;   // bytes sent with DC low
+  uint64_t dataBytes = 0;      // parameter and pixel bytes sent with DC high
+  uint64_t pixels = 0;         // pixels written to RAM
+  uint64_t queuedTransfers = 0; // SPI master transactions that reached the panel
+  double busUs = 0;            // estimated time the bus was busy
+};
+
+class Adafruit_ST7789 : public Adafruit_GFX {
+public:
+  Adafruit_ST7789(int8_t cs, int8_t dc, int8_t rst);
+  Adafruit_ST7789(int8_t cs, int8_t dc, int8_t mosi, int8_t sclk, int8_t rst);
+  ~Adafruit_ST7789();
+
+  void init(uint16_t width, uint16_t height, uint8_t spiMode = SPI_MODE0);
+  void setRotation(uint8_t r) override;
+  void setSPISpeed(uint32_t freq) { spiHz = freq; }
+  void invertDisplay(bool) {}
+  void enableDisplay(bool) {}
+
+  void startWrite();
+  void endWrite();
+  void setAddrWindow(uint16_t x, uint16_t y, uint16_t w, uint16_t h);
+  void writePixels(uint16_t *colors, uint32_t len, bool block = true, bool bigEndian = false);
+  void writeColor(uint16_t color, uint32_t len);
+  void writePixel(int16_t x, int16_t y, uint16_t color);
+  void writeFillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) override;
+  void drawCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) override;
+  void fillCircle(int16_t x0, int16_t y0, int16_t r, uint16_t color) override;
+  void fillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, uint16_t color) override;
+  void drawRGBBitmap(int16_t x, int16_t y, uint16_t *bitmap, int16_t w, int16_t h);
+
+  // ----- host side -----
+  uint32_t spiHz = 40000000;
+  double txnOverheadUs = 1.0;   // bus lock, CS and mode setup per transaction
+  double cmdOverheadUs = 0.25;  // DC switch around every command byte
+
+  const PanelStats &hostStats() const { return stats_; }
+  void hostResetStats() { stats_ = PanelStats(); }
+  // Framebuffer in logical (rotated) coordinates, RGB565.
+  const std::vector<uint16_t> &hostFramebuffer() const { return fb_; }
+  uint16_t hostPixel(int x, int y) const { return fb_[(size_t)y * _width + x]; }
+  uint32_t hostChecksum() const;
+  // Called by the SPI master stand-in for every queued transaction.
+  static void hostBusTransfer(const uint8_t *data, size_t len, double busUs);
+
+protected:
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t sx, uint8_t sy) override;
+
+private:
+  void sendCommand(uint32_t paramBytes);
+  void sendData(uint64_t bytes);
+  void putPixel(uint16_t color);
+  void chargeBusTime(double us);
+  void busReceive(bool dc, const uint8_t *data, size_t len, double busUs);
+
+  PanelStats stats_;
+  std::vector<uint16_t> fb_;
+  uint16_t winX0_ = 0, winY0_ = 0, winX1_ = 0, winY1_ = 0;
+  int16_t colStart_ = 0, colStart2_ = 0, rowStart_ = 0, rowStart2_ = 0;
+  int16_t xStart_ = 0, yStart_ = 0; // RAM offset of the visible area
+  uint16_t curX_ = 0, curY_ = 0;
+  double owedUs_ = 0;
+  int8_t csPin_, dcPin_;
+  uint8_t busCmd_ = 0;
+  uint8_t busParams_[4] = {0, 0, 0, 0};
+  size_t busParamCount_ = 0;
+  bool busPixelHalf_ = false;
+  uint8_t busPixelHi_ = 0;
+};
@@ -0,0 +1,221 @@
+#include "Arduino.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "HostInternal.h"
+#include "HostSim.h"
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+EspClass ESP;
+
+namespace host {
+
+static const auto kStart = std::chrono::steady_clock::now();
+static uint64_t gVirtualUs = 0;
+static bool gRealTime = true;
+
+uint64_t nowUs() {
+  if (!gRealTime) return gVirtualUs;
+  auto real = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - kStart);
+  return (uint64_t)real.count() + gVirtualUs;
+}
+
+uint64_t virtualUs() { return gVirtualUs; }
+
+void advanceUs(uint64_t us) {
+  if (!internal::sleepTaskUs(us)) gVirtualUs += us;
+}
+
+void setRealTime(bool on) { gRealTime = on; }
+bool realTime() { return gRealTime; }
+
+namespace internal {
+void jumpClockUs(uint64_t us) { gVirtualUs += us; }
+
+void idleWaitUs(uint64_t us) {
+  if (!sleepTaskUs(us, true)) idleUs(us);
+}
+} // namespace internal
+
+// Without real time, a sketch that polls millis() in a loop would never
+// see it move; charge each read a microsecond instead.
+static uint64_t readClockUs() {
+  if (!gRealTime) internal::jumpClockUs(1);
+  return nowUs();
+}
+
+// Each block carries its size in a header so frees can be accounted.
+struct alignas(16) BlockHeader {
+  size_t size;
+  bool counted; // false: an OffSketchHeap block
+};
+
+static thread_local bool tOffSketchHeap = false;
+
+namespace internal {
+bool offSketchHeap() { return tOffSketchHeap; }
+void setOffSketchHeap(bool on) { tOffSketchHeap = on; }
+} // namespace internal
+
+OffSketchHeap::OffSketchHeap() : saved_(tOffSketchHeap) { tOffSketchHeap = true; }
+OffSketchHeap::~OffSketchHeap() { tOffSketchHeap = saved_; }
+
+static HeapStats gHeap = {320 * 1024, 80 * 1024, 0, 0, 0, 0, 0};
+
+HeapStats &heap() { return gHeap; }
+
+void resetHeapCounters() {
+  gHeap.peak = gHeap.inUse;
+  gHeap.allocations = gHeap.frees = gHeap.failures = 0;
+}
+
+void *heapAlloc(size_t n) {
+  if (tOffSketchHeap) {
+    auto *h = static_cast<BlockHeader *>(std::malloc(sizeof(BlockHeader) + n));
+    if (!h) return nullptr;
+    h->size = n;
+    h->counted = false;
+    return h + 1;
+  }
+  if (gHeap.reserved + gHeap.inUse + n > gHeap.capacity) {
+    ++gHeap.failures;
+    return nullptr;
+  }
+  auto *h = static_cast<BlockHeader *>(std::malloc(sizeof(BlockHeader) + n));
+  if (!h) {
+    ++gHeap.failures;
+    return nullptr;
+  }
+  h->size = n;
+  h->counted = true;
+  gHeap.inUse += n;
+  gHeap.peak = std::max(gHeap.peak, gHeap.inUse);
+  ++gHeap.allocations;
+  return h + 1;
+}
+
+void *heapCalloc(size_t n, size_t size) {
+  void *p = heapAlloc(n * size);
+  if (p) std::memset(p, 0, n * size);
+  return p;
+}
+
+void *heapRealloc(void *p, size_t n) {
+  if (!p) return heapAlloc(n);
+  auto *h = static_cast<BlockHeader *>(p) - 1;
+  void *q = heapAlloc(n);
+  if (!q) return nullptr;
+  std::memcpy(q, p, std::min(h->size, n));
+  heapFree(p);
+  return q;
+}
+
+void heapFree(void *p) {
+  if (!p) return;
+  auto *h = static_cast<BlockHeader *>(p) - 1;
+  if (h->counted) {
+    gHeap.inUse -= h->size;
+    ++gHeap.frees;
+  }
+  std::free(h);
+}
+
+static int gPins[64];
+
+int pinState(int pin) { return (pin >= 0 && pin < 64) ? gPins[pin] : 0; }
+
+Sensors &sensors() {
+  static Sensors s;
+  return s;
+}
+
+DecodeStats &decodeStats() {
+  static DecodeStats d;
+  return d;
+}
+
+static bool gSerialEcho = false;
+static uint64_t gSerialBytes = 0;
+
+void setSerialEcho(bool on) { gSerialEcho = on; }
+uint64_t serialBytes() { return gSerialBytes; }
+
+} // namespace host
+
+unsigned long millis() { return (unsigned long)(host::readClockUs() / 1000); }
+unsigned long micros() { return (unsigned long)host::readClockUs(); }
+void delay(unsigned long ms) { host::internal::idleWaitUs((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { host::advanceUs(us); }
+void yield() { host::advanceUs(0); }
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < 64) host::gPins[pin] = val ? HIGH : LOW;
+}
+int digitalRead(uint8_t pin) { return host::pinState(pin); }
+int analogRead(uint8_t) { return 0; }
+
+static std::mt19937 gRng(1);
+long random(long max) { return max > 0 ? (long)(gRng() % (unsigned long)max) : 0; }
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+void randomSeed(unsigned long seed) { gRng.seed((uint32_t)seed); }
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+size_t Print::write(const char *s) {
+  if (!s) return 0;
+  return write((const uint8_t *)s, std::strlen(s));
+}
+
+size_t Print::printf(const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  if ((size_t)n < sizeof(buf)) return write((const uint8_t *)buf, n);
+  std::string big(n + 1, '\0');
+  va_start(ap, fmt);
+  std::vsnprintf(&big[0], big.size(), fmt, ap);
+  va_end(ap);
+  return write((const uint8_t *)big.data(), n);
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t, int8_t) {
+  if (uart_ != 0) host::internal::uartBegin(uart_, (uint32_t)baud);
+}
+
+int HardwareSerial::available() { return uart_ != 0 ? host::internal::uartAvailable(uart_) : 0; }
+int HardwareSerial::read() { return uart_ != 0 ? host::internal::uartRead(uart_) : -1; }
+void HardwareSerial::flush() {
+  if (uart_ != 0) host::internal::uartFlush(uart_);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t *buf, size_t len) {
+  if (uart_ != 0) return host::internal::uartWrite(uart_, buf, len);
+  host::gSerialBytes += len;
+  if (host::gSerialEcho && uart_ == 0) std::fwrite(buf, 1, len, stdout);
+  return len;
+}
+
+uint32_t EspClass::getHeapSize() { return (uint32_t)host::gHeap.capacity; }
+
+uint32_t EspClass::getFreeHeap() {
+  return (uint32_t)(host::gHeap.capacity - host::gHeap.reserved - host::gHeap.inUse);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return (uint32_t)(host::gHeap.capacity - host::gHeap.reserved - host::gHeap.peak);
+}
+
+uint32_t EspClass::getMaxAllocHeap() { return getFreeHeap(); }
+
+void EspClass::restart() { throw host::RestartRequested(); }
@@ -0,0 +1,123 @@
+#include "DFPlayerSim.h"
+
+#include <algorithm>
+
+namespace host {
+
+namespace {
+
+uint16_t checksum(const uint8_t *f) {
+  uint16_t sum = 0;
+  for (int i = 1; i < 7; ++i) sum += f[i];
+  return (uint16_t)-sum;
+}
+
+} // namespace
+
+DFPlayerSim::DFPlayerSim(int uart, const Config &config) : uart_(uart), config_(config) {}
+
+void DFPlayerSim::powerOn() {
+  uartAttach(uart_, this, 9600);
+  len_ = 0;
+  finishUs_.clear();
+  onlineAtUs_ = nowUs() + config_.bootMs * 1000ull;
+  reply(0x3F, 0x02, onlineAtUs_); // SD card online
+}
+
+void DFPlayerSim::received(uint8_t b, uint64_t atUs) {
+  if (len_ == 0 && b != 0x7E) return; // resync on the start byte
+  buf_[len_++] = b;
+  if (len_ < 10) return;
+  len_ = 0;
+  if (buf_[9] != 0xEF) return;
+  frame(buf_, atUs);
+}
+
+void DFPlayerSim::frame(const uint8_t *f, uint64_t atUs) {
+  ++frames_;
+  if (config_.loseEvery > 0 && frames_ % config_.loseEvery == 0) {
+    ++lost_;
+    return;
+  }
+  bool garbled = config_.corruptEvery > 0 && frames_ % config_.corruptEvery == 0;
+  if (atUs < onlineAtUs_) {
+    ++ignored_;
+    return;
+  }
+  if (garbled || (uint16_t)(f[7] << 8 | f[8]) != checksum(f)) {
+    ++badChecksums_;
+    reply(0x40, 0x04, atUs + 1000);
+    return;
+  }
+
+  uint8_t cmd = f[3];
+  bool feedback = f[4] != 0;
+  uint16_t param = (uint16_t)(f[5] << 8 | f[6]);
+
+  if (cmd == 0x3F) { // which storage is online
+    reply(0x3F, 0x02, atUs + 1000);
+    return;
+  }
+
+  finishUs_.erase(std::remove_if(finishUs_.begin(), finishUs_.end(), [&](uint64_t t) { return t <= atUs; }),
+                  finishUs_.end());
+  if ((int)finishUs_.size() >= config_.depth) {
+    ++overruns_;
+    return;
+  }
+  uint64_t start = finishUs_.empty() ? atUs : std::max(atUs, finishUs_.back());
+  uint64_t done = start + config_.commandUs;
+  finishUs_.push_back(done);
+
+  uint8_t error = 0;
+  switch (cmd) {
+  case 0x03:
+  case 0x12: // track, track in /MP3
+    if (param == 0 || param > config_.tracks) {
+      error = 0x06; // file not found
+    } else {
+      track_ = param;
+      playing_ = true;
+      paused_ = false;
+    }
+    break;
+  case 0x06:
+    volume_ = std::min<int>(param, 30);
+    break;
+  case 0x0C: // reset: offline until the card is read again
+    playing_ = paused_ = false;
+    onlineAtUs_ = done + config_.bootMs * 1000ull;
+    reply(0x3F, 0x02, onlineAtUs_);
+    break;
+  case 0x0D:
+    if (track_ > 0) {
+      playing_ = true;
+      paused_ = false;
+    }
+    break;
+  case 0x0E:
+    if (playing_) paused_ = true;
+    break;
+  case 0x16:
+    playing_ = paused_ = false;
+    break;
+  default:
+    break;
+  }
+  if (error) {
+    reply(0x40, error, done);
+    return;
+  }
+  applied_.push_back({cmd, param, start});
+  if (feedback) reply(0x41, 0, done);
+}
+
+void DFPlayerSim::reply(uint8_t cmd, uint16_t param, uint64_t atUs) {
+  uint8_t f[10] = {0x7E, 0xFF, 0x06, cmd, 0x00, (uint8_t)(param >> 8), (uint8_t)param, 0, 0, 0xEF};
+  uint16_t sum = checksum(f);
+  f[7] = (uint8_t)(sum >> 8);
+  f[8] = (uint8_t)sum;
+  uartReply(uart_, f, sizeof(f), atUs);
+}
+
+} // namespace host
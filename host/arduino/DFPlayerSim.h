@@ -0,0 +1,73 @@
+// A DFPlayer Mini on a simulated UART (see host::UartDevice). It parses
+// the module's 10-byte command frames, carries them out one at a time and
+// answers the way the module does: an ACK (0x41) when feedback was asked
+// for, an error (0x40) for bad checksums or missing files, and 0x3F once
+// its SD card is online. Line loss, corruption and overrun of the
+// module's small command buffer can be switched on to exercise retries.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "HostSim.h"
+
+namespace host {
+
+class DFPlayerSim : public UartDevice {
+public:
+  struct Config {
+    uint32_t bootMs = 1500;     // power-on or reset until the card is online
+    uint32_t commandUs = 20000; // to carry out one command; its ACK follows
+    int depth = 2;              // commands held while busy; more are lost
+    int loseEvery = 0;          // drop every Nth frame on the line (0: never)
+    int corruptEvery = 0;       // garble every Nth frame (checksum error)
+    uint16_t tracks = 12;       // files in /MP3
+  };
+
+  // A command the module carried out
+  struct Applied {
+    uint8_t cmd;
+    uint16_t param;
+    uint64_t atUs; // when it started on it
+  };
+
+  DFPlayerSim(int uart, const Config &config);
+
+  // Wires the module to the UART; it comes online bootMs later
+  void powerOn();
+  void received(uint8_t b, uint64_t atUs) override;
+
+  const std::vector<Applied> &applied() const { return applied_; }
+  void clearApplied() { applied_.clear(); }
+  Config &config() { return config_; }
+
+  int volume() const { return volume_; }
+  uint16_t track() const { return track_; }
+  bool playing() const { return playing_; }
+  bool paused() const { return paused_; }
+
+  uint64_t frames() const { return frames_; }       // complete frames seen
+  uint64_t lost() const { return lost_; }           // dropped by loseEvery
+  uint64_t badChecksums() const { return badChecksums_; }
+  uint64_t overruns() const { return overruns_; }   // lost to a full buffer
+  uint64_t ignored() const { return ignored_; }     // arrived while offline
+
+private:
+  void frame(const uint8_t *f, uint64_t atUs);
+  void reply(uint8_t cmd, uint16_t param, uint64_t atUs);
+
+  int uart_;
+  Config config_;
+  uint8_t buf_[10];
+  int len_ = 0;
+  uint64_t onlineAtUs_ = 0;
+  std::vector<uint64_t> finishUs_; // commands accepted and not yet done
+  std::vector<Applied> applied_;
+  int volume_ = 30;
+  uint16_t track_ = 0;
+  bool playing_ = false;
+  bool paused_ = false;
+  uint64_t frames_ = 0, lost_ = 0, badChecksums_ = 0, overruns_ = 0, ignored_ = 0;
+};
+
+} // namespace host
@@ -0,0 +1,26 @@
+// Host stand-in for the Adafruit DHT sensor library.
+#pragma once
+
+#include "Arduino.h"
+#include "HostSim.h"
+
+#define DHT11 11
+#define DHT12 12
+#define DHT21 21
+#define DHT22 22
+#define AM2301 21
+
+class DHT {
+public:
+  DHT(uint8_t pin, uint8_t type, uint8_t count = 6) { (void)pin; (void)type; (void)count; }
+  void begin(uint8_t usecDelay = 55) { (void)usecDelay; }
+  float readTemperature(bool fahrenheit = false, bool force = false) {
+    (void)force;
+    float c = host::sensors().temperature;
+    return fahrenheit ? c * 1.8f + 32 : c;
+  }
+  float readHumidity(bool force = false) {
+    (void)force;
+    return host::sensors().humidity;
+  }
+};
@@ -0,0 +1,22 @@
+// Host stand-in for the captive-portal DNS server.
+#pragma once
+
+#include "Arduino.h"
+
+class DNSServer {
+public:
+  bool start(uint16_t port, const String &domain, const IPAddress &ip) {
+    (void)port; (void)domain; (void)ip;
+    running_ = true;
+    return true;
+  }
+  void stop() { running_ = false; }
+  void processNextRequest() { ++polls_; }
+
+  bool running() const { return running_; }
+  uint64_t polls() const { return polls_; }
+
+private:
+  bool running_ = false;
+  uint64_t polls_ = 0;
+};
@@ -0,0 +1,184 @@
+// ESP-NOW over one simulated channel (see host::EspNowSim).
+
+#include "esp_now.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#include "Arduino.h"
+#include "HostSim.h"
+
+namespace {
+
+host::EspNowSim gSim;
+bool gInit = false;
+esp_now_recv_cb_t gRecv = nullptr;
+esp_now_send_cb_t gSent = nullptr;
+std::vector<std::array<uint8_t, 6>> gPeers;
+std::vector<host::EspNowNode *> gNodes;
+uint64_t gAirFreeUs = 0;
+uint32_t gSketchLoss = 0x5EED;
+const uint8_t kSketchMac[6] = {0x24, 0xA1, 0x60, 0xC0, 0xFF, 0xEE}; // WiFi.macAddress()
+
+bool isBroadcast(const uint8_t *mac) {
+  for (int i = 0; i < 6; ++i) {
+    if (mac[i] != 0xFF) return false;
+  }
+  return true;
+}
+
+bool lose(uint32_t &state, int pct) {
+  if (pct <= 0) return false;
+  state = state * 1103515245u + 12345u;
+  return (int)((state >> 16) % 100) < pct;
+}
+
+// Holds the channel for us from when it is free; returns when that is over
+void occupy(uint32_t us) {
+  uint64_t now = host::nowUs();
+  gAirFreeUs = std::max(now, gAirFreeUs) + us;
+  gSim.airUs += us;
+  ++gSim.frames;
+  host::advanceUs(gAirFreeUs - now);
+}
+
+int findPeer(const uint8_t *mac) {
+  for (size_t i = 0; i < gPeers.size(); ++i) {
+    if (std::memcmp(gPeers[i].data(), mac, 6) == 0) return (int)i;
+  }
+  return -1;
+}
+
+} // namespace
+
+namespace host {
+
+class EspNowChannel {
+public:
+  // from is nullptr for the sketch
+  static bool transmit(EspNowNode *from, const uint8_t *to, const uint8_t *data, int len) {
+    const uint8_t *fromMac = from ? from->mac_ : kSketchMac;
+    uint32_t air = espNowAirUs(len);
+    gSim.bytes += len;
+    if (isBroadcast(to)) {
+      occupy(air);
+      std::vector<EspNowNode *> nodes = gNodes; // a callback may attach or detach
+      for (EspNowNode *node : nodes) {
+        if (node != from) deliver(node, fromMac, data, len);
+      }
+      if (from) deliver(nullptr, fromMac, data, len);
+      return true;
+    }
+    bool toSketch = from && std::memcmp(to, kSketchMac, 6) == 0;
+    EspNowNode *target = nullptr;
+    for (EspNowNode *node : gNodes) {
+      if (node != from && std::memcmp(node->mac_, to, 6) == 0) target = node;
+    }
+    for (int i = 0; i < gSim.unicastTries; ++i) {
+      occupy(air + gSim.ackUs);
+      if ((toSketch || target) && deliver(target, fromMac, data, len)) return true;
+    }
+    return false;
+  }
+
+private:
+  // To node, or to the sketch if node is nullptr; false if lost
+  static bool deliver(EspNowNode *node, const uint8_t *from, const uint8_t *data, int len) {
+    if (node == nullptr && (!gInit || gRecv == nullptr)) return false;
+    if (node ? lose(node->lossState_, node->lossPct) : lose(gSketchLoss, gSim.lossPct)) {
+      ++gSim.lost;
+      return false;
+    }
+    if (node) {
+      node->received(from, data, len);
+    } else {
+      gRecv(from, data, len);
+    }
+    return true;
+  }
+};
+
+EspNowSim &espNowSim() { return gSim; }
+
+uint32_t espNowAirUs(size_t len) {
+  return gSim.frameOverheadUs + (uint32_t)((len + gSim.macBytes) * 8 / gSim.phyMbps);
+}
+
+EspNowNode::EspNowNode(const uint8_t mac[6]) {
+  std::memcpy(mac_, mac, 6);
+  lossState_ = (uint32_t)mac[3] << 16 | (uint32_t)mac[4] << 8 | mac[5];
+}
+
+bool EspNowNode::send(const uint8_t *to, const uint8_t *data, int len) {
+  return EspNowChannel::transmit(this, to, data, len);
+}
+
+void espNowAttach(EspNowNode *node) {
+  if (std::find(gNodes.begin(), gNodes.end(), node) == gNodes.end()) gNodes.push_back(node);
+}
+
+void espNowDetach(EspNowNode *node) { gNodes.erase(std::remove(gNodes.begin(), gNodes.end(), node), gNodes.end()); }
+
+} // namespace host
+
+esp_err_t esp_now_init(void) {
+  gInit = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_deinit(void) {
+  gInit = false;
+  gRecv = nullptr;
+  gSent = nullptr;
+  gPeers.clear();
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb) {
+  if (!gInit) return ESP_ERR_ESPNOW_NOT_INIT;
+  gRecv = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb) {
+  if (!gInit) return ESP_ERR_ESPNOW_NOT_INIT;
+  gSent = cb;
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer) {
+  if (!gInit) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (peer == nullptr) return ESP_ERR_ESPNOW_ARG;
+  if (findPeer(peer->peer_addr) >= 0) return ESP_ERR_ESPNOW_EXIST;
+  if (gPeers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM) return ESP_ERR_ESPNOW_FULL;
+  std::array<uint8_t, 6> mac;
+  std::memcpy(mac.data(), peer->peer_addr, 6);
+  gPeers.push_back(mac);
+  return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer_addr) {
+  if (!gInit) return ESP_ERR_ESPNOW_NOT_INIT;
+  int i = peer_addr ? findPeer(peer_addr) : -1;
+  if (i < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+  gPeers.erase(gPeers.begin() + i);
+  return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr) { return gInit && peer_addr && findPeer(peer_addr) >= 0; }
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len) {
+  if (!gInit) return ESP_ERR_ESPNOW_NOT_INIT;
+  if (data == nullptr || len == 0 || len > ESP_NOW_MAX_DATA_LEN) return ESP_ERR_ESPNOW_ARG;
+  if (peer_addr == nullptr) {
+    std::vector<std::array<uint8_t, 6>> peers = gPeers;
+    for (const auto &p : peers) esp_now_send(p.data(), data, len);
+    return ESP_OK;
+  }
+  if (findPeer(peer_addr) < 0) return ESP_ERR_ESPNOW_NOT_FOUND;
+  bool ok = host::EspNowChannel::transmit(nullptr, peer_addr, data, (int)len);
+  if (gSent) gSent(peer_addr, ok ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+  return ESP_OK;
+}
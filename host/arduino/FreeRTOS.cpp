@@ -0,0 +1,372 @@
+#include "freertos/FreeRTOS.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "HostInternal.h"
+#include "HostSim.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct HostTask {
+  enum State { RUNNING, RUNNABLE, SLEEPING, BLOCKED, DONE };
+  std::string name;
+  TaskFunction_t fn = nullptr;
+  void *arg = nullptr;
+  int core = 1;
+  State state = RUNNABLE;
+  bool hasToken = false;
+  uint64_t readySeq = 0;
+  uint64_t wakeUs = 0;        // SLEEPING, or BLOCKED with a timeout
+  bool idleSleep = false;     // SLEEPING in a delay rather than on a bus
+  const void *waitObj = nullptr;
+  bool timedOut = false;
+  uint32_t notify = 0;
+  bool offSketchHeap = false; // see host::OffSketchHeap
+  std::condition_variable cv;
+};
+
+struct HostSyncObject {
+  bool isQueue = false;
+  UBaseType_t count = 0, maxCount = 1;          // semaphores
+  UBaseType_t length = 0, itemSize = 0;         // queues
+  std::deque<std::vector<uint8_t>> items;
+};
+
+namespace {
+
+const uint64_t kForever = UINT64_MAX;
+
+struct TaskDeleted {};
+
+// Never destroyed: task threads may still be parked on these at exit.
+std::mutex &lock() {
+  static std::mutex *m = new std::mutex;
+  return *m;
+}
+std::vector<HostTask *> &tasks() {
+  static std::vector<HostTask *> *v = new std::vector<HostTask *>;
+  return *v;
+}
+uint64_t gReadySeq = 0;
+uint64_t gSwitches = 0;
+thread_local HostTask *tSelf = nullptr;
+
+// The thread that first touches the scheduler becomes the loop task.
+HostTask *self() {
+  if (!tSelf) {
+    tSelf = new HostTask;
+    tSelf->name = "loopTask";
+    tSelf->state = HostTask::RUNNING;
+    tSelf->hasToken = true;
+    tasks().push_back(tSelf);
+  }
+  return tSelf;
+}
+
+size_t liveTasks() {
+  size_t n = 0;
+  for (HostTask *t : tasks()) n += t->state != HostTask::DONE;
+  return n;
+}
+
+void makeRunnable(HostTask *t) {
+  t->state = HostTask::RUNNABLE;
+  t->readySeq = ++gReadySeq;
+}
+
+void wakeWaiters(const void *obj) {
+  for (HostTask *t : tasks()) {
+    if (t->state == HostTask::BLOCKED && t->waitObj == obj) makeRunnable(t);
+  }
+}
+
+// Next task to run, moving the clock to the next wake-up while everyone is
+// blocked. The caller holds the lock and has already left RUNNING.
+HostTask *pickNext() {
+  for (;;) {
+    uint64_t now = host::nowUs();
+    uint64_t earliest = kForever;
+    bool idle = true;
+    for (HostTask *t : tasks()) {
+      if (t->state != HostTask::SLEEPING && t->state != HostTask::BLOCKED) continue;
+      if (t->state == HostTask::SLEEPING && !t->idleSleep) idle = false;
+      if (t->wakeUs <= now) {
+        t->timedOut = t->state == HostTask::BLOCKED;
+        makeRunnable(t);
+      } else {
+        earliest = std::min(earliest, t->wakeUs);
+      }
+    }
+    HostTask *next = nullptr;
+    for (HostTask *t : tasks()) {
+      if (t->state == HostTask::RUNNABLE && (!next || t->readySeq < next->readySeq)) next = t;
+    }
+    if (next) return next;
+    if (earliest == kForever) {
+      std::fprintf(stderr, "host FreeRTOS: all tasks blocked forever\n");
+      std::abort();
+    }
+    if (idle) {
+      host::internal::idleUs(earliest - now);
+    } else {
+      host::internal::jumpClockUs(earliest - now);
+    }
+  }
+}
+
+void switchAway(std::unique_lock<std::mutex> &lk, HostTask *me) {
+  HostTask *next = pickNext();
+  next->state = HostTask::RUNNING;
+  if (next == me) return;
+  ++gSwitches;
+  me->hasToken = false;
+  next->hasToken = true;
+  next->cv.notify_one();
+  me->cv.wait(lk, [me] { return me->hasToken; });
+  if (me->state == HostTask::DONE) throw TaskDeleted();
+}
+
+uint64_t deadline(TickType_t ticks) {
+  return ticks == portMAX_DELAY ? kForever : host::nowUs() + (uint64_t)ticks * 1000;
+}
+
+// Blocks until obj is signalled or the deadline passes; false on timeout.
+bool block(std::unique_lock<std::mutex> &lk, HostTask *me, const void *obj, uint64_t until) {
+  me->state = HostTask::BLOCKED;
+  me->waitObj = obj;
+  me->wakeUs = until;
+  me->timedOut = false;
+  switchAway(lk, me);
+  me->waitObj = nullptr;
+  return !me->timedOut;
+}
+
+void taskMain(HostTask *t) {
+  {
+    std::unique_lock<std::mutex> lk(lock());
+    t->cv.wait(lk, [t] { return t->hasToken; });
+  }
+  tSelf = t;
+  host::internal::setOffSketchHeap(t->offSketchHeap);
+  if (t->state != HostTask::DONE) {
+    try {
+      t->fn(t->arg);
+    } catch (TaskDeleted &) {
+    }
+  }
+  std::unique_lock<std::mutex> lk(lock());
+  t->state = HostTask::DONE;
+  HostTask *next = pickNext();
+  next->state = HostTask::RUNNING;
+  t->hasToken = false;
+  next->hasToken = true;
+  next->cv.notify_one();
+}
+
+} // namespace
+
+namespace host {
+
+size_t taskCount() {
+  std::lock_guard<std::mutex> lk(lock());
+  return std::max<size_t>(1, liveTasks());
+}
+
+uint64_t contextSwitches() { return gSwitches; }
+
+namespace internal {
+
+bool sleepTaskUs(uint64_t us, bool idle) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  if (liveTasks() <= 1) return false;
+  me->state = HostTask::SLEEPING;
+  me->wakeUs = host::nowUs() + us;
+  me->idleSleep = idle;
+  switchAway(lk, me);
+  return true;
+}
+
+} // namespace internal
+} // namespace host
+
+// ----- Tasks -----
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t, void *arg, UBaseType_t,
+                                   TaskHandle_t *created, BaseType_t coreId) {
+  std::unique_lock<std::mutex> lk(lock());
+  self();
+  HostTask *t = new HostTask;
+  t->name = name ? name : "";
+  t->fn = fn;
+  t->arg = arg;
+  t->core = coreId == tskNO_AFFINITY ? 0 : coreId;
+  t->offSketchHeap = host::internal::offSketchHeap();
+  makeRunnable(t);
+  tasks().push_back(t);
+  std::thread(taskMain, t).detach();
+  if (created) *created = t;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stackDepth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *created) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, arg, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  if (!task || task == me) {
+    lk.unlock();
+    throw TaskDeleted(); // unwinds to taskMain, which hands the CPU on
+  }
+  task->state = HostTask::DONE; // its thread stays parked
+}
+
+void vTaskDelay(TickType_t ticks) { host::internal::idleWaitUs((uint64_t)ticks * 1000); }
+
+TickType_t xTaskGetTickCount() { return (TickType_t)(host::nowUs() / 1000); }
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  std::lock_guard<std::mutex> lk(lock());
+  return self();
+}
+
+BaseType_t xPortGetCoreID() {
+  std::lock_guard<std::mutex> lk(lock());
+  return self()->core;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  uint64_t until = deadline(ticksToWait);
+  while (me->notify == 0) {
+    if (ticksToWait == 0 || !block(lk, me, me, until)) return 0;
+  }
+  uint32_t v = me->notify;
+  me->notify = clearCountOnExit ? 0 : v - 1;
+  return v;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  std::lock_guard<std::mutex> lk(lock());
+  ++task->notify;
+  wakeWaiters(task);
+  return pdPASS;
+}
+
+// ----- Semaphores -----
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  HostSyncObject *s = new HostSyncObject;
+  s->maxCount = maxCount;
+  s->count = initialCount;
+  return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xSemaphoreCreateCounting(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateMutex() { return xSemaphoreCreateCounting(1, 1); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  uint64_t until = deadline(ticksToWait);
+  while (sem->count == 0) {
+    if (ticksToWait == 0 || !block(lk, me, sem, until)) return pdFALSE;
+  }
+  --sem->count;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  std::lock_guard<std::mutex> lk(lock());
+  if (sem->count >= sem->maxCount) return pdFALSE;
+  ++sem->count;
+  wakeWaiters(sem);
+  return pdTRUE;
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t sem) {
+  std::lock_guard<std::mutex> lk(lock());
+  return sem->count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) { delete sem; }
+
+// ----- Queues -----
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostSyncObject *q = new HostSyncObject;
+  q->isQueue = true;
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+static BaseType_t queueSend(QueueHandle_t q, const void *item, TickType_t ticksToWait, bool front) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  uint64_t until = deadline(ticksToWait);
+  while (q->items.size() >= q->length) {
+    if (ticksToWait == 0 || !block(lk, me, q, until)) return errQUEUE_FULL;
+  }
+  const uint8_t *p = static_cast<const uint8_t *>(item);
+  std::vector<uint8_t> v(p, p + q->itemSize);
+  if (front) q->items.push_front(std::move(v));
+  else q->items.push_back(std::move(v));
+  wakeWaiters(q);
+  return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t t) { return queueSend(q, item, t, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t t) { return queueSend(q, item, t, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t t) { return queueSend(q, item, t, true); }
+
+static BaseType_t queueReceive(QueueHandle_t q, void *item, TickType_t ticksToWait, bool remove) {
+  std::unique_lock<std::mutex> lk(lock());
+  HostTask *me = self();
+  uint64_t until = deadline(ticksToWait);
+  while (q->items.empty()) {
+    if (ticksToWait == 0 || !block(lk, me, q, until)) return errQUEUE_EMPTY;
+  }
+  std::memcpy(item, q->items.front().data(), q->itemSize);
+  if (remove) {
+    q->items.pop_front();
+    wakeWaiters(q);
+  }
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t t) { return queueReceive(q, item, t, true); }
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t t) { return queueReceive(q, item, t, false); }
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(lock());
+  return (UBaseType_t)q->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(lock());
+  return q->length - (UBaseType_t)q->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+  std::lock_guard<std::mutex> lk(lock());
+  q->items.clear();
+  wakeWaiters(q);
+  return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t q) { delete q; }
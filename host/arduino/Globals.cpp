@@ -0,0 +1,6 @@
+// Bus singletons declared by the stand-in headers.
+#include "SPI.h"
+#include "Wire.h"
+
+SPIClass SPI;
+TwoWire Wire;
@@ -0,0 +1,44 @@
+// Shared between the stand-in implementations; not for sketches or benches.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace host {
+namespace internal {
+
+// Move the sketch clock forward without yielding to other tasks.
+void jumpClockUs(uint64_t us);
+
+// Called by advanceUs(): if other tasks exist, block the calling task for
+// us of sketch time and run the others meanwhile; idle marks a wait rather
+// than time charged to a bus. Returns false when the caller is the only
+// task, in which case the clock is simply advanced.
+bool sleepTaskUs(uint64_t us, bool idle = false);
+
+// delay() and vTaskDelay(): like advanceUs(), but the task is idle rather
+// than busy, so the chip may light-sleep meanwhile (host::PmSim).
+void idleWaitUs(uint64_t us);
+
+// Every task is idle for us: move the clock past it, light-sleeping if the
+// power management state allows it.
+void idleUs(uint64_t us);
+
+// Blocks until queued SPI transactions have left the bus. Synchronous
+// panel writes call this first: they share the bus with the DMA path.
+void spiWaitIdle();
+
+// Whether this thread allocates off the sketch's heap (OffSketchHeap);
+// tasks take it over from the thread that creates them.
+bool offSketchHeap();
+void setOffSketchHeap(bool on);
+
+// Serial1 and Serial2 (see host::UartDevice)
+void uartBegin(int uart, uint32_t baud);
+size_t uartWrite(int uart, const uint8_t *buf, size_t len);
+int uartAvailable(int uart);
+int uartRead(int uart);
+void uartFlush(int uart);
+
+} // namespace internal
+} // namespace host
@@ -0,0 +1,223 @@
+// Simulation controls for the host stand-ins: virtual clock, simulated
+// heap, pin state and sensor values. Benchmarks and tests drive the sketch
+// through these; the sketch itself never includes this header.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace host {
+
+// ----- Clock -----
+// millis()/micros() report real elapsed time plus everything the sketch
+// spent in delay(). delay() never sleeps, so blocking waits cost nothing
+// on the host but still move the sketch's notion of time forward.
+// With real time off, only simulated time counts and runs are repeatable.
+uint64_t nowUs();
+uint64_t virtualUs();       // accumulated delay() time
+void advanceUs(uint64_t us);
+void setRealTime(bool on);
+bool realTime();
+
+// ----- Tasks -----
+// See freertos/FreeRTOS.h. advanceUs() from one of several tasks lets the
+// others run for that long.
+size_t taskCount();         // live tasks, including the loop task
+uint64_t contextSwitches();
+
+// ----- Heap -----
+// Sketch allocations (malloc/free/heap_caps_malloc) are routed through a
+// tracked allocator bounded by a simulated ESP32 heap, so out-of-memory
+// paths behave as they do on the device.
+struct HeapStats {
+  size_t capacity;     // simulated total heap
+  size_t reserved;     // taken by the core and Wi-Fi before setup()
+  size_t inUse;        // currently allocated by the sketch
+  size_t peak;
+  uint64_t allocations;
+  uint64_t frees;
+  uint64_t failures;   // allocations refused for lack of heap
+};
+
+HeapStats &heap();
+void resetHeapCounters();
+
+void *heapAlloc(size_t n);
+void *heapCalloc(size_t n, size_t size);
+void *heapRealloc(void *p, size_t n);
+void heapFree(void *p);
+
+// While one of these is alive, allocations on this thread, and in tasks it
+// creates, come from the host heap and are not counted. For the devices
+// simulated next to the sketch (RelayGroup), which run sketch code but
+// have heaps of their own.
+class OffSketchHeap {
+public:
+  OffSketchHeap();
+  ~OffSketchHeap();
+  OffSketchHeap(const OffSketchHeap &) = delete;
+  OffSketchHeap &operator=(const OffSketchHeap &) = delete;
+
+private:
+  bool saved_;
+};
+
+// ----- Pins and sensors -----
+int pinState(int pin);
+
+struct Sensors {
+  float temperature = 24.5f;
+  float humidity = 48.0f;
+  float lux = 320.0f;
+};
+Sensors &sensors();
+
+// ----- Wi-Fi -----
+// Cost model for station joins, in sketch time. A join that names the
+// access point's BSSID and channel skips the scan; a join with a static
+// IP configuration skips DHCP. Raw request bodies arrive at rxKBps.
+struct WiFiSim {
+  bool reachable = true;
+  uint32_t scanMs = 2200;
+  uint32_t authMs = 350;
+  uint32_t dhcpMs = 900;
+  uint32_t rxKBps = 1000;
+  uint8_t bssid[6] = {0x7C, 0x10, 0xC9, 0x2A, 0x51, 0x08};
+  int channel = 6;
+  uint32_t leaseIP = 0x2A01A8C0;    // 192.168.1.42, IPAddress byte order
+  uint32_t gateway = 0x0101A8C0;    // 192.168.1.1
+  uint32_t subnet = 0x00FFFFFF;     // 255.255.255.0
+  uint32_t dns = 0x0101A8C0;
+  uint64_t joins = 0;
+  uint64_t scans = 0;
+};
+WiFiSim &wifiSim();
+
+// ----- UART -----
+// Serial1 and Serial2 can be wired to a simulated device. A byte takes 10
+// bits at the baud rate on the wire in each direction. The device is handed
+// each byte with the time its stop bit arrived, and a reply byte becomes
+// readable once it has been sent. Writes return at once unless the 128-byte
+// TX FIFO is full. Delivery to the device is lazy: uartPump() catches it
+// up with the clock before a bench reads the device's state.
+class UartDevice {
+public:
+  virtual ~UartDevice() {}
+  virtual void received(uint8_t b, uint64_t atUs) = 0;
+};
+void uartAttach(int uart, UartDevice *device, uint32_t baud);
+// Device side: send len bytes to the sketch, the first starting at atUs or
+// when the line is free
+void uartReply(int uart, const uint8_t *data, size_t len, uint64_t atUs);
+void uartPump(int uart);
+
+struct UartStats {
+  uint64_t txBytes = 0; // sketch to device
+  uint64_t rxBytes = 0; // device to sketch
+  uint64_t fifoStalls = 0;
+};
+UartStats &uartStats(int uart);
+
+// ----- Power management -----
+// Model behind esp_pm.h. Once esp_pm_configure() has run, the CPU is at
+// max_freq_mhz while an ESP_PM_CPU_FREQ_MAX lock is held and at
+// min_freq_mhz otherwise; before that, at the setCpuFrequencyMhz() clock.
+// When light sleep is enabled, no lock of any kind is held and every task
+// is waiting (delay(), a queue, a semaphore) for at least minSleepUs, the
+// chip light-sleeps and the first task to wake starts wakeUs late. Busy
+// time (bus, network, delayMicroseconds()) never sleeps. The currents are
+// the datasheet's modem-sleep figures, without Wi-Fi traffic, and only
+// serve to compare runs.
+struct PmSim {
+  bool supported = true;           // CONFIG_PM_ENABLE
+  bool lightSleepSupported = true; // CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  uint32_t minSleepUs = 3000;      // 3 ticks, as the IDF idle hook requires
+  uint32_t wakeUs = 1000;
+  std::map<int, double> activeMa = {{80, 31.0}, {160, 44.0}, {240, 68.0}};
+  double sleepMa = 0.8;
+  std::map<int, uint64_t> residencyUs; // awake, by CPU clock
+  uint64_t sleepUs = 0;
+  uint64_t sleeps = 0;
+};
+PmSim &pmSim();
+int pmCpuMhz();
+void pmSettle();      // brings residencyUs up to now
+void resetPmCounters();
+double pmChargeMAs(); // residency times current
+
+// ----- ESP-NOW -----
+// One radio channel shared by esp_now.h and simulated devices around the
+// sketch (EspNowNode). A frame holds the channel for frameOverheadUs
+// (DIFS, backoff, preamble) plus its bytes at phyMbps, from when the
+// channel is free, and the sender waits that long: esp_now_send()
+// followed by waiting for its send callback. A broadcast goes out once and
+// each node loses it with its own lossPct. A unicast is retried up to
+// unicastTries times, each try costing ackUs more. lossPct here is for
+// frames to the sketch. Losses follow a fixed pseudo-random sequence per
+// receiver, so runs repeat.
+struct EspNowSim {
+  double phyMbps = 1.0;
+  uint32_t frameOverheadUs = 400;
+  uint32_t macBytes = 43;  // 802.11 header, vendor action fields, FCS
+  uint32_t ackUs = 314;    // SIFS and ACK at 1 Mbps
+  int unicastTries = 8;
+  int lossPct = 0;
+  uint64_t frames = 0;     // tries included
+  uint64_t bytes = 0;      // payload
+  uint64_t airUs = 0;
+  uint64_t lost = 0;       // frames a receiver did not get
+};
+EspNowSim &espNowSim();
+uint32_t espNowAirUs(size_t len); // one try, without the ACK
+
+class EspNowNode {
+public:
+  explicit EspNowNode(const uint8_t mac[6]);
+  virtual ~EspNowNode() {}
+  // Runs in the sender's task once the frame is on the air
+  virtual void received(const uint8_t *from, const uint8_t *data, int len) = 0;
+  // Sends from this node; false if a unicast was never acknowledged
+  bool send(const uint8_t *to, const uint8_t *data, int len);
+  const uint8_t *mac() const { return mac_; }
+  int lossPct = 0;
+
+private:
+  friend class EspNowChannel;
+  uint8_t mac_[6];
+  uint32_t lossState_;
+};
+void espNowAttach(EspNowNode *node);
+void espNowDetach(EspNowNode *node);
+
+// ----- SPI master -----
+// Queued transactions (driver/spi_master.h) run back to back on the bus,
+// each taking its bits at the device clock plus txnGapUs of driver and
+// interrupt time between transfers.
+struct SpiSim {
+  double txnGapUs = 5.0;
+  uint64_t transactions = 0;
+  uint64_t bytes = 0;
+};
+SpiSim &spiSim();
+
+// ----- Decoders -----
+// Counted by the stand-in decoders in decoders/ (the real libraries leave
+// these at zero).
+struct DecodeStats {
+  uint64_t jpegDecodes = 0;
+  uint64_t gifFrames = 0;
+};
+DecodeStats &decodeStats();
+
+// ----- Serial -----
+// Serial output is dropped unless echo is on; the byte count is kept so
+// logging cost can still be accounted for.
+void setSerialEcho(bool on);
+uint64_t serialBytes();
+
+// Thrown by ESP.restart(); callers that expect a reboot catch it.
+struct RestartRequested {};
+
+} // namespace host
@@ -0,0 +1,13 @@
+// Included ahead of sketch code compiled for the host (the generated
+// sketch translation unit and anything that includes sketch headers).
+// Routes the C allocator through the simulated heap.
+#pragma once
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "esp_heap_caps.h"
+
+#define malloc(n) host::heapAlloc(n)
+#define calloc(n, s) host::heapCalloc(n, s)
+#define realloc(p, n) host::heapRealloc(p, n)
+#define free(p) host::heapFree(p)
@@ -0,0 +1,45 @@
+// Host stand-in for IPAddress.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+#include "Print.h"
+
+class IPAddress : public Printable {
+public:
+  IPAddress() : addr_{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_{a, b, c, d} {}
+  IPAddress(uint32_t v) { *this = v; }
+
+  IPAddress &operator=(uint32_t v) {
+    for (int i = 0; i < 4; ++i) addr_[i] = (uint8_t)(v >> (8 * i));
+    return *this;
+  }
+  operator uint32_t() const {
+    return (uint32_t)addr_[0] | (uint32_t)addr_[1] << 8 | (uint32_t)addr_[2] << 16 | (uint32_t)addr_[3] << 24;
+  }
+  bool operator==(const IPAddress &o) const { return (uint32_t)*this == (uint32_t)o; }
+  bool operator!=(const IPAddress &o) const { return !(*this == o); }
+  uint8_t operator[](int i) const { return addr_[i]; }
+  uint8_t &operator[](int i) { return addr_[i]; }
+
+  bool fromString(const String &s) {
+    unsigned a, b, c, d;
+    if (std::sscanf(s.c_str(), "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+      return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+
+  String toString() const {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%u.%u.%u.%u", addr_[0], addr_[1], addr_[2], addr_[3]);
+    return String(buf);
+  }
+
+  size_t printTo(Print &p) const override { return p.print(toString()); }
+
+private:
+  uint8_t addr_[4];
+};
@@ -0,0 +1,165 @@
+// Power management model behind esp_pm.h (see host::PmSim).
+
+#include "esp_pm.h"
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "HostInternal.h"
+#include "HostSim.h"
+
+struct HostPmLock {
+  esp_pm_lock_type_t type;
+  std::string name;
+  int count = 0;
+};
+
+namespace {
+
+host::PmSim gPm;
+bool gConfigured = false;
+esp_pm_config_esp32_t gConfig = {240, 240, false};
+uint32_t gFixedMhz = 240;
+uint64_t gSinceUs = 0; // residency is counted up to here
+std::vector<HostPmLock *> gLocks;
+
+int held(esp_pm_lock_type_t type) {
+  int n = 0;
+  for (HostPmLock *l : gLocks) n += l->type == type ? l->count : 0;
+  return n;
+}
+
+int cpuMhz() {
+  if (!gConfigured) return (int)gFixedMhz;
+  return held(ESP_PM_CPU_FREQ_MAX) > 0 ? gConfig.max_freq_mhz : gConfig.min_freq_mhz;
+}
+
+bool canSleep() {
+  if (!gConfigured || !gConfig.light_sleep_enable) return false;
+  for (HostPmLock *l : gLocks) {
+    if (l->count > 0) return false;
+  }
+  return true;
+}
+
+// Charges the time since the last change to the clock in effect
+void account() {
+  uint64_t now = host::nowUs();
+  if (now > gSinceUs) gPm.residencyUs[cpuMhz()] += now - gSinceUs;
+  gSinceUs = now;
+}
+
+bool validMhz(int mhz) { return mhz == 80 || mhz == 160 || mhz == 240; }
+
+} // namespace
+
+namespace host {
+
+PmSim &pmSim() { return gPm; }
+
+int pmCpuMhz() { return cpuMhz(); }
+
+void pmSettle() { account(); }
+
+void resetPmCounters() {
+  account();
+  gPm.residencyUs.clear();
+  gPm.sleepUs = gPm.sleeps = 0;
+}
+
+double pmChargeMAs() {
+  account();
+  double mAs = gPm.sleepUs / 1e6 * gPm.sleepMa;
+  for (const auto &r : gPm.residencyUs) {
+    auto ma = gPm.activeMa.lower_bound(r.first);
+    if (ma == gPm.activeMa.end()) --ma;
+    mAs += r.second / 1e6 * ma->second;
+  }
+  return mAs;
+}
+
+namespace internal {
+
+void idleUs(uint64_t us) {
+  if (!canSleep() || us < gPm.minSleepUs) {
+    jumpClockUs(us);
+    return;
+  }
+  account();
+  jumpClockUs(us);
+  gPm.sleepUs += us;
+  ++gPm.sleeps;
+  gSinceUs = nowUs();
+  jumpClockUs(gPm.wakeUs); // awake again, at the idle clock
+}
+
+} // namespace internal
+} // namespace host
+
+bool setCpuFrequencyMhz(uint32_t mhz) {
+  if (!validMhz((int)mhz)) return false;
+  account();
+  gFixedMhz = mhz;
+  return true;
+}
+
+uint32_t getCpuFrequencyMhz() { return (uint32_t)cpuMhz(); }
+
+esp_err_t esp_pm_configure(const void *config) {
+  if (!gPm.supported) return ESP_ERR_NOT_SUPPORTED;
+  const esp_pm_config_esp32_t *c = static_cast<const esp_pm_config_esp32_t *>(config);
+  if (!validMhz(c->max_freq_mhz) || !validMhz(c->min_freq_mhz) || c->min_freq_mhz > c->max_freq_mhz) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (c->light_sleep_enable && !gPm.lightSleepSupported) return ESP_ERR_NOT_SUPPORTED;
+  account();
+  gConfig = *c;
+  gConfigured = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_get_configuration(void *config) {
+  if (!gPm.supported) return ESP_ERR_NOT_SUPPORTED;
+  *static_cast<esp_pm_config_esp32_t *>(config) = gConfig;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int, const char *name, esp_pm_lock_handle_t *handle) {
+  if (!gPm.supported) return ESP_ERR_NOT_SUPPORTED;
+  if (handle == nullptr) return ESP_ERR_INVALID_ARG;
+  HostPmLock *l = new HostPmLock;
+  l->type = type;
+  l->name = name ? name : "";
+  gLocks.push_back(l);
+  *handle = l;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+  if (handle == nullptr) return ESP_ERR_INVALID_ARG;
+  account();
+  ++handle->count;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+  if (handle == nullptr) return ESP_ERR_INVALID_ARG;
+  if (handle->count == 0) return ESP_ERR_INVALID_STATE;
+  account();
+  --handle->count;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle) {
+  if (handle == nullptr) return ESP_ERR_INVALID_ARG;
+  if (handle->count > 0) return ESP_ERR_INVALID_STATE;
+  for (size_t i = 0; i < gLocks.size(); ++i) {
+    if (gLocks[i] == handle) {
+      gLocks.erase(gLocks.begin() + i);
+      break;
+    }
+  }
+  delete handle;
+  return ESP_OK;
+}
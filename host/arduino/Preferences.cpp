@@ -0,0 +1,79 @@
+#include "Preferences.h"
+
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> gStore;
+static uint64_t gWrites = 0;
+
+bool Preferences::begin(const char *name, bool readOnly, const char *) {
+  name_ = name ? name : "";
+  readOnly_ = readOnly;
+  open_ = true;
+  if (!readOnly) gStore[name_];
+  return true;
+}
+
+Preferences::Namespace *Preferences::ns() const {
+  if (!open_) return nullptr;
+  auto it = gStore.find(name_);
+  return it == gStore.end() ? nullptr : &it->second;
+}
+
+bool Preferences::clear() {
+  Namespace *n = ns();
+  if (!n || readOnly_) return false;
+  n->clear();
+  ++gWrites;
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  Namespace *n = ns();
+  if (!n || readOnly_) return false;
+  ++gWrites;
+  return n->erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key) const {
+  Namespace *n = ns();
+  return n && n->count(key);
+}
+
+size_t Preferences::putString(const char *key, const String &value) {
+  size_t n = putBytes(key, value.c_str(), value.length() + 1);
+  return n ? n - 1 : 0;
+}
+
+String Preferences::getString(const char *key, const String &defaultValue) const {
+  Namespace *n = ns();
+  if (!n) return defaultValue;
+  auto it = n->find(key);
+  if (it == n->end() || it->second.empty()) return defaultValue;
+  return String((const char *)it->second.data());
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len) {
+  Namespace *n = ns();
+  if (!n || readOnly_) return 0;
+  const uint8_t *p = static_cast<const uint8_t *>(value);
+  (*n)[key].assign(p, p + len);
+  ++gWrites;
+  return len;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen) const {
+  Namespace *n = ns();
+  if (!n) return 0;
+  auto it = n->find(key);
+  if (it == n->end() || it->second.size() > maxLen) return 0;
+  std::memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) const {
+  Namespace *n = ns();
+  if (!n) return 0;
+  auto it = n->find(key);
+  return it == n->end() ? 0 : it->second.size();
+}
+
+void Preferences::hostWipe() { gStore.clear(); }
+uint64_t Preferences::hostWrites() { return gWrites; }
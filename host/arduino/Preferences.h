@@ -0,0 +1,61 @@
+// Host stand-in for the ESP32 Preferences (NVS) library. Namespaces live
+// in process memory and survive simulated reboots.
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "Arduino.h"
+
+class Preferences {
+public:
+  bool begin(const char *name, bool readOnly = false, const char *partition = nullptr);
+  void end() { open_ = false; }
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key) const;
+
+  size_t putString(const char *key, const String &value);
+  String getString(const char *key, const String &defaultValue = String()) const;
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen) const;
+  size_t getBytesLength(const char *key) const;
+
+  size_t putInt(const char *key, int32_t v) { return putScalar(key, v); }
+  int32_t getInt(const char *key, int32_t d = 0) const { return getScalar(key, d); }
+  size_t putUInt(const char *key, uint32_t v) { return putScalar(key, v); }
+  uint32_t getUInt(const char *key, uint32_t d = 0) const { return getScalar(key, d); }
+  size_t putULong(const char *key, uint32_t v) { return putScalar(key, v); }
+  uint32_t getULong(const char *key, uint32_t d = 0) const { return getScalar(key, d); }
+  size_t putUChar(const char *key, uint8_t v) { return putScalar(key, v); }
+  uint8_t getUChar(const char *key, uint8_t d = 0) const { return getScalar(key, d); }
+  size_t putBool(const char *key, bool v) { return putScalar(key, (uint8_t)v); }
+  bool getBool(const char *key, bool d = false) const { return getScalar(key, (uint8_t)d) != 0; }
+  size_t putFloat(const char *key, float v) { return putScalar(key, v); }
+  float getFloat(const char *key, float d = NAN) const { return getScalar(key, d); }
+
+  // ----- host side -----
+  static void hostWipe();
+  static uint64_t hostWrites();
+
+private:
+  typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+  template <typename T>
+  size_t putScalar(const char *key, T v) {
+    return putBytes(key, &v, sizeof(v));
+  }
+  template <typename T>
+  T getScalar(const char *key, T d) const {
+    T v;
+    if (getBytesLength(key) != sizeof(T)) return d;
+    getBytes(key, &v, sizeof(T));
+    return v;
+  }
+
+  Namespace *ns() const;
+
+  std::string name_;
+  bool open_ = false;
+  bool readOnly_ = true;
+};
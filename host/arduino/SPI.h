@@ -0,0 +1,35 @@
+// Host stand-in for the SPI bus. Panel traffic is accounted by the
+// Adafruit_ST7789 stand-in, not here.
+#pragma once
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE3 0x03
+#define SPI_LSBFIRST 0
+#define SPI_MSBFIRST 1
+#ifndef MSBFIRST
+#define MSBFIRST SPI_MSBFIRST
+#endif
+
+struct SPISettings {
+  SPISettings(uint32_t clock = 1000000, uint8_t bitOrder = SPI_MSBFIRST, uint8_t dataMode = SPI_MODE0)
+      : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+class SPIClass {
+public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {
+    (void)sck; (void)miso; (void)mosi; (void)ss;
+  }
+  void end() {}
+  // Nothing is clocked here; the settings are only kept
+  void beginTransaction(SPISettings settings) { last = settings; }
+  void endTransaction() {}
+  SPISettings last;
+};
+
+extern SPIClass SPI;
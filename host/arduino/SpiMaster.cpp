@@ -0,0 +1,117 @@
+#include "driver/spi_master.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "Adafruit_ST7789.h"
+#include "HostInternal.h"
+#include "HostSim.h"
+
+struct spi_device_t {
+  spi_host_device_t host;
+  spi_device_interface_config_t cfg;
+  std::deque<std::pair<spi_transaction_t *, uint64_t>> inflight; // with their end times
+};
+
+namespace {
+
+struct Bus {
+  bool initialized = false;
+  int devices = 0;
+  uint64_t freeAtUs = 0;
+};
+
+Bus gBuses[3];
+
+} // namespace
+
+namespace host {
+
+SpiSim &spiSim() {
+  static SpiSim s;
+  return s;
+}
+
+namespace internal {
+
+void spiWaitIdle() {
+  uint64_t freeAt = 0;
+  for (const Bus &b : gBuses) freeAt = std::max(freeAt, b.freeAtUs);
+  uint64_t now = nowUs();
+  if (now < freeAt) advanceUs(freeAt - now);
+}
+
+} // namespace internal
+} // namespace host
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *config, int) {
+  if (host < SPI2_HOST || host > SPI3_HOST || !config) return ESP_ERR_INVALID_ARG;
+  if (gBuses[host].initialized) return ESP_ERR_INVALID_STATE;
+  gBuses[host].initialized = true;
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host) {
+  if (host < SPI2_HOST || host > SPI3_HOST || !gBuses[host].initialized) return ESP_ERR_INVALID_STATE;
+  if (gBuses[host].devices > 0) return ESP_ERR_INVALID_STATE;
+  gBuses[host].initialized = false;
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle) {
+  if (host < SPI2_HOST || host > SPI3_HOST || !config || !handle || config->clock_speed_hz <= 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!gBuses[host].initialized) return ESP_ERR_INVALID_STATE;
+  ++gBuses[host].devices;
+  *handle = new spi_device_t{host, *config, {}};
+  return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle) {
+  if (!handle) return ESP_ERR_INVALID_ARG;
+  if (!handle->inflight.empty()) return ESP_ERR_INVALID_STATE;
+  --gBuses[handle->host].devices;
+  delete handle;
+  return ESP_OK;
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t *trans, TickType_t) {
+  if (!handle || !trans) return ESP_ERR_INVALID_ARG;
+  // The caller has to collect results to make room; a full queue here
+  // would block forever on the device.
+  if ((int)handle->inflight.size() >= handle->cfg.queue_size) return ESP_ERR_INVALID_STATE;
+  if (handle->cfg.pre_cb) handle->cfg.pre_cb(trans);
+  const size_t bytes = (trans->length + 7) / 8;
+  const uint8_t *data = (trans->flags & SPI_TRANS_USE_TXDATA) ? trans->tx_data
+                                                              : static_cast<const uint8_t *>(trans->tx_buffer);
+  double busUs = host::spiSim().txnGapUs + trans->length * 1e6 / handle->cfg.clock_speed_hz;
+  Adafruit_ST7789::hostBusTransfer(data, bytes, busUs);
+
+  Bus &bus = gBuses[handle->host];
+  uint64_t start = std::max(host::nowUs(), bus.freeAtUs);
+  bus.freeAtUs = start + (uint64_t)(busUs + 0.5);
+  handle->inflight.push_back({trans, bus.freeAtUs});
+  if (handle->cfg.post_cb) handle->cfg.post_cb(trans);
+  ++host::spiSim().transactions;
+  host::spiSim().bytes += bytes;
+  return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t **trans, TickType_t ticksToWait) {
+  if (!handle || !trans) return ESP_ERR_INVALID_ARG;
+  if (handle->inflight.empty()) return ESP_ERR_TIMEOUT; // would wait forever
+  uint64_t end = handle->inflight.front().second;
+  uint64_t now = host::nowUs();
+  if (now < end) {
+    if (ticksToWait != portMAX_DELAY && (uint64_t)ticksToWait * 1000 < end - now) {
+      host::advanceUs((uint64_t)ticksToWait * 1000);
+      return ESP_ERR_TIMEOUT;
+    }
+    host::advanceUs(end - now);
+  }
+  *trans = handle->inflight.front().first;
+  handle->inflight.pop_front();
+  return ESP_OK;
+}
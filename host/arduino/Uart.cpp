@@ -0,0 +1,131 @@
+// Serial1 and Serial2 wired to simulated devices (host::UartDevice).
+
+#include <algorithm>
+#include <deque>
+
+#include "Arduino.h"
+#include "HostInternal.h"
+#include "HostSim.h"
+
+namespace {
+
+struct Byte {
+  uint8_t value;
+  uint64_t atUs; // when its stop bit is done
+};
+
+struct Port {
+  uint32_t baud = 9600;
+  host::UartDevice *device = nullptr;
+  std::deque<Byte> tx; // on the wire to the device, or not yet handed over
+  std::deque<Byte> rx; // on the wire to the sketch, or in its RX buffer
+  uint64_t txFreeUs = 0;
+  host::UartStats stats;
+};
+
+const size_t kTxFifo = 128;
+
+Port gPorts[3];
+
+Port &port(int uart) { return gPorts[uart < 0 || uart > 2 ? 0 : uart]; }
+
+uint64_t byteUs(const Port &p) { return 10000000ull / (p.baud ? p.baud : 9600); }
+
+// Hands the device everything that has reached it by now
+void deliver(Port &p) {
+  uint64_t now = host::nowUs();
+  while (!p.tx.empty() && p.tx.front().atUs <= now) {
+    Byte b = p.tx.front();
+    p.tx.pop_front();
+    if (p.device) p.device->received(b.value, b.atUs);
+  }
+}
+
+} // namespace
+
+namespace host {
+
+void uartAttach(int uart, UartDevice *device, uint32_t baud) {
+  Port &p = port(uart);
+  p = Port();
+  p.device = device;
+  p.baud = baud;
+}
+
+void uartReply(int uart, const uint8_t *data, size_t len, uint64_t atUs) {
+  Port &p = port(uart);
+  // The line carries one reply at a time: start after any byte in the way
+  uint64_t bit = byteUs(p), start = atUs, end = atUs + len * bit;
+  for (bool moved = true; moved;) {
+    moved = false;
+    for (const Byte &b : p.rx) {
+      if (b.atUs - bit < end && b.atUs > start) {
+        start = b.atUs;
+        end = start + len * bit;
+        moved = true;
+      }
+    }
+  }
+  for (size_t i = 0; i < len; ++i) {
+    uint64_t t = start + (i + 1) * bit;
+    auto at = std::upper_bound(p.rx.begin(), p.rx.end(), t, [](uint64_t v, const Byte &b) { return v < b.atUs; });
+    p.rx.insert(at, Byte{data[i], t});
+  }
+  p.stats.rxBytes += len;
+}
+
+void uartPump(int uart) { deliver(port(uart)); }
+
+UartStats &uartStats(int uart) { return port(uart).stats; }
+
+namespace internal {
+
+void uartBegin(int uart, uint32_t baud) { port(uart).baud = baud; }
+
+size_t uartWrite(int uart, const uint8_t *buf, size_t len) {
+  Port &p = port(uart);
+  for (size_t i = 0; i < len; ++i) {
+    deliver(p);
+    if (p.tx.size() >= kTxFifo) {
+      // FIFO full: the write blocks until the oldest byte has gone
+      ++p.stats.fifoStalls;
+      advanceUs(p.tx.front().atUs - std::min(p.tx.front().atUs, nowUs()));
+      deliver(p);
+    }
+    uint64_t start = std::max(nowUs(), p.txFreeUs);
+    p.txFreeUs = start + byteUs(p);
+    p.tx.push_back(Byte{buf[i], p.txFreeUs});
+  }
+  p.stats.txBytes += len;
+  return len;
+}
+
+int uartAvailable(int uart) {
+  Port &p = port(uart);
+  deliver(p);
+  uint64_t now = nowUs();
+  int n = 0;
+  for (const Byte &b : p.rx) {
+    if (b.atUs > now) break;
+    ++n;
+  }
+  return n;
+}
+
+int uartRead(int uart) {
+  if (uartAvailable(uart) == 0) return -1;
+  Port &p = port(uart);
+  int v = p.rx.front().value;
+  p.rx.pop_front();
+  return v;
+}
+
+void uartFlush(int uart) {
+  Port &p = port(uart);
+  uint64_t now = nowUs();
+  if (p.txFreeUs > now) advanceUs(p.txFreeUs - now);
+  deliver(p);
+}
+
+} // namespace internal
+} // namespace host
@@ -0,0 +1,121 @@
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+static std::string toBase(unsigned long long v, unsigned char base, bool neg) {
+  if (base < 2 || base > 36) base = 10;
+  char buf[72];
+  int i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    int d = (int)(v % base);
+    buf[--i] = (char)(d < 10 ? '0' + d : 'a' + d - 10);
+    v /= base;
+  } while (v);
+  if (neg) buf[--i] = '-';
+  return std::string(buf + i);
+}
+
+String::String(int v, unsigned char base)
+    : s_(base == 10 ? toBase(v < 0 ? -(long long)v : v, 10, v < 0) : toBase((unsigned int)v, base, false)) {}
+String::String(unsigned int v, unsigned char base) : s_(toBase(v, base, false)) {}
+String::String(long v, unsigned char base)
+    : s_(base == 10 ? toBase(v < 0 ? -(long long)v : v, 10, v < 0) : toBase((unsigned long)v, base, false)) {}
+String::String(unsigned long v, unsigned char base) : s_(toBase(v, base, false)) {}
+
+String::String(float v, unsigned int decimals) : String((double)v, decimals) {}
+
+String::String(double v, unsigned int decimals) {
+  char buf[64];
+  std::snprintf(buf, sizeof(buf), "%.*f", (int)decimals, v);
+  s_ = buf;
+}
+
+bool String::equalsIgnoreCase(const String &o) const {
+  if (s_.size() != o.s_.size()) return false;
+  for (size_t i = 0; i < s_.size(); ++i) {
+    if (std::tolower((unsigned char)s_[i]) != std::tolower((unsigned char)o.s_[i])) return false;
+  }
+  return true;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t p = s_.find(c, from);
+  return p == std::string::npos ? -1 : (int)p;
+}
+
+int String::indexOf(const String &s, unsigned int from) const {
+  size_t p = s_.find(s.s_, from);
+  return p == std::string::npos ? -1 : (int)p;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t p = s_.rfind(c);
+  return p == std::string::npos ? -1 : (int)p;
+}
+
+String String::substring(unsigned int from) const {
+  if (from >= s_.size()) return String();
+  return String(s_.substr(from));
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= s_.size()) return String();
+  if (to > s_.size()) to = (unsigned int)s_.size();
+  return String(s_.substr(from, to - from));
+}
+
+bool String::endsWith(const String &p) const {
+  return s_.size() >= p.s_.size() && s_.compare(s_.size() - p.s_.size(), p.s_.size(), p.s_) == 0;
+}
+
+void String::trim() {
+  size_t b = 0, e = s_.size();
+  while (b < e && std::isspace((unsigned char)s_[b])) ++b;
+  while (e > b && std::isspace((unsigned char)s_[e - 1])) --e;
+  s_ = s_.substr(b, e - b);
+}
+
+void String::toLowerCase() {
+  for (char &c : s_) c = (char)std::tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char &c : s_) c = (char)std::toupper((unsigned char)c);
+}
+
+void String::replace(const String &from, const String &to) {
+  if (from.s_.empty()) return;
+  size_t p = 0;
+  while ((p = s_.find(from.s_, p)) != std::string::npos) {
+    s_.replace(p, from.s_.size(), to.s_);
+    p += to.s_.size();
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index >= s_.size()) return;
+  s_.erase(index, count);
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const {
+  if (!bufsize) return;
+  size_t n = 0;
+  if (index < s_.size()) n = std::min<size_t>(bufsize - 1, s_.size() - index);
+  for (size_t i = 0; i < n; ++i) buf[i] = (unsigned char)s_[index + i];
+  buf[n] = 0;
+}
+
+String operator+(const String &a, const String &b) { String r(a); r += b; return r; }
+String operator+(const String &a, const char *b) { String r(a); r += b; return r; }
+String operator+(const char *a, const String &b) { String r(a); r += b; return r; }
+String operator+(const String &a, char b) { String r(a); r += b; return r; }
+String operator+(const String &a, int b) { String r(a); r += b; return r; }
+String operator+(const String &a, unsigned int b) { String r(a); r += b; return r; }
+String operator+(const String &a, long b) { String r(a); r += b; return r; }
+String operator+(const String &a, unsigned long b) { String r(a); r += b; return r; }
+String operator+(const String &a, float b) { String r(a); r += b; return r; }
+String operator+(const String &a, double b) { String r(a); r += b; return r; }
@@ -0,0 +1,85 @@
+// Host stand-in for the Arduino String class, backed by std::string.
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+class String {
+public:
+  String() {}
+  String(const char *s) : s_(s ? s : "") {}
+  String(const std::string &s) : s_(s) {}
+  String(char c) : s_(1, c) {}
+  String(int v, unsigned char base = 10);
+  String(unsigned int v, unsigned char base = 10);
+  String(long v, unsigned char base = 10);
+  String(unsigned long v, unsigned char base = 10);
+  String(float v, unsigned int decimals = 2);
+  String(double v, unsigned int decimals = 2);
+
+  unsigned int length() const { return (unsigned int)s_.size(); }
+  const char *c_str() const { return s_.c_str(); }
+  bool reserve(unsigned int n) { s_.reserve(n); return true; }
+
+  char operator[](unsigned int i) const { return i < s_.size() ? s_[i] : 0; }
+  char &operator[](unsigned int i) { return s_[i]; }
+  char charAt(unsigned int i) const { return (*this)[i]; }
+
+  String &operator+=(const String &o) { s_ += o.s_; return *this; }
+  String &operator+=(const char *o) { s_ += o ? o : ""; return *this; }
+  String &operator+=(char c) { s_ += c; return *this; }
+  String &operator+=(int v) { return *this += String(v); }
+  String &operator+=(unsigned int v) { return *this += String(v); }
+  String &operator+=(long v) { return *this += String(v); }
+  String &operator+=(unsigned long v) { return *this += String(v); }
+  String &operator+=(float v) { return *this += String(v); }
+  String &operator+=(double v) { return *this += String(v); }
+  bool concat(const String &o) { s_ += o.s_; return true; }
+  bool concat(const char *buf, unsigned int len) { s_.append(buf, len); return true; }
+
+  bool operator==(const String &o) const { return s_ == o.s_; }
+  bool operator==(const char *o) const { return s_ == (o ? o : ""); }
+  bool operator!=(const String &o) const { return s_ != o.s_; }
+  bool operator!=(const char *o) const { return !(*this == o); }
+  bool operator<(const String &o) const { return s_ < o.s_; }
+  bool equals(const String &o) const { return s_ == o.s_; }
+  bool equalsIgnoreCase(const String &o) const;
+
+  long toInt() const { return std::strtol(s_.c_str(), nullptr, 10); }
+  float toFloat() const { return std::strtof(s_.c_str(), nullptr); }
+  double toDouble() const { return std::strtod(s_.c_str(), nullptr); }
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &s, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  bool startsWith(const String &p) const { return s_.compare(0, p.s_.size(), p.s_) == 0; }
+  bool endsWith(const String &p) const;
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  void replace(const String &from, const String &to);
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+  void getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index = 0) const;
+
+  const std::string &std() const { return s_; }
+
+private:
+  std::string s_;
+};
+
+String operator+(const String &a, const String &b);
+String operator+(const String &a, const char *b);
+String operator+(const char *a, const String &b);
+String operator+(const String &a, char b);
+String operator+(const String &a, int b);
+String operator+(const String &a, unsigned int b);
+String operator+(const String &a, long b);
+String operator+(const String &a, unsigned long b);
+String operator+(const String &a, float b);
+String operator+(const String &a, double b);
+
+// Arduino's F() macro stores literals in flash; on the host they are plain.
+class __FlashStringHelper;
+#define F(s) (s)
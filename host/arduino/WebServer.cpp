@@ -0,0 +1,138 @@
+#include "WebServer.h"
+
+#include "HostSim.h"
+#include "WiFi.h"
+
+String WebServer::arg(const String &name) const {
+  const Context *c = ctx();
+  if (!c) return String();
+  for (const auto &a : c->args) {
+    if (a.first == name) return a.second;
+  }
+  return String();
+}
+
+String WebServer::arg(int i) const {
+  const Context *c = ctx();
+  if (!c || i < 0 || i >= (int)c->args.size()) return String();
+  return c->args[i].second;
+}
+
+String WebServer::argName(int i) const {
+  const Context *c = ctx();
+  if (!c || i < 0 || i >= (int)c->args.size()) return String();
+  return c->args[i].first;
+}
+
+int WebServer::args() const {
+  const Context *c = ctx();
+  return c ? (int)c->args.size() : 0;
+}
+
+bool WebServer::hasArg(const String &name) const {
+  const Context *c = ctx();
+  if (!c) return false;
+  for (const auto &a : c->args) {
+    if (a.first == name) return true;
+  }
+  return false;
+}
+
+void WebServer::send(int code, const char *contentType, const String &content) {
+  Context *c = ctx();
+  if (!c) return;
+  c->resp.code = code;
+  c->resp.contentType = contentType ? contentType : "";
+  c->resp.body = content;
+  c->resp.headers = c->pendingHeaders;
+  c->pendingHeaders.clear();
+}
+
+void WebServer::sendHeader(const String &name, const String &value, bool first) {
+  Context *c = ctx();
+  if (!c) return;
+  if (first) c->pendingHeaders.insert(c->pendingHeaders.begin(), {name, value});
+  else c->pendingHeaders.push_back({name, value});
+}
+
+WebServer::HostResponse WebServer::hostRequest(const HostRequest &req) {
+  if (!WiFi.hostReachable()) {
+    HostResponse refused; // code 0: the client could not connect
+    refused.body = "no network interface up";
+    return refused;
+  }
+  stack_.push_back(std::unique_ptr<Context>(new Context()));
+  Context *c = stack_.back().get();
+  c->req = req;
+  c->args = req.args;
+  if (req.method == HTTP_POST && req.body.length()) c->args.push_back({"plain", req.body});
+
+  THandlerFunction fn, ufn;
+  for (const auto &r : routes_) {
+    if (r.uri == req.uri && (r.method == HTTP_ANY || r.method == req.method)) {
+      fn = r.fn;
+      ufn = r.ufn;
+      break;
+    }
+  }
+  if (fn && ufn && req.method == HTTP_POST && !req.raw.empty()) {
+    c->resp.routed = true;
+    if (deliverRaw(*c, ufn)) fn();
+  } else if (fn) {
+    c->resp.routed = true;
+    fn();
+  } else if (notFound_) {
+    notFound_();
+  } else {
+    send(404, "text/plain", "Not found");
+  }
+
+  HostResponse resp = c->resp;
+  stack_.pop_back();
+  return resp;
+}
+
+bool WebServer::deliverRaw(Context &c, const THandlerFunction &ufn) {
+  HTTPRaw &raw = c.raw;
+  raw.status = RAW_START;
+  raw.totalSize = raw.currentSize = 0;
+  raw.data = nullptr;
+  ufn();
+  const std::vector<uint8_t> &body = c.req.raw;
+  for (size_t off = 0; off < body.size(); off += HTTP_RAW_BUFLEN) {
+    if (c.req.pace && !c.req.pace(off)) {
+      raw.status = RAW_ABORTED;
+      ufn();
+      return false;
+    }
+    raw.status = RAW_WRITE;
+    raw.currentSize = std::min<size_t>(HTTP_RAW_BUFLEN, body.size() - off);
+    host::advanceUs((uint64_t)raw.currentSize * 1000 / host::wifiSim().rxKBps);
+    std::memcpy(raw.buf, &body[off], raw.currentSize);
+    raw.totalSize += raw.currentSize;
+    ufn();
+  }
+  raw.status = RAW_END;
+  raw.currentSize = 0;
+  ufn();
+  return true;
+}
+
+void WebServer::hostQueue(const HostRequest &req, unsigned afterPolls) {
+  pending_.push_back({req, polls_ + afterPolls, 0});
+}
+
+void WebServer::hostQueueAt(const HostRequest &req, uint64_t atUs) {
+  pending_.push_back({req, 0, atUs});
+}
+
+void WebServer::handleClient() {
+  ++polls_;
+  if (!started_ || pending_.empty() || pending_.front().duePoll > polls_) return;
+  uint64_t now = host::nowUs();
+  if (pending_.front().dueUs > now) return;
+  Pending p = pending_.front();
+  pending_.pop_front();
+  queuedResponses_.push_back(hostRequest(p.req));
+  if (p.dueUs > 0) queuedResponses_.back().waitUs = now - p.dueUs;
+}
@@ -0,0 +1,140 @@
+// Host stand-in for the ESP32 WebServer. Requests are injected by the
+// harness (hostRequest) or queued for delivery on a later handleClient()
+// call (hostQueue), which is how handlers that poll the server from a
+// long-running loop get interrupted.
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Arduino.h"
+
+enum HTTPMethod {
+  HTTP_ANY = 0,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS,
+};
+
+#define HTTP_RAW_BUFLEN 1436
+
+enum HTTPRawStatus { RAW_START, RAW_WRITE, RAW_END, RAW_ABORTED };
+
+struct HTTPRaw {
+  HTTPRawStatus status;
+  size_t totalSize;   // bytes delivered so far
+  size_t currentSize; // bytes in buf for this RAW_WRITE
+  void *data;
+  uint8_t buf[HTTP_RAW_BUFLEN];
+};
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::vector<std::pair<String, String>> Args;
+
+  struct HostResponse {
+    bool routed = false;
+    int code = 0;
+    String contentType;
+    String body;
+    Args headers;
+    uint64_t waitUs = 0; // hostQueueAt(): from arrival to the handler
+  };
+
+  struct HostRequest {
+    HTTPMethod method = HTTP_GET;
+    String uri;
+    Args args;
+    String body;
+    // Binary POST body for routes with an upload handler, delivered through
+    // raw() in HTTP_RAW_BUFLEN pieces like a socket read. pace (if set) runs
+    // before each piece with the bytes delivered so far, so a harness can
+    // model arrival time; returning false aborts the upload.
+    std::vector<uint8_t> raw;
+    std::function<bool(size_t)> pace;
+  };
+
+  explicit WebServer(int port = 80) : port_(port) {}
+
+  void begin() { started_ = true; }
+  void stop() { started_ = false; }
+  void close() { stop(); }
+  void handleClient();
+
+  void on(const String &uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn) { routes_.push_back({uri, method, fn, nullptr}); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn) {
+    routes_.push_back({uri, method, fn, ufn});
+  }
+  void onNotFound(THandlerFunction fn) { notFound_ = fn; }
+
+  String arg(const String &name) const;
+  String arg(int i) const;
+  String argName(int i) const;
+  int args() const;
+  bool hasArg(const String &name) const;
+  HTTPMethod method() const { return ctx() ? ctx()->req.method : HTTP_GET; }
+  String uri() const { return ctx() ? ctx()->req.uri : String(); }
+  HTTPRaw &raw() { return ctx()->raw; }
+
+  void send(int code, const char *contentType = nullptr, const String &content = String());
+  void send(int code, const String &contentType, const String &content) {
+    send(code, contentType.c_str(), content);
+  }
+  void sendHeader(const String &name, const String &value, bool first = false);
+
+  // ----- host side -----
+  HostResponse hostRequest(const HostRequest &req);
+  // Deliver req on the afterPolls-th handleClient() call from now (0 and 1
+  // both mean the next one).
+  void hostQueue(const HostRequest &req, unsigned afterPolls = 0);
+  // Deliver req on the first handleClient() call at or after atUs of sketch
+  // time (host::nowUs()), as a request arriving then would be
+  void hostQueueAt(const HostRequest &req, uint64_t atUs);
+  bool started() const { return started_; }
+  uint64_t polls() const { return polls_; }
+  size_t routeCount() const { return routes_.size(); }
+  const std::vector<HostResponse> &hostQueuedResponses() const { return queuedResponses_; }
+  void hostClearRoutes() { routes_.clear(); notFound_ = nullptr; }
+
+private:
+  struct Route {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+  struct Context {
+    HostRequest req;
+    Args args; // query args, then "plain" for a body
+    HostResponse resp;
+    Args pendingHeaders;
+    HTTPRaw raw;
+  };
+  struct Pending {
+    HostRequest req;
+    uint64_t duePoll;
+    uint64_t dueUs;
+  };
+
+  bool deliverRaw(Context &c, const THandlerFunction &ufn);
+  const Context *ctx() const { return stack_.empty() ? nullptr : stack_.back().get(); }
+  Context *ctx() { return stack_.empty() ? nullptr : stack_.back().get(); }
+
+  int port_;
+  bool started_ = false;
+  uint64_t polls_ = 0;
+  std::vector<Route> routes_;
+  THandlerFunction notFound_;
+  std::vector<std::unique_ptr<Context>> stack_;
+  std::deque<Pending> pending_;
+  std::vector<HostResponse> queuedResponses_;
+};
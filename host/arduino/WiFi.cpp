@@ -0,0 +1,124 @@
+#include "WiFi.h"
+
+#include "HostSim.h"
+
+WiFiClass WiFi;
+
+namespace host {
+WiFiSim &wifiSim() {
+  static WiFiSim w;
+  return w;
+}
+} // namespace host
+
+bool WiFiClass::mode(wifi_mode_t m) {
+  mode_ = m;
+  if (m != WIFI_AP && m != WIFI_AP_STA) apUp_ = false;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char *ssid, const char *pass, int32_t channel, const uint8_t *bssid, bool connect) {
+  (void)pass;
+  host::WiFiSim &sim = host::wifiSim();
+  if (mode_ == WIFI_OFF || mode_ == WIFI_AP) mode_ = (mode_ == WIFI_AP) ? WIFI_AP_STA : WIFI_STA;
+  ssid_ = ssid ? ssid : "";
+  if (!connect) return WL_DISCONNECTED;
+
+  bool directed = bssid && channel > 0 && channel == sim.channel && std::memcmp(bssid, sim.bssid, 6) == 0;
+  uint64_t costMs = sim.authMs + (staticIP_ ? 0 : sim.dhcpMs);
+  if (!directed) {
+    costMs += sim.scanMs;
+    ++sim.scans;
+  }
+  ++sim.joins;
+  joining_ = true;
+  joinStartUs_ = host::nowUs();
+  joinCostUs_ = costMs * 1000;
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+  (void)dns2;
+  staticIP_ = (uint32_t)local != 0;
+  staticLocal_ = local;
+  staticGateway_ = gateway;
+  staticSubnet_ = subnet;
+  staticDns_ = dns1;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap) {
+  (void)eraseap;
+  joining_ = false;
+  if (wifioff) mode_ = WIFI_OFF;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!joining_) return mode_ == WIFI_AP ? WL_IDLE_STATUS : WL_DISCONNECTED;
+  if (!host::wifiSim().reachable) {
+    return host::nowUs() - joinStartUs_ >= joinCostUs_ ? WL_NO_SSID_AVAIL : WL_DISCONNECTED;
+  }
+  return host::nowUs() - joinStartUs_ >= joinCostUs_ ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIP_ ? staticLocal_ : IPAddress(host::wifiSim().leaseIP);
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIP_ ? staticGateway_ : IPAddress(host::wifiSim().gateway);
+}
+
+IPAddress WiFiClass::subnetMask() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIP_ ? staticSubnet_ : IPAddress(host::wifiSim().subnet);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t) {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return staticIP_ ? staticDns_ : IPAddress(host::wifiSim().dns);
+}
+
+uint8_t *WiFiClass::BSSID() {
+  if (status() != WL_CONNECTED) return nullptr;
+  std::memcpy(bssid_, host::wifiSim().bssid, 6);
+  return bssid_;
+}
+
+String WiFiClass::BSSIDstr() {
+  uint8_t *b = BSSID();
+  if (!b) return String();
+  char buf[18];
+  std::snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", b[0], b[1], b[2], b[3], b[4], b[5]);
+  return String(buf);
+}
+
+int32_t WiFiClass::channel() { return status() == WL_CONNECTED ? host::wifiSim().channel : 0; }
+
+bool WiFiClass::softAP(const char *ssid, const char *pass, int channel, int hidden, int maxConn) {
+  (void)ssid; (void)pass; (void)channel; (void)hidden; (void)maxConn;
+  if (mode_ == WIFI_STA) mode_ = WIFI_AP_STA;
+  else if (mode_ == WIFI_OFF) mode_ = WIFI_AP;
+  apUp_ = true;
+  return true;
+}
+
+bool WiFiClass::softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet) {
+  (void)gateway; (void)subnet;
+  apIP_ = local;
+  return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifioff) {
+  apUp_ = false;
+  if (mode_ == WIFI_AP_STA) mode_ = WIFI_STA;
+  else if (mode_ == WIFI_AP && wifioff) mode_ = WIFI_OFF;
+  return true;
+}
+
+bool WiFiClass::hostReachable() {
+  return apUp_ || (mode_ != WIFI_AP && status() == WL_CONNECTED);
+}
@@ -0,0 +1,75 @@
+// Host stand-in for the ESP32 WiFi class. Joins complete after a
+// configurable amount of sketch time (see host::wifiSim()).
+#pragma once
+
+#include "Arduino.h"
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t m);
+  wifi_mode_t getMode() const { return mode_; }
+
+  wl_status_t begin(const char *ssid, const char *pass = nullptr, int32_t channel = 0,
+                    const uint8_t *bssid = nullptr, bool connect = true);
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifioff = false, bool eraseap = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t i = 0);
+  String SSID() const { return ssid_; }
+  uint8_t *BSSID();
+  String BSSIDstr();
+  int32_t channel();
+  int8_t RSSI() { return status() == WL_CONNECTED ? -58 : 0; }
+  String macAddress() { return "24:A1:60:C0:FF:EE"; }
+
+  bool softAP(const char *ssid, const char *pass = nullptr, int channel = 1, int hidden = 0, int maxConn = 4);
+  bool softAPConfig(IPAddress local, IPAddress gateway, IPAddress subnet);
+  IPAddress softAPIP() { return apIP_; }
+  bool softAPdisconnect(bool wifioff = false);
+
+  bool setAutoReconnect(bool) { return true; }
+  bool persistent(bool) { return true; }
+  bool setSleep(bool) { return true; }
+
+  // ----- host side -----
+  // Whether a client can reach the device at all: the station has an
+  // address or the soft AP is up
+  bool hostReachable();
+
+private:
+  wifi_mode_t mode_ = WIFI_OFF;
+  String ssid_;
+  bool joining_ = false;
+  uint64_t joinStartUs_ = 0;
+  uint64_t joinCostUs_ = 0;
+  bool staticIP_ = false;
+  IPAddress staticLocal_, staticGateway_, staticSubnet_, staticDns_;
+  IPAddress apIP_ = IPAddress(192, 168, 4, 1);
+  bool apUp_ = false;
+  uint8_t bssid_[6] = {0};
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,15 @@
+// Host stand-in for the ESP-IDF GPIO driver; levels land in the same pin
+// table as digitalWrite().
+#pragma once
+
+#include "Arduino.h"
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+#define GPIO_NUM_NC (-1)
+
+inline esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+  if (pin < 0) return ESP_ERR_INVALID_ARG;
+  digitalWrite((uint8_t)pin, level ? HIGH : LOW);
+  return ESP_OK;
+}
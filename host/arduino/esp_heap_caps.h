@@ -0,0 +1,21 @@
+// Host stand-in for the ESP-IDF capability-based allocator.
+#pragma once
+
+#include <cstddef>
+
+#include "HostSim.h"
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+inline void *heap_caps_malloc(size_t size, uint32_t) { return host::heapAlloc(size); }
+inline void *heap_caps_calloc(size_t n, size_t size, uint32_t) { return host::heapCalloc(n, size); }
+inline void heap_caps_free(void *p) { host::heapFree(p); }
+inline size_t heap_caps_get_free_size(uint32_t) {
+  const host::HeapStats &h = host::heap();
+  return h.capacity - h.reserved - h.inUse;
+}
+inline size_t heap_caps_get_largest_free_block(uint32_t caps) { return heap_caps_get_free_size(caps); }
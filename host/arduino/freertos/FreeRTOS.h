@@ -0,0 +1,51 @@
+// Host stand-in for the FreeRTOS API as the ESP32 Arduino core exposes it.
+// Tasks are real threads, but only one runs at a time: a task keeps the
+// CPU until it blocks (delay, vTaskDelay, a semaphore, queue or
+// notification wait, or time spent on a simulated bus), and while every
+// task is blocked the sketch clock jumps to the next wake-up. Work on the
+// two cores therefore overlaps in sketch time exactly where the tasks
+// wait, and runs are deterministic when real time is not counted.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define errQUEUE_EMPTY 0
+
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define tskIDLE_PRIORITY 0
+#define configMAX_PRIORITIES 25
+
+struct HostTask;
+struct HostSyncObject;
+typedef HostTask *TaskHandle_t;
+typedef HostSyncObject *SemaphoreHandle_t;
+typedef HostSyncObject *QueueHandle_t;
+
+// Critical sections only guard against the other core; with one task
+// running at a time there is nothing to exclude.
+typedef struct {
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+#define portYIELD_FROM_ISR() ((void)0)
+#define taskYIELD() vTaskDelay(0)
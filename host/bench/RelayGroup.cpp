@@ -0,0 +1,88 @@
+#include "RelayGroup.h"
+
+#include <cstdio>
+
+// The same MediaRelay as the sketch's, so the same allocator macros; the
+// peers' buffers stay off the sketch's heap through host::OffSketchHeap
+#include "HostSketch.h"
+#include "MediaRelay.h"
+
+struct RelayGroup::Node : host::EspNowNode {
+  explicit Node(const uint8_t mac[6]) : EspNowNode(mac) {}
+
+  void received(const uint8_t *from, const uint8_t *data, int len) override { relay.onReceive(from, data, len); }
+
+  static bool sendFn(void *ctx, const uint8_t *mac, const uint8_t *data, int len) {
+    return static_cast<Node *>(ctx)->send(mac, data, len);
+  }
+
+  MediaRelay relay;
+};
+
+RelayGroup::RelayGroup(int group, int peers) {
+  host::OffSketchHeap offHeap; // and for the relay tasks started here
+  for (int i = 0; i < peers; ++i) {
+    const uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, (uint8_t)group, (uint8_t)(i + 1)};
+    Node *node = new Node(mac);
+    node->relay.begin(Node::sendFn, node, 0);
+    node->relay.setListening(true);
+    host::espNowAttach(node);
+    nodes_.push_back(node);
+  }
+}
+
+RelayGroup::~RelayGroup() {
+  host::OffSketchHeap offHeap;
+  for (Node *node : nodes_) {
+    host::espNowDetach(node);
+    node->relay.setListening(false);
+  }
+}
+
+std::string RelayGroup::macList() const {
+  std::string s;
+  for (const Node *node : nodes_) {
+    const uint8_t *m = node->mac();
+    char buf[19];
+    std::snprintf(buf, sizeof(buf), "%s%02X:%02X:%02X:%02X:%02X:%02X", s.empty() ? "" : ",", m[0], m[1], m[2], m[3],
+                  m[4], m[5]);
+    s += buf;
+  }
+  return s;
+}
+
+void RelayGroup::setLoss(int peer, int pct) { nodes_[peer]->lossPct = pct; }
+
+RelayGroup::Peer RelayGroup::take(int peer) {
+  MediaRelay &relay = nodes_[peer]->relay;
+  Peer p;
+  p.recovered = relay.getRecovered();
+  p.nacks = relay.getNacks();
+  p.badFiles = relay.getBadFiles();
+  p.overflows = relay.getOverflows();
+  p.showAt = relay.showAt();
+  uint8_t *data;
+  uint32_t size;
+  if (relay.takeFile(&data, &size, &p.kind)) {
+    p.pending = true;
+    p.file.assign(data, data + size);
+    free(data);
+  }
+  return p;
+}
+
+bool RelayGroup::lead(const uint8_t mac[6], uint8_t kind, const std::vector<uint8_t> &data, uint32_t leadMs,
+                      uint32_t &showAt) {
+  host::OffSketchHeap offHeap;
+  MediaRelay &relay = nodes_[0]->relay;
+  relay.setListening(false);
+  relay.clearPeers();
+  relay.addPeer(mac);
+  bool ok = relay.transfer(kind, data.data(), (uint32_t)data.size());
+  showAt = ok ? relay.show(leadMs) : 0;
+  return ok;
+}
+
+int RelayGroup::leadRounds() const { return nodes_[0]->relay.getLastRounds(); }
+
+uint32_t RelayGroup::leadRepairs() const { return nodes_[0]->relay.getRepairs(); }
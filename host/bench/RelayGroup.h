@@ -0,0 +1,47 @@
+// Displays around the sketch on the simulated ESP-NOW channel
+// (host::EspNowSim), each running the sketch's own MediaRelay.h. As peers
+// they take what the sketch relays; one can also lead and relay a file to
+// the sketch. Their files live on the host heap, so the sketch's heap
+// metrics only show the sketch.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class RelayGroup {
+public:
+  // What a peer ended up with
+  struct Peer {
+    bool pending = false;       // has a complete file and a show time
+    std::vector<uint8_t> file;
+    uint8_t kind = 0;
+    uint32_t showAt = 0;        // micros()
+    uint32_t recovered = 0;     // packets rebuilt from parity
+    uint32_t nacks = 0;
+    uint32_t badFiles = 0;
+    uint32_t overflows = 0;
+  };
+
+  // Peers 02:00:00:00:<group>:01 on, on the channel and listening.
+  // Nodes are never freed: their relay tasks stay parked on their queues.
+  RelayGroup(int group, int peers);
+  ~RelayGroup();
+
+  int size() const { return (int)nodes_.size(); }
+  std::string macList() const; // for /relay?peers=
+  void setLoss(int peer, int pct);
+  // Takes the file peer holds, if any
+  Peer take(int peer);
+
+  // Peer 0 relays data to mac and has it shown leadMs later. Returns
+  // whether mac got it; showAt is the agreed time.
+  bool lead(const uint8_t mac[6], uint8_t kind, const std::vector<uint8_t> &data, uint32_t leadMs,
+            uint32_t &showAt);
+  int leadRounds() const;
+  uint32_t leadRepairs() const;
+
+private:
+  struct Node;
+  std::vector<Node *> nodes_;
+};
@@ -0,0 +1,1412 @@
+// sketch_bench: drives the ESP32 sketch through its HTTP API on the host
+// and reports what each scenario cost in sketch time, panel traffic and
+// heap. Exact metrics (bytes, transactions, checksums, allocations) are
+// deterministic and gate --check. Timing metrics depend on the machine,
+// so they stay out of the baseline; --timings keeps them in a separate
+// local file, and --check then warns when they regress beyond
+// --time-tolerance.
+//
+//   sketch_bench --corpus DIR [--filter SUBSTR]
+//                [--baseline FILE (--check | --update-baseline)]
+//                [--timings FILE] [--time-tolerance PCT] [--dump DIR]
+//
+// --dump writes the panel framebuffer after each scenario as a PPM.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HostSketch.h"
+#include "MediaReaders.h"
+#include "Adafruit_ST7789.h"
+#include "AnimatedGIF.h"
+#include "AudioQueue.h"
+#include "DFPlayerSim.h"
+#include "PanelAnim.h"
+#include "Preferences.h"
+#include "RelayGroup.h"
+#include "WebServer.h"
+#include "WiFi.h"
+#include "tjpgdClass.h"
+
+extern WebServer server;
+extern Adafruit_ST7789 tft;
+extern bool isPlayingGif;
+extern PanelAnim panelAnim;
+extern AudioQueue audio;
+extern unsigned long firstRequestMs;
+extern const char *joinMethod;
+extern int displayTest;
+void setup();
+void loop();
+
+namespace {
+
+// ----- Metrics -----
+
+enum Kind { EXACT, TIMING };
+
+struct Metric {
+  std::string name;
+  double value;
+  Kind kind;
+};
+
+struct Result {
+  std::string scenario;
+  std::vector<Metric> metrics;
+  bool ok = true;
+  std::string error;
+
+  void exact(const std::string &n, double v) { metrics.push_back({n, v, EXACT}); }
+  void timing(const std::string &n, double v) { metrics.push_back({n, v, TIMING}); }
+  double value(const std::string &n) const {
+    for (const Metric &m : metrics) {
+      if (m.name == n) return m.value;
+    }
+    return -1;
+  }
+  void fail(const std::string &why) {
+    ok = false;
+    if (error.empty()) error = why;
+  }
+};
+
+// ----- Request helpers -----
+
+std::string base64(const std::vector<uint8_t> &in) {
+  static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((in.size() + 2) / 3 * 4);
+  for (size_t i = 0; i < in.size(); i += 3) {
+    uint32_t v = in[i] << 16;
+    if (i + 1 < in.size()) v |= in[i + 1] << 8;
+    if (i + 2 < in.size()) v |= in[i + 2];
+    out += kAlphabet[v >> 18 & 63];
+    out += kAlphabet[v >> 12 & 63];
+    out += i + 1 < in.size() ? kAlphabet[v >> 6 & 63] : '=';
+    out += i + 2 < in.size() ? kAlphabet[v & 63] : '=';
+  }
+  return out;
+}
+
+WebServer::HostRequest request(HTTPMethod method, const char *uri, WebServer::Args args = {}, const String &body = String()) {
+  WebServer::HostRequest req;
+  req.method = method;
+  req.uri = uri;
+  req.args = std::move(args);
+  req.body = body;
+  return req;
+}
+
+double field(const String &body, const char *name);
+
+// Panel, heap and clock counters around one measured section.
+class Probe {
+public:
+  Probe() {
+    server.hostRequest(request(HTTP_GET, "/panelStats", {{"reset", "1"}}));
+    tft.hostResetStats();
+    host::resetHeapCounters();
+    host::decodeStats() = host::DecodeStats();
+    virtualStart_ = host::virtualUs();
+    simStart_ = host::nowUs();
+    hostStart_ = std::chrono::steady_clock::now();
+  }
+
+  double simMs() const { return (host::nowUs() - simStart_) / 1000.0; }
+  double virtualMs() const { return (host::virtualUs() - virtualStart_) / 1000.0; }
+  double hostUs() const {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - hostStart_).count();
+  }
+
+  void report(Result &r) const {
+    const PanelStats &p = tft.hostStats();
+    r.exact("panel_transactions", (double)p.transactions);
+    r.exact("panel_windows", (double)p.addrWindows);
+    r.exact("panel_cmd_bytes", (double)p.commandBytes);
+    r.exact("panel_data_bytes", (double)p.dataBytes);
+    r.exact("panel_pixels", (double)p.pixels);
+    r.exact("panel_bus_us", std::floor(p.busUs));
+    r.exact("panel_queued_transfers", (double)p.queuedTransfers);
+    r.exact("fb_crc", (double)tft.hostChecksum());
+    r.exact("heap_allocs", (double)host::heap().allocations);
+    r.exact("heap_peak", (double)host::heap().peak);
+    r.exact("heap_failures", (double)host::heap().failures);
+    r.timing("sim_ms", simMs());
+    r.timing("host_us", hostUs());
+    // Last: the request itself allocates and reads the clock
+    String stats = server.hostRequest(request(HTTP_GET, "/panelStats")).body;
+    r.exact("panel_coalesced", field(stats, "coalesced"));
+    r.exact("panel_stalls", field(stats, "stalls"));
+    r.timing("panel_stall_ms", field(stats, "stall_ms"));
+  }
+
+private:
+  uint64_t virtualStart_, simStart_;
+  std::chrono::steady_clock::time_point hostStart_;
+};
+
+// Upload the way the app does: /imageChunk takes 1500-character GET
+// chunks, /gifChunk takes 8000-character POST bodies, both with the file
+// size. A chunk the sketch refuses ends the upload; with rejected set that
+// is the expected outcome and its response is handed back.
+std::vector<WebServer::HostRequest> chunkRequests(const char *uri, const std::vector<uint8_t> &data, bool sendSize = true) {
+  const bool post = !std::strcmp(uri, "/gifChunk");
+  const size_t chunk = post ? 8000 : 1500;
+  std::string b64 = base64(data);
+  size_t total = (b64.size() + chunk - 1) / chunk;
+  std::vector<WebServer::HostRequest> reqs;
+  for (size_t i = 0; i < total; ++i) {
+    String part(b64.substr(i * chunk, chunk).c_str());
+    WebServer::Args args = {{"index", String((int)i)}, {"total", String((int)total)}};
+    if (sendSize) args.push_back({"size", String((int)data.size())});
+    if (post) {
+      reqs.push_back(request(HTTP_POST, uri, args, part));
+    } else {
+      args.push_back({"data", part});
+      reqs.push_back(request(HTTP_GET, uri, args));
+    }
+  }
+  return reqs;
+}
+
+// Without sendSize, as older apps do, the first chunk only gives the
+// chunk count
+bool upload(const char *uri, const std::vector<uint8_t> &data, Result &r,
+            WebServer::HostResponse *rejected = nullptr, bool sendSize = true) {
+  std::vector<WebServer::HostRequest> reqs = chunkRequests(uri, data, sendSize);
+  size_t total = reqs.size();
+  size_t sent = 0;
+  for (size_t i = 0; i < total; ++i) {
+    const WebServer::HostRequest &req = reqs[i];
+    WebServer::HostResponse resp = server.hostRequest(req);
+    sent += req.method == HTTP_POST ? req.body.length() : req.args.back().second.length();
+    if (resp.code != 200) {
+      if (rejected) {
+        *rejected = resp;
+        r.exact("chunks_sent", (double)(i + 1));
+        r.exact("base64_bytes_sent", (double)sent);
+        return false;
+      }
+      r.fail(String(uri).c_str() + std::string(" chunk ") + std::to_string(i) + ": " + resp.body.c_str());
+      return false;
+    }
+  }
+  r.exact("chunks", (double)total);
+  if (rejected) r.fail(std::string(uri) + ": accepted a file it cannot show");
+  return true;
+}
+
+// ----- Scenarios -----
+
+struct Corpus {
+  std::string dir;
+  std::vector<std::string> jpegs;
+  std::vector<std::string> gifs;
+};
+
+bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Boots with stored credentials. Cold starts from wiped preferences, so
+// the sketch has to scan and ask for a lease; warm reboots the sketch
+// after that with its fast-reconnect cache in place.
+Result runBoot(bool warm) {
+  Result r;
+  r.scenario = warm ? "boot_warm" : "boot";
+  if (warm) {
+    // What a reset clears that setup() does not
+    server.hostClearRoutes();
+    WiFi.disconnect();
+    firstRequestMs = 0;
+    joinMethod = "none";
+  } else {
+    Preferences::hostWipe();
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.putString("ssid", "bench-ap");
+    prefs.putString("pass", "bench-pass");
+    prefs.end();
+  }
+  const host::WiFiSim &sim = host::wifiSim();
+  uint64_t joins = sim.joins, scans = sim.scans;
+  unsigned long bootMs = millis();
+
+  Probe probe;
+  setup();
+  // Boot time is all delay()s and modelled waits, so report it exactly.
+  r.exact("setup_virtual_ms", probe.virtualMs());
+  // A client polling the device gets in on the first loop()
+  server.hostQueue(request(HTTP_GET, "/status"));
+  size_t queued = server.hostQueuedResponses().size();
+  while ((displayTest >= 0 || !std::strcmp(joinMethod, "none")) && millis() - bootMs < 30000) {
+    loop();
+    delay(1); // handleClient() sleeps this long when idle on the device
+  }
+  r.exact("boot_virtual_ms", probe.virtualMs());
+  r.exact("wifi_joins", (double)(sim.joins - joins));
+  r.exact("wifi_scans", (double)(sim.scans - scans));
+  if (server.hostQueuedResponses().size() == queued + 1) {
+    // Code 0 when no interface was up: the station has no address until
+    // the join ends, so only the setup AP can answer this
+    const WebServer::HostResponse &early = server.hostQueuedResponses().back();
+    bool served = early.code == 200 && early.body.indexOf("wifi:joining") >= 0;
+    r.exact("served_while_joining", served);
+    if (!served) r.fail("the device could not be reached during the join");
+  } else {
+    r.fail("first /status was not answered");
+  }
+  String status = server.hostRequest(request(HTTP_GET, "/status")).body;
+  r.exact("fast_join", status.indexOf("join:fast") >= 0);
+  r.exact("join_ms", field(status, "join_ms"));
+  r.exact("serving_ms", field(status, "serving_ms") - bootMs);
+  r.exact("first_request_ms", field(status, "first_request_ms") - bootMs);
+  probe.report(r);
+  r.exact("routes", (double)server.routeCount());
+  if (!server.started()) r.fail("web server not started");
+  if (warm && status.indexOf("join:fast") < 0) r.fail("warm boot did not use the cached AP");
+  return r;
+}
+
+Result runUploadJpeg(const std::string &name, const std::vector<uint8_t> &data) {
+  Result r;
+  r.scenario = "upload_jpeg/" + name;
+  Probe probe;
+  upload("/imageChunk", data, r);
+  probe.report(r);
+  return r;
+}
+
+// With the preview (a second decode at 1/8), or, with plain set, straight
+// to the full decode. Both have to leave the same picture.
+Result runDisplayJpeg(const std::string &name, bool plain, uint32_t &crc) {
+  Result r;
+  r.scenario = "display_jpeg/" + name + (plain ? "/no_preview" : "");
+  Probe probe;
+  WebServer::HostResponse resp =
+      server.hostRequest(request(HTTP_GET, "/displayImage", plain ? WebServer::Args{{"preview", "0"}} : WebServer::Args{}));
+  r.exact("code", resp.code);
+  r.exact("decodes", (double)host::decodeStats().jpegDecodes);
+  r.exact("previewed", field(resp.body, "preview_ms") >= 0);
+  r.timing("first_pixel_ms", field(resp.body, "first_pixel_ms"));
+  r.timing("final_ms", field(resp.body, "final_ms"));
+  probe.report(r);
+  if (resp.code != 200) r.fail(std::string("/displayImage: ") + resp.body.c_str());
+  if (plain && tft.hostChecksum() != crc) r.fail("picture differs from the one drawn over the preview");
+  crc = tft.hostChecksum();
+  return r;
+}
+
+// The sensor screen (/display?mode=data): each row has its own colour, so
+// a row laid out past the bottom of a smaller panel shows up as a colour
+// missing from the framebuffer
+Result runDisplayData() {
+  Result r;
+  r.scenario = "display/data";
+  Probe probe;
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/display", {{"mode", "data"}}));
+  r.exact("code", resp.code);
+  probe.report(r);
+  const struct {
+    uint16_t color;
+    const char *row;
+  } rows[] = {{ST77XX_CYAN, "title"}, {ST77XX_GREEN, "temperature"}, {ST77XX_YELLOW, "WiFi"},
+              {ST77XX_WHITE, "LED"}, {ST77XX_MAGENTA, "light"}};
+  const std::vector<uint16_t> &fb = tft.hostFramebuffer();
+  for (const auto &row : rows) {
+    if (std::find(fb.begin(), fb.end(), row.color) == fb.end()) r.fail(std::string("the ") + row.row + " row is off the panel");
+  }
+  return r;
+}
+
+Result runUploadGif(const std::string &name, const std::vector<uint8_t> &data) {
+  Result r;
+  r.scenario = "upload_gif/" + name;
+  Probe probe;
+  upload("/gifChunk", data, r);
+  probe.report(r);
+  return r;
+}
+
+// Files the sketch has to turn away from the first chunk. Each is a corpus
+// file with its header edited; the rest is never sent.
+Result runUploadReject(const char *label, const char *uri, std::vector<uint8_t> data, int expectCode,
+                       bool sendSize = true) {
+  Result r;
+  r.scenario = std::string("upload_reject/") + label;
+  Probe probe;
+  WebServer::HostResponse resp;
+  upload(uri, data, r, &resp, sendSize);
+  r.exact("code", resp.code);
+  r.exact("file_bytes", (double)data.size());
+  probe.report(r);
+  if (resp.code != expectCode) r.fail(std::string(uri) + ": " + resp.body.c_str());
+  if (r.value("chunks_sent") != 1) r.fail("not turned away on the first chunk");
+  return r;
+}
+
+// Offset of the first SOF0 marker's height field, or 0
+size_t jpegSofOffset(const std::vector<uint8_t> &jpg) {
+  for (size_t i = 2; i + 8 < jpg.size(); ++i) {
+    if (jpg[i] == 0xFF && jpg[i + 1] == 0xC0) return i + 5;
+  }
+  return 0;
+}
+
+void reportPerFrame(Result &r, const Probe &probe, uint64_t frames) {
+  if (!frames) return;
+  const PanelStats &p = tft.hostStats();
+  r.exact("transactions_per_frame", std::floor((double)(p.transactions + p.queuedTransfers) / frames));
+  r.exact("bus_us_per_frame", std::floor(p.busUs / frames));
+  r.timing("sim_ms_per_frame", probe.simMs() / frames);
+  r.timing("host_us_per_frame", probe.hostUs() / frames);
+  r.timing("fps", frames * 1000.0 / probe.simMs());
+}
+
+// Plays the uploaded GIF for about two passes: /stopGif is queued to land
+// on the poll that handlePlayGif makes once enough frames have gone by.
+Result runGifLoop(const std::string &name, const std::vector<uint8_t> &data) {
+  Result r;
+  r.scenario = "gif_loop/" + name;
+
+  AnimatedGIF probeGif;
+  GIFINFO info = {};
+  probeGif.begin(GIF_PALETTE_RGB565_BE);
+  std::vector<uint8_t> copy(data);
+  if (!probeGif.open(copy.data(), (int)copy.size(), [](GIFDRAW *) {}) || !probeGif.getInfo(&info)) {
+    r.fail("cannot parse GIF");
+    return r;
+  }
+  probeGif.close();
+  unsigned polls = (unsigned)(2 * info.iFrameCount + 9) / 10;
+
+  Probe probe;
+  server.hostQueue(request(HTTP_GET, "/stopGif"), polls);
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/playGif"));
+  r.exact("code", resp.code);
+  if (resp.code != 200) {
+    r.fail(std::string("/playGif: ") + resp.body.c_str());
+    return r;
+  }
+  if (isPlayingGif) r.fail("playback did not stop");
+
+  uint64_t frames = host::decodeStats().gifFrames;
+  r.exact("frames", (double)frames);
+  r.exact("gif_frames_in_file", info.iFrameCount);
+  r.exact("bytes_per_frame", std::floor((double)data.size() / info.iFrameCount));
+  probe.report(r);
+  reportPerFrame(r, probe, frames);
+  return r;
+}
+
+// The same GIF converted to a .pan animation (PanelAnim.h) the way panenc
+// does it, then uploaded and played through the GIF endpoints so the
+// numbers line up with gif_loop. One too big for the upload buffer has to
+// be turned away at the first chunk.
+Result runAnimLoop(const std::string &name, const std::vector<uint8_t> &gifData) {
+  Result r;
+  r.scenario = "anim_loop/" + name;
+  std::vector<AnimFrame> frames;
+  if (!decodeGifFrames(gifData, frames)) {
+    r.fail("cannot parse GIF");
+    return r;
+  }
+  PanelAnimStats stats;
+  std::vector<uint8_t> pan = encodePanelAnim(frames, 0, &stats);
+  r.exact("file_bytes", (double)pan.size());
+  r.exact("bytes_per_frame", std::floor((double)pan.size() / frames.size()));
+  r.exact("rects", stats.rects);
+  r.exact("pixels_sent_pct", std::floor(100.0 * stats.pixels / ((double)frames[0].image.width * frames[0].image.height * frames.size())));
+
+  if (pan.size() > 150000) { // MAX_GIF_SIZE
+    WebServer::HostResponse resp;
+    upload("/gifChunk", pan, r, &resp);
+    r.exact("code", resp.code);
+    if (resp.code != 413) r.fail(std::string("/gifChunk: ") + resp.body.c_str());
+    return r;
+  }
+  if (!upload("/gifChunk", pan, r)) return r;
+
+  unsigned polls = (unsigned)(2 * frames.size() + 9) / 10;
+  uint32_t shownBefore = panelAnim.getFramesShown();
+  Probe probe;
+  server.hostQueue(request(HTTP_GET, "/stopGif"), polls);
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/playGif"));
+  r.exact("code", resp.code);
+  if (resp.code != 200) {
+    r.fail(std::string("/playGif: ") + resp.body.c_str());
+    return r;
+  }
+  if (isPlayingGif) r.fail("playback did not stop");
+  uint32_t shown = panelAnim.getFramesShown() - shownBefore;
+  r.exact("frames", shown);
+  probe.report(r);
+  reportPerFrame(r, probe, shown);
+  return r;
+}
+
+double field(const String &body, const char *name) {
+  std::string b = body.c_str(), key = std::string(name) + ":";
+  for (size_t at = b.find(key); at != std::string::npos; at = b.find(key, at + 1)) {
+    if (at == 0 || b[at - 1] == '\n' || b[at - 1] == ' ') return std::atof(b.c_str() + at + key.size());
+  }
+  return -1;
+}
+
+// ----- Audio -----
+// The sketch's DFPlayer sits on UART2 as a simulated module (DFPlayerSim).
+
+// Lets sketch time pass until the audio queue has nothing left to send
+double waitAudioIdle(unsigned long limitMs) {
+  unsigned long start = millis();
+  while (!audio.idle() && millis() - start < limitMs) delay(1);
+  host::uartPump(2);
+  return millis() - start;
+}
+
+// Posts commands the way the app would and checks the module carried out
+// exactly those, in order. handler_ms is what the requests cost the web
+// server; the UART work happens afterwards, in drain_ms.
+Result runAudio(host::DFPlayerSim &dfplayer, const char *scenario, int loseEvery, int corruptEvery) {
+  Result r;
+  r.scenario = std::string("audio/") + scenario;
+  struct Cmd {
+    const char *uri;
+    const char *arg;
+    const char *value;
+    uint8_t code;
+    uint16_t param;
+  };
+  const Cmd kCmds[] = {
+      {"/audio/volume", "v", "18", 0x06, 18}, {"/audio/play", "track", "3", 0x12, 3},
+      {"/audio/pause", nullptr, nullptr, 0x0E, 0}, {"/audio/resume", nullptr, nullptr, 0x0D, 0},
+      {"/audio/volume", "v", "22", 0x06, 22}, {"/audio/play", "track", "5", 0x12, 5},
+      {"/audio/volume", "v", "12", 0x06, 12},
+  };
+  waitAudioIdle(2000);
+  dfplayer.config().loseEvery = loseEvery;
+  dfplayer.config().corruptEvery = corruptEvery;
+  dfplayer.clearApplied();
+  server.hostRequest(request(HTTP_GET, "/audio/status", {{"reset", "1"}}));
+
+  Probe probe;
+  for (const Cmd &c : kCmds) {
+    WebServer::Args args;
+    if (c.arg) args.push_back({c.arg, c.value});
+    WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, c.uri, args));
+    if (resp.code != 200) r.fail(std::string(c.uri) + ": " + resp.body.c_str());
+  }
+  r.exact("handler_ms", probe.simMs());
+  r.exact("drain_ms", waitAudioIdle(5000));
+  dfplayer.config().loseEvery = dfplayer.config().corruptEvery = 0;
+
+  String stats = server.hostRequest(request(HTTP_GET, "/audio/status")).body;
+  for (const char *f : {"posted", "sent", "acked", "retries", "failed"}) r.exact(f, field(stats, f));
+  r.timing("ack_ms", field(stats, "ack_ms"));
+  r.exact("module_lost", (double)dfplayer.lost());
+  r.exact("module_bad_checksums", (double)dfplayer.badChecksums());
+  r.exact("module_overruns", (double)dfplayer.overruns());
+
+  // Repeats may apply a command more than once, but the posted sequence
+  // must appear, in order, within what the module carried out
+  const std::vector<host::DFPlayerSim::Applied> &applied = dfplayer.applied();
+  size_t next = 0;
+  for (size_t i = 0; i < applied.size() && next < sizeof(kCmds) / sizeof(kCmds[0]); ++i) {
+    if (applied[i].cmd == kCmds[next].code && applied[i].param == kCmds[next].param) ++next;
+  }
+  r.exact("applied", (double)applied.size());
+  r.exact("volume", dfplayer.volume());
+  r.exact("track", dfplayer.track());
+  if (next != sizeof(kCmds) / sizeof(kCmds[0])) r.fail("module missed a command or got them out of order");
+  if (dfplayer.volume() != 12 || dfplayer.track() != 5 || !dfplayer.playing()) r.fail("module state is not the last posted");
+  return r;
+}
+
+// Plays the spinner with tracks tied to two of its frames, two of them to
+// the same frame. The animation must keep its frame rate (compare
+// gif_loop/), every trigger must reach the module in the order it was
+// added, and none later than AUDIO_TRIGGER_MAX_SKEW_MS.
+Result runAudioGifSync(host::DFPlayerSim &dfplayer, const std::vector<uint8_t> &gifData) {
+  Result r;
+  r.scenario = "audio/gif_sync";
+  waitAudioIdle(2000);
+  if (!upload("/gifChunk", gifData, r)) return r;
+  server.hostRequest(request(HTTP_GET, "/audio/trigger", {{"clear", "1"}}));
+  server.hostRequest(request(HTTP_GET, "/audio/trigger", {{"frame", "0"}, {"track", "1"}}));
+  server.hostRequest(request(HTTP_GET, "/audio/trigger", {{"frame", "4"}, {"track", "2"}}));
+  server.hostRequest(request(HTTP_GET, "/audio/trigger", {{"frame", "4"}, {"track", "3"}}));
+  server.hostRequest(request(HTTP_GET, "/audio/status", {{"reset", "1"}}));
+  dfplayer.clearApplied();
+
+  Probe probe;
+  server.hostQueue(request(HTTP_GET, "/stopGif"), 2);
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/playGif"));
+  if (resp.code != 200) {
+    r.fail(std::string("/playGif: ") + resp.body.c_str());
+    return r;
+  }
+  uint64_t frames = host::decodeStats().gifFrames;
+  probe.report(r);
+  reportPerFrame(r, probe, frames);
+  waitAudioIdle(2000);
+  server.hostRequest(request(HTTP_GET, "/audio/trigger", {{"clear", "1"}}));
+
+  String stats = server.hostRequest(request(HTTP_GET, "/audio/status")).body;
+  double fired = field(stats, "triggers_fired"), late = field(stats, "triggers_late");
+  size_t plays = 0;
+  uint16_t lastTrack = 0;
+  bool inOrder = true;
+  for (const host::DFPlayerSim::Applied &a : dfplayer.applied()) {
+    if (a.cmd != 0x12) continue;
+    if (a.param == 3 && lastTrack != 2) inOrder = false; // frame 4's tracks: 2, then 3
+    lastTrack = a.param;
+    ++plays;
+  }
+  r.exact("frames", (double)frames);
+  r.exact("triggers_fired", fired);
+  r.exact("triggers_late", late);
+  r.exact("module_plays", (double)plays);
+  r.exact("max_skew_ms", field(stats, "max_skew_ms"));
+  if (fired == 0 || plays != fired - late) r.fail("triggers did not all reach the module");
+  if (!inOrder) r.fail("triggers reached the module out of order");
+  if (field(stats, "max_skew_ms") > AUDIO_TRIGGER_MAX_SKEW_MS) r.fail("trigger later than AUDIO_TRIGGER_MAX_SKEW_MS");
+  return r;
+}
+
+// ----- Power -----
+// What host::PmSim saw since resetPmCounters()
+void reportPower(Result &r) {
+  host::pmSettle();
+  const host::PmSim &pm = host::pmSim();
+  auto at = [&](int mhz) {
+    auto it = pm.residencyUs.find(mhz);
+    return it == pm.residencyUs.end() ? 0.0 : it->second / 1000.0;
+  };
+  r.exact("ms_at_240", at(240));
+  r.exact("ms_at_80", at(80));
+  r.exact("sleep_ms", pm.sleepUs / 1000.0);
+  r.exact("sleeps", (double)pm.sleeps);
+  r.exact("charge_mAs", std::round(host::pmChargeMAs() * 1000) / 1000);
+}
+
+// Ten seconds of the device as the app uses it: idle, a few sensor reads,
+// and one photo uploaded and shown. Requests arrive at set times while
+// loop() runs on its own, so wait_ms is what a client would see on top of
+// the network. always_max_mAs is the same time at 240 MHz without sleep,
+// which is what the sketch drew before it had a governor.
+Result runPowerIdle(const std::vector<uint8_t> &jpg) {
+  Result r;
+  r.scenario = "power/idle";
+  server.hostRequest(request(HTTP_GET, "/power", {{"reset", "1"}}));
+  host::resetPmCounters();
+  size_t first = server.hostQueuedResponses().size();
+  uint64_t start = host::nowUs();
+  auto at = [&](double ms, const WebServer::HostRequest &req) {
+    server.hostQueueAt(req, start + (uint64_t)(ms * 1000));
+  };
+  at(1000, request(HTTP_GET, "/status"));
+  at(2500, request(HTTP_GET, "/dht"));
+  double ms = 4000;
+  for (const WebServer::HostRequest &req : chunkRequests("/imageChunk", jpg)) {
+    at(ms, req);
+    ms += 15; // the app sends the next chunk when the last is answered
+  }
+  at(ms, request(HTTP_GET, "/displayImage"));
+  at(7000, request(HTTP_GET, "/light"));
+  at(9000, request(HTTP_GET, "/status"));
+  while (host::nowUs() < start + 10000000) loop();
+
+  const std::vector<WebServer::HostResponse> &resps = server.hostQueuedResponses();
+  double waitSum = 0, waitMax = 0;
+  for (size_t i = first; i < resps.size(); ++i) {
+    if (resps[i].code != 200) r.fail("request " + std::to_string(i - first) + ": " + resps[i].body.c_str());
+    waitSum += resps[i].waitUs / 1000.0;
+    waitMax = std::max(waitMax, resps[i].waitUs / 1000.0);
+  }
+  size_t n = resps.size() - first;
+  r.exact("requests", (double)n);
+  r.exact("wait_ms", n ? std::round(waitSum / n * 1000) / 1000 : 0);
+  r.exact("max_wait_ms", waitMax);
+  reportPower(r);
+  r.exact("always_max_mAs", 10.0 * host::pmSim().activeMa.at(240));
+
+  String power = server.hostRequest(request(HTTP_GET, "/power")).body;
+  for (const char *f : {"boosts", "max_clock_ms", "min_clock_ms", "idle_ms", "wake_us", "max_wake_us"}) {
+    r.exact(f, field(power, f));
+  }
+  if (n != chunkRequests("/imageChunk", jpg).size() + 5) r.fail("not every request was answered");
+  if (waitMax > field(power, "idle_wait_ms") + field(power, "max_wake_us") / 1000) {
+    r.fail("a request waited longer than the idle wait and a wake-up");
+  }
+  if (host::pmSim().sleeps == 0) r.fail("never slept");
+  return r;
+}
+
+// GIF playback must run at full clock from start to finish and never sleep
+Result runPowerGif(const std::vector<uint8_t> &gifData) {
+  Result r;
+  r.scenario = "power/gif";
+  if (!upload("/gifChunk", gifData, r)) return r;
+  host::resetPmCounters();
+  server.hostQueue(request(HTTP_GET, "/stopGif"), 2);
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/playGif"));
+  if (resp.code != 200) r.fail(std::string("/playGif: ") + resp.body.c_str());
+  reportPower(r);
+  if (host::pmSim().sleeps > 0 || host::pmSim().residencyUs.count(80)) r.fail("playback left full clock");
+  if (host::pmCpuMhz() != 240) r.fail("clock dropped before the request hold ran out");
+  return r;
+}
+
+// ----- Batch -----
+
+WebServer::HostResponse batchRequest(const char *body) {
+  return server.hostRequest(request(HTTP_POST, "/batch", {}, String(body)));
+}
+
+// Three commands as three requests, then as one /batch: the panel has to
+// end up the same, and the batch reports each command.
+Result runBatchCommands() {
+  Result r;
+  r.scenario = "batch/commands";
+  uint64_t start = host::nowUs();
+  server.hostRequest(request(HTTP_GET, "/on"));
+  server.hostRequest(request(HTTP_GET, "/display", {{"mode", "smiley"}}));
+  server.hostRequest(request(HTTP_GET, "/displayText", {{"text", "Hello"}}));
+  double separateMs = (host::nowUs() - start) / 1000.0;
+  uint32_t separateCrc = tft.hostChecksum();
+  server.hostRequest(request(HTTP_GET, "/off"));
+  server.hostRequest(request(HTTP_GET, "/display", {{"mode", "heart"}}));
+
+  Probe probe;
+  WebServer::HostResponse resp = batchRequest("on\ndisplay smiley\n\n  displayText Hello  \n");
+  r.exact("code", resp.code);
+  r.exact("commands", field(resp.body, "commands"));
+  r.exact("failed", field(resp.body, "failed"));
+  r.exact("skipped", field(resp.body, "skipped"));
+  probe.report(r);
+  r.timing("total_ms", field(resp.body, "total_us") / 1000);
+  r.timing("separate_sim_ms", separateMs);
+  if (resp.code != 200) r.fail(std::string("/batch: ") + resp.body.c_str());
+  if (tft.hostChecksum() != separateCrc) r.fail("the batch drew something else than the requests");
+  if (resp.body.indexOf("\n0 on 200 ") < 0 || resp.body.indexOf("\n2 displayText 200 ") < 0 ||
+      resp.body.indexOf("us Text displayed") < 0) {
+    r.fail(std::string("no per-command results: ") + resp.body.c_str());
+  }
+  return r;
+}
+
+// A body with a mistake in it runs nothing; a command that fails stops
+// the ones after it.
+Result runBatchErrors() {
+  Result r;
+  r.scenario = "batch/errors";
+  server.hostRequest(request(HTTP_GET, "/display", {{"mode", "heart"}}));
+  Probe probe;
+  const char *bad[] = {"on\nblink\ndisplay smiley", "playGif\non", "off now", "\n\n",
+                       "on\non\non\non\non\non\non\non\non\non\non\non\non\non\non\non\non"};
+  int rejected = 0;
+  for (const char *body : bad) rejected += batchRequest(body).code == 400;
+  r.exact("rejected", rejected);
+  if (rejected != (int)(sizeof(bad) / sizeof(bad[0]))) r.fail("a malformed batch was accepted");
+  if (tft.hostStats().transactions > 0) r.fail("a rejected batch drew");
+
+  WebServer::HostResponse resp = batchRequest("display smiley\ndisplayImage\ndisplayText never");
+  r.exact("code", resp.code);
+  r.exact("failed", field(resp.body, "failed"));
+  r.exact("skipped", field(resp.body, "skipped"));
+  probe.report(r);
+  if (resp.code != 400 || resp.body.indexOf("No image data") < 0 || resp.body.indexOf("\n2 displayText 0 ") < 0) {
+    r.fail(std::string("/batch: ") + resp.body.c_str());
+  }
+  return r;
+}
+
+// A photo shown from a batch: the reply carries displayImage's timing on
+// the command's own line, and every line after the totals is a command
+Result runBatchImage(const std::vector<uint8_t> &jpg) {
+  Result r;
+  r.scenario = "batch/image";
+  if (!upload("/imageChunk", jpg, r)) return r;
+  Probe probe;
+  WebServer::HostResponse resp = batchRequest("displayImage\ndisplayText Done");
+  r.exact("code", resp.code);
+  r.exact("commands", field(resp.body, "commands"));
+  r.exact("failed", field(resp.body, "failed"));
+  probe.report(r);
+  if (resp.code != 200 || resp.body.indexOf("\n0 displayImage 200 ") < 0 || resp.body.indexOf(" final_ms:") < 0) {
+    r.fail(std::string("/batch: ") + resp.body.c_str());
+  }
+  // Lines after the four totals start with the command's index
+  std::string b = resp.body.c_str();
+  size_t at = 0;
+  for (int line = 0; at != std::string::npos; ++line) {
+    if (line >= 4 && !std::isdigit((unsigned char)b[at])) r.fail("a reply spilled onto its own line: " + b.substr(at));
+    at = b.find('\n', at);
+    if (at != std::string::npos) ++at;
+  }
+  return r;
+}
+
+// A batch that ends in playGif answers before the animation starts, and
+// the animation stops on /stopGif as usual
+Result runBatchGif(const std::vector<uint8_t> &gifData) {
+  Result r;
+  r.scenario = "batch/gif";
+  if (!upload("/gifChunk", gifData, r)) return r;
+  Probe probe;
+  server.hostQueue(request(HTTP_GET, "/stopGif"), 2);
+  WebServer::HostResponse resp = batchRequest("off\ndisplayText Loading\nplayGif");
+  r.exact("code", resp.code);
+  r.exact("commands", field(resp.body, "commands"));
+  r.exact("frames", (double)host::decodeStats().gifFrames);
+  probe.report(r);
+  if (resp.code != 200 || resp.body.indexOf("\n2 playGif 200 ") < 0) r.fail(std::string("/batch: ") + resp.body.c_str());
+  if (isPlayingGif) r.fail("playback did not stop");
+  if (host::decodeStats().gifFrames == 0) r.fail("the GIF never played");
+  return r;
+}
+
+// ----- Rules -----
+
+WebServer::HostResponse rulesRequest(const char *body) {
+  return server.hostRequest(request(HTTP_POST, "/rules", {}, String(body)));
+}
+
+// Lets sketch time pass with loop() running until done() or limitMs;
+// returns the time taken
+double loopUntil(const std::function<bool()> &done, double limitMs) {
+  uint64_t start = host::nowUs();
+  while (!done() && host::nowUs() - start < limitMs * 1000) loop();
+  return (host::nowUs() - start) / 1000.0;
+}
+
+// The app posts its rules once. A temperature rise then has to put up the
+// alert and the LED with no request after the 10 s hold, a dip within the
+// hysteresis must not clear it, and a fall past it must. A moving
+// average of the light level then fires a second rule.
+Result runRules() {
+  Result r;
+  r.scenario = "rules/threshold";
+  const int kLed = 2;
+  const host::Sensors saved = host::sensors();
+  const char *bad[] = {"temp > -> alert", "temp > 30 -> blink", "pressure < 2 -> alert", "avg(temp, 40) > 1 -> alert",
+                       "temp > 30 for 10", "temp > 30 -> alert else alert else data", "temp > 1e20 -> alert"};
+  int rejected = 0;
+  for (const char *body : bad) rejected += rulesRequest(body).code == 400;
+  r.exact("rejected", rejected);
+  if (rejected != (int)(sizeof(bad) / sizeof(bad[0]))) r.fail("a malformed rule was accepted");
+
+  const char *kRules = "temp > 30 hyst 2 for 10 -> alert led_on else data led_off\n# comment\navg(light, 3) < 5 -> heart\n";
+  WebServer::HostResponse resp = rulesRequest(kRules);
+  r.exact("code", resp.code);
+  r.exact("rules", field(resp.body, "rules"));
+  r.exact("program_bytes", field(resp.body, "program_bytes"));
+  if (resp.code != 200 || resp.body.indexOf("\n0 idle temp > 30 hyst 2 for 10 -> alert led_on else data led_off") < 0 ||
+      resp.body.indexOf("\n1 idle avg(light, 3) < 5 -> heart") < 0) {
+    r.fail(std::string("/rules: ") + resp.body.c_str());
+  }
+  Preferences stored;
+  stored.begin("rules", true);
+  r.exact("stored_bytes", (double)stored.getBytesLength("program"));
+  stored.end();
+  server.hostRequest(request(HTTP_GET, "/display", {{"mode", "smiley"}}));
+  digitalWrite(kLed, LOW);
+
+  Probe probe;
+  uint32_t before = tft.hostChecksum();
+  loopUntil([] { return false; }, 5000);
+  if (tft.hostChecksum() != before || host::pinState(kLed)) r.fail("a rule fired at 24.5 C");
+  host::sensors().temperature = 31;
+  r.exact("fire_ms", loopUntil([&] { return host::pinState(kLed) == HIGH; }, 30000));
+  r.exact("alert_crc", (double)tft.hostChecksum());
+  host::sensors().temperature = 29.5;
+  loopUntil([] { return false; }, 10000);
+  if (!host::pinState(kLed)) r.fail("cleared within the hysteresis");
+  host::sensors().temperature = 27;
+  r.exact("clear_ms", loopUntil([&] { return host::pinState(kLed) == LOW; }, 30000));
+  r.exact("data_crc", (double)tft.hostChecksum());
+  host::sensors().lux = 2;
+  uint32_t data = tft.hostChecksum();
+  r.exact("average_ms", loopUntil([&] { return tft.hostChecksum() != data; }, 30000));
+
+  String stats = server.hostRequest(request(HTTP_GET, "/rules")).body;
+  for (const char *f : {"samples", "evaluations", "fired", "cleared"}) r.exact(f, field(stats, f));
+  probe.report(r);
+  r.timing("eval_us", field(stats, "eval_us"));
+  r.timing("max_eval_us", field(stats, "max_eval_us"));
+  if (host::pinState(kLed)) r.fail("the LED stayed on");
+  if (field(stats, "fired") != 2 || field(stats, "cleared") != 1) r.fail(std::string("/rules: ") + stats.c_str());
+  host::sensors() = saved;
+  if (field(rulesRequest("").body, "rules") != 0) r.fail("the rules could not be removed");
+  return r;
+}
+
+// ----- Relay -----
+// The sketch relays to RelayGroup peers over the simulated ESP-NOW
+// channel, or takes a file that one of them relays.
+
+WebServer::HostResponse relayRequest(WebServer::Args args) {
+  return server.hostRequest(request(HTTP_GET, "/relay", std::move(args)));
+}
+
+// Takes each peer's file and checks it against data. show_spread_us is how
+// far the peers' show times are from the sketch's. Returns the packets
+// the peers rebuilt from parity.
+double reportRelay(Result &r, RelayGroup &group, const std::vector<uint8_t> &data, const host::EspNowSim &before) {
+  String stats = relayRequest({}).body;
+  uint32_t showAt = (uint32_t)field(stats, "last_show_us");
+  int ok = 0;
+  double spread = 0, recovered = 0, nacks = 0, badFiles = 0, overflows = 0;
+  for (int i = 0; i < group.size(); ++i) {
+    RelayGroup::Peer p = group.take(i);
+    if (p.pending && p.file == data) ++ok;
+    if (p.pending) spread = std::max(spread, std::fabs((double)(int32_t)(p.showAt - showAt)));
+    recovered += p.recovered;
+    nacks += p.nacks;
+    badFiles += p.badFiles;
+    overflows += p.overflows;
+  }
+  const host::EspNowSim &sim = host::espNowSim();
+  double us = field(stats, "last_us");
+  r.exact("peers", group.size());
+  r.exact("peers_ok", ok);
+  for (const char *f : {"sent", "send_failures", "repairs", "last_rounds", "last_peers_ok"}) r.exact(f, field(stats, f));
+  r.exact("recovered", recovered);
+  r.exact("nacks", nacks);
+  r.exact("bad_files", badFiles);
+  r.exact("overflows", overflows);
+  r.exact("air_frames", (double)(sim.frames - before.frames));
+  r.exact("air_lost", (double)(sim.lost - before.lost));
+  r.exact("relay_ms", us / 1000);
+  r.exact("show_spread_us", spread);
+  r.timing("relay_kBps", us > 0 ? data.size() / us * 1000 : 0);
+  if (ok != group.size()) r.fail("not every peer got the file intact");
+  if (spread > 1000) r.fail("peers would switch more than 1 ms apart");
+  return recovered;
+}
+
+// One photo to ten peers on a clean channel
+Result runRelayFanout(const std::vector<uint8_t> &jpg) {
+  Result r;
+  r.scenario = "relay/fanout";
+  RelayGroup group(1, 10);
+  relayRequest({{"peers", group.macList().c_str()}, {"listen", "0"}});
+  relayRequest({{"reset", "1"}});
+  if (!upload("/imageChunk", jpg, r)) return r;
+  host::EspNowSim before = host::espNowSim();
+  Probe probe;
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/displayImage"));
+  r.exact("code", resp.code);
+  reportRelay(r, group, jpg, before);
+  probe.report(r);
+  if (resp.code != 200) r.fail(std::string("/displayImage: ") + resp.body.c_str());
+  relayRequest({{"peers", ""}});
+  return r;
+}
+
+// A GIF to twenty peers that each lose a tenth of what they hear (one a
+// third), while a twentieth of their replies are lost too. Parity has to
+// rebuild packets and the NACK rounds fetch the rest.
+Result runRelayLossy(const std::vector<uint8_t> &gifData) {
+  Result r;
+  r.scenario = "relay/lossy";
+  RelayGroup group(2, 20);
+  for (int i = 0; i < group.size(); ++i) group.setLoss(i, i == 7 ? 30 : 10);
+  host::espNowSim().lossPct = 5;
+  relayRequest({{"peers", group.macList().c_str()}, {"listen", "0"}});
+  relayRequest({{"reset", "1"}});
+  if (!upload("/gifChunk", gifData, r)) return r;
+  host::EspNowSim before = host::espNowSim();
+  Probe probe;
+  server.hostQueue(request(HTTP_GET, "/stopGif"), 2);
+  WebServer::HostResponse resp = server.hostRequest(request(HTTP_GET, "/playGif"));
+  host::espNowSim().lossPct = 0;
+  r.exact("code", resp.code);
+  double recovered = reportRelay(r, group, gifData, before);
+  probe.report(r);
+  if (resp.code != 200) r.fail(std::string("/playGif: ") + resp.body.c_str());
+  if (recovered == 0) r.fail("parity rebuilt nothing");
+  if (field(relayRequest({}).body, "repairs") == 0) r.fail("no NACK round sent anything again");
+  relayRequest({{"peers", ""}});
+  return r;
+}
+
+// The sketch listening, with another display relaying a photo to it. It
+// must draw what a direct upload draws, at the agreed time.
+Result runRelayReceive(const std::vector<uint8_t> &jpg) {
+  Result r;
+  r.scenario = "relay/receive";
+  Result direct;
+  upload("/imageChunk", jpg, direct);
+  server.hostRequest(request(HTTP_GET, "/displayImage"));
+  uint32_t directCrc = tft.hostChecksum();
+  server.hostRequest(request(HTTP_GET, "/display", {{"mode", "heart"}}));
+  relayRequest({{"peers", ""}, {"listen", "1"}});
+  relayRequest({{"reset", "1"}});
+
+  RelayGroup leader(3, 1);
+  uint8_t mac[6];
+  unsigned int b[6];
+  std::sscanf(WiFi.macAddress().c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+  for (int i = 0; i < 6; ++i) mac[i] = (uint8_t)b[i];
+  Probe probe;
+  uint64_t decodes = host::decodeStats().jpegDecodes;
+  uint32_t showAt = 0;
+  bool ok = leader.lead(mac, 1 /* RELAY_IMAGE */, jpg, 100, showAt);
+  r.exact("transfer_ms", probe.simMs());
+  while (host::decodeStats().jpegDecodes == decodes && probe.simMs() < 2000) loop();
+  String stats = relayRequest({}).body;
+  r.exact("rounds", leader.leadRounds());
+  r.exact("repairs", (double)leader.leadRepairs());
+  for (const char *f : {"received", "nacks", "show_late_us"}) r.exact(f, field(stats, f));
+  probe.report(r);
+  relayRequest({{"listen", "0"}});
+  if (!ok) r.fail("the sketch did not take the file");
+  if (host::decodeStats().jpegDecodes == decodes) r.fail("the relayed photo was never shown");
+  if (tft.hostChecksum() != directCrc) r.fail("the relayed photo drew differently");
+  if (field(stats, "show_late_us") > 1000) r.fail("shown more than 1 ms late");
+  return r;
+}
+
+// Streams 24 frames, cycling through jpegs, to /mjpeg in one multipart
+// POST. With fps the sender paces itself; otherwise it sends as fast as
+// Wi-Fi allows. truncate cuts the middle frame short.
+Result streamMjpeg(const std::string &scenario, const std::vector<std::vector<uint8_t>> &jpegs, double fps,
+                   bool truncate) {
+  Result r;
+  r.scenario = scenario;
+  const int kFrames = 24;
+  std::vector<uint8_t> body;
+  std::vector<size_t> frameStart;
+  for (int i = 0; i < kFrames; ++i) {
+    const std::vector<uint8_t> &jpg = jpegs[i % jpegs.size()];
+    std::string part = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " + std::to_string(jpg.size()) +
+                       "\r\n\r\n";
+    frameStart.push_back(body.size());
+    body.insert(body.end(), part.begin(), part.end());
+    size_t n = (truncate && i == kFrames / 2) ? jpg.size() / 2 : jpg.size();
+    body.insert(body.end(), jpg.begin(), jpg.begin() + n);
+    body.push_back('\r');
+    body.push_back('\n');
+  }
+
+  Probe probe;
+  WebServer::HostRequest req = request(HTTP_POST, "/mjpeg");
+  req.raw = body;
+  const uint64_t start = host::nowUs();
+  if (fps > 0) {
+    req.pace = [&](size_t off) {
+      size_t k = std::upper_bound(frameStart.begin(), frameStart.end(), off) - frameStart.begin() - 1;
+      uint64_t due = start + (uint64_t)(k * 1e6 / fps);
+      uint64_t now = host::nowUs();
+      if (now < due) host::advanceUs(due - now);
+      return true;
+    };
+  }
+  WebServer::HostResponse resp = server.hostRequest(req);
+  r.exact("code", resp.code);
+  if (resp.code != 200) {
+    r.fail(std::string("/mjpeg: ") + resp.body.c_str());
+    return r;
+  }
+  r.exact("frames_sent", kFrames);
+  r.exact("frames_drawn", field(resp.body, "frames"));
+  r.exact("frames_dropped", field(resp.body, "dropped"));
+  r.exact("dropped_late", field(resp.body, "dropped_late"));
+  r.exact("dropped_overflow", field(resp.body, "dropped_overflow"));
+  r.exact("dropped_bad", field(resp.body, "dropped_bad"));
+  r.exact("max_queue", field(resp.body, "max_queue"));
+  r.exact("stream_bytes", (double)body.size());
+  probe.report(r);
+  r.timing("fps", field(resp.body, "fps"));
+  r.timing("decode_ms", field(resp.body, "decode_ms"));
+  r.timing("latency_ms", field(resp.body, "latency_ms"));
+  r.timing("max_latency_ms", field(resp.body, "max_latency_ms"));
+  return r;
+}
+
+Result runMjpegStream(const Corpus &c, const char *label, double fps, bool truncate) {
+  std::vector<std::vector<uint8_t>> jpegs;
+  for (const std::string &name : c.jpegs) {
+    jpegs.emplace_back();
+    readFile(c.dir + "/" + name, jpegs.back());
+  }
+  return streamMjpeg(std::string("mjpeg_stream/") + label, jpegs, fps, truncate);
+}
+
+// Host CPU to decode a frame whole against the longer of its two restart
+// slices, decoded one after the other: the simulation charges no time for
+// computation, so this is what shows the second core's share.
+struct SliceTiming {
+  double wholeUs = 0;
+  double sliceUs = 0; // max(top, bottom), summed over frames
+  int sliced = 0;
+};
+
+struct MemJpeg {
+  const uint8_t *p;
+  uint32_t left;
+};
+
+uint32_t memRead(TJpgD *jdec, uint8_t *buf, uint32_t len) {
+  MemJpeg &m = *static_cast<MemJpeg *>(jdec->device);
+  len = std::min(len, m.left);
+  if (buf) std::memcpy(buf, m.p, len);
+  m.p += len;
+  m.left -= len;
+  return len;
+}
+
+uint32_t nullWrite(TJpgD *, void *, TJpgD::JRECT *) { return 1; }
+
+SliceTiming timeSlices(const std::vector<std::vector<uint8_t>> &jpegs) {
+  typedef std::chrono::steady_clock Clock;
+  auto us = [](Clock::time_point t) { return std::chrono::duration<double, std::micro>(Clock::now() - t).count(); };
+  static TJpgD top, bottom;
+  SliceTiming t;
+  const int kRepeats = 5;
+  for (const std::vector<uint8_t> &jpg : jpegs) {
+    for (int k = 0; k < kRepeats; ++k) {
+      MemJpeg m{jpg.data(), (uint32_t)jpg.size()};
+      Clock::time_point start = Clock::now();
+      top.prepare(memRead, &m);
+      top.decomp(nullWrite, nullptr);
+      t.wholeUs += us(start);
+
+      m = MemJpeg{jpg.data(), (uint32_t)jpg.size()};
+      start = Clock::now();
+      top.prepare(memRead, &m);
+      uint32_t split = 0;
+      int32_t at = top.findRestartSplit(jpg.data(), (int32_t)jpg.size(), split);
+      if (at < 0) {
+        top.decomp(nullWrite, nullptr);
+        t.sliceUs += us(start);
+        continue;
+      }
+      top.decompSlice(nullWrite, nullptr, 0, 0, split);
+      double topUs = us(start);
+      start = Clock::now();
+      MemJpeg mb{jpg.data() + at, (uint32_t)(jpg.size() - at)};
+      bottom = top;
+      bottom.rewind(memRead, &mb);
+      bottom.decompSlice(nullWrite, nullptr, 0, split, bottom.mcuRows());
+      t.sliceUs += std::max(topUs, us(start));
+      t.sliced += k == 0;
+    }
+  }
+  t.wholeUs /= kRepeats * jpegs.size();
+  t.sliceUs /= kRepeats * jpegs.size();
+  return t;
+}
+
+// The scene GIF as a 320x240 clip, re-encoded the way host/tools/mjpack
+// does: with no restart markers (serial) or one every MCU row (sliced).
+// Restart markers only reset the DC predictors, so both must draw the
+// same pixels.
+Result runMjpegSlices(const Corpus &c, bool sliced, double serialCrc) {
+  std::vector<uint8_t> gif;
+  std::vector<AnimFrame> frames;
+  readFile(c.dir + "/scene_320x240.gif", gif);
+  decodeGifFrames(gif, frames);
+  std::vector<RgbImage> images;
+  for (const AnimFrame &f : frames) images.push_back(fitImage(f.image, 320, 240));
+  JpegOptions opt;
+  opt.restartInterval = sliced ? 320 / 16 : 0;
+  std::vector<MjpegIndexEntry> index;
+  std::vector<uint8_t> clip = encodeMjpeg(images, opt, &index);
+  std::vector<std::vector<uint8_t>> jpegs;
+  for (const MjpegIndexEntry &e : index) jpegs.emplace_back(clip.begin() + e.offset, clip.begin() + e.offset + e.bytes);
+
+  Result r = streamMjpeg(std::string("mjpeg_slices/") + (sliced ? "restart_1row" : "serial"), jpegs, 15, false);
+  if (!r.ok) return r;
+  String stats = server.hostRequest(request(HTTP_GET, "/mjpegStats")).body;
+  r.exact("sliced", field(stats, "sliced"));
+  if (sliced) r.exact("fb_matches_serial", tft.hostChecksum() == serialCrc ? 1 : 0);
+  r.timing("slice_wait_ms", field(stats, "slice_wait_ms"));
+  SliceTiming t = timeSlices(jpegs);
+  r.exact("frames_splittable", t.sliced);
+  r.timing("host_decode_us", t.wholeUs);
+  r.timing("host_slice_us", t.sliceUs);
+  r.timing("slice_speedup", t.sliceUs > 0 ? t.wholeUs / t.sliceUs : 0);
+  return r;
+}
+
+// ----- Baseline -----
+
+typedef std::map<std::string, double> Baseline;
+
+std::string key(const Result &r, const Metric &m) { return r.scenario + " " + m.name; }
+
+// Differences below this are scheduler noise on a shared machine
+double noiseFloor(const std::string &metric) { return endsWith(metric, "_us") ? 5000 : 5; }
+
+bool loadBaseline(const std::string &path, Baseline &out) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ls(line);
+    std::string scenario, metric;
+    double v;
+    if (ls >> scenario >> metric >> v) out[scenario + " " + metric] = v;
+  }
+  return true;
+}
+
+// The metrics of one kind: exact ones for the baseline, timing ones for --timings
+bool saveBaseline(const std::string &path, const std::vector<Result> &results, Kind kind) {
+  std::ofstream out(path);
+  if (!out) return false;
+  out << "# sketch_bench " << (kind == EXACT ? "baseline" : "timings") << " (" << HOST_DECODERS << " decoders)\n"
+      << "# scenario metric value\n";
+  char buf[64];
+  for (const Result &r : results) {
+    for (const Metric &m : r.metrics) {
+      if (m.kind != kind) continue;
+      std::snprintf(buf, sizeof(buf), "%.3f", m.value);
+      out << r.scenario << ' ' << m.name << ' ' << buf << '\n';
+    }
+  }
+  return true;
+}
+
+bool dumpFramebuffer(const std::string &dir, const std::string &scenario) {
+  std::string name = scenario;
+  std::replace(name.begin(), name.end(), '/', '_');
+  std::ofstream out(dir + "/" + name + ".ppm", std::ios::binary);
+  if (!out) return false;
+  out << "P6\n" << tft.width() << ' ' << tft.height() << "\n255\n";
+  for (uint16_t c : tft.hostFramebuffer()) {
+    const char px[3] = {(char)((c >> 11) << 3), (char)(((c >> 5) & 63) << 2), (char)((c & 31) << 3)};
+    out.write(px, 3);
+  }
+  return (bool)out;
+}
+
+void printResult(const Result &r) {
+  std::printf("%-32s %s\n", r.scenario.c_str(), r.ok ? "" : ("FAILED: " + r.error).c_str());
+  for (const Metric &m : r.metrics) std::printf("    %-24s %14.3f\n", m.name.c_str(), m.value);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Corpus corpus;
+  std::string baselinePath, timingsPath, filter, dumpDir;
+  bool check = false, update = false;
+  double tolerance = 50.0;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    auto next = [&]() -> std::string { return i + 1 < argc ? argv[++i] : std::string(); };
+    if (a == "--corpus") corpus.dir = next();
+    else if (a == "--baseline") baselinePath = next();
+    else if (a == "--timings") timingsPath = next();
+    else if (a == "--filter") filter = next();
+    else if (a == "--dump") dumpDir = next();
+    else if (a == "--check") check = true;
+    else if (a == "--update-baseline") update = true;
+    else if (a == "--time-tolerance") tolerance = std::atof(next().c_str());
+    else {
+      std::fprintf(stderr, "sketch_bench: unknown option %s\n", a.c_str());
+      return 2;
+    }
+  }
+  // Sketch time only: the host's own speed must not leak into sim_ms, and
+  // task interleavings have to repeat from run to run.
+  host::setRealTime(false);
+
+  if (corpus.dir.empty() || ((check || update) && baselinePath.empty())) {
+    std::fprintf(stderr, "usage: sketch_bench --corpus DIR [--filter S] [--baseline FILE (--check|--update-baseline)] "
+                         "[--timings FILE] [--time-tolerance PCT] [--dump DIR]\n");
+    return 2;
+  }
+
+  const char *kFiles[] = {"photo_320x240.jpg", "photo_640x480.jpg", "card_240x135.jpg", "gray_200x200.jpg",
+                          "spinner_320x240.gif", "scene_320x240.gif"};
+  for (const char *f : kFiles) (endsWith(f, ".gif") ? corpus.gifs : corpus.jpegs).push_back(f);
+
+  auto wanted = [&](const std::string &scenario) { return filter.empty() || scenario.find(filter) != std::string::npos; };
+
+  std::vector<Result> results;
+  auto add = [&](Result r) {
+    printResult(r);
+    if (!dumpDir.empty() && !dumpFramebuffer(dumpDir, r.scenario))
+      std::fprintf(stderr, "sketch_bench: cannot write to %s\n", dumpDir.c_str());
+    results.push_back(std::move(r));
+  };
+
+  // Powered with the board; comes online during boot
+  host::DFPlayerSim dfplayer(2, host::DFPlayerSim::Config());
+  dfplayer.powerOn();
+
+  add(runBoot(false));
+  add(runBoot(true));
+  for (const std::string &name : corpus.jpegs) {
+    if (!wanted("upload_jpeg/" + name) && !wanted("display_jpeg/" + name)) continue;
+    std::vector<uint8_t> data;
+    if (!readFile(corpus.dir + "/" + name, data)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s/%s\n", corpus.dir.c_str(), name.c_str());
+      return 2;
+    }
+    add(runUploadJpeg(name, data));
+    uint32_t crc = 0;
+    add(runDisplayJpeg(name, false, crc));
+    Result again;
+    upload("/imageChunk", data, again);
+    add(runDisplayJpeg(name, true, crc));
+  }
+  if (wanted("display/data")) add(runDisplayData());
+  for (const std::string &name : corpus.gifs) {
+    if (!wanted("upload_gif/" + name) && !wanted("gif_loop/" + name) && !wanted("anim_loop/" + name)) continue;
+    std::vector<uint8_t> data;
+    if (!readFile(corpus.dir + "/" + name, data)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s/%s\n", corpus.dir.c_str(), name.c_str());
+      return 2;
+    }
+    add(runUploadGif(name, data));
+    add(runGifLoop(name, data));
+    add(runAnimLoop(name, data));
+  }
+  if (wanted("upload_reject")) {
+    std::vector<uint8_t> jpg, gifData;
+    if (!readFile(corpus.dir + "/photo_320x240.jpg", jpg) || !readFile(corpus.dir + "/spinner_320x240.gif", gifData)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", corpus.dir.c_str());
+      return 2;
+    }
+    std::vector<uint8_t> huge(jpg);
+    size_t sof = jpegSofOffset(huge);
+    huge[sof] = 0x0F; // 4000x3000: beyond 1/8 scale
+    huge[sof + 1] = 0xA0;
+    huge[sof + 2] = 0x0B;
+    huge[sof + 3] = 0xB8;
+    std::vector<uint8_t> progressive(jpg);
+    progressive[jpegSofOffset(progressive) - 4] = 0xC2;
+    std::vector<uint8_t> oversize(jpg);
+    oversize.resize(100000, 0);
+    std::vector<uint8_t> wide(gifData);
+    wide[6] = 0x80; // 640 pixels wide
+    wide[7] = 0x02;
+    add(runUploadReject("jpeg_4000x3000", "/imageChunk", huge, 415));
+    add(runUploadReject("jpeg_progressive", "/imageChunk", progressive, 415));
+    add(runUploadReject("jpeg_100k", "/imageChunk", oversize, 413));
+    add(runUploadReject("gif_640_wide", "/gifChunk", wide, 415));
+    std::vector<uint8_t> bigGif(gifData);
+    bigGif.resize(200000, 0);
+    add(runUploadReject("jpeg_100k_no_size", "/imageChunk", oversize, 413, false));
+    add(runUploadReject("gif_200k_no_size", "/gifChunk", bigGif, 413, false));
+  }
+  if (wanted("audio")) {
+    std::vector<uint8_t> gifData;
+    if (!readFile(corpus.dir + "/spinner_320x240.gif", gifData)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", corpus.dir.c_str());
+      return 2;
+    }
+    add(runAudio(dfplayer, "commands", 0, 0));
+    add(runAudio(dfplayer, "lossy", 4, 5));
+    add(runAudioGifSync(dfplayer, gifData));
+  }
+  if (wanted("power")) {
+    std::vector<uint8_t> jpg, gifData;
+    if (!readFile(corpus.dir + "/photo_320x240.jpg", jpg) || !readFile(corpus.dir + "/spinner_320x240.gif", gifData)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", corpus.dir.c_str());
+      return 2;
+    }
+    add(runPowerIdle(jpg));
+    add(runPowerGif(gifData));
+  }
+  if (wanted("batch")) {
+    std::vector<uint8_t> jpg, gifData;
+    if (!readFile(corpus.dir + "/photo_320x240.jpg", jpg) || !readFile(corpus.dir + "/spinner_320x240.gif", gifData)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", corpus.dir.c_str());
+      return 2;
+    }
+    add(runBatchCommands());
+    add(runBatchErrors());
+    add(runBatchGif(gifData));
+    add(runBatchImage(jpg));
+  }
+  if (wanted("mjpeg_stream/15fps")) add(runMjpegStream(corpus, "15fps", 15, false));
+  if (wanted("mjpeg_stream/60fps")) add(runMjpegStream(corpus, "60fps", 60, false));
+  if (wanted("mjpeg_stream/burst")) add(runMjpegStream(corpus, "burst", 0, true));
+  if (wanted("mjpeg_slices")) {
+    add(runMjpegSlices(corpus, false, 0));
+    add(runMjpegSlices(corpus, true, (double)tft.hostChecksum()));
+  }
+  if (wanted("rules")) add(runRules());
+  // Last: the radio stays on once the relay has started
+  if (wanted("relay")) {
+    std::vector<uint8_t> jpg, gifData;
+    if (!readFile(corpus.dir + "/photo_320x240.jpg", jpg) || !readFile(corpus.dir + "/spinner_320x240.gif", gifData)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", corpus.dir.c_str());
+      return 2;
+    }
+    add(runRelayFanout(jpg));
+    add(runRelayLossy(gifData));
+    add(runRelayReceive(jpg));
+  }
+
+  int failures = 0;
+  for (const Result &r : results) failures += !r.ok;
+
+  if (update) {
+    if (!saveBaseline(baselinePath, results, EXACT)) {
+      std::fprintf(stderr, "sketch_bench: cannot write %s\n", baselinePath.c_str());
+      return 2;
+    }
+    std::printf("baseline written to %s\n", baselinePath.c_str());
+    if (!timingsPath.empty()) {
+      if (!saveBaseline(timingsPath, results, TIMING)) {
+        std::fprintf(stderr, "sketch_bench: cannot write %s\n", timingsPath.c_str());
+        return 2;
+      }
+      std::printf("timings written to %s\n", timingsPath.c_str());
+    }
+  }
+
+  if (check) {
+    Baseline base, times;
+    if (!loadBaseline(baselinePath, base)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", baselinePath.c_str());
+      return 2;
+    }
+    if (!timingsPath.empty() && !loadBaseline(timingsPath, times)) {
+      std::fprintf(stderr, "sketch_bench: cannot read %s\n", timingsPath.c_str());
+      return 2;
+    }
+    int mismatches = 0, warnings = 0;
+    for (const Result &r : results) {
+      for (const Metric &m : r.metrics) {
+        const Baseline &from = m.kind == EXACT ? base : times;
+        auto it = from.find(key(r, m));
+        if (it == from.end()) {
+          if (m.kind == EXACT) std::printf("new metric: %s = %.3f\n", key(r, m).c_str(), m.value);
+          continue;
+        }
+        if (m.kind == EXACT && std::fabs(m.value - it->second) > 0.0005) {
+          std::printf("MISMATCH %s: %.3f (baseline %.3f)\n", key(r, m).c_str(), m.value, it->second);
+          ++mismatches;
+        } else if (m.kind == TIMING && m.name != "fps" && !endsWith(m.name, "speedup") && it->second > 0 &&
+                   m.value > it->second * (1 + tolerance / 100) && m.value - it->second > noiseFloor(m.name)) {
+          std::printf("warning: %s slower: %.3f (baseline %.3f)\n", key(r, m).c_str(), m.value, it->second);
+          ++warnings;
+        }
+      }
+    }
+    std::printf("%d mismatches, %d timing warnings, %d failed scenarios\n", mismatches, warnings, failures);
+    if (mismatches) return 1;
+  }
+  return failures ? 1 : 0;
+}
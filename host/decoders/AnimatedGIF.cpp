@@ -0,0 +1,326 @@
+#include "AnimatedGIF.h"
+
+#include <cstring>
+
+#include "Arduino.h"
+#include "HostSim.h"
+
+int AnimatedGIF::readByte() { return pos_ < size_ ? data_[pos_++] : -1; }
+
+int AnimatedGIF::readWord() {
+  int lo = readByte(), hi = readByte();
+  return (lo < 0 || hi < 0) ? -1 : (lo | hi << 8);
+}
+
+bool AnimatedGIF::readPalette(uint16_t *pal565, uint8_t *pal24, int entries) {
+  if (pos_ + entries * 3 > size_) return false;
+  for (int i = 0; i < entries; ++i) {
+    uint8_t r = data_[pos_++], g = data_[pos_++], b = data_[pos_++];
+    pal24[i * 3] = r;
+    pal24[i * 3 + 1] = g;
+    pal24[i * 3 + 2] = b;
+    uint16_t c = (uint16_t)((r & 0xF8) << 8 | (g & 0xFC) << 3 | b >> 3);
+    pal565[i] = paletteType_ == GIF_PALETTE_RGB565_BE ? (uint16_t)(c << 8 | c >> 8) : c;
+  }
+  for (int i = entries; i < 256; ++i) pal565[i] = 0;
+  return true;
+}
+
+bool AnimatedGIF::skipSubBlocks() {
+  for (;;) {
+    int n = readByte();
+    if (n < 0) return false;
+    if (n == 0) return true;
+    pos_ += n;
+    if (pos_ > size_) return false;
+  }
+}
+
+int AnimatedGIF::open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw) {
+  data_ = pData;
+  size_ = iDataSize;
+  pos_ = 0;
+  draw_ = pfnDraw;
+  loopCount_ = 0;
+  if (!pData || iDataSize < 13 || (std::memcmp(pData, "GIF87a", 6) && std::memcmp(pData, "GIF89a", 6))) {
+    lastError_ = GIF_BAD_FILE;
+    return 0;
+  }
+  pos_ = 6;
+  canvasW_ = readWord();
+  canvasH_ = readWord();
+  int flags = readByte();
+  background_ = readByte();
+  readByte(); // aspect
+  hasGlobal_ = flags & 0x80;
+  if (hasGlobal_ && !readPalette(global565_, global24_, 2 << (flags & 7))) {
+    lastError_ = GIF_EARLY_EOF;
+    return 0;
+  }
+  firstFramePos_ = pos_;
+  lastError_ = GIF_SUCCESS;
+  return 1;
+}
+
+void AnimatedGIF::close() {
+  data_ = nullptr;
+  size_ = 0;
+  line_.clear();
+  frame_.clear();
+}
+
+void AnimatedGIF::reset() { pos_ = firstFramePos_; }
+
+int AnimatedGIF::getInfo(GIFINFO *pInfo) {
+  if (!data_ || !pInfo) return 0;
+  int saved = pos_;
+  pos_ = firstFramePos_;
+  GIFINFO info = {0, 0, 0, 0x7FFFFFFF};
+  int delay = 0;
+  for (;;) {
+    int b = readByte();
+    if (b == 0x21) {
+      int label = readByte();
+      if (label == 0xF9) {
+        readByte(); // block size
+        readByte(); // flags
+        delay = readWord() * 10;
+        readByte(); // transparent index
+      }
+      if (!skipSubBlocks()) break;
+    } else if (b == 0x2C) {
+      pos_ += 8;
+      int flags = readByte();
+      if (flags & 0x80) pos_ += 3 * (2 << (flags & 7));
+      readByte(); // LZW minimum code size
+      if (!skipSubBlocks()) break;
+      ++info.iFrameCount;
+      info.iDuration += delay;
+      info.iMaxDelay = std::max<int32_t>(info.iMaxDelay, delay);
+      info.iMinDelay = std::min<int32_t>(info.iMinDelay, delay);
+      delay = 0;
+    } else {
+      break;
+    }
+  }
+  if (!info.iFrameCount) info.iMinDelay = 0;
+  pos_ = saved;
+  *pInfo = info;
+  return 1;
+}
+
+int AnimatedGIF::decodeImage(GIFDRAW &d, int minCodeSize, bool interlaced) {
+  if (minCodeSize < 2 || minCodeSize > 11) return -1;
+  static uint16_t prefix[4096];
+  static uint8_t suffix[4096];
+  static uint8_t stack[4097];
+
+  const int clear = 1 << minCodeSize, eoi = clear + 1;
+  int codeSize = minCodeSize + 1, next = clear + 2;
+  int prev = -1, first = 0;
+  for (int i = 0; i < clear; ++i) {
+    prefix[i] = 0;
+    suffix[i] = (uint8_t)i;
+  }
+
+  const int w = d.iWidth, h = d.iHeight;
+  line_.assign(w, 0);
+  if (interlaced) frame_.assign((size_t)w * h, 0);
+  int x = 0, row = 0;
+  int pass = 0, passY = 0;
+  static const int kStart[4] = {0, 4, 2, 1}, kStep[4] = {8, 8, 4, 2};
+
+  auto emitLine = [&]() {
+    if (interlaced) {
+      std::memcpy(&frame_[(size_t)passY * w], line_.data(), w);
+      passY += kStep[pass];
+      while (pass < 3 && passY >= h) {
+        ++pass;
+        passY = kStart[pass];
+      }
+    } else {
+      d.y = row;
+      d.pPixels = line_.data();
+      draw_(&d);
+    }
+    ++row;
+    x = 0;
+  };
+
+  uint32_t bits = 0;
+  int nbits = 0;
+  int blockLeft = 0;
+  bool done = false;
+  while (!done && row < h) {
+    while (nbits < codeSize) {
+      if (!blockLeft) {
+        blockLeft = readByte();
+        if (blockLeft <= 0) {
+          done = true;
+          break;
+        }
+      }
+      int c = readByte();
+      if (c < 0) return -1;
+      --blockLeft;
+      bits |= (uint32_t)c << nbits;
+      nbits += 8;
+    }
+    if (done) break;
+    int code = bits & ((1 << codeSize) - 1);
+    bits >>= codeSize;
+    nbits -= codeSize;
+
+    if (code == clear) {
+      codeSize = minCodeSize + 1;
+      next = clear + 2;
+      prev = -1;
+      continue;
+    }
+    if (code == eoi) break;
+
+    int sp = 0;
+    int in = code;
+    if (prev < 0) {
+      if (code >= clear) return -1;
+      stack[sp++] = (uint8_t)code;
+      first = code;
+    } else {
+      if (code > next) return -1;
+      if (code == next) {
+        stack[sp++] = (uint8_t)first;
+        code = prev;
+      }
+      while (code >= clear) {
+        stack[sp++] = suffix[code];
+        code = prefix[code];
+      }
+      first = code;
+      stack[sp++] = (uint8_t)first;
+      if (next < 4096) {
+        prefix[next] = (uint16_t)prev;
+        suffix[next] = (uint8_t)first;
+        ++next;
+        if (next == (1 << codeSize) && codeSize < 12) ++codeSize;
+      }
+    }
+    prev = in;
+    while (sp > 0 && row < h) {
+      line_[x++] = stack[--sp];
+      if (x == w) emitLine();
+    }
+  }
+  // Consume the rest of the image data (including the terminator)
+  if (blockLeft > 0) pos_ += blockLeft;
+  if (!done && !skipSubBlocks()) return -1;
+
+  if (interlaced) {
+    for (int y = 0; y < h; ++y) {
+      d.y = y;
+      d.pPixels = &frame_[(size_t)y * w];
+      draw_(&d);
+    }
+  }
+  return 0;
+}
+
+int AnimatedGIF::playFrame(bool bSync, int *delayMilliseconds, void *pUser) {
+  if (!data_) {
+    lastError_ = GIF_FILE_NOT_OPEN;
+    return -1;
+  }
+  unsigned long start = millis();
+  int delay = 0, disposal = 0, transparent = 0, hasTransparency = 0;
+  for (;;) {
+    int b = readByte();
+    if (b == 0x21) {
+      int label = readByte();
+      if (label == 0xF9) {
+        readByte();
+        int flags = readByte();
+        delay = readWord() * 10;
+        transparent = readByte();
+        disposal = (flags >> 2) & 7;
+        hasTransparency = flags & 1;
+      } else if (label == 0xFF) {
+        int n = readByte();
+        if (n == 11 && pos_ + 11 <= size_ && !std::memcmp(data_ + pos_, "NETSCAPE2.0", 11)) {
+          pos_ += 11;
+          if (readByte() == 3) {
+            readByte();
+            loopCount_ = readWord();
+          }
+        } else if (n > 0) {
+          pos_ += n;
+        }
+      }
+      if (!skipSubBlocks()) {
+        lastError_ = GIF_EARLY_EOF;
+        return -1;
+      }
+    } else if (b == 0x2C) {
+      GIFDRAW d;
+      std::memset(&d, 0, sizeof(d));
+      d.iX = readWord();
+      d.iY = readWord();
+      d.iWidth = readWord();
+      d.iHeight = readWord();
+      int flags = readByte();
+      if (d.iWidth <= 0 || d.iHeight <= 0) {
+        lastError_ = GIF_DECODE_ERROR;
+        return -1;
+      }
+      d.iCanvasWidth = canvasW_;
+      d.pUser = pUser;
+      d.ucTransparent = (uint8_t)transparent;
+      d.ucHasTransparency = (uint8_t)hasTransparency;
+      d.ucDisposalMethod = (uint8_t)disposal;
+      d.ucBackground = (uint8_t)background_;
+      d.ucPaletteType = paletteType_;
+      if (flags & 0x80) {
+        if (!readPalette(local565_, local24_, 2 << (flags & 7))) {
+          lastError_ = GIF_EARLY_EOF;
+          return -1;
+        }
+        d.pPalette = local565_;
+        d.pPalette24 = local24_;
+      } else {
+        d.pPalette = global565_;
+        d.pPalette24 = global24_;
+        d.ucIsGlobalPalette = 1;
+      }
+      if (decodeImage(d, readByte(), flags & 0x40) < 0) {
+        lastError_ = GIF_DECODE_ERROR;
+        return -1;
+      }
+      ++host::decodeStats().gifFrames;
+      break;
+    } else if (b == 0x3B || b < 0) {
+      return 0; // trailer with no frame left
+    } else {
+      lastError_ = GIF_DECODE_ERROR;
+      return -1;
+    }
+  }
+
+  if (delayMilliseconds) *delayMilliseconds = delay;
+  if (bSync) {
+    long wait = delay - (long)(millis() - start);
+    if (wait > 0) ::delay(wait);
+  }
+  // Peek for another frame
+  int save = pos_;
+  int more = 0;
+  for (;;) {
+    int b = readByte();
+    if (b == 0x21) {
+      readByte();
+      if (!skipSubBlocks()) break;
+    } else {
+      more = (b == 0x2C);
+      break;
+    }
+  }
+  pos_ = save;
+  return more;
+}
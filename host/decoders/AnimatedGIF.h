@@ -0,0 +1,94 @@
+// Host stand-in for bitbank2's AnimatedGIF, used when the real library is
+// not available to the build. Same calling contract: one draw callback per
+// frame line with 8-bit palette indices and an RGB565 palette; frames are
+// not composited.
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#define GIF_PALETTE_RGB565_LE 0
+#define GIF_PALETTE_RGB565_BE 1
+#define GIF_PALETTE_RGB888 2
+
+enum {
+  GIF_SUCCESS = 0,
+  GIF_DECODE_ERROR,
+  GIF_TOO_WIDE,
+  GIF_INVALID_PARAMETER,
+  GIF_UNSUPPORTED_FEATURE,
+  GIF_FILE_NOT_OPEN,
+  GIF_EARLY_EOF,
+  GIF_EMPTY_FRAME,
+  GIF_BAD_FILE,
+  GIF_ERROR_MEMORY,
+};
+
+typedef struct gif_draw_tag {
+  int iX, iY;           // corner offset of this frame on the canvas
+  int y;                // current line being drawn (0 = top line of image)
+  int iWidth, iHeight;  // size of this frame
+  int iCanvasWidth;
+  void *pUser;
+  uint8_t *pPixels;     // 8-bit source pixels for this line
+  uint16_t *pPalette;   // RGB565 palette
+  uint8_t *pPalette24;  // RGB888 palette
+  uint8_t ucTransparent;
+  uint8_t ucHasTransparency;
+  uint8_t ucDisposalMethod;
+  uint8_t ucBackground;
+  uint8_t ucPaletteType;
+  uint8_t ucIsGlobalPalette;
+} GIFDRAW;
+
+typedef struct gif_info_tag {
+  int32_t iFrameCount;
+  int32_t iDuration;  // total of all frame delays, ms
+  int32_t iMaxDelay;
+  int32_t iMinDelay;
+} GIFINFO;
+
+typedef void(GIF_DRAW_CALLBACK)(GIFDRAW *pDraw);
+
+class AnimatedGIF {
+public:
+  void begin(unsigned char ucPaletteType = GIF_PALETTE_RGB565_LE) { paletteType_ = ucPaletteType; }
+  int open(uint8_t *pData, int iDataSize, GIF_DRAW_CALLBACK *pfnDraw);
+  void close();
+  void reset();
+  // Decodes and draws the next frame. Returns 1 when more frames follow,
+  // 0 when the frame just drawn was the last one, -1 on error. With bSync
+  // it waits out the frame delay with delay().
+  int playFrame(bool bSync, int *delayMilliseconds, void *pUser = nullptr);
+  int getCanvasWidth() const { return canvasW_; }
+  int getCanvasHeight() const { return canvasH_; }
+  int getLoopCount() const { return loopCount_; }
+  int getLastError() const { return lastError_; }
+  int getInfo(GIFINFO *pInfo);
+
+private:
+  int readByte();
+  int readWord();
+  bool readPalette(uint16_t *pal565, uint8_t *pal24, int entries);
+  bool skipSubBlocks();
+  int decodeImage(GIFDRAW &d, int minCodeSize, bool interlaced);
+
+  uint8_t *data_ = nullptr;
+  int size_ = 0;
+  int pos_ = 0;
+  int firstFramePos_ = 0;
+  GIF_DRAW_CALLBACK *draw_ = nullptr;
+  unsigned char paletteType_ = GIF_PALETTE_RGB565_LE;
+  int canvasW_ = 0, canvasH_ = 0;
+  int background_ = 0;
+  bool hasGlobal_ = false;
+  int loopCount_ = 0;
+  int lastError_ = GIF_SUCCESS;
+  uint16_t global565_[256];
+  uint8_t global24_[768];
+  uint16_t local565_[256];
+  uint8_t local24_[768];
+  std::vector<uint8_t> line_;
+  std::vector<uint8_t> frame_;
+};
@@ -0,0 +1,143 @@
+#include "JPEGDEC.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "HostSim.h"
+#include "tjpgdClass.h"
+
+struct JpegdecSession {
+  JPEGDEC *owner;
+  int x0, y0;
+  int pos;
+  int mcuW, mcuH;         // scaled MCU size
+  int mcusPerCall;
+  std::vector<uint16_t> strip;
+  int stripX = -1, stripY = 0, stripW = 0, stripH = 0;
+  int stripMcus = 0;
+  bool aborted = false;
+
+  static uint32_t read(TJpgD *jdec, uint8_t *buf, uint32_t len) {
+    auto *s = static_cast<JpegdecSession *>(jdec->device);
+    uint32_t n = std::min<uint32_t>(len, s->owner->size_ - s->pos);
+    if (buf) std::memcpy(buf, s->owner->data_ + s->pos, n);
+    s->pos += n;
+    return n;
+  }
+
+  bool flush() {
+    if (stripX < 0) return true;
+    // Compact rows to the block's actual width (the strip stride is the widest batch)
+    int stride = mcusPerCall * mcuW;
+    if (stripW != stride) {
+      for (int j = 1; j < stripH; ++j) std::memmove(&strip[j * stripW], &strip[j * stride], stripW * 2);
+    }
+    JPEGDRAW d;
+    d.x = x0 + stripX;
+    d.y = y0 + stripY;
+    d.iWidth = stripW;
+    d.iHeight = stripH;
+    d.iBpp = 16;
+    d.pPixels = strip.data();
+    d.pUser = owner->user_;
+    stripX = -1;
+    stripMcus = 0;
+    return owner->draw_(&d) != 0;
+  }
+
+  static uint32_t out(TJpgD *jdec, void *bitmap, TJpgD::JRECT *rect) {
+    auto *s = static_cast<JpegdecSession *>(jdec->device);
+    int w = rect->right - rect->left + 1;
+    int h = rect->bottom - rect->top + 1;
+    if (s->stripX >= 0 && (int)rect->top != s->stripY) {
+      if (!s->flush()) return 0;
+    }
+    if (s->stripX < 0) {
+      s->stripX = rect->left;
+      s->stripY = rect->top;
+      s->stripW = 0;
+      s->stripH = h;
+    }
+    const int stride = s->mcusPerCall * s->mcuW;
+    const uint8_t *src = static_cast<const uint8_t *>(bitmap);
+    const bool be = s->owner->pixelType_ == RGB565_BIG_ENDIAN;
+    for (int j = 0; j < h; ++j) {
+      uint16_t *dst = &s->strip[j * stride + s->stripW];
+      for (int i = 0; i < w; ++i, src += 3) {
+        uint16_t c = (uint16_t)((src[0] & 0xF8) << 8 | (src[1] & 0xFC) << 3 | src[2] >> 3);
+        dst[i] = be ? (uint16_t)(c << 8 | c >> 8) : c;
+      }
+    }
+    s->stripW += w;
+    if (++s->stripMcus == s->mcusPerCall || (int)rect->right + 1 >= (int)((jdec->width + (1 << s->scaleShift) - 1) >> s->scaleShift)) {
+      if (!s->flush()) return 0;
+    }
+    return 1;
+  }
+
+  int scaleShift = 0;
+};
+
+int JPEGDEC::openRAM(uint8_t *pData, int iDataSize, JPEG_DRAW_CALLBACK *pfnDraw) {
+  data_ = pData;
+  size_ = iDataSize;
+  draw_ = pfnDraw;
+  width_ = height_ = 0;
+  pixelType_ = RGB565_LITTLE_ENDIAN; // JPEGDEC clears its state on open
+  TJpgD jdec;
+  JpegdecSession s;
+  s.owner = this;
+  s.pos = 0;
+  if (!pData || iDataSize <= 0 || jdec.prepare(JpegdecSession::read, &s) != TJpgD::JDR_OK) {
+    lastError_ = JPEG_INVALID_FILE;
+    return 0;
+  }
+  width_ = jdec.width;
+  height_ = jdec.height;
+  lastError_ = JPEG_SUCCESS;
+  return 1;
+}
+
+void JPEGDEC::close() {
+  data_ = nullptr;
+  size_ = 0;
+}
+
+int JPEGDEC::decode(int x, int y, int iOptions) {
+  if (!data_ || !draw_) {
+    lastError_ = JPEG_INVALID_PARAMETER;
+    return 0;
+  }
+  TJpgD jdec;
+  JpegdecSession s;
+  s.owner = this;
+  s.pos = 0;
+  s.x0 = x;
+  s.y0 = y;
+  if (jdec.prepare(JpegdecSession::read, &s) != TJpgD::JDR_OK) {
+    lastError_ = JPEG_DECODE_ERROR;
+    return 0;
+  }
+  uint8_t scale = 0;
+  if (iOptions & JPEG_SCALE_EIGHTH) scale = 3;
+  else if (iOptions & JPEG_SCALE_QUARTER) scale = 2;
+  else if (iOptions & JPEG_SCALE_HALF) scale = 1;
+  s.scaleShift = scale;
+  s.mcuW = (jdec.msx * 8) >> scale;
+  s.mcuH = (jdec.msy * 8) >> scale;
+  int mcusPerRow = (jdec.width + jdec.msx * 8 - 1) / (jdec.msx * 8);
+  s.mcusPerCall = std::max(1, std::min(mcusPerRow, MAX_BUFFERED_PIXELS / (s.mcuW * s.mcuH)));
+  if (maxMCUs_ > 0) s.mcusPerCall = std::min(s.mcusPerCall, maxMCUs_);
+  s.strip.assign((size_t)s.mcusPerCall * s.mcuW * s.mcuH, 0);
+
+  TJpgD::JRESULT r = jdec.decomp(JpegdecSession::out, nullptr, scale);
+  if (r == TJpgD::JDR_OK && !s.flush()) r = TJpgD::JDR_INTR;
+  if (r != TJpgD::JDR_OK) {
+    lastError_ = JPEG_DECODE_ERROR;
+    return 0;
+  }
+  ++host::decodeStats().jpegDecodes;
+  lastError_ = JPEG_SUCCESS;
+  return 1;
+}
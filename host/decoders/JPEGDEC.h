@@ -0,0 +1,67 @@
+// Host stand-in for bitbank2's JPEGDEC, used when the real library is not
+// available to the build. Decoding is done by the sketch's own TJpgD;
+// draw callbacks are batched like JPEGDEC's: one MCU row high and as many
+// MCUs wide as fit in MAX_BUFFERED_PIXELS.
+#pragma once
+
+#include <stdint.h>
+
+#define JPEG_SCALE_HALF 2
+#define JPEG_SCALE_QUARTER 4
+#define JPEG_SCALE_EIGHTH 8
+#define JPEG_LE_PIXELS 16
+#define JPEG_EXIF_THUMBNAIL 32
+#define JPEG_LUMA_ONLY 64
+
+#define MAX_BUFFERED_PIXELS 4096
+
+enum {
+  RGB565_LITTLE_ENDIAN = 0,
+  RGB565_BIG_ENDIAN,
+  EIGHT_BIT_GRAYSCALE,
+};
+
+enum {
+  JPEG_SUCCESS = 0,
+  JPEG_INVALID_PARAMETER,
+  JPEG_DECODE_ERROR,
+  JPEG_UNSUPPORTED_FEATURE,
+  JPEG_INVALID_FILE,
+};
+
+typedef struct jpeg_draw_tag {
+  int x, y;           // upper left corner of current MCU block
+  int iWidth, iHeight; // size of this block
+  int iBpp;
+  uint16_t *pPixels;
+  void *pUser;
+} JPEGDRAW;
+
+typedef int(JPEG_DRAW_CALLBACK)(JPEGDRAW *pDraw);
+
+class JPEGDEC {
+public:
+  int openRAM(uint8_t *pData, int iDataSize, JPEG_DRAW_CALLBACK *pfnDraw);
+  int openFLASH(uint8_t *pData, int iDataSize, JPEG_DRAW_CALLBACK *pfnDraw) { return openRAM(pData, iDataSize, pfnDraw); }
+  void close();
+  int decode(int x, int y, int iOptions);
+  int getWidth() const { return width_; }
+  int getHeight() const { return height_; }
+  int getBpp() const { return 24; }
+  int getLastError() const { return lastError_; }
+  int getOrientation() const { return 0; }
+  void setPixelType(int iType) { pixelType_ = iType; }
+  void setUserPointer(void *p) { user_ = p; }
+  void setMaxOutputSize(int iMaxMCUs) { maxMCUs_ = iMaxMCUs; }
+
+private:
+  uint8_t *data_ = nullptr;
+  int size_ = 0;
+  JPEG_DRAW_CALLBACK *draw_ = nullptr;
+  void *user_ = nullptr;
+  int width_ = 0, height_ = 0;
+  int lastError_ = JPEG_SUCCESS;
+  int pixelType_ = RGB565_LITTLE_ENDIAN;
+  int maxMCUs_ = 0;
+  friend struct JpegdecSession;
+};
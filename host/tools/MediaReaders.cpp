@@ -0,0 +1,130 @@
+#include "MediaReaders.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "AnimatedGIF.h"
+#include "tjpgdClass.h"
+
+namespace {
+
+struct Canvas {
+  RgbImage image;
+  RgbImage saved; // for disposal 3
+  int x = 0, y = 0, w = 0, h = 0, disposal = 0;
+  bool started = false;
+};
+
+void drawLine(GIFDRAW *d) {
+  Canvas &c = *static_cast<Canvas *>(d->pUser);
+  if (!c.started) {
+    c.started = true;
+    c.x = d->iX;
+    c.y = d->iY;
+    c.w = d->iWidth;
+    c.h = d->iHeight;
+    c.disposal = d->ucDisposalMethod;
+    if (c.disposal == 3) c.saved = c.image;
+  }
+  int y = d->iY + d->y;
+  if (y < 0 || y >= c.image.height) return;
+  for (int i = 0; i < d->iWidth; ++i) {
+    int x = d->iX + i;
+    if (x >= c.image.width) break;
+    uint8_t idx = d->pPixels[i];
+    if (d->ucHasTransparency && idx == d->ucTransparent) continue;
+    std::memcpy(c.image.at(x, y), &d->pPalette24[idx * 3], 3);
+  }
+}
+
+struct JpegSource {
+  const std::vector<uint8_t> *data;
+  size_t pos;
+  RgbImage *image;
+};
+
+uint32_t jpegRead(TJpgD *jdec, uint8_t *buf, uint32_t len) {
+  JpegSource &s = *static_cast<JpegSource *>(jdec->device);
+  len = (uint32_t)std::min<size_t>(len, s.data->size() - s.pos);
+  if (buf) std::memcpy(buf, s.data->data() + s.pos, len);
+  s.pos += len;
+  return len;
+}
+
+uint32_t jpegWrite(TJpgD *jdec, void *bitmap, TJpgD::JRECT *rect) {
+  RgbImage &img = *static_cast<JpegSource *>(jdec->device)->image;
+  const uint8_t *src = static_cast<const uint8_t *>(bitmap);
+  const int w = rect->right + 1 - rect->left;
+  for (unsigned y = rect->top; y <= rect->bottom; ++y, src += w * 3)
+    std::memcpy(img.at(rect->left, y), src, w * 3);
+  return 1;
+}
+
+} // namespace
+
+bool decodeGifFrames(const std::vector<uint8_t> &gif, std::vector<AnimFrame> &frames) {
+  std::vector<uint8_t> data(gif);
+  AnimatedGIF dec;
+  dec.begin(GIF_PALETTE_RGB888);
+  if (!dec.open(data.data(), (int)data.size(), drawLine)) return false;
+  Canvas c;
+  c.image = RgbImage(dec.getCanvasWidth(), dec.getCanvasHeight());
+  frames.clear();
+  for (;;) {
+    int delayMs = 0;
+    c.started = false;
+    int rc = dec.playFrame(false, &delayMs, &c);
+    if (rc < 0) break;
+    if (c.started) frames.push_back({c.image, delayMs});
+    // Disposal applies before the next image is drawn
+    if (c.disposal == 2) {
+      for (int y = c.y; y < c.y + c.h && y < c.image.height; ++y)
+        for (int x = c.x; x < c.x + c.w && x < c.image.width; ++x) std::memset(c.image.at(x, y), 0, 3);
+    } else if (c.disposal == 3 && c.saved.width) {
+      c.image = c.saved;
+    }
+    if (rc == 0) break;
+  }
+  dec.close();
+  return !frames.empty();
+}
+
+bool readPpm(const std::string &path, RgbImage &img) {
+  FILE *f = std::fopen(path.c_str(), "rb");
+  if (!f) return false;
+  int w = 0, h = 0, maxval = 0;
+  bool ok = std::fscanf(f, "P6 %d %d %d", &w, &h, &maxval) == 3 && w > 0 && h > 0 && maxval == 255 &&
+            std::fgetc(f) != EOF;
+  if (ok) {
+    img = RgbImage(w, h);
+    ok = std::fread(img.rgb.data(), 1, img.rgb.size(), f) == img.rgb.size();
+  }
+  std::fclose(f);
+  return ok;
+}
+
+bool decodeJpeg(const std::vector<uint8_t> &jpg, RgbImage &img) {
+  TJpgD dec;
+  JpegSource src{&jpg, 0, &img};
+  if (dec.prepare(jpegRead, &src) != TJpgD::JDR_OK) return false;
+  img = RgbImage(dec.width, dec.height);
+  return dec.decomp(jpegWrite, nullptr) == TJpgD::JDR_OK;
+}
+
+std::vector<std::vector<uint8_t>> splitMjpeg(const std::vector<uint8_t> &stream) {
+  std::vector<std::vector<uint8_t>> frames;
+  size_t start = 0;
+  bool inFrame = false;
+  for (size_t i = 1; i < stream.size(); ++i) {
+    if (stream[i - 1] != 0xFF) continue;
+    if (!inFrame && stream[i] == 0xD8) {
+      start = i - 1;
+      inFrame = true;
+    } else if (inFrame && stream[i] == 0xD9) {
+      frames.emplace_back(stream.begin() + start, stream.begin() + i + 1);
+      inFrame = false;
+    }
+  }
+  return frames;
+}
@@ -0,0 +1,24 @@
+// Readers for the host tools: GIFs decoded with the AnimatedGIF the build
+// uses and composited into whole frames, baseline JPEGs decoded with the
+// sketch's TJpgD, and binary PPMs.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MediaWriters.h"
+
+// One AnimFrame per GIF image, each the full canvas after that image is
+// drawn (transparency and disposal applied, black background).
+bool decodeGifFrames(const std::vector<uint8_t> &gif, std::vector<AnimFrame> &frames);
+
+// P6 with maxval 255, the format sketch_bench --dump writes
+bool readPpm(const std::string &path, RgbImage &img);
+
+// Baseline JPEG to RGB888 (the sketch's TJpgD, so the same subset the
+// device decodes)
+bool decodeJpeg(const std::vector<uint8_t> &jpg, RgbImage &img);
+
+// Splits concatenated JPEGs (an MJPEG stream, multipart framing allowed)
+// at SOI/EOI the way MjpegClass does
+std::vector<std::vector<uint8_t>> splitMjpeg(const std::vector<uint8_t> &stream);
@@ -0,0 +1,609 @@
+#include "MediaWriters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+const uint8_t kZigzag[64] = {
+  0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+  12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+const uint8_t kLumaQ[64] = {
+  16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+  14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+  18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+  49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99,
+};
+
+const uint8_t kChromaQ[64] = {
+  17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+  24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+  99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+};
+
+const uint8_t kDcLumaBits[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+const uint8_t kDcChromaBits[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+const uint8_t kDcVals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+const uint8_t kAcLumaBits[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+const uint8_t kAcLumaVals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa,
+};
+
+const uint8_t kAcChromaBits[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+const uint8_t kAcChromaVals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa,
+};
+
+struct HuffCode {
+  uint16_t code[256];
+  uint8_t len[256];
+};
+
+HuffCode buildCodes(const uint8_t *bits, const uint8_t *vals) {
+  HuffCode h;
+  std::memset(&h, 0, sizeof(h));
+  int code = 0, k = 0;
+  for (int l = 1; l <= 16; ++l) {
+    for (int i = 0; i < bits[l - 1]; ++i, ++k, ++code) {
+      h.code[vals[k]] = (uint16_t)code;
+      h.len[vals[k]] = (uint8_t)l;
+    }
+    code <<= 1;
+  }
+  return h;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(std::vector<uint8_t> &out) : out_(out) {}
+  void put(uint32_t bits, int n) {
+    acc_ = (acc_ << n) | (bits & ((1u << n) - 1));
+    cnt_ += n;
+    while (cnt_ >= 8) {
+      uint8_t b = (uint8_t)(acc_ >> (cnt_ - 8));
+      out_.push_back(b);
+      if (b == 0xFF) out_.push_back(0);
+      cnt_ -= 8;
+    }
+  }
+  void flush() {
+    if (cnt_ > 0) put(0x7F, 8 - cnt_); // pad with ones
+    acc_ = 0;
+    cnt_ = 0;
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  uint32_t acc_ = 0;
+  int cnt_ = 0;
+};
+
+void put16(std::vector<uint8_t> &o, int v) {
+  o.push_back((uint8_t)(v >> 8));
+  o.push_back((uint8_t)v);
+}
+
+void fdct(const float *in, float *out) {
+  static float c[8][8];
+  static bool init = false;
+  if (!init) {
+    for (int u = 0; u < 8; ++u)
+      for (int x = 0; x < 8; ++x)
+        c[u][x] = (u == 0 ? std::sqrt(0.125f) : 0.5f) * std::cos((2 * x + 1) * u * (float)M_PI / 16);
+    init = true;
+  }
+  float tmp[64];
+  for (int y = 0; y < 8; ++y)
+    for (int u = 0; u < 8; ++u) {
+      float s = 0;
+      for (int x = 0; x < 8; ++x) s += c[u][x] * in[y * 8 + x];
+      tmp[y * 8 + u] = s;
+    }
+  for (int u = 0; u < 8; ++u)
+    for (int v = 0; v < 8; ++v) {
+      float s = 0;
+      for (int y = 0; y < 8; ++y) s += c[v][y] * tmp[y * 8 + u];
+      out[v * 8 + u] = s;
+    }
+}
+
+int bitLength(int v) {
+  v = std::abs(v);
+  int n = 0;
+  while (v) {
+    ++n;
+    v >>= 1;
+  }
+  return n;
+}
+
+void encodeBlock(BitWriter &bw, const float *pix, const int *q, int &pred, const HuffCode &dc, const HuffCode &ac) {
+  float f[64];
+  fdct(pix, f);
+  int coef[64];
+  for (int k = 0; k < 64; ++k) {
+    int n = kZigzag[k];
+    coef[k] = (int)std::lround(f[n] / q[n]);
+  }
+  int diff = coef[0] - pred;
+  pred = coef[0];
+  int s = bitLength(diff);
+  bw.put(dc.code[s], dc.len[s]);
+  if (s) bw.put(diff < 0 ? diff - 1 : diff, s);
+  int run = 0;
+  for (int k = 1; k < 64; ++k) {
+    int v = coef[k];
+    if (!v) {
+      ++run;
+      continue;
+    }
+    while (run > 15) {
+      bw.put(ac.code[0xF0], ac.len[0xF0]);
+      run -= 16;
+    }
+    s = bitLength(v);
+    int rs = (run << 4) | s;
+    bw.put(ac.code[rs], ac.len[rs]);
+    bw.put(v < 0 ? v - 1 : v, s);
+    run = 0;
+  }
+  if (run) bw.put(ac.code[0], ac.len[0]);
+}
+
+} // namespace
+
+std::vector<uint8_t> encodeJpeg(const RgbImage &img, const JpegOptions &opt) {
+  std::vector<uint8_t> o;
+  int quality = std::min(100, std::max(1, opt.quality));
+  int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+  int qY[64], qC[64];
+  for (int i = 0; i < 64; ++i) {
+    qY[i] = std::min(255, std::max(1, (kLumaQ[i] * scale + 50) / 100));
+    qC[i] = std::min(255, std::max(1, (kChromaQ[i] * scale + 50) / 100));
+  }
+  const bool gray = opt.grayscale;
+  const int ms = (!gray && opt.subsample420) ? 2 : 1;
+
+  o.insert(o.end(), {0xFF, 0xD8, 0xFF, 0xE0});
+  put16(o, 16);
+  o.insert(o.end(), {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+
+  for (int t = 0; t < (gray ? 1 : 2); ++t) {
+    o.insert(o.end(), {0xFF, 0xDB});
+    put16(o, 67);
+    o.push_back((uint8_t)t);
+    for (int k = 0; k < 64; ++k) o.push_back((uint8_t)(t ? qC : qY)[kZigzag[k]]);
+  }
+
+  o.insert(o.end(), {0xFF, 0xC0});
+  put16(o, gray ? 11 : 17);
+  o.push_back(8);
+  put16(o, img.height);
+  put16(o, img.width);
+  o.push_back(gray ? 1 : 3);
+  o.insert(o.end(), {1, (uint8_t)(ms << 4 | ms), 0});
+  if (!gray) o.insert(o.end(), {2, 0x11, 1, 3, 0x11, 1});
+
+  struct Table { int cls, id; const uint8_t *bits, *vals; int n; };
+  const Table tables[4] = {
+    {0, 0, kDcLumaBits, kDcVals, 12}, {1, 0, kAcLumaBits, kAcLumaVals, 162},
+    {0, 1, kDcChromaBits, kDcVals, 12}, {1, 1, kAcChromaBits, kAcChromaVals, 162},
+  };
+  for (int t = 0; t < (gray ? 2 : 4); ++t) {
+    o.insert(o.end(), {0xFF, 0xC4});
+    put16(o, 2 + 1 + 16 + tables[t].n);
+    o.push_back((uint8_t)(tables[t].cls << 4 | tables[t].id));
+    o.insert(o.end(), tables[t].bits, tables[t].bits + 16);
+    o.insert(o.end(), tables[t].vals, tables[t].vals + tables[t].n);
+  }
+
+  if (opt.restartInterval > 0) {
+    o.insert(o.end(), {0xFF, 0xDD});
+    put16(o, 4);
+    put16(o, opt.restartInterval);
+  }
+
+  o.insert(o.end(), {0xFF, 0xDA});
+  put16(o, gray ? 8 : 12);
+  o.push_back(gray ? 1 : 3);
+  o.insert(o.end(), {1, 0x00});
+  if (!gray) o.insert(o.end(), {2, 0x11, 3, 0x11});
+  o.insert(o.end(), {0, 63, 0});
+
+  const HuffCode dcY = buildCodes(kDcLumaBits, kDcVals), acY = buildCodes(kAcLumaBits, kAcLumaVals);
+  const HuffCode dcC = buildCodes(kDcChromaBits, kDcVals), acC = buildCodes(kAcChromaBits, kAcChromaVals);
+
+  auto sample = [&](int x, int y, float *ycc) {
+    x = std::min(x, img.width - 1);
+    y = std::min(y, img.height - 1);
+    const uint8_t *p = img.at(x, y);
+    float r = p[0], g = p[1], b = p[2];
+    ycc[0] = 0.299f * r + 0.587f * g + 0.114f * b - 128;
+    ycc[1] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+    ycc[2] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+  };
+
+  BitWriter bw(o);
+  int pred[3] = {0, 0, 0};
+  const int mcu = 8 * ms;
+  const int mcusX = (img.width + mcu - 1) / mcu, mcusY = (img.height + mcu - 1) / mcu;
+  int count = 0, rst = 0;
+  for (int my = 0; my < mcusY; ++my) {
+    for (int mx = 0; mx < mcusX; ++mx) {
+      if (opt.restartInterval && count && count % opt.restartInterval == 0) {
+        bw.flush();
+        o.push_back(0xFF);
+        o.push_back((uint8_t)(0xD0 + (rst++ & 7)));
+        pred[0] = pred[1] = pred[2] = 0;
+      }
+      ++count;
+      float Y[4][64], Cb[64], Cr[64];
+      std::fill(Cb, Cb + 64, 0.f);
+      std::fill(Cr, Cr + 64, 0.f);
+      for (int by = 0; by < ms; ++by)
+        for (int bx = 0; bx < ms; ++bx)
+          for (int y = 0; y < 8; ++y)
+            for (int x = 0; x < 8; ++x) {
+              float ycc[3];
+              int px = mx * mcu + bx * 8 + x, py = my * mcu + by * 8 + y;
+              sample(px, py, ycc);
+              Y[by * ms + bx][y * 8 + x] = ycc[0];
+              int cx = (bx * 8 + x) / ms, cy = (by * 8 + y) / ms;
+              Cb[cy * 8 + cx] += ycc[1] / (ms * ms);
+              Cr[cy * 8 + cx] += ycc[2] / (ms * ms);
+            }
+      for (int b = 0; b < ms * ms; ++b) encodeBlock(bw, Y[b], qY, pred[0], dcY, acY);
+      if (!gray) {
+        encodeBlock(bw, Cb, qC, pred[1], dcC, acC);
+        encodeBlock(bw, Cr, qC, pred[2], dcC, acC);
+      }
+    }
+  }
+  bw.flush();
+  o.insert(o.end(), {0xFF, 0xD9});
+  return o;
+}
+
+// ----- GIF -----
+
+namespace {
+
+uint8_t paletteIndex(const uint8_t *p) {
+  int r = (p[0] * 5 + 127) / 255, g = (p[1] * 6 + 127) / 255, b = (p[2] * 5 + 127) / 255;
+  return (uint8_t)(r * 42 + g * 6 + b);
+}
+
+void putLE16(std::vector<uint8_t> &o, int v) {
+  o.push_back((uint8_t)v);
+  o.push_back((uint8_t)(v >> 8));
+}
+
+void lzwEncode(std::vector<uint8_t> &o, const std::vector<uint8_t> &idx) {
+  const int minCode = 8, clear = 256, eoi = 257;
+  o.push_back(minCode);
+  std::vector<uint8_t> block;
+  uint32_t acc = 0;
+  int nbits = 0;
+  auto emit = [&](int code, int size) {
+    acc |= (uint32_t)code << nbits;
+    nbits += size;
+    while (nbits >= 8) {
+      block.push_back((uint8_t)acc);
+      acc >>= 8;
+      nbits -= 8;
+      if (block.size() == 255) {
+        o.push_back(255);
+        o.insert(o.end(), block.begin(), block.end());
+        block.clear();
+      }
+    }
+  };
+
+  std::vector<int> table(4096 * 256, -1); // (prefix code, byte) -> code
+  int next = eoi + 1, size = minCode + 1;
+  emit(clear, size);
+  int prefix = idx.empty() ? -1 : idx[0];
+  for (size_t i = 1; i < idx.size(); ++i) {
+    int c = idx[i];
+    int &slot = table[prefix * 256 + c];
+    if (slot >= 0) {
+      prefix = slot;
+      continue;
+    }
+    emit(prefix, size);
+    if (next < 4096) {
+      slot = next++;
+      if (next > (1 << size) && size < 12) ++size;
+    } else {
+      emit(clear, size);
+      std::fill(table.begin(), table.end(), -1);
+      next = eoi + 1;
+      size = minCode + 1;
+    }
+    prefix = c;
+  }
+  if (prefix >= 0) emit(prefix, size);
+  emit(eoi, size);
+  if (nbits > 0) emit(0, 8 - nbits);
+  if (!block.empty()) {
+    o.push_back((uint8_t)block.size());
+    o.insert(o.end(), block.begin(), block.end());
+  }
+  o.push_back(0);
+}
+
+} // namespace
+
+std::vector<uint8_t> encodeGif(int canvasW, int canvasH, const std::vector<GifFrame> &frames, int loopCount) {
+  std::vector<uint8_t> o = {'G', 'I', 'F', '8', '9', 'a'};
+  putLE16(o, canvasW);
+  putLE16(o, canvasH);
+  o.push_back(0xF7); // global palette of 256 entries
+  o.push_back(0);
+  o.push_back(0);
+  for (int i = 0; i < 256; ++i) {
+    if (i < 252) {
+      o.push_back((uint8_t)(i / 42 * 255 / 5));
+      o.push_back((uint8_t)(i / 6 % 7 * 255 / 6));
+      o.push_back((uint8_t)(i % 6 * 255 / 5));
+    } else {
+      uint8_t g = (uint8_t)((i - 251) * 51);
+      o.insert(o.end(), {g, g, g});
+    }
+  }
+  o.insert(o.end(), {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1});
+  putLE16(o, loopCount);
+  o.push_back(0);
+
+  for (const GifFrame &f : frames) {
+    o.insert(o.end(), {0x21, 0xF9, 4, (uint8_t)((f.disposal & 7) << 2)});
+    putLE16(o, (f.delayMs + 5) / 10);
+    o.push_back(0);
+    o.push_back(0);
+    o.push_back(0x2C);
+    putLE16(o, f.x);
+    putLE16(o, f.y);
+    putLE16(o, f.image.width);
+    putLE16(o, f.image.height);
+    o.push_back(0);
+    std::vector<uint8_t> idx((size_t)f.image.width * f.image.height);
+    for (int y = 0; y < f.image.height; ++y)
+      for (int x = 0; x < f.image.width; ++x) idx[(size_t)y * f.image.width + x] = paletteIndex(f.image.at(x, y));
+    lzwEncode(o, idx);
+  }
+  o.push_back(0x3B);
+  return o;
+}
+
+// ----- Panel animation -----
+
+namespace {
+
+struct Rect {
+  int x, y, w, h;
+};
+
+std::vector<uint16_t> toRgb565(const RgbImage &img) {
+  std::vector<uint16_t> px((size_t)img.width * img.height);
+  for (size_t i = 0; i < px.size(); ++i) {
+    const uint8_t *p = &img.rgb[i * 3];
+    px[i] = (uint16_t)((p[0] & 0xF8) << 8 | (p[1] & 0xFC) << 3 | p[2] >> 3);
+  }
+  return px;
+}
+
+// Rows of dirty 16x16 tiles become spans; spans with the same columns in
+// consecutive tile rows merge; each result is trimmed to what differs.
+std::vector<Rect> dirtyRects(const std::vector<uint16_t> &prev, const std::vector<uint16_t> &cur, int w, int h) {
+  const int T = 16;
+  auto differs = [&](int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; ++y)
+      for (int x = x0; x < x1; ++x)
+        if (prev[(size_t)y * w + x] != cur[(size_t)y * w + x]) return true;
+    return false;
+  };
+  std::vector<Rect> rects, open;
+  for (int ty = 0; ty < h; ty += T) {
+    int y1 = std::min(ty + T, h);
+    std::vector<Rect> row;
+    for (int tx = 0; tx < w; tx += T) {
+      if (!differs(tx, ty, std::min(tx + T, w), y1)) continue;
+      if (!row.empty() && row.back().x + row.back().w == tx) row.back().w = std::min(tx + T, w) - row.back().x;
+      else row.push_back({tx, ty, std::min(tx + T, w) - tx, y1 - ty});
+    }
+    std::vector<Rect> next;
+    for (Rect r : row) {
+      auto it = std::find_if(open.begin(), open.end(), [&](const Rect &o) { return o.x == r.x && o.w == r.w; });
+      if (it != open.end()) {
+        r.y = it->y;
+        r.h = y1 - it->y;
+        open.erase(it);
+      }
+      next.push_back(r);
+    }
+    rects.insert(rects.end(), open.begin(), open.end());
+    open = next;
+  }
+  rects.insert(rects.end(), open.begin(), open.end());
+
+  for (Rect &r : rects) {
+    int x0 = r.x + r.w, x1 = r.x, y0 = r.y + r.h, y1 = r.y;
+    for (int y = r.y; y < r.y + r.h; ++y)
+      for (int x = r.x; x < r.x + r.w; ++x)
+        if (prev[(size_t)y * w + x] != cur[(size_t)y * w + x]) {
+          x0 = std::min(x0, x);
+          x1 = std::max(x1, x + 1);
+          y0 = std::min(y0, y);
+          y1 = std::max(y1, y + 1);
+        }
+    r = {x0, y0, x1 - x0, y1 - y0};
+  }
+  std::sort(rects.begin(), rects.end(), [](const Rect &a, const Rect &b) { return a.y != b.y ? a.y < b.y : a.x < b.x; });
+  return rects;
+}
+
+void putBE16(std::vector<uint8_t> &o, uint16_t v) {
+  o.push_back(v >> 8);
+  o.push_back(v & 0xFF);
+}
+
+// Repeat runs of 3 or more pixels, literals in between (max 32768 each)
+void encodeRuns(std::vector<uint8_t> &o, const std::vector<uint16_t> &px, PanelAnimStats &stats) {
+  const size_t kMax = 0x8000;
+  size_t i = 0, litStart = 0;
+  auto flushLiterals = [&](size_t end) {
+    while (litStart < end) {
+      size_t n = std::min(end - litStart, kMax);
+      putLE16(o, (int)(n - 1));
+      for (size_t k = 0; k < n; ++k) putBE16(o, px[litStart + k]);
+      litStart += n;
+    }
+  };
+  while (i < px.size()) {
+    size_t run = 1;
+    while (i + run < px.size() && run < kMax && px[i + run] == px[i]) ++run;
+    if (run >= 3) {
+      flushLiterals(i);
+      putLE16(o, (int)(0x8000 | (run - 1)));
+      putBE16(o, px[i]);
+      stats.runPixels += run;
+      i += run;
+      litStart = i;
+    } else {
+      i += run;
+    }
+  }
+  flushLiterals(px.size());
+}
+
+void putLE32(std::vector<uint8_t> &o, uint32_t v) {
+  putLE16(o, v & 0xFFFF);
+  putLE16(o, v >> 16);
+}
+
+} // namespace
+
+std::vector<uint8_t> encodePanelAnim(const std::vector<AnimFrame> &frames, int loopCount, PanelAnimStats *stats) {
+  PanelAnimStats local;
+  PanelAnimStats &st = stats ? *stats : local;
+  st = PanelAnimStats();
+  std::vector<uint8_t> o;
+  if (frames.empty()) return o;
+  const int w = frames[0].image.width, h = frames[0].image.height;
+  o.insert(o.end(), {'P', 'A', 'N', '1'});
+  putLE16(o, w);
+  putLE16(o, h);
+  putLE16(o, (int)frames.size());
+  putLE16(o, loopCount);
+  putLE32(o, 0);
+
+  std::vector<uint16_t> prev;
+  for (const AnimFrame &f : frames) {
+    std::vector<uint16_t> cur = toRgb565(f.image);
+    std::vector<Rect> rects = prev.empty() ? std::vector<Rect>{{0, 0, w, h}} : dirtyRects(prev, cur, w, h);
+    size_t start = o.size();
+    putLE32(o, 0); // patched below
+    putLE16(o, f.delayMs);
+    putLE16(o, (int)rects.size());
+    for (const Rect &r : rects) {
+      putLE16(o, r.x);
+      putLE16(o, r.y);
+      putLE16(o, r.w);
+      putLE16(o, r.h);
+      std::vector<uint16_t> px;
+      px.reserve((size_t)r.w * r.h);
+      for (int y = r.y; y < r.y + r.h; ++y)
+        px.insert(px.end(), cur.begin() + (size_t)y * w + r.x, cur.begin() + (size_t)y * w + r.x + r.w);
+      encodeRuns(o, px, st);
+      ++st.rects;
+      st.pixels += px.size();
+    }
+    uint32_t bytes = (uint32_t)(o.size() - start - 4);
+    for (int k = 0; k < 4; ++k) o[start + k] = (uint8_t)(bytes >> (8 * k));
+    prev.swap(cur);
+  }
+  return o;
+}
+
+RgbImage fitImage(const RgbImage &img, int w, int h) {
+  RgbImage out(w, h);
+  if (img.width <= 0 || img.height <= 0) return out;
+  // Largest size with the source aspect ratio that fits
+  int fw = w, fh = (int)((int64_t)img.height * w / img.width);
+  if (fh > h) {
+    fh = h;
+    fw = (int)((int64_t)img.width * h / img.height);
+  }
+  fw = std::max(fw, 1);
+  fh = std::max(fh, 1);
+  const int ox = (w - fw) / 2, oy = (h - fh) / 2;
+  for (int y = 0; y < fh; ++y) {
+    int y0 = (int)((int64_t)y * img.height / fh);
+    int y1 = std::max(y0 + 1, (int)((int64_t)(y + 1) * img.height / fh));
+    for (int x = 0; x < fw; ++x) {
+      int x0 = (int)((int64_t)x * img.width / fw);
+      int x1 = std::max(x0 + 1, (int)((int64_t)(x + 1) * img.width / fw));
+      int sum[3] = {0, 0, 0};
+      for (int sy = y0; sy < y1; ++sy)
+        for (int sx = x0; sx < x1; ++sx)
+          for (int c = 0; c < 3; ++c) sum[c] += img.at(sx, sy)[c];
+      int n = (x1 - x0) * (y1 - y0);
+      for (int c = 0; c < 3; ++c) out.at(ox + x, oy + y)[c] = (uint8_t)((sum[c] + n / 2) / n);
+    }
+  }
+  return out;
+}
+
+std::vector<uint8_t> encodeMjpeg(const std::vector<RgbImage> &frames, const JpegOptions &opt,
+                                 std::vector<MjpegIndexEntry> *index) {
+  std::vector<uint8_t> o;
+  if (index) index->clear();
+  for (const RgbImage &img : frames) {
+    std::vector<uint8_t> jpg = encodeJpeg(img, opt);
+    if (index) index->push_back({(uint32_t)o.size(), (uint32_t)jpg.size()});
+    o.insert(o.end(), jpg.begin(), jpg.end());
+  }
+  return o;
+}
+
+bool writeFile(const std::string &path, const std::vector<uint8_t> &data) {
+  std::ofstream f(path, std::ios::binary);
+  f.write(reinterpret_cast<const char *>(data.data()), data.size());
+  return (bool)f;
+}
+
+bool readFile(const std::string &path, std::vector<uint8_t> &data) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+  return true;
+}
@@ -0,0 +1,73 @@
+// Minimal baseline JPEG and GIF89a writers used by the host tools to build
+// benchmark corpora and re-encode media for the device.
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct RgbImage {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> rgb; // packed RGB888, row major
+
+  RgbImage() {}
+  RgbImage(int w, int h) : width(w), height(h), rgb((size_t)w * h * 3, 0) {}
+  uint8_t *at(int x, int y) { return &rgb[((size_t)y * width + x) * 3]; }
+  const uint8_t *at(int x, int y) const { return &rgb[((size_t)y * width + x) * 3]; }
+};
+
+struct JpegOptions {
+  int quality = 80;          // 1..100, IJG scaling of the Annex K tables
+  bool subsample420 = true;  // 2x2 luma MCU (4:2:0); false for 4:4:4
+  bool grayscale = false;
+  int restartInterval = 0;   // MCUs between RSTn markers, 0 for none
+};
+
+std::vector<uint8_t> encodeJpeg(const RgbImage &img, const JpegOptions &opt = JpegOptions());
+
+// Scales img to fit inside w x h, keeping its aspect ratio (area average
+// when shrinking, nearest pixel when enlarging), centred on black.
+RgbImage fitImage(const RgbImage &img, int w, int h);
+
+// MJPEG as the sketch's /mjpeg endpoint takes it: the frames' JPEGs back
+// to back. index gets where each one starts and how long it is.
+struct MjpegIndexEntry {
+  uint32_t offset = 0;
+  uint32_t bytes = 0;
+};
+
+std::vector<uint8_t> encodeMjpeg(const std::vector<RgbImage> &frames, const JpegOptions &opt,
+                                 std::vector<MjpegIndexEntry> *index = nullptr);
+
+struct GifFrame {
+  RgbImage image;   // sub-image placed at (x, y) on the canvas
+  int x = 0, y = 0;
+  int delayMs = 100;
+  int disposal = 1; // 1 = leave in place
+};
+
+// Encodes with a fixed 6x7x6 colour cube palette (plus grays) shared by all
+// frames. loopCount 0 loops forever.
+std::vector<uint8_t> encodeGif(int canvasW, int canvasH, const std::vector<GifFrame> &frames, int loopCount = 0);
+
+// Panel-native animation (.pan, see PanelAnim.h in the sketch). Each frame
+// is the whole canvas as it should look; the encoder stores the first one
+// in full and then only the 16x16 tiles that change, trimmed to the pixels
+// that differ.
+struct AnimFrame {
+  RgbImage image;
+  int delayMs = 100;
+};
+
+struct PanelAnimStats {
+  int rects = 0;         // over all frames
+  uint64_t pixels = 0;   // pixels inside those rects
+  uint64_t runPixels = 0; // of those, stored as repeat runs
+};
+
+std::vector<uint8_t> encodePanelAnim(const std::vector<AnimFrame> &frames, int loopCount = 0,
+                                     PanelAnimStats *stats = nullptr);
+
+bool writeFile(const std::string &path, const std::vector<uint8_t> &data);
+bool readFile(const std::string &path, std::vector<uint8_t> &data);
@@ -0,0 +1,137 @@
+// corpusgen: writes the deterministic benchmark corpus (host/corpus).
+//
+//   corpusgen <out-dir>
+//
+// Images are synthetic but photo-like (gradients, shapes, texture) so the
+// entropy coder and the decoders see realistic coefficient statistics.
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "MediaWriters.h"
+
+namespace {
+
+uint32_t rng = 12345;
+int noise() {
+  rng = rng * 1103515245u + 12345u;
+  return (int)((rng >> 16) & 31) - 16;
+}
+
+uint8_t clamp8(double v) { return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+// grain scales the sensor-like noise; GIF frames use less so the LZW
+// stream stays within the sketch's 150 KB upload buffer.
+RgbImage scene(int w, int h, double t, double grain = 1.0) {
+  RgbImage img(w, h);
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      double u = (double)x / w, v = (double)y / h;
+      double r = 60 + 150 * v + 30 * std::sin(6 * u + t);
+      double g = 90 + 100 * u + 40 * std::cos(5 * v - t);
+      double b = 170 - 90 * v + 50 * std::sin(9 * (u + v) + 2 * t);
+      // sun
+      double dx = u - 0.7 - 0.1 * std::sin(t), dy = v - 0.3;
+      if (dx * dx + dy * dy < 0.012) {
+        r = 250;
+        g = 220;
+        b = 90;
+      }
+      // hills
+      if (v > 0.65 + 0.08 * std::sin(11 * u + 0.5 * t)) {
+        r = 40 + 30 * u;
+        g = 120 + 50 * v;
+        b = 50;
+      }
+      double n = noise() * grain;
+      uint8_t *p = img.at(x, y);
+      p[0] = clamp8(r + n);
+      p[1] = clamp8(g + n);
+      p[2] = clamp8(b + n);
+    }
+  }
+  return img;
+}
+
+RgbImage spinnerFrame(int w, int h, int i, int n) {
+  RgbImage img(w, h);
+  double a = 2 * M_PI * i / n;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      uint8_t *p = img.at(x, y);
+      p[0] = 20;
+      p[1] = 24;
+      p[2] = 40;
+      double dx = x - w / 2.0, dy = y - h / 2.0;
+      double r = std::sqrt(dx * dx + dy * dy);
+      if (r > h * 0.25 && r < h * 0.4) {
+        double ang = std::atan2(dy, dx) - a;
+        while (ang < 0) ang += 2 * M_PI;
+        double k = 1 - ang / (2 * M_PI);
+        p[0] = clamp8(255 * k);
+        p[1] = clamp8(180 * k);
+        p[2] = clamp8(40 + 60 * k);
+      }
+    }
+  }
+  return img;
+}
+
+bool emit(const std::string &dir, const char *name, const std::vector<uint8_t> &data) {
+  std::string path = dir + "/" + name;
+  if (!writeFile(path, data)) {
+    std::fprintf(stderr, "corpusgen: cannot write %s\n", path.c_str());
+    return false;
+  }
+  std::printf("%-28s %7zu bytes\n", name, data.size());
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    std::fprintf(stderr, "usage: corpusgen <out-dir>\n");
+    return 2;
+  }
+  std::string dir = argv[1];
+  bool ok = true;
+
+  JpegOptions q80;
+  ok &= emit(dir, "photo_320x240.jpg", encodeJpeg(scene(320, 240, 0.0), q80));
+  JpegOptions q60;
+  q60.quality = 60;
+  ok &= emit(dir, "photo_640x480.jpg", encodeJpeg(scene(640, 480, 0.4), q60));
+  JpegOptions q85;
+  q85.quality = 85;
+  q85.subsample420 = false;
+  ok &= emit(dir, "card_240x135.jpg", encodeJpeg(scene(240, 135, 1.1), q85));
+  JpegOptions gray;
+  gray.grayscale = true;
+  ok &= emit(dir, "gray_200x200.jpg", encodeJpeg(scene(200, 200, 2.0), gray));
+
+  // Small spinner: only the ring changes between frames
+  std::vector<GifFrame> spin;
+  for (int i = 0; i < 16; ++i) {
+    GifFrame f;
+    f.image = spinnerFrame(160, 120, i, 16);
+    f.x = 80;
+    f.y = 60;
+    f.delayMs = 50;
+    spin.push_back(f);
+  }
+  ok &= emit(dir, "spinner_320x240.gif", encodeGif(320, 240, spin));
+
+  // Full-screen motion
+  std::vector<GifFrame> pan;
+  for (int i = 0; i < 8; ++i) {
+    GifFrame f;
+    f.image = scene(320, 240, i * 0.3, 0.25);
+    f.delayMs = 100;
+    pan.push_back(f);
+  }
+  ok &= emit(dir, "scene_320x240.gif", encodeGif(320, 240, pan));
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// mjpack: re-encodes a clip as 320x240 baseline MJPEG with restart markers
+// every N MCU rows, so the sketch's MjpegClass can decode each frame in two
+// slices on both cores (see TJpgD::findRestartSplit), plus a frame index.
+//
+//   mjpack [--rows N] [--quality Q] [--fps F] -o OUT.mjpeg IN.mjpeg
+//   mjpack [--rows N] [--quality Q] -o OUT.mjpeg IN.gif
+//   mjpack [--rows N] [--quality Q] [--fps F] -o OUT.mjpeg FRAME.(jpg|ppm)...
+//
+// Frames are scaled to fit the panel, keeping their aspect ratio. --rows
+// (default 1) is the restart interval in 16-line MCU rows; 0 writes no
+// markers. GIFs keep their own frame delays, other inputs play at --fps
+// (default 15).
+//
+// OUT.mjpeg.idx is a text index, one line per frame after a header line:
+//   mjpack 320 240 <frames> <rows>
+//   <offset> <bytes> <pts_ms>
+// A sender can pace or seek with it without scanning for SOI markers.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "MediaReaders.h"
+#include "MediaWriters.h"
+
+namespace {
+
+const int kPanelW = 320, kPanelH = 240;
+const int kMcuSize = 16; // 4:2:0
+
+bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = std::string(suffix).size();
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+bool readFrames(const std::vector<std::string> &inputs, int fps, std::vector<AnimFrame> &frames) {
+  const int delayMs = 1000 / fps;
+  if (inputs.size() == 1 && endsWith(inputs[0], ".gif")) {
+    std::vector<uint8_t> gif;
+    return readFile(inputs[0], gif) && decodeGifFrames(gif, frames);
+  }
+  for (const std::string &path : inputs) {
+    if (endsWith(path, ".ppm")) {
+      AnimFrame f;
+      if (!readPpm(path, f.image)) {
+        std::fprintf(stderr, "mjpack: %s is not a binary PPM (P6, maxval 255)\n", path.c_str());
+        return false;
+      }
+      f.delayMs = delayMs;
+      frames.push_back(f);
+      continue;
+    }
+    std::vector<uint8_t> data;
+    if (!readFile(path, data)) return false;
+    std::vector<std::vector<uint8_t>> jpegs = splitMjpeg(data);
+    if (jpegs.empty()) {
+      std::fprintf(stderr, "mjpack: no JPEG frames in %s\n", path.c_str());
+      return false;
+    }
+    for (const std::vector<uint8_t> &jpg : jpegs) {
+      AnimFrame f;
+      if (!decodeJpeg(jpg, f.image)) {
+        std::fprintf(stderr, "mjpack: frame %zu of %s is not a baseline JPEG\n", frames.size(), path.c_str());
+        return false;
+      }
+      f.delayMs = delayMs;
+      frames.push_back(f);
+    }
+  }
+  return !frames.empty();
+}
+
+int usage() {
+  std::fprintf(stderr, "usage: mjpack [--rows N] [--quality Q] [--fps F] -o OUT.mjpeg "
+                       "(IN.mjpeg | IN.gif | FRAME.jpg... | FRAME.ppm...)\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string out;
+  std::vector<std::string> inputs;
+  int rows = 1, fps = 15;
+  JpegOptions opt;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if ((a == "-o" || a == "--rows" || a == "--quality" || a == "--fps") && i + 1 >= argc) return usage();
+    if (a == "-o") out = argv[++i];
+    else if (a == "--rows") rows = std::atoi(argv[++i]);
+    else if (a == "--quality") opt.quality = std::atoi(argv[++i]);
+    else if (a == "--fps") fps = std::atoi(argv[++i]);
+    else if (!a.empty() && a[0] == '-') return usage();
+    else inputs.push_back(a);
+  }
+  if (out.empty() || inputs.empty() || rows < 0 || fps <= 0 || opt.quality < 1 || opt.quality > 100) return usage();
+
+  std::vector<AnimFrame> frames;
+  if (!readFrames(inputs, fps, frames)) {
+    std::fprintf(stderr, "mjpack: cannot read the input\n");
+    return 1;
+  }
+  std::vector<RgbImage> images;
+  for (const AnimFrame &f : frames) images.push_back(fitImage(f.image, kPanelW, kPanelH));
+  opt.restartInterval = rows * (kPanelW / kMcuSize);
+
+  std::vector<MjpegIndexEntry> index;
+  std::vector<uint8_t> mjpeg = encodeMjpeg(images, opt, &index);
+  std::string idx = "mjpack " + std::to_string(kPanelW) + " " + std::to_string(kPanelH) + " " +
+                    std::to_string(frames.size()) + " " + std::to_string(rows) + "\n";
+  int pts = 0;
+  for (size_t i = 0; i < index.size(); ++i) {
+    idx += std::to_string(index[i].offset) + " " + std::to_string(index[i].bytes) + " " + std::to_string(pts) + "\n";
+    pts += frames[i].delayMs;
+  }
+  if (!writeFile(out, mjpeg) || !writeFile(out + ".idx", std::vector<uint8_t>(idx.begin(), idx.end()))) {
+    std::fprintf(stderr, "mjpack: cannot write %s\n", out.c_str());
+    return 1;
+  }
+  std::printf("%s: %zu frames, %zu bytes (%zu per frame), ", out.c_str(), frames.size(), mjpeg.size(),
+              mjpeg.size() / frames.size());
+  if (rows > 0) std::printf("restart every %d MCU row%s\n", rows, rows == 1 ? "" : "s");
+  else std::printf("no restart markers\n");
+  return 0;
+}
@@ -0,0 +1,102 @@
+// panenc: converts a GIF or a sequence of frames to the sketch's
+// panel-native animation format (.pan, see PanelAnim.h).
+//
+//   panenc [--delay MS] [--loops N] -o OUT.pan IN.gif
+//   panenc [--delay MS] [--loops N] -o OUT.pan FRAME.ppm...
+//
+// GIFs keep their own frame delays; --delay (default 100) applies to PPM
+// frames, which must all be the same size. Canvases larger than the panel
+// (320x240) are cropped, as the GIF player would clip them.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "MediaReaders.h"
+#include "MediaWriters.h"
+
+namespace {
+
+const int kPanelW = 320, kPanelH = 240;
+
+bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = std::string(suffix).size();
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+RgbImage crop(const RgbImage &img, int w, int h) {
+  RgbImage out(w, h);
+  for (int y = 0; y < h; ++y)
+    for (int x = 0; x < w; ++x)
+      for (int c = 0; c < 3; ++c) out.at(x, y)[c] = img.at(x, y)[c];
+  return out;
+}
+
+int usage() {
+  std::fprintf(stderr, "usage: panenc [--delay MS] [--loops N] -o OUT.pan (IN.gif | FRAME.ppm...)\n");
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string out;
+  std::vector<std::string> inputs;
+  int delayMs = 100, loops = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if ((a == "-o" || a == "--delay" || a == "--loops") && i + 1 >= argc) return usage();
+    if (a == "-o") out = argv[++i];
+    else if (a == "--delay") delayMs = std::atoi(argv[++i]);
+    else if (a == "--loops") loops = std::atoi(argv[++i]);
+    else if (!a.empty() && a[0] == '-') return usage();
+    else inputs.push_back(a);
+  }
+  if (out.empty() || inputs.empty()) return usage();
+
+  std::vector<AnimFrame> frames;
+  if (inputs.size() == 1 && endsWith(inputs[0], ".gif")) {
+    std::vector<uint8_t> gif;
+    if (!readFile(inputs[0], gif) || !decodeGifFrames(gif, frames)) {
+      std::fprintf(stderr, "panenc: cannot decode %s\n", inputs[0].c_str());
+      return 1;
+    }
+  } else {
+    for (const std::string &path : inputs) {
+      AnimFrame f;
+      if (!readPpm(path, f.image)) {
+        std::fprintf(stderr, "panenc: %s is not a binary PPM (P6, maxval 255)\n", path.c_str());
+        return 1;
+      }
+      if (!frames.empty() && (f.image.width != frames[0].image.width || f.image.height != frames[0].image.height)) {
+        std::fprintf(stderr, "panenc: %s is %dx%d, the first frame is %dx%d\n", path.c_str(), f.image.width,
+                     f.image.height, frames[0].image.width, frames[0].image.height);
+        return 1;
+      }
+      f.delayMs = delayMs;
+      frames.push_back(f);
+    }
+  }
+
+  int w = frames[0].image.width, h = frames[0].image.height;
+  if (w > kPanelW || h > kPanelH) {
+    int cw = std::min(w, kPanelW), ch = std::min(h, kPanelH);
+    std::fprintf(stderr, "panenc: cropping %dx%d to %dx%d\n", w, h, cw, ch);
+    for (AnimFrame &f : frames) f.image = crop(f.image, cw, ch);
+    w = cw;
+    h = ch;
+  }
+
+  PanelAnimStats stats;
+  std::vector<uint8_t> pan = encodePanelAnim(frames, loops, &stats);
+  if (!writeFile(out, pan)) {
+    std::fprintf(stderr, "panenc: cannot write %s\n", out.c_str());
+    return 1;
+  }
+  std::printf("%s: %dx%d, %zu frames, %zu bytes (%zu per frame), %d rects, %.0f%% of pixels sent, %.0f%% in runs\n",
+              out.c_str(), w, h, frames.size(), pan.size(), pan.size() / frames.size(), stats.rects,
+              100.0 * stats.pixels / ((double)w * h * frames.size()),
+              stats.pixels ? 100.0 * stats.runPixels / stats.pixels : 0.0);
+  return 0;
+}
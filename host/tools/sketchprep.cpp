@@ -0,0 +1,176 @@
+// sketchprep: turns an Arduino .ino into a C++ translation unit the way the
+// Arduino builder does. It prepends the host prelude and inserts
+// prototypes for every top-level function ahead of the first function
+// definition, so functions can be used before they are defined.
+//
+//   sketchprep <sketch.ino> <out.cpp>
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Statement {
+  size_t line;       // 1-based line where the statement starts
+  std::string text;  // text up to (not including) the opening brace
+};
+
+bool startsWithWord(const std::string &s, const char *w) {
+  size_t n = std::char_traits<char>::length(w);
+  return s.compare(0, n, w) == 0 && (s.size() == n || !(std::isalnum((unsigned char)s[n]) || s[n] == '_'));
+}
+
+std::string trim(const std::string &s) {
+  size_t b = s.find_first_not_of(" \t\r\n");
+  if (b == std::string::npos) return "";
+  size_t e = s.find_last_not_of(" \t\r\n");
+  return s.substr(b, e - b + 1);
+}
+
+bool looksLikeFunction(const std::string &t) {
+  if (t.empty() || !(std::isalpha((unsigned char)t[0]) || t[0] == '_')) return false;
+  static const char *kNot[] = {"struct", "class", "enum", "union", "typedef", "namespace", "using",
+                               "template", "extern", "if", "for", "while", "switch", "do", "else"};
+  for (const char *w : kNot) {
+    if (startsWithWord(t, w)) return false;
+  }
+  size_t paren = t.find('(');
+  if (paren == std::string::npos || t.back() != ')') {
+    // allow trailing qualifiers such as "const" or "override" after ')'
+    size_t close = t.rfind(')');
+    if (paren == std::string::npos || close == std::string::npos) return false;
+    std::string tail = trim(t.substr(close + 1));
+    if (!tail.empty() && tail != "const" && tail != "noexcept") return false;
+  }
+  size_t eq = t.find('=');
+  return eq == std::string::npos || eq > paren;
+}
+
+// Strip default arguments: "(int a, int b = 0)" -> "(int a, int b)".
+std::string stripDefaults(const std::string &sig) {
+  std::string out;
+  int depth = 0;
+  bool skipping = false;
+  for (char c : sig) {
+    if (c == '(') {
+      ++depth;
+      if (!skipping) out += c;
+      continue;
+    }
+    if (c == ')') {
+      if (depth == 1 && skipping) skipping = false;
+      --depth;
+      if (!skipping) out += c;
+      continue;
+    }
+    if (depth == 1 && c == ',' && skipping) skipping = false;
+    if (depth == 1 && c == '=' && !skipping) {
+      skipping = true;
+      while (!out.empty() && out.back() == ' ') out.pop_back();
+      continue;
+    }
+    if (!skipping) out += c;
+  }
+  return out;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::cerr << "usage: sketchprep <sketch.ino> <out.cpp>\n";
+    return 2;
+  }
+  std::ifstream in(argv[1]);
+  if (!in) {
+    std::cerr << "sketchprep: cannot read " << argv[1] << "\n";
+    return 1;
+  }
+  std::vector<std::string> lines;
+  for (std::string l; std::getline(in, l);) lines.push_back(l);
+
+  // Scan top-level statements, skipping comments, strings and
+  // preprocessor lines, and collect function definitions.
+  std::vector<Statement> functions;
+  int depth = 0;
+  bool inBlockComment = false;
+  std::string current;
+  size_t currentLine = 0;
+  for (size_t li = 0; li < lines.size(); ++li) {
+    const std::string &l = lines[li];
+    if (!inBlockComment && depth == 0 && trim(l).rfind("#", 0) == 0) continue;
+    for (size_t i = 0; i < l.size(); ++i) {
+      char c = l[i];
+      if (inBlockComment) {
+        if (c == '*' && i + 1 < l.size() && l[i + 1] == '/') {
+          inBlockComment = false;
+          ++i;
+        }
+        continue;
+      }
+      if (c == '/' && i + 1 < l.size() && l[i + 1] == '/') break;
+      if (c == '/' && i + 1 < l.size() && l[i + 1] == '*') {
+        inBlockComment = true;
+        ++i;
+        continue;
+      }
+      if (c == '"' || c == '\'') {
+        char q = c;
+        if (depth == 0) current += c;
+        for (++i; i < l.size() && l[i] != q; ++i) {
+          if (l[i] == '\\') ++i;
+        }
+        if (depth == 0) current += q;
+        continue;
+      }
+      if (depth == 0) {
+        if (c == '{') {
+          std::string t = trim(current);
+          if (looksLikeFunction(t)) functions.push_back({currentLine, t});
+          current.clear();
+          ++depth;
+          continue;
+        }
+        if (c == ';' || c == '}') {
+          current.clear();
+          continue;
+        }
+        if (trim(current).empty() && !std::isspace((unsigned char)c)) currentLine = li + 1;
+        current += c;
+      } else {
+        if (c == '{') ++depth;
+        if (c == '}') --depth;
+      }
+    }
+    if (depth == 0 && !current.empty()) current += ' ';
+  }
+
+  std::ostringstream out;
+  out << "// Generated by sketchprep from " << argv[1] << " - do not edit.\n";
+  out << "#include \"HostSketch.h\"\n";
+  size_t insertAt = functions.empty() ? lines.size() + 1 : functions.front().line;
+  out << "#line 1 \"" << argv[1] << "\"\n";
+  for (size_t li = 1; li <= lines.size(); ++li) {
+    if (li == insertAt) {
+      for (const Statement &f : functions) out << stripDefaults(f.text) << ";\n";
+      out << "#line " << li << " \"" << argv[1] << "\"\n";
+    }
+    out << lines[li - 1] << "\n";
+  }
+
+  // Only rewrite when the content changes, to keep rebuilds incremental.
+  std::string text = out.str();
+  std::ifstream existing(argv[2]);
+  if (existing) {
+    std::stringstream prev;
+    prev << existing.rdbuf();
+    if (prev.str() == text) return 0;
+  }
+  std::ofstream o(argv[2]);
+  o << text;
+  return o ? 0 : 1;
+}
@@ -292,14 +292,20 @@ export default function DeviceTabScreen_Enhanced({ route }) {
       // Optimal chunk size for ESP32 WebServer URL limit
       const chunkSize = 1500;
       const totalChunks = Math.ceil(base64.length / chunkSize);
+      // Decoded size, so the ESP32 can allocate exactly and refuse early
+      const byteSize = Math.floor(base64.length * 3 / 4) - (base64.endsWith('==') ? 2 : base64.endsWith('=') ? 1 : 0);
 
       setLastResponse(`Sending ${totalChunks} chunks...`);
 
       for (let i = 0; i < totalChunks; i++) {
         const chunk = base64.substring(i * chunkSize, (i + 1) * chunkSize);
-        const url = `http://${host}/imageChunk?index=${i}&total=${totalChunks}&data=${encodeURIComponent(chunk)}`;
+        const url = `http://${host}/imageChunk?index=${i}&total=${totalChunks}&size=${byteSize}&data=${encodeURIComponent(chunk)}`;
         
-        await fetch(url);
+        const chunkResponse = await fetch(url);
+        if (!chunkResponse.ok) {
+          const errorText = await chunkResponse.text();
+          throw new Error(`Upload failed at chunk ${i + 1}: ${errorText}`);
+        }
         setLastResponse(`Sent chunk ${i + 1}/${totalChunks}`);
       }
 
@@ -414,7 +420,7 @@ export default function DeviceTabScreen_Enhanced({ route }) {
       let host = device.host.trim().replace(/^https?:\/\//i, '').replace(/\/+$/,'');
       
       // Send file size first so ESP32 can allocate the right amount
-      const actualSize = blob.size;
+      const actualSize = Math.floor(base64.length * 3 / 4) - (base64.endsWith('==') ? 2 : base64.endsWith('=') ? 1 : 0);
       
       // With POST body, we can use much larger chunks (no URL limit)
       // 180KB GIF (240KB base64) with 8000 byte chunks = ~30 chunks
@@ -428,7 +434,7 @@ export default function DeviceTabScreen_Enhanced({ route }) {
         const chunk = base64.substring(i * chunkSize, (i + 1) * chunkSize);
         
         // Use POST with body instead of GET with URL params to avoid URL length limits
-        const url = `http://${host}/gifChunk?index=${i}&total=${totalChunks}`;
+        const url = `http://${host}/gifChunk?index=${i}&total=${totalChunks}&size=${actualSize}`;
         
         const chunkResponse = await fetch(url, {
           method: 'POST',